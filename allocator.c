@@ -0,0 +1,125 @@
+#include "allocator.h"
+#include <stdlib.h>
+
+/* every allocation from a bump arena is rounded up to this alignment, which is
+ * enough for any of the types stored in the containers. */
+#define BUMP_ALIGNMENT (sizeof(union { long double d; void *p; long long l; }))
+#define ROUND_UP(size) \
+    (((size) + BUMP_ALIGNMENT - 1) / BUMP_ALIGNMENT * BUMP_ALIGNMENT)
+
+struct BumpBlock_t {
+  struct BumpBlock_t *next;
+  size_t size; // usable bytes after the (rounded up) header
+};
+
+static void *defaultAllocate(void *context, size_t size) {
+  (void) context;
+  return malloc(size);
+}
+
+static void defaultFree(void *context, void *memory) {
+  (void) context;
+  free(memory);
+}
+
+static const Allocator default_allocator = {defaultAllocate, defaultFree,
+                                            NULL};
+
+const Allocator *allocatorGetDefault() {
+  return &default_allocator;
+}
+
+void *allocatorAllocate(const Allocator *allocator, size_t size) {
+  if (allocator == NULL) {
+    allocator = &default_allocator;
+  }
+  return allocator->allocate(allocator->context, size);
+}
+
+void allocatorFree(const Allocator *allocator, void *memory) {
+  if (memory == NULL) {
+    return;
+  }
+  if (allocator == NULL) {
+    allocator = &default_allocator;
+  }
+  allocator->free(allocator->context, memory);
+}
+
+static void *bumpAllocate(void *context, size_t size) {
+  BumpArena *arena = context;
+  size = ROUND_UP(size);
+  if (arena->blocks == NULL || arena->used + size > arena->blocks->size) {
+    // the current block is full, starting a new one.
+    size_t block_size = size > arena->block_size ? size : arena->block_size;
+    struct BumpBlock_t *block =
+        allocatorAllocate(&arena->backing,
+                          ROUND_UP(sizeof(*block)) + block_size);
+    if (block == NULL) {
+      return NULL;
+    }
+    block->size = block_size;
+    block->next = arena->blocks;
+    arena->blocks = block;
+    arena->used = 0;
+  }
+  char *memory = (char *) arena->blocks + ROUND_UP(sizeof(*arena->blocks))
+      + arena->used;
+  arena->used += size;
+  return memory;
+}
+
+static void bumpFree(void *context, void *memory) {
+  // memory of a bump arena is only returned by bumpArenaRelease.
+  (void) context;
+  (void) memory;
+}
+
+void bumpArenaInit(BumpArena *arena, const Allocator *backing,
+                   size_t blockSize) {
+  if (arena == NULL) {
+    return;
+  }
+  arena->allocator.allocate = bumpAllocate;
+  arena->allocator.free = bumpFree;
+  arena->allocator.context = arena;
+  arena->backing = backing != NULL ? *backing : default_allocator;
+  arena->block_size = blockSize;
+  arena->blocks = NULL;
+  arena->used = 0;
+}
+
+void bumpArenaRelease(BumpArena *arena) {
+  if (arena == NULL) {
+    return;
+  }
+  struct BumpBlock_t *block = arena->blocks;
+  while (block != NULL) {
+    struct BumpBlock_t *next = block->next;
+    allocatorFree(&arena->backing, block);
+    block = next;
+  }
+  arena->blocks = NULL;
+  arena->used = 0;
+}
+
+void bumpArenaReset(BumpArena *arena) {
+  if (arena == NULL) {
+    return;
+  }
+  struct BumpBlock_t *kept = NULL;
+  struct BumpBlock_t *block = arena->blocks;
+  while (block != NULL) {
+    struct BumpBlock_t *next = block->next;
+    // blocks of large allocations are bigger than the others, so aren't kept
+    if (kept == NULL && block->size == arena->block_size) {
+      kept = block;
+      kept->next = NULL;
+    } else {
+      allocatorFree(&arena->backing, block);
+    }
+    block = next;
+  }
+  arena->blocks = kept;
+  arena->used = 0;
+}
@@ -0,0 +1,109 @@
+#ifndef ALLOCATOR_H_
+#define ALLOCATOR_H_
+
+#include <stddef.h>
+
+/**
+ * Pluggable memory allocator
+ *
+ * Lets the containers route all of their allocations through a user supplied
+ * allocator instead of calling malloc and free directly. An allocator is a
+ * pair of functions and a user context which is passed to both of them.
+ * Containers copy the Allocator struct itself, but the context it points to
+ * must outlive every object allocated through it.
+ *
+ * The following functions are available:
+ *   allocatorGetDefault - Returns the malloc/free allocator
+ *   allocatorAllocate   - Allocates memory using an allocator
+ *   allocatorFree       - Frees memory allocated by allocatorAllocate
+ *   bumpArenaInit       - Initializes a bump arena
+ *   bumpArenaRelease    - Frees all the memory held by a bump arena
+ *   bumpArenaReset      - Empties a bump arena, keeping a block for reuse
+ */
+
+/** Type of function for allocating memory, as malloc */
+typedef void *(*AllocateFunction)(void *context, size_t size);
+
+/** Type of function for freeing memory, as free. memory may be NULL */
+typedef void (*FreeFunction)(void *context, void *memory);
+
+/** Type for defining an allocator */
+typedef struct Allocator_t {
+  AllocateFunction allocate;
+  FreeFunction free;
+  void *context;
+} Allocator;
+
+/**
+ * allocatorGetDefault: Returns the allocator which uses malloc and free.
+ */
+const Allocator *allocatorGetDefault();
+
+/**
+ * allocatorAllocate: Allocates a block of memory.
+ *
+ * @param allocator - The allocator to use. NULL means the default allocator.
+ * @param size - The size of the block in bytes.
+ * @return
+ *     NULL if the allocation failed.
+ *     A pointer to the new block otherwise.
+ */
+void *allocatorAllocate(const Allocator *allocator, size_t size);
+
+/**
+ * allocatorFree: Frees a block of memory returned by allocatorAllocate.
+ *
+ * @param allocator - The allocator the block was allocated with. NULL means
+ *     the default allocator.
+ * @param memory - The block to free. If memory is NULL nothing will be done.
+ */
+void allocatorFree(const Allocator *allocator, void *memory);
+
+/**
+ * A bump arena hands out memory from large blocks by advancing an offset.
+ * Freeing a single allocation does nothing, and all the memory is returned at
+ * once by bumpArenaRelease. This suits short-lived objects which are built,
+ * used and then thrown away together, e.g. the cart of an order.
+ *
+ * The 'allocator' field is the Allocator to pass to the containers, and its
+ * context is the arena itself, so the arena must not move while in use.
+ */
+typedef struct BumpArena_t {
+  Allocator allocator;
+  Allocator backing;
+  size_t block_size;
+  struct BumpBlock_t *blocks;
+  size_t used; // bytes used in the first block of 'blocks'
+} BumpArena;
+
+/**
+ * bumpArenaInit: Initializes an empty bump arena. No memory is allocated
+ * until the first allocation from the arena.
+ *
+ * @param arena - The arena to initialize.
+ * @param backing - The allocator the blocks are taken from. NULL means the
+ *     default allocator.
+ * @param blockSize - The size of each block in bytes. Larger allocations get
+ *     a block of their own.
+ */
+void bumpArenaInit(BumpArena *arena, const Allocator *backing,
+                   size_t blockSize);
+
+/**
+ * bumpArenaRelease: Frees all the blocks of a bump arena. Every pointer
+ * allocated from the arena becomes invalid, and the arena is empty again.
+ *
+ * @param arena - The arena to release. If arena is NULL nothing will be done.
+ */
+void bumpArenaRelease(BumpArena *arena);
+
+/**
+ * bumpArenaReset: Empties a bump arena like bumpArenaRelease, but keeps one
+ * block of the arena's block size (if it has one), from which the next
+ * allocations are made without calling the backing allocator.
+ *
+ * @param arena - The arena to reset. If arena is NULL nothing will be done.
+ */
+void bumpArenaReset(BumpArena *arena);
+
+#endif /* ALLOCATOR_H_ */
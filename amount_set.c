@@ -4,10 +4,16 @@
 
 #define ERROR -1
 
+/* nodes may be shared between a set and its snapshots (see asSnapshot).
+ * ref_count is the number of links (from nodes or from sets' dummy heads)
+ * pointing to the node. a node whose ref_count is 1, reached from a node that
+ * is only in this set, is only in this set as well, and may be modified.
+ * shared nodes are copied before being modified (copy on write). */
 typedef struct node_t {
   ASElement element;
   double amount;
   struct node_t *next;
+  int ref_count;
 } *Node;
 struct AmountSet_t {
   CopyASElement user_copy_function;
@@ -15,32 +21,72 @@ struct AmountSet_t {
   CompareASElements user_compare_function;
   Node head; // the start of a linked list. 'head' is a dummy.
   Node iterator;
+  Allocator allocator; // used for the set itself and all of its nodes
+  struct node_t dummy; // 'head' points here, saving an allocation.
+  bool owns_memory; // false if the set was created by asCreateAt
 };
 static Node getElementNodePtr(AmountSet set, ASElement element);
+static void releaseNodes(AmountSet set, Node node);
+static Node getWritableNodeBefore(AmountSet set, ASElement element);
+static Node claimNextNode(AmountSet set, Node node_before);
 
 AmountSet asCreate(CopyASElement copyElement,
                    FreeASElement freeElement,
                    CompareASElements compareElements) {
+  return asCreateWithAllocator(copyElement, freeElement, compareElements,
+                               NULL);
+}
+
+AmountSet asCreateWithAllocator(CopyASElement copyElement,
+                                FreeASElement freeElement,
+                                CompareASElements compareElements,
+                                const Allocator *allocator) {
   if (copyElement == NULL || freeElement == NULL || compareElements == NULL) {
     return NULL;
   }
-  AmountSet new_set = malloc(sizeof(*new_set));
-  if (new_set == NULL) {
+  if (allocator == NULL) {
+    allocator = allocatorGetDefault();
+  }
+  void *memory = allocatorAllocate(allocator, sizeof(struct AmountSet_t));
+  if (memory == NULL) {
+    return NULL;
+  }
+  AmountSet new_set = asCreateAt(memory, copyElement, freeElement,
+                                 compareElements, allocator);
+  new_set->owns_memory = true;
+  return new_set;
+}
+
+size_t asGetStructSize() {
+  return sizeof(struct AmountSet_t);
+}
+
+AmountSet asCreateAt(void *memory,
+                     CopyASElement copyElement,
+                     FreeASElement freeElement,
+                     CompareASElements compareElements,
+                     const Allocator *allocator) {
+  if (memory == NULL || copyElement == NULL || freeElement == NULL
+      || compareElements == NULL) {
     return NULL;
   }
+  if (allocator == NULL) {
+    allocator = allocatorGetDefault();
+  }
+  AmountSet new_set = memory;
   // initializing all fields
+  new_set->allocator = *allocator;
   new_set->user_compare_function = compareElements;
   new_set->user_free_function = freeElement;
   new_set->user_copy_function = copyElement;
-  new_set->head = malloc(sizeof(*(new_set->head)));
-  if (new_set->head == NULL) {
-    free(new_set);
-    return NULL;
-  }
+  new_set->owns_memory = false;
+  new_set->iterator = NULL;
   // first node in linked list is a dummy
+  new_set->head = &new_set->dummy;
   new_set->head->next = NULL;
   new_set->head->element = NULL;
   new_set->head->amount = 0;
+  new_set->head->ref_count = 1;
   return new_set;
 }
 
@@ -48,22 +94,17 @@ void asDestroy(AmountSet set) {
   if (set == NULL) {
     return;
   }
-  /* going through every the list's node, making sure it isn't NULL,
+  /* going through every the list's node which isn't shared with a snapshot,
    * using the user's free function, freeing the element and then the node. */
-  Node prior_node = NULL;
-  Node current_node = set->head->next;
-  while (current_node != NULL) {
-    assert(current_node != set->head);
-    set->user_free_function(current_node->element);
-    prior_node = current_node;
-    current_node = current_node->next;
-    free(prior_node);
-  }
-  /* eventually, freeing the dummy node and the set itself.
+  releaseNodes(set, set->head->next);
+  /* eventually, freeing the set itself. the dummy node is a part of it.
    * the internal iterator may point somewhere, but all the nodes are
-   * already freed so no need to free the iterator as well.*/
-  free(set->head);
-  free(set);
+   * already freed so no need to free the iterator as well.
+   * the allocator lives inside the set, so it's copied before freeing it. */
+  if (set->owns_memory) {
+    Allocator allocator = set->allocator;
+    allocatorFree(&allocator, set);
+  }
 }
 
 bool asContains(AmountSet set, ASElement element) {
@@ -107,6 +148,11 @@ AmountSetResult asGetAmount(AmountSet set, ASElement element, double
   if (set == NULL || element == NULL || outAmount == NULL) {
     return AS_NULL_ARGUMENT;
   }
+  if (set->iterator != NULL && set->iterator->element == element) {
+    // the element is the current one of an iteration, no need to search it
+    *outAmount = set->iterator->amount;
+    return AS_SUCCESS;
+  }
   if (asContains(set, element) == false) {
     return AS_ITEM_DOES_NOT_EXIST;
   }
@@ -116,14 +162,70 @@ AmountSetResult asGetAmount(AmountSet set, ASElement element, double
   return AS_SUCCESS;
 }
 
+AmountSet asSnapshot(AmountSet set) {
+  if (set == NULL) {
+    return NULL;
+  }
+  AmountSet snapshot = asCreateWithAllocator(set->user_copy_function,
+                                             set->user_free_function,
+                                             set->user_compare_function,
+                                             &set->allocator);
+  if (snapshot == NULL) {
+    return NULL;
+  }
+  // both sets now link to the same first node, and so share all the nodes.
+  snapshot->head->next = set->head->next;
+  if (snapshot->head->next != NULL) {
+    snapshot->head->next->ref_count++;
+  }
+  return snapshot;
+}
+
+AmountSet asSnapshotAt(void *memory, AmountSet set) {
+  if (set == NULL) {
+    return NULL;
+  }
+  AmountSet snapshot = asCreateAt(memory, set->user_copy_function,
+                                  set->user_free_function,
+                                  set->user_compare_function, &set->allocator);
+  if (snapshot == NULL) {
+    return NULL;
+  }
+  snapshot->head->next = set->head->next;
+  if (snapshot->head->next != NULL) {
+    snapshot->head->next->ref_count++;
+  }
+  return snapshot;
+}
+
+ASElement asGetMutable(AmountSet set, ASElement element) {
+  if (set == NULL || element == NULL || !asContains(set, element)) {
+    return NULL;
+  }
+  Node node_before = getWritableNodeBefore(set, element);
+  if (node_before == NULL) {
+    return NULL;
+  }
+  Node node = claimNextNode(set, node_before);
+  return node != NULL ? node->element : NULL;
+}
+
 AmountSet asCopy(AmountSet set) {
+  if (set == NULL) {
+    return NULL;
+  }
+  return asCopyWithAllocator(set, &set->allocator);
+}
+
+AmountSet asCopyWithAllocator(AmountSet set, const Allocator *allocator) {
   if (set == NULL) {
     return NULL;
   }
   // creating a new empty AS with the given set's functions.
-  AmountSet new_set = asCreate(set->user_copy_function,
-                               set->user_free_function,
-                               set->user_compare_function);
+  AmountSet new_set = asCreateWithAllocator(set->user_copy_function,
+                                            set->user_free_function,
+                                            set->user_compare_function,
+                                            allocator);
   if (new_set == NULL) {
     return NULL;
   }
@@ -168,32 +270,97 @@ AmountSetResult asRegister(AmountSet set, ASElement element) {
   if (asContains(set, element)) {
     return AS_ITEM_ALREADY_EXISTS;
   }
-  Node node_before = set->head;
-  Node node_after = set->head->next;
+  /* the node before the new one is modified, so it can't be shared.
+   * the loop runs until it reaches a bigger element (by user_compare_function)
+   * or the end of the list (NULL) */
+  Node node_before = getWritableNodeBefore(set, element);
+  if (node_before == NULL) {
+    return AS_OUT_OF_MEMORY;
+  }
+  Node node_after = node_before->next;
   // will be used to connect the linked list properly.
 
-  while (node_after != NULL) {
-    if (set->user_compare_function(element, node_after->element) < 0) {
-      break;
-      /*loop runs until it reaches a bigger element (by user_compare_function)
-       * or the end of the list (NULL) */
-    }
-    node_before = node_after;
-    node_after = node_after->next;
-  }
-  Node new_node = malloc(sizeof(*new_node));
+  Node new_node = allocatorAllocate(&set->allocator, sizeof(*new_node));
   // the node which will hold the element.
   if (new_node == NULL) {
     return AS_OUT_OF_MEMORY;
   }
   // assigning all field.
   new_node->element = set->user_copy_function(element);
+  if (new_node->element == NULL) {
+    allocatorFree(&set->allocator, new_node);
+    return AS_OUT_OF_MEMORY;
+  }
   new_node->amount = 0;
-  new_node->next = node_after != NULL ? node_after : NULL;
+  new_node->ref_count = 1;
+  // node_after's link from node_before is replaced by a link from new_node
+  new_node->next = node_after;
   node_before->next = new_node;
   return AS_SUCCESS;
 }
 
+AmountSetResult asRegisterSorted(AmountSet set, ASElement *elements,
+                                 const double *amounts, int count) {
+  if (set == NULL || (elements == NULL && count > 0)) {
+    return AS_NULL_ARGUMENT;
+  }
+  if (count <= 0) {
+    return AS_SUCCESS;
+  }
+  // merging the elements with the nodes, only to check none of them exists
+  Node node_ptr = set->head->next;
+  for (int i = 0; i < count; i++) {
+    assert(i == 0 || set->user_compare_function(elements[i - 1],
+                                                elements[i]) < 0);
+    while (node_ptr != NULL
+        && set->user_compare_function(node_ptr->element, elements[i]) < 0) {
+      node_ptr = node_ptr->next;
+    }
+    if (node_ptr != NULL
+        && set->user_compare_function(node_ptr->element, elements[i]) == 0) {
+      return AS_ITEM_ALREADY_EXISTS;
+    }
+  }
+  /* every node before the place of the last element is about to be linked to
+   * a new node, so all of them are made to belong only to set in advance */
+  if (getWritableNodeBefore(set, elements[count - 1]) == NULL) {
+    return AS_OUT_OF_MEMORY;
+  }
+  Node new_nodes = NULL; // the new nodes, linked through 'next' until used
+  for (int i = 0; i < count; i++) {
+    Node new_node = allocatorAllocate(&set->allocator, sizeof(*new_node));
+    if (new_node == NULL) {
+      while (new_nodes != NULL) {
+        Node next_node = new_nodes->next;
+        allocatorFree(&set->allocator, new_nodes);
+        new_nodes = next_node;
+      }
+      return AS_OUT_OF_MEMORY;
+    }
+    new_node->next = new_nodes;
+    new_nodes = new_node;
+  }
+  // nothing can fail from here, so the new nodes are linked in a single merge
+  Node node_before = set->head;
+  for (int i = 0; i < count; i++) {
+    while (node_before->next != NULL
+        && set->user_compare_function(node_before->next->element,
+                                      elements[i]) < 0) {
+      assert(node_before->next->ref_count == 1);
+      node_before = node_before->next;
+    }
+    Node new_node = new_nodes;
+    new_nodes = new_nodes->next;
+    new_node->element = elements[i];
+    new_node->amount = amounts != NULL ? amounts[i] : 0;
+    new_node->ref_count = 1;
+    new_node->next = node_before->next;
+    node_before->next = new_node;
+    node_before = new_node;
+  }
+  return AS_SUCCESS;
+}
+
 AmountSetResult asDelete(AmountSet set, ASElement element) {
   if (set == NULL || element == NULL) {
     return AS_NULL_ARGUMENT;
@@ -201,26 +368,52 @@ AmountSetResult asDelete(AmountSet set, ASElement element) {
   if (!asContains(set, element)) {
     return AS_ITEM_DOES_NOT_EXIST;
   }
-  Node node_before = set->head;
-  Node node_to_delete = set->head->next;
+  // the node before the deleted one is modified, so it can't be shared.
+  Node node_before = getWritableNodeBefore(set, element);
+  if (node_before == NULL) {
+    return AS_OUT_OF_MEMORY;
+  }
+  Node node_to_delete = node_before->next;
   // will be used to connect the linked list properly.
+  assert(node_to_delete != NULL);
+  /* connecting the nodes properly, and releasing the deleted node. if it's
+   * shared with a snapshot it stays there, still linked to the next node. */
+  node_before->next = node_to_delete->next;
+  if (node_before->next != NULL) {
+    node_before->next->ref_count++;
+  }
+  if (set->iterator == node_to_delete) {
+    set->iterator = NULL;
+  }
+  releaseNodes(set, node_to_delete);
+  return AS_SUCCESS;
+}
 
-  // the loop rubs until the element is found or the linked list is over
-  while (node_to_delete != NULL) {
-    if (set->user_compare_function(element, node_to_delete->element) == 0) {
-      break;
-    }
-    node_before = node_to_delete;
-    node_to_delete = node_to_delete->next;
+AmountSetResult asMove(AmountSet set, AmountSet target, ASElement element) {
+  if (set == NULL || target == NULL || element == NULL) {
+    return AS_NULL_ARGUMENT;
   }
-  if (node_to_delete == NULL) {
-    // if linked list is over and the element isn't found.
+  if (!asContains(set, element)) {
     return AS_ITEM_DOES_NOT_EXIST;
   }
-  // freeing the element and connecting the nodes properly.
-  set->user_free_function(node_to_delete->element);
-  node_before->next = node_to_delete->next;
-  free(node_to_delete);
+  if (asContains(target, element)) {
+    return AS_ITEM_ALREADY_EXISTS;
+  }
+  /* the moved node and the nodes before it in both sets are modified, so
+   * they're made to belong only to their sets first */
+  Node node_before = getWritableNodeBefore(set, element);
+  Node node = node_before != NULL ? claimNextNode(set, node_before) : NULL;
+  Node target_before = node != NULL ?
+                       getWritableNodeBefore(target, element) : NULL;
+  if (target_before == NULL) {
+    return AS_OUT_OF_MEMORY;
+  }
+  // the links are passed on as they are, so no ref_count changes
+  node_before->next = node->next;
+  node->next = target_before->next;
+  target_before->next = node;
+  set->iterator = NULL;
+  target->iterator = NULL;
   return AS_SUCCESS;
 }
 
@@ -228,17 +421,10 @@ AmountSetResult asClear(AmountSet set) {
   if (set == NULL) {
     return AS_NULL_ARGUMENT;
   }
-  // a pointer to the first node in linked list, will be promoted later.
-  Node next_node = set->head->next;
-  Node prior_node = NULL;
-  while (next_node != NULL) {
-    // as long as the linked list isn't over
-    prior_node = next_node;
-    set->user_free_function(prior_node->element);
-    next_node = next_node->next;
-    free(prior_node);
-  }
+  // releasing all the nodes, starting from the first one in linked list.
+  releaseNodes(set, set->head->next);
   set->head->next = NULL;
+  set->iterator = NULL;
   return AS_SUCCESS;
 }
 
@@ -247,19 +433,267 @@ amount) {
   if (set == NULL || element == NULL) {
     return AS_NULL_ARGUMENT;
   }
-  if (asContains(set, element) == false) {
-    return AS_ITEM_DOES_NOT_EXIST;
-  }
   // getting the node that holds the element
   Node node_of_element = getElementNodePtr(set, element);
-  assert(node_of_element != NULL);
+  if (node_of_element == NULL) {
+    return AS_ITEM_DOES_NOT_EXIST;
+  }
   if (node_of_element->amount + amount < 0) {
     return AS_INSUFFICIENT_AMOUNT;
   }
+  if (amount == 0) {
+    return AS_SUCCESS;
+  }
+  /* the node may be shared with a snapshot, through itself or any node
+   * before it. if so, it's copied before it's changed. */
+  Node node_before = getWritableNodeBefore(set, element);
+  node_of_element = node_before != NULL ?
+                    claimNextNode(set, node_before) : NULL;
+  if (node_of_element == NULL) {
+    return AS_OUT_OF_MEMORY;
+  }
   node_of_element->amount = node_of_element->amount + amount;
   return AS_SUCCESS;
 }
 
+AmountSetResult asChangeAmounts(AmountSet set, ASElement *elements,
+                                const double *amounts, int count) {
+  if (set == NULL || ((elements == NULL || amounts == NULL) && count > 0)) {
+    return AS_NULL_ARGUMENT;
+  }
+  if (count <= 0) {
+    return AS_SUCCESS;
+  }
+  // merging the elements with the nodes, only to check all the changes
+  Node node_ptr = set->head->next;
+  for (int i = 0; i < count; i++) {
+    assert(i == 0 || set->user_compare_function(elements[i - 1],
+                                                elements[i]) < 0);
+    while (node_ptr != NULL
+        && set->user_compare_function(node_ptr->element, elements[i]) < 0) {
+      node_ptr = node_ptr->next;
+    }
+    if (node_ptr == NULL
+        || set->user_compare_function(node_ptr->element, elements[i]) != 0) {
+      return AS_ITEM_DOES_NOT_EXIST;
+    }
+    if (node_ptr->amount + amounts[i] < 0) {
+      return AS_INSUFFICIENT_AMOUNT;
+    }
+  }
+  /* all the nodes up to the last element's are made to belong only to set in
+   * advance, so the changes can't fail half way */
+  Node node_before = getWritableNodeBefore(set, elements[count - 1]);
+  if (node_before == NULL || claimNextNode(set, node_before) == NULL) {
+    return AS_OUT_OF_MEMORY;
+  }
+  node_ptr = set->head->next;
+  for (int i = 0; i < count; i++) {
+    while (set->user_compare_function(node_ptr->element, elements[i]) < 0) {
+      node_ptr = node_ptr->next;
+    }
+    assert(node_ptr->ref_count == 1);
+    node_ptr->amount += amounts[i];
+  }
+  return AS_SUCCESS;
+}
+
+AmountSetResult asSetAmount(AmountSet set, ASElement element, double amount) {
+  if (set == NULL || element == NULL) {
+    return AS_NULL_ARGUMENT;
+  }
+  if (getElementNodePtr(set, element) == NULL) {
+    return AS_ITEM_DOES_NOT_EXIST;
+  }
+  if (amount < 0) {
+    return AS_INSUFFICIENT_AMOUNT;
+  }
+  Node node_before = getWritableNodeBefore(set, element);
+  Node node = node_before != NULL ? claimNextNode(set, node_before) : NULL;
+  if (node == NULL) {
+    return AS_OUT_OF_MEMORY;
+  }
+  node->amount = amount;
+  return AS_SUCCESS;
+}
+
+/* returns the last node of set, or NULL if it's empty */
+static Node getLastNode(AmountSet set) {
+  Node node_ptr = set->head->next;
+  while (node_ptr != NULL && node_ptr->next != NULL) {
+    node_ptr = node_ptr->next;
+  }
+  return node_ptr;
+}
+
+/* makes all the nodes of set, up to and including the first one which isn't
+ * smaller than element, belong only to set. returns false if copying a shared
+ * node failed. */
+static bool claimNodesUpTo(AmountSet set, ASElement element) {
+  Node node_before = getWritableNodeBefore(set, element);
+  return node_before != NULL
+      && (node_before->next == NULL || claimNextNode(set, node_before) != NULL);
+}
+
+AmountSetResult asMergeAdd(AmountSet set, AmountSet other) {
+  if (set == NULL || other == NULL) {
+    return AS_NULL_ARGUMENT;
+  }
+  Node last = getLastNode(other);
+  if (last == NULL) {
+    return AS_SUCCESS;
+  }
+  if (!claimNodesUpTo(set, last->element)) {
+    return AS_OUT_OF_MEMORY;
+  }
+  /* merging the sets once to copy the elements set doesn't have, in order,
+   * so nothing can fail once the set starts changing */
+  Node new_nodes = NULL;
+  Node *new_nodes_end = &new_nodes;
+  Node node_ptr = set->head->next;
+  for (Node other_ptr = other->head->next; other_ptr != NULL;
+       other_ptr = other_ptr->next) {
+    while (node_ptr != NULL && set->user_compare_function(
+        node_ptr->element, other_ptr->element) < 0) {
+      node_ptr = node_ptr->next;
+    }
+    if (node_ptr != NULL && set->user_compare_function(
+        node_ptr->element, other_ptr->element) == 0) {
+      continue;
+    }
+    Node new_node = allocatorAllocate(&set->allocator, sizeof(*new_node));
+    ASElement copy = new_node != NULL ?
+                     set->user_copy_function(other_ptr->element) : NULL;
+    if (copy == NULL) {
+      if (new_node != NULL) {
+        allocatorFree(&set->allocator, new_node);
+      }
+      *new_nodes_end = NULL;
+      releaseNodes(set, new_nodes);
+      return AS_OUT_OF_MEMORY;
+    }
+    new_node->element = copy;
+    new_node->ref_count = 1;
+    *new_nodes_end = new_node;
+    new_nodes_end = &new_node->next;
+  }
+  *new_nodes_end = NULL;
+  // the second merge adds the amounts, and links the new nodes
+  Node node_before = set->head;
+  for (Node other_ptr = other->head->next; other_ptr != NULL;
+       other_ptr = other_ptr->next) {
+    while (node_before->next != NULL && set->user_compare_function(
+        node_before->next->element, other_ptr->element) < 0) {
+      node_before = node_before->next;
+    }
+    Node node = node_before->next;
+    if (node == NULL || set->user_compare_function(
+        node->element, other_ptr->element) != 0) {
+      node = new_nodes;
+      new_nodes = new_nodes->next;
+      node->amount = 0;
+      node->next = node_before->next;
+      node_before->next = node;
+    }
+    assert(node->ref_count == 1);
+    node->amount += other_ptr->amount;
+    node_before = node;
+  }
+  assert(new_nodes == NULL);
+  return AS_SUCCESS;
+}
+
+AmountSetResult asSubtract(AmountSet set, AmountSet other, bool clamp) {
+  if (set == NULL || other == NULL) {
+    return AS_NULL_ARGUMENT;
+  }
+  // merging the sets once to check the amounts, and find the last change
+  Node last_common = NULL;
+  Node node_ptr = set->head->next;
+  for (Node other_ptr = other->head->next; other_ptr != NULL;
+       other_ptr = other_ptr->next) {
+    while (node_ptr != NULL && set->user_compare_function(
+        node_ptr->element, other_ptr->element) < 0) {
+      node_ptr = node_ptr->next;
+    }
+    bool common = node_ptr != NULL && set->user_compare_function(
+        node_ptr->element, other_ptr->element) == 0;
+    double amount = common ? node_ptr->amount : 0;
+    if (!clamp && amount - other_ptr->amount < 0) {
+      return AS_INSUFFICIENT_AMOUNT;
+    }
+    if (common) {
+      last_common = node_ptr;
+    }
+  }
+  if (last_common == NULL) {
+    return AS_SUCCESS;
+  }
+  if (!claimNodesUpTo(set, last_common->element)) {
+    return AS_OUT_OF_MEMORY;
+  }
+  node_ptr = set->head->next;
+  for (Node other_ptr = other->head->next; other_ptr != NULL;
+       other_ptr = other_ptr->next) {
+    while (node_ptr != NULL && set->user_compare_function(
+        node_ptr->element, other_ptr->element) < 0) {
+      node_ptr = node_ptr->next;
+    }
+    if (node_ptr == NULL) {
+      break;
+    }
+    if (set->user_compare_function(node_ptr->element,
+                                   other_ptr->element) == 0) {
+      assert(node_ptr->ref_count == 1);
+      double amount = node_ptr->amount - other_ptr->amount;
+      node_ptr->amount = amount < 0 ? 0 : amount;
+    }
+  }
+  return AS_SUCCESS;
+}
+
+AmountSetResult asIntersect(AmountSet set, AmountSet other) {
+  if (set == NULL || other == NULL) {
+    return AS_NULL_ARGUMENT;
+  }
+  /* the nodes after other's last element are dropped together, so only those
+   * up to it may be changed */
+  Node last = getLastNode(other);
+  if (last != NULL && !claimNodesUpTo(set, last->element)) {
+    return AS_OUT_OF_MEMORY;
+  }
+  set->iterator = NULL;
+  Node node_before = set->head;
+  Node other_ptr = other->head->next;
+  while (node_before->next != NULL) {
+    Node node = node_before->next;
+    while (other_ptr != NULL && set->user_compare_function(
+        other_ptr->element, node->element) < 0) {
+      other_ptr = other_ptr->next;
+    }
+    if (other_ptr == NULL) {
+      // none of the rest is in other. shared nodes stay in the snapshot.
+      node_before->next = NULL;
+      releaseNodes(set, node);
+      break;
+    }
+    assert(node->ref_count == 1);
+    if (set->user_compare_function(other_ptr->element, node->element) == 0) {
+      if (other_ptr->amount < node->amount) {
+        node->amount = other_ptr->amount;
+      }
+      node_before = node;
+      continue;
+    }
+    node_before->next = node->next;
+    if (node->next != NULL) {
+      node->next->ref_count++;
+    }
+    releaseNodes(set, node);
+  }
+  return AS_SUCCESS;
+}
+
 ASElement asGetFirst(AmountSet set) {
   if (set == NULL || set->head->next == NULL) {
     //if the list is empty
@@ -271,8 +705,8 @@ ASElement asGetFirst(AmountSet set) {
 }
 
 ASElement asGetNext(AmountSet set) {
-  if (set == NULL || set->head->next == NULL) {
-    // if the list is empty
+  if (set == NULL || set->head->next == NULL || set->iterator == NULL) {
+    // if the list is empty or the iterator is invalid
     return NULL;
   }
   set->iterator = set->iterator->next;
@@ -282,6 +716,47 @@ ASElement asGetNext(AmountSet set) {
   return set->iterator->element;
 }
 
+ASElement asSeek(AmountSet set, ASElement element) {
+  if (set == NULL || element == NULL) {
+    return NULL;
+  }
+  Node node_ptr = set->head->next;
+  while (node_ptr != NULL &&
+         set->user_compare_function(node_ptr->element, element) < 0) {
+    node_ptr = node_ptr->next;
+  }
+  set->iterator = node_ptr;
+  return node_ptr == NULL ? NULL : node_ptr->element;
+}
+
+ASElement asSeekBefore(AmountSet set, ASElement element, ASElement bound) {
+  if (bound == NULL) {
+    return NULL;
+  }
+  ASElement found = asSeek(set, element);
+  if (found == NULL || set->user_compare_function(found, bound) >= 0) {
+    if (set != NULL) {
+      set->iterator = NULL;
+    }
+    return NULL;
+  }
+  return found;
+}
+
+ASElement asGetNextBefore(AmountSet set, ASElement bound) {
+  if (bound == NULL) {
+    return NULL;
+  }
+  ASElement next = asGetNext(set);
+  if (next == NULL || set->user_compare_function(next, bound) >= 0) {
+    if (set != NULL) {
+      set->iterator = NULL;
+    }
+    return NULL;
+  }
+  return next;
+}
+
 
 /* the function receives the AS and a wanted element,
  * and going through the linked list until element is found
@@ -299,4 +774,68 @@ static Node getElementNodePtr(AmountSet set, ASElement element) {
     node_ptr = node_ptr->next;
   }
   return NULL;
-}
\ No newline at end of file
+}
+
+/* the function removes a single link to node. if it was the last one, the node
+ * is freed, which removes its link to the next node, and so on. */
+static void releaseNodes(AmountSet set, Node node) {
+  while (node != NULL) {
+    assert(node->ref_count > 0);
+    if (--node->ref_count > 0) {
+      return;
+    }
+    Node next_node = node->next;
+    set->user_free_function(node->element);
+    allocatorFree(&set->allocator, node);
+    node = next_node;
+  }
+}
+
+/* the function receives a node which belongs only to set, and makes sure the
+ * node after it belongs only to set as well, by copying it if it is shared
+ * with a snapshot. returns the (possibly new) next node, or NULL if there is
+ * no next node or the copy failed. */
+static Node claimNextNode(AmountSet set, Node node_before) {
+  Node shared = node_before->next;
+  if (shared == NULL || shared->ref_count == 1) {
+    return shared;
+  }
+  Node copy = allocatorAllocate(&set->allocator, sizeof(*copy));
+  if (copy == NULL) {
+    return NULL;
+  }
+  copy->element = set->user_copy_function(shared->element);
+  if (copy->element == NULL) {
+    allocatorFree(&set->allocator, copy);
+    return NULL;
+  }
+  copy->amount = shared->amount;
+  copy->ref_count = 1;
+  // the copy links to the same next node, and replaces the link to 'shared'
+  copy->next = shared->next;
+  if (copy->next != NULL) {
+    copy->next->ref_count++;
+  }
+  shared->ref_count--;
+  node_before->next = copy;
+  if (set->iterator == shared) {
+    set->iterator = copy;
+  }
+  return copy;
+}
+
+/* the function goes through the linked list until it reaches the last node
+ * which is smaller than element, and returns it. all the nodes on the way,
+ * and the returned node, are made to belong only to set so they may be
+ * modified. returns NULL if copying a shared node failed. */
+static Node getWritableNodeBefore(AmountSet set, ASElement element) {
+  Node node_before = set->head;
+  while (node_before->next != NULL
+      && set->user_compare_function(node_before->next->element, element) < 0) {
+    node_before = claimNextNode(set, node_before);
+    if (node_before == NULL) {
+      return NULL;
+    }
+  }
+  return node_before;
+}
@@ -3,6 +3,7 @@
 
 #include <stdio.h>
 #include <stdbool.h>
+#include "allocator.h"
 
 /**
  * Generic Amount Set Container
@@ -16,20 +17,42 @@
  *
  * The following functions are available:
  *   asCreate           - Creates a new empty set
+ *   asCreateWithAllocator - Creates a new empty set which allocates its
+ *                        memory using a given allocator
+ *   asGetStructSize    - Returns the size of the memory used by asCreateAt
+ *   asCreateAt         - Creates a new empty set in memory given by the caller
  *   asDestroy          - Deletes an existing set and frees all resources
  *   asCopy             - Copies an existing set
+ *   asCopyWithAllocator - Copies an existing set into a given allocator
+ *   asSnapshot         - Creates a copy-on-write snapshot of an existing set
+ *   asSnapshotAt       - Creates a snapshot in memory given by the caller
+ *   asGetMutable       - Returns an element which may be modified in place
  *   asGetSize          - Returns the size of the set
  *   asContains         - Checks if an element exists in the set
  *   asGetAmount         - Returns the amount of an element in the set
  *   asRegister         - Add a new element into the set
+ *   asRegisterSorted   - Adds many new elements at once, taking ownership
+ *                        of them
  *   asChangeAmount     - Increase or decrease the amount of an element in the set
+ *   asChangeAmounts    - Changes the amounts of many elements at once
+ *   asSetAmount        - Sets the amount of an element in the set
+ *   asMergeAdd         - Adds the elements and amounts of another set
+ *   asSubtract         - Subtracts the amounts of another set
+ *   asIntersect        - Keeps only the elements of another set
  *   asDelete           - Delete an element completely from the set
+ *   asMove             - Moves an element, with its amount, to another set
  *   asClear            - Deletes all elements from target set
  *   asGetFirst         - Sets the internal iterator to the first element
  *                        in the set, and returns it.
  *   asGetNext          - Advances the internal iterator to the next element
  *                        and returns it.
+ *   asSeek             - Sets the internal iterator to the first element
+ *                        not smaller than a given one, and returns it.
+ *   asSeekBefore       - Like asSeek, for a range ending at a given element
+ *   asGetNextBefore    - Like asGetNext, for a range ending at a given element
  *   AS_FOREACH         - A macro for iterating over the set's elements
+ *   AS_FOREACH_RANGE   - A macro for iterating over the set's elements in a
+ *                        range
  */
 
 /** Type for defining the set */
@@ -80,6 +103,64 @@ AmountSet asCreate(CopyASElement copyElement,
                    FreeASElement freeElement,
                    CompareASElements compareElements);
 
+/**
+ * asCreateWithAllocator: Allocates a new empty amount set, whose own memory
+ * and nodes are allocated using the given allocator.
+ *
+ * The elements themselves are allocated by copyElement, the set has no
+ * control over them.
+ *
+ * @param copyElement - Function pointer to be used for copying elements into
+ *     the set or when copying the set.
+ * @param freeElement - Function pointer to be used for removing data elements from
+ *     the set.
+ * @param compareElements - Function pointer to be used for comparing elements
+ *     inside the set. Used to check if new elements already exist in the set.
+ * @param allocator - The allocator used for the set's memory. NULL means the
+ *     default allocator (malloc and free). The allocator is copied, but its
+ *     context must outlive the set.
+ * @return
+ *     NULL - if one of the function pointers is NULL or allocations failed.
+ *     A new amount set in case of success.
+ */
+AmountSet asCreateWithAllocator(CopyASElement copyElement,
+                                FreeASElement freeElement,
+                                CompareASElements compareElements,
+                                const Allocator *allocator);
+
+/**
+ * asGetStructSize: Returns the number of bytes asCreateAt needs for a set.
+ */
+size_t asGetStructSize();
+
+/**
+ * asCreateAt: Creates a new empty amount set inside memory supplied by the
+ * caller, so that the set can share a single allocation with the object that
+ * holds it. Only the nodes are allocated using the allocator.
+ *
+ * asDestroy frees the set's nodes and elements but not the memory itself,
+ * which is owned by the caller and must stay valid until asDestroy is called.
+ *
+ * @param memory - At least asGetStructSize() bytes, aligned as memory returned
+ *     by malloc.
+ * @param copyElement - Function pointer to be used for copying elements into
+ *     the set or when copying the set.
+ * @param freeElement - Function pointer to be used for removing data elements from
+ *     the set.
+ * @param compareElements - Function pointer to be used for comparing elements
+ *     inside the set. Used to check if new elements already exist in the set.
+ * @param allocator - The allocator used for the set's nodes. NULL means the
+ *     default allocator.
+ * @return
+ *     NULL - if memory or one of the function pointers is NULL.
+ *     The new amount set (located at memory) in case of success.
+ */
+AmountSet asCreateAt(void *memory,
+                     CopyASElement copyElement,
+                     FreeASElement freeElement,
+                     CompareASElements compareElements,
+                     const Allocator *allocator);
+
 /**
  * asDestroy: Deallocates an existing amount set. Clears all elements by using
  * the stored free functions.
@@ -100,6 +181,77 @@ void asDestroy(AmountSet set);
  */
 AmountSet asCopy(AmountSet set);
 
+/**
+ * asCopyWithAllocator: Creates a copy of target set, whose memory is
+ * allocated using the given allocator instead of the allocator of set.
+ *
+ * Iterator values for both sets are undefined after this operation.
+ *
+ * @param set - Target set.
+ * @param allocator - The allocator used for the new set's memory. NULL means
+ *     the default allocator.
+ * @return
+ *     NULL if a NULL was sent as set or a memory allocation failed.
+ *     An amount set containing the same elements (and amounts) as set, otherwise.
+ */
+AmountSet asCopyWithAllocator(AmountSet set, const Allocator *allocator);
+
+/**
+ * asSnapshot: Creates a snapshot of target set in O(1).
+ *
+ * The snapshot is a set of its own, containing the same elements (and
+ * amounts) as set. Instead of copying the elements, the snapshot shares the
+ * nodes of set, and a node is copied only when one of the sets modifies it
+ * (copy on write), so changes to either set are not seen by the other.
+ * The elements are copied using the copy function of set, and the snapshot
+ * uses the same allocator as set.
+ *
+ * Reading a snapshot, e.g. iterating over it, doesn't modify any state shared
+ * with set, so it may be done from another thread while set is modified. The
+ * calls which create, modify or destroy either set must not run concurrently.
+ *
+ * Elements returned from a set may be shared with its snapshots, so they must
+ * not be modified in place unless returned by asGetMutable.
+ *
+ * @param set - Target set.
+ * @return
+ *     NULL if a NULL was sent or a memory allocation failed.
+ *     A new amount set with the same contents as set, otherwise.
+ */
+AmountSet asSnapshot(AmountSet set);
+
+/**
+ * asSnapshotAt: Creates a snapshot of target set (@see asSnapshot) in memory
+ * given by the caller, which must be at least asGetStructSize() bytes and
+ * suitably aligned, and must outlive the snapshot. Nothing is allocated, so
+ * it can't fail if the arguments are valid.
+ *
+ * @param memory - The memory in which the snapshot is created.
+ * @param set - Target set.
+ * @return
+ *     NULL if a NULL argument was sent.
+ *     A new amount set with the same contents as set, otherwise.
+ */
+AmountSet asSnapshotAt(void *memory, AmountSet set);
+
+/**
+ * asGetMutable: Returns the element of the set which is equal to element,
+ * copying it first if it's shared with a snapshot (@see asSnapshot), so that
+ * it may be modified in place without affecting the snapshot. The modification
+ * must not change how the element compares to other elements.
+ *
+ * Pointers to elements of set which were returned before this call may point
+ * to elements which now belong only to a snapshot.
+ * Iterator's state is unchanged after this operation.
+ *
+ * @param set - The set containing the element.
+ * @param element - The element to look for.
+ * @return
+ *     NULL if a NULL was sent, element doesn't exist in set or copying failed.
+ *     The element of set which is equal to element, otherwise.
+ */
+ASElement asGetMutable(AmountSet set, ASElement element);
+
 /**
  * asGetSize: Returns the number of elements in a set.
  *
@@ -134,6 +286,8 @@ bool asContains(AmountSet set, ASElement element);
  * The function returns an error code indicating wether the operation succeeded,
  * and in case of success also returns the element's amount via the outAmount
  * pointer.
+ * If element is the current element of the iterator (e.g. inside AS_FOREACH),
+ * the amount is returned in O(1) without searching the set.
  * Iterator's state is unchanged after this operation.
  *
  * @param set - The set which contains the element.
@@ -167,10 +321,38 @@ AmountSetResult asGetAmount(AmountSet set, ASElement element, double *outAmount)
  * @return
  *     AS_NULL_ARGUMENT - if a NULL argument was passed.
  *     AS_ITEM_ALREADY_EXISTS - if an equal element already exists in the set.
+ *     AS_OUT_OF_MEMORY - if an allocation or a copy of an element failed.
  *     AS_SUCCESS - if the element was added successfully.
  */
 AmountSetResult asRegister(AmountSet set, ASElement element);
 
+/**
+ * asRegisterSorted: Add many new elements into the set, in a single pass over
+ * it. Unlike asRegister, the elements aren't copied: the set takes ownership of
+ * them, and frees them with its free function when they're deleted.
+ *
+ * Adding m elements to a set of n elements takes O(n + m), instead of the
+ * O(n * m) of m calls to asRegister.
+ * Iterator's value is undefined after this operation.
+ *
+ * @param set - The target set to which the elements are added.
+ * @param elements - The elements to add, in strictly increasing order
+ *     according to the set's comparison function.
+ * @param amounts - The initial amounts of the elements, or NULL to add all of
+ *     them with an amount of 0.
+ * @param count - The number of elements.
+ * @return
+ *     AS_NULL_ARGUMENT - if a NULL argument was passed.
+ *     AS_ITEM_ALREADY_EXISTS - if an element equal to one of the elements
+ *         already exists in the set.
+ *     AS_OUT_OF_MEMORY - if an allocation failed.
+ *     AS_SUCCESS - if the elements were added successfully.
+ *     The set is unchanged, and the caller keeps the ownership of the elements,
+ *     unless AS_SUCCESS is returned.
+ */
+AmountSetResult asRegisterSorted(AmountSet set, ASElement *elements,
+                                 const double *amounts, int count);
+
 /**
  * asChangeAmount: Increase or decrease the amount of an element in the set.
  *
@@ -188,6 +370,8 @@ AmountSetResult asRegister(AmountSet set, ASElement element);
  *         in the set is less than the amount that needs to be decreased (i.e.,
  *         if the change will result in a negative amount for the element in the
  *         set.)
+ *     AS_OUT_OF_MEMORY - if the element is shared with a snapshot and copying
+ *         it failed.
  *     AS_SUCCESS - if the element's amount was changed successfully.
  *
  * @note parameter amount doesn't affect the return value. Even if amount is 0,
@@ -197,6 +381,109 @@ AmountSetResult asRegister(AmountSet set, ASElement element);
  */
 AmountSetResult asChangeAmount(AmountSet set, ASElement element, const double amount);
 
+/**
+ * asChangeAmounts: Increase or decrease the amounts of many elements in the
+ * set, in a single pass over it.
+ *
+ * Changing the amounts of m elements of a set of n elements takes O(n + m),
+ * instead of the O(n * m) of m calls to asChangeAmount. Either all of the
+ * amounts are changed, or none of them.
+ *
+ * @param set - The set for which to change the amounts.
+ * @param elements - The elements whose amounts are changed, in strictly
+ *     increasing order according to the set's comparison function.
+ * @param amounts - The amounts to add to the elements, as in asChangeAmount.
+ * @param count - The number of elements.
+ * @return
+ *     AS_NULL_ARGUMENT - if a NULL argument was passed.
+ *     AS_ITEM_DOES_NOT_EXIST - if one of the elements doesn't exist in the set.
+ *     AS_INSUFFICIENT_AMOUNT - if one of the amounts would become negative.
+ *     AS_OUT_OF_MEMORY - if copying a node shared with a snapshot failed.
+ *     AS_SUCCESS - if all the amounts were changed.
+ */
+AmountSetResult asChangeAmounts(AmountSet set, ASElement *elements,
+                                const double *amounts, int count);
+
+/**
+ * asSetAmount: Sets the amount of an element in the set to a given value.
+ * Unlike changing it by the difference, the amount is exactly the given one.
+ *
+ * Iterator's state is unchanged after this operation.
+ *
+ * @param set - The target set containing the element.
+ * @param element - The element whose amount is set.
+ * @param amount - The new amount of the element.
+ * @return
+ *     AS_NULL_ARGUMENT - if a NULL argument was passed.
+ *     AS_ITEM_DOES_NOT_EXIST - if the element doesn't exist in the set.
+ *     AS_INSUFFICIENT_AMOUNT - if amount is negative.
+ *     AS_OUT_OF_MEMORY - if the element is shared with a snapshot and copying
+ *         it failed.
+ *     AS_SUCCESS - if the element's amount was set successfully.
+ */
+AmountSetResult asSetAmount(AmountSet set, ASElement element, double amount);
+
+/**
+ * asMergeAdd: Adds the amounts of all the elements of another set to set.
+ * Elements which aren't in set are added to it (copied using set's copy
+ * function) with their amounts in the other set.
+ *
+ * Both sets are sorted by the same comparison function, so they are merged in
+ * a single pass, in O(n + m). Either all of the elements are added, or none
+ * of them. Iterator's value is undefined after this operation.
+ *
+ * @param set - The target set, to which the elements are added.
+ * @param other - The set whose elements are added. Must be sorted by the same
+ *     comparison function as set. It isn't changed.
+ * @return
+ *     AS_NULL_ARGUMENT - if a NULL argument was passed.
+ *     AS_OUT_OF_MEMORY - if an allocation or a copy of an element failed.
+ *     AS_SUCCESS - if all the elements were added.
+ */
+AmountSetResult asMergeAdd(AmountSet set, AmountSet other);
+
+/**
+ * asSubtract: Subtracts the amounts of the elements of another set from the
+ * amounts of the equal elements in set. An element which isn't in set counts
+ * as having an amount of 0 there, and no element is removed from set.
+ *
+ * The sets are merged in a single pass, in O(n + m). Either all of the amounts
+ * are subtracted, or none of them. Iterator's value is undefined after this
+ * operation.
+ *
+ * @param set - The target set, whose amounts are decreased.
+ * @param other - The set whose amounts are subtracted. Must be sorted by the
+ *     same comparison function as set. It isn't changed.
+ * @param clamp - true to set amounts which would become negative to 0, false
+ *     to fail instead.
+ * @return
+ *     AS_NULL_ARGUMENT - if a NULL argument was passed.
+ *     AS_INSUFFICIENT_AMOUNT - if clamp is false, and an amount of other is
+ *         bigger than the amount of the element in set.
+ *     AS_OUT_OF_MEMORY - if copying a node shared with a snapshot failed.
+ *     AS_SUCCESS - if all the amounts were subtracted.
+ */
+AmountSetResult asSubtract(AmountSet set, AmountSet other, bool clamp);
+
+/**
+ * asIntersect: Deletes from set every element which isn't in another set. The
+ * amount of each remaining element becomes the smaller of its amounts in the
+ * two sets. The deleted elements are deallocated using the stored free
+ * function.
+ *
+ * The sets are merged in a single pass, in O(n + m). Either the whole set is
+ * changed, or none of it. Iterator's value is undefined after this operation.
+ *
+ * @param set - The target set, from which elements are deleted.
+ * @param other - The set to intersect with. Must be sorted by the same
+ *     comparison function as set. It isn't changed.
+ * @return
+ *     AS_NULL_ARGUMENT - if a NULL argument was passed.
+ *     AS_OUT_OF_MEMORY - if copying a node shared with a snapshot failed.
+ *     AS_SUCCESS - if the set was intersected.
+ */
+AmountSetResult asIntersect(AmountSet set, AmountSet other);
+
 /**
  * asDelete: Delete an element completely from the set.
  *
@@ -209,10 +496,35 @@ AmountSetResult asChangeAmount(AmountSet set, ASElement element, const double am
  * @return
  *     AS_NULL_ARGUMENT - if a NULL argument was passed.
  *     AS_ITEM_DOES_NOT_EXIST - if the element doesn't exist in the set.
+ *     AS_OUT_OF_MEMORY - if the set shares nodes with a snapshot and copying
+ *         them failed.
  *     AS_SUCCESS - if the element was deleted successfully.
  */
 AmountSetResult asDelete(AmountSet set, ASElement element);
 
+/**
+ * asMove: Moves an element of the set, with its amount, into another set.
+ *
+ * The element itself is moved, so nothing is copied or allocated unless one of
+ * the sets shares the nodes on the way with a snapshot. Both sets must be
+ * sorted by the same comparison function, and must free their elements and
+ * allocate their memory the same way.
+ * Iterator's value is undefined after this operation, for both sets.
+ *
+ * @param set - The set from which the element is moved.
+ * @param target - The set into which the element is moved.
+ * @param element - The element to move. It doesn't have to be the element of
+ *     set itself, only equal to it.
+ * @return
+ *     AS_NULL_ARGUMENT - if a NULL argument was passed.
+ *     AS_ITEM_DOES_NOT_EXIST - if the element doesn't exist in set.
+ *     AS_ITEM_ALREADY_EXISTS - if an equal element already exists in target.
+ *     AS_OUT_OF_MEMORY - if copying a node shared with a snapshot failed, in
+ *         which case both sets are unchanged.
+ *     AS_SUCCESS - if the element was moved successfully.
+ */
+AmountSetResult asMove(AmountSet set, AmountSet target, ASElement element);
+
 /**
  * asClear: Deletes all elements from target set.
  *
@@ -254,6 +566,54 @@ ASElement asGetFirst(AmountSet set);
  */
 ASElement asGetNext(AmountSet set);
 
+/**
+ * asSeek: Sets the internal iterator to the smallest element in the set which
+ * isn't smaller than the given element (which doesn't have to be in the set),
+ * and returns it. Use this to start iterating over the set from some point.
+ * To continue iteration use asGetNext or asGetNextBefore.
+ *
+ * The elements are kept in a sorted list, so this takes time proportional to
+ * the number of elements smaller than the given one.
+ *
+ * @param set - The set for which to set the iterator.
+ * @param element - The element to seek.
+ * @return
+ *     NULL if a NULL argument was sent or there is no such element in the set,
+ *     in which case the iterator is in an invalid state.
+ *     The smallest element not smaller than 'element' otherwise.
+ */
+ASElement asSeek(AmountSet set, ASElement element);
+
+/**
+ * asSeekBefore: Like asSeek, but returns NULL (and invalidates the iterator)
+ * if the element found isn't smaller than 'bound'. Together with
+ * asGetNextBefore, iterates over the elements in the range [element, bound).
+ *
+ * @param set - The set for which to set the iterator.
+ * @param element - The element to seek.
+ * @param bound - The element at which the range ends, which doesn't have to
+ *     be in the set.
+ * @return
+ *     NULL if a NULL argument was sent or the range is empty.
+ *     The smallest element in the range otherwise.
+ */
+ASElement asSeekBefore(AmountSet set, ASElement element, ASElement bound);
+
+/**
+ * asGetNextBefore: Advances the set iterator to the next element and returns
+ * it, unless it isn't smaller than 'bound', in which case the iteration ends
+ * (and the iterator is invalidated).
+ *
+ * @param set - The set for which to advance the iterator.
+ * @param bound - The element at which the iteration ends, which doesn't have
+ *     to be in the set.
+ * @return
+ *     NULL if reached the end of the set or 'bound', or the iterator is at an
+ *     invalid state or a NULL argument was sent.
+ *     The next element on the set otherwise.
+ */
+ASElement asGetNextBefore(AmountSet set, ASElement bound);
+
 /**
  * Macro for iterating over a set.
  * Declares a new iterator for the loop.
@@ -263,4 +623,13 @@ ASElement asGetNext(AmountSet set);
         iterator ;                               \
         iterator = asGetNext(set))
 
+/**
+ * Macro for iterating over the elements of a set in the range [from, to).
+ * Declares a new iterator for the loop.
+ */
+#define AS_FOREACH_RANGE(type, iterator, set, from, to)          \
+    for(type iterator = (type) asSeekBefore(set, from, to) ;     \
+        iterator ;                                               \
+        iterator = asGetNextBefore(set, to))
+
 #endif /* AMOUNT_SET_H_ */
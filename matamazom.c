@@ -1,14 +1,40 @@
+#define _POSIX_C_SOURCE 200809L /* for open_memstream */
 #include "matamazom.h"
-#include "list.h"
 #include "amount_set.h"
 #include <stdlib.h>
 #include <string.h>
 #include <math.h>
 #include <assert.h>
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
 #include "matamazom_print.h"
+#include "matamazom_metrics.h"
+#include "product_store.h"
+#include "string_pool.h"
+#include "stock_index.h"
+#include "stock_counters.h"
+#include "shipment_ledger.h"
 
 #define HALF 0.5
 #define RANGE 0.001
+/* tolerance for rounding errors of sums of amounts, e.g. reservations */
+#define EPSILON 1e-9
+/* the parts of an order's block are aligned as memory returned by malloc */
+#define BLOCK_ALIGNMENT (sizeof(union { long double d; void *p; long long l; }))
+#define ALIGN_UP(size) \
+    (((size) + BLOCK_ALIGNMENT - 1) / BLOCK_ALIGNMENT * BLOCK_ALIGNMENT)
+/* names shorter than this are kept inside the product instead of the pool */
+#define SHORT_NAME_SIZE 16
+/* the fields of a row of an imported catalog: id, name, amount, type, price */
+#define IMPORT_FIELDS 5
+#define IMPORT_CAPACITY 64
+/* the number of orders kept for reuse by default, @see mtmSetOrderPool */
+#define ORDER_POOL_CAPACITY 64
+/* the number of independent sums a column is summed in, @see sumColumn */
+#define SUM_LANES 4
+/* the number of changes the log of a transaction has room for at first */
+#define UNDO_LOG_CAPACITY 64
 
 typedef struct productInformation_t {
   MtmProductData customData;
@@ -17,37 +43,112 @@ typedef struct productInformation_t {
   MtmGetProductPrice prodPrice;
   MatamazomAmountType amountType;
   unsigned int id;
-  char *name;
+  const char *name; // points to short_name, or to a string of name_pool
   double total_income;
+  double reserved; // amount held by orders, only used in reservation mode
+  double on_order; // total amount of the product in all the open orders
+  const Allocator *allocator; // the warehouse's allocator
+  StringPool *name_pool; // the pool of the warehouse which created the product
+  char short_name[SHORT_NAME_SIZE];
 } *ProductInfo;
 
+/* an order is a single block of memory: the order_t itself, then the arena
+ * (if there is one) and then the cart's AmountSet struct. */
 typedef struct order_t {
   AmountSet cart;
   unsigned int order_id;
+  const Allocator *allocator; // the warehouse's allocator
+  BumpArena *arena; // holds the cart's memory, NULL if carts use 'allocator'
+  bool logged; // the open transaction can already undo changes to the cart
+  struct order_t *next;
 } *Order;
 
+/* a change made by a transaction, and what undoing it takes */
+typedef enum UndoType_t {
+  UNDO_ORDER_ADDED, // 'order' was created
+  UNDO_ORDER_REMOVED, // 'order' was shipped, canceled or merged, and is kept
+  UNDO_ORDER_CART, // the cart of 'order' was changed, and 'cart' is the old one
+  UNDO_INDEX_CHANGED, // 'amount' was added to product 'id' in the stock index
+  UNDO_INDEX_INSERTED, // product 'id' was added to the stock index
+  UNDO_INDEX_REMOVED, // product 'id' was removed from the stock index
+  UNDO_PRODUCT_ADDED, // product 'id' was added
+  UNDO_PRODUCT_REMOVED, // product 'id' was cleared, and 'products' keeps it
+  UNDO_PRODUCT_CHANGED // product 'id' had 'amount', 'income', and so on
+} UndoType;
+
+typedef struct UndoEntry_t {
+  UndoType type;
+  Order order;
+  Order previous; // the last order before 'order' was added
+  AmountSet cart;
+  AmountSet products; // holds a cleared product, with its amount
+  unsigned int id;
+  double amount; // the amount of the product, or its change in the index
+  double income;
+  double reserved;
+  double on_order;
+  bool has_watermark;
+  double watermark;
+  MtmLowStockCallback callback;
+  void *context;
+} UndoEntry;
+
+/* the state of an open transaction. the log undoes its changes one by one,
+ * from the last, and the rest is put back as it was when it began. */
+typedef struct Transaction_t {
+  unsigned int depth; // 0 if no transaction is open, more if nested
+  unsigned int max_order_id;
+  bool reservation_mode;
+  bool stock_indexed; // if not, an index built meanwhile is just dropped
+  bool index_lost; // undoing a change of the index failed
+  size_t ledger_count;
+  bool ledger_reopened; // the ledger was opened or closed meanwhile
+  UndoEntry *log;
+  size_t log_size;
+  size_t log_capacity;
+} Transaction;
+
 struct Matamazom_t {
   AmountSet products;
-  List orders;
+  Order orders; // a linked list of the orders, sorted by order_id
+  Order last_order;
+  Order order_pool; // removed orders with empty carts, reused for new orders
+  size_t order_pool_size;
+  size_t order_pool_capacity;
+  uint64_t order_pool_hits; // new orders taken from the pool
+  uint64_t order_pool_misses; // new orders allocated since the pool was empty
+  Allocator allocator;
+  StringPool names; // the names of products, shared by all of their copies
+  size_t cart_arena_size; // 0 if carts aren't allocated from an arena
   unsigned int max_order_id;
   /* in case of removing an order from the list, max_order_id making sure that
    * indexes are always getting bigger to avoid repeating.*/
+  ProductStore store; // columnar copy of products, for scans
+  MtmTotals totals; // the last totals of mtmAggregate
+  bool totals_valid; // false whenever a row of the store changes
+  bool shared; // products may share nodes (and elements) with a snapshot
+  Matamazom source; // the warehouse this is a snapshot of, NULL if none
+  unsigned int snapshots; // the live snapshots of this warehouse
+  bool reservation_mode; // the contents of orders are reserved in products
+  bool report_demand; // inventory reports show the amounts on order
+  StockIndex stock_index; // amounts of products, built on first use
+  bool stock_indexed;
+  double low_stock_watermark; // the watermark of all the products
+  MtmLowStockCallback low_stock_callback;
+  void *low_stock_context;
+  bool concurrent_mode; // amounts are changed in 'counters' meanwhile
+  StockCounters counters;
+  ShipmentLedger ledger; // closed unless mtmOpenLedger was called
+  Transaction transaction;
+#ifdef MTM_ENABLE_METRICS
+  MtmMetrics metrics;
+#endif
 };
 
-static bool isOrderExists(Matamazom matamazom, const unsigned int orderId) {
-  if (matamazom == NULL) {
-    return false;
-  }
-  /* going through all orders, returning true if we find the relevent ordr,
-   according to orderId.
-   return false otherwise. */
-  LIST_FOREACH(Order, iteraor, matamazom->orders) {
-    if (iteraor->order_id == orderId) {
-      return true;
-    }
-  }
-  return false;
-}
+static MatamazomResult changeProductAmount(Matamazom matamazom,
+                                           const unsigned int id,
+                                           const double amount);
+static ProductInfo getMutableProduct(Matamazom matamazom, ProductInfo product);
 
 static Order getOrder(Matamazom matamazom, const unsigned int orderId) {
   if (matamazom == NULL) {
@@ -56,14 +157,30 @@ static Order getOrder(Matamazom matamazom, const unsigned int orderId) {
   /*going through all orders, returning a pointer to the Order struct
    * if we find the relevant order, according to orderId.
    *return NULL otherwise*/
-  LIST_FOREACH(Order, iterator, matamazom->orders) {
-    if (iterator->order_id == orderId) {
-      return iterator;
+  uint64_t steps = 0;
+  for (Order iterator = matamazom->orders; iterator != NULL;
+       iterator = iterator->next) {
+    steps++;
+    if (iterator->order_id >= orderId) {
+      // orders are sorted by id, no need to look further
+      MTM_METRICS_WALK(matamazom, order_walks, steps);
+      return iterator->order_id == orderId ? iterator : NULL;
     }
   }
+  MTM_METRICS_WALK(matamazom, order_walks, steps);
   return NULL;
 }
 
+static bool isOrderExists(Matamazom matamazom, const unsigned int orderId) {
+  if (matamazom == NULL) {
+    return false;
+  }
+  /* going through all orders, returning true if we find the relevent ordr,
+   according to orderId.
+   return false otherwise. */
+  return getOrder(matamazom, orderId) != NULL;
+}
+
 static bool isAmountValid(double amount_to_change, MatamazomAmountType
 type) {
   /* making sure that the amount given by the user is valid,
@@ -103,26 +220,33 @@ type) {
   return false;
 }
 
-static ProductInfo findProductInfo(AmountSet set, unsigned int id) {
+static ProductInfo findProductInfo(Matamazom matamazom, AmountSet set,
+                                   unsigned int id) {
+  (void) matamazom; // only used by the metrics
   // going through all the products and return a pointer to a given order.
   ProductInfo iterator = (ProductInfo) asGetFirst(set);
   if (iterator == NULL) {
     return NULL;
   }
+  uint64_t steps = 0;
   while (iterator != NULL) {
+    steps++;
     if (iterator->id == id) {
       // product is found
+      MTM_METRICS_WALK(matamazom, product_walks, steps);
       return iterator;
     }
     iterator = (ProductInfo) asGetNext(set);
   }
+  MTM_METRICS_WALK(matamazom, product_walks, steps);
   asGetFirst(set); //product's iterator back to start
   return iterator;
 }
 
 static MatamazomAmountType getAmountType(const unsigned int productId, Matamazom
 matamazom) {
-  ProductInfo product_info = findProductInfo(matamazom->products, productId);
+  ProductInfo product_info = findProductInfo(matamazom, matamazom->products,
+                                             productId);
   // return the wanted product's amount type
   return product_info->amountType;
 }
@@ -135,13 +259,10 @@ static bool isNameValid(const char *name) {
 
 int compareProductsID(ASElement product_id1, ASElement product_id2) {
   // a function we provied the AmountSet as users.
-  return (int) (((ProductInfo) product_id1)->id
-      - ((ProductInfo) product_id2)->id);
-}
-
-int compareOrdersID(Order order_1, Order order_2) {
-  // a function we provied the List as users.
-  return ((int) (order_1->order_id) - (int) (order_2->order_id));
+  // ids are compared, not subtracted, as their difference may not fit an int
+  unsigned int id1 = ((ProductInfo) product_id1)->id;
+  unsigned int id2 = ((ProductInfo) product_id2)->id;
+  return (id1 > id2) - (id1 < id2);
 }
 
 void freeProduct(ASElement element) {
@@ -151,18 +272,24 @@ void freeProduct(ASElement element) {
   }
   ProductInfo product_info = (ProductInfo) element;
   product_info->freeData(product_info->customData);
-  free(product_info->name);
-  free(product_info);
+  if (product_info->name != product_info->short_name) {
+    stringPoolDrop(product_info->name_pool, product_info->name);
+  }
+  allocatorFree(product_info->allocator, product_info);
 }
 
-void freeOrders(ListElement element) {
-  // a function we provied the List as users.
-  if (element == NULL) {
-    return;
+/* setting the name of a new product: short names are copied into the product,
+ * longer ones are interned in the pool. returns false if interning failed. */
+static bool setProductName(ProductInfo product, StringPool *pool,
+                           const char *name) {
+  product->name_pool = pool;
+  if (strlen(name) < SHORT_NAME_SIZE) {
+    strcpy(product->short_name, name);
+    product->name = product->short_name;
+    return true;
   }
-  Order order = (Order) element;
-  asDestroy(order->cart);
-  free(order);
+  product->name = stringPoolIntern(pool, name);
+  return product->name != NULL;
 }
 
 ASElement copyProductInfo(ASElement element) {
@@ -171,22 +298,27 @@ ASElement copyProductInfo(ASElement element) {
     return NULL;
   }
   ProductInfo product_info = (ProductInfo) element;
-  ProductInfo new_product_info = malloc(sizeof(*new_product_info));
+  ProductInfo new_product_info =
+      allocatorAllocate(product_info->allocator, sizeof(*new_product_info));
   if (new_product_info == NULL) {
     return NULL;
   }
+  new_product_info->allocator = product_info->allocator;
   new_product_info->customData =
       product_info->copyData(product_info->customData);
   new_product_info->amountType = product_info->amountType;
   new_product_info->id = product_info->id;
-  new_product_info->name =
-      malloc(strlen(product_info->name) + 1);
-  if (new_product_info->name == NULL) {
-    freeProduct(new_product_info);
-    return NULL;
+  new_product_info->name_pool = product_info->name_pool;
+  if (product_info->name == product_info->short_name) {
+    strcpy(new_product_info->short_name, product_info->short_name);
+    new_product_info->name = new_product_info->short_name;
+  } else {
+    // the copy shares the pool's string
+    new_product_info->name = stringPoolRetain(product_info->name);
   }
-  strcpy(new_product_info->name, product_info->name);
   new_product_info->total_income = product_info->total_income;
+  new_product_info->reserved = product_info->reserved;
+  new_product_info->on_order = product_info->on_order;
   new_product_info->copyData = product_info->copyData;
   new_product_info->prodPrice = product_info->prodPrice;
   new_product_info->freeData = product_info->freeData;
@@ -194,353 +326,2697 @@ ASElement copyProductInfo(ASElement element) {
   return new_product_info;
 }
 
-ListElement copyOrder(ListElement element) {
-  // a function we provied the List as users.
-  if (element == NULL) {
+/* creating an order with an empty cart, in a single allocation. if arena_size
+ * isn't 0, the cart's memory will be taken from a bump arena owned by the
+ * order, so it's all released at once when the order is shipped or canceled.
+ */
+static Order createOrder(const Allocator *allocator, size_t arena_size,
+                         unsigned int order_id) {
+  size_t arena_offset = ALIGN_UP(sizeof(struct order_t));
+  size_t cart_offset = arena_offset
+      + (arena_size > 0 ? ALIGN_UP(sizeof(BumpArena)) : 0);
+  char *block = allocatorAllocate(allocator,
+                                  cart_offset + asGetStructSize());
+  if (block == NULL) {
     return NULL;
   }
-  Order order = (Order) element;
-  Order new_order = malloc(sizeof(*new_order));
-  if (new_order == NULL) {
-    return NULL;
+  Order order = (Order) block;
+  order->allocator = allocator;
+  order->order_id = order_id;
+  order->next = NULL;
+  order->arena = NULL;
+  order->logged = false;
+  if (arena_size > 0) {
+    order->arena = (BumpArena *) (block + arena_offset);
+    bumpArenaInit(order->arena, allocator, arena_size);
+  }
+  order->cart = asCreateAt(block + cart_offset, copyProductInfo, freeProduct,
+                           compareProductsID,
+                           order->arena != NULL ? &order->arena->allocator
+                                                : allocator);
+  assert(order->cart != NULL);
+  return order;
+}
+
+static void freeOrder(Order order) {
+  if (order == NULL) {
+    return;
   }
-  new_order->cart = asCopy(order->cart);
-  if (new_order->cart == NULL) {
-    free(new_order);
-    return NULL;
+  // the cart and the arena are a part of the order's block
+  asDestroy(order->cart);
+  if (order->arena != NULL) {
+    bumpArenaRelease(order->arena);
   }
-  new_order->order_id = order->order_id;
-  return new_order;
+  allocatorFree(order->allocator, order);
 }
 
-Matamazom matamazomCreate() {
-  // creating the AS for product and List for orders
-  Matamazom new_warehouse = malloc(sizeof(*new_warehouse));
-  if (new_warehouse == NULL) {
+/* adding an order to the end of the orders list, without copying it. the
+ * list takes ownership of the order. */
+static void adoptOrder(Matamazom matamazom, Order order) {
+  assert(matamazom->last_order == NULL
+             || matamazom->last_order->order_id < order->order_id);
+  order->next = NULL;
+  if (matamazom->last_order == NULL) {
+    matamazom->orders = order;
+  } else {
+    matamazom->last_order->next = order;
+  }
+  matamazom->last_order = order;
+}
+
+/* removing an order from the orders list and returning it, without freeing
+ * it. returns NULL if there is no such order. */
+static Order detachOrder(Matamazom matamazom, const unsigned int orderId) {
+  Order previous = NULL;
+  Order order = matamazom->orders;
+  while (order != NULL && order->order_id < orderId) {
+    previous = order;
+    order = order->next;
+  }
+  if (order == NULL || order->order_id != orderId) {
     return NULL;
   }
-  new_warehouse->products =
-      asCreate(copyProductInfo, freeProduct, compareProductsID);
-  if (new_warehouse->products == NULL) {
-    free(new_warehouse);
-    return NULL;
+  if (previous == NULL) {
+    matamazom->orders = order->next;
+  } else {
+    previous->next = order->next;
+  }
+  if (matamazom->last_order == order) {
+    matamazom->last_order = previous;
   }
+  order->next = NULL;
+  return order;
+}
 
-  new_warehouse->orders = listCreate(copyOrder, freeOrders);
-  if (new_warehouse->orders == NULL) {
-    asDestroy(new_warehouse->products);
-    free(new_warehouse);
-    return NULL;
+/* putting a detached order back in its place in the orders list */
+static void insertOrder(Matamazom matamazom, Order order) {
+  Order previous = NULL;
+  Order next = matamazom->orders;
+  while (next != NULL && next->order_id < order->order_id) {
+    previous = next;
+    next = next->next;
+  }
+  order->next = next;
+  if (previous == NULL) {
+    matamazom->orders = order;
+  } else {
+    previous->next = order;
+  }
+  if (next == NULL) {
+    matamazom->last_order = order;
   }
-  // initializing max order is, since there are no orders yet.
-  new_warehouse->max_order_id = 0;
-  return new_warehouse;
 }
-// destroying the product (AS) and the orders (List)
-void matamazomDestroy(Matamazom matamazom) {
-  if (matamazom == NULL) {
+
+/* keeping a removed order in the pool with an empty cart (whose arena keeps a
+ * block for the next cart), or freeing it if the pool is full */
+static void recycleOrder(Matamazom matamazom, Order order) {
+  if (order == NULL) {
     return;
   }
-  if (matamazom->products != NULL) {
-    asDestroy(matamazom->products);
+  if (matamazom->order_pool_size >= matamazom->order_pool_capacity) {
+    freeOrder(order);
+    return;
   }
-  if (matamazom->orders != NULL) {
-    listDestroy(matamazom->orders);
+  asClear(order->cart);
+  if (order->arena != NULL) {
+    bumpArenaReset(order->arena);
   }
-  free(matamazom);
+  order->next = matamazom->order_pool;
+  matamazom->order_pool = order;
+  matamazom->order_pool_size++;
 }
 
-MatamazomResult mtmNewProduct(Matamazom matamazom,
-                              const unsigned int id,
-                              const char *name,
-                              const double amount,
-                              const MatamazomAmountType amountType,
-                              const MtmProductData customData,
-                              MtmCopyData copyData,
-                              MtmFreeData freeData,
-                              MtmGetProductPrice prodPrice) {
-  /* ** if allocation fails at any level, we must free all the memory allocated
-  so far! **  */
+/* returns an order with an empty cart for a new order id, from the pool if
+ * it isn't empty. returns NULL if an allocation failed. */
+static Order newOrder(Matamazom matamazom, unsigned int order_id) {
+  Order order = matamazom->order_pool;
+  if (order == NULL) {
+    matamazom->order_pool_misses++;
+    return createOrder(&matamazom->allocator, matamazom->cart_arena_size,
+                       order_id);
+  }
+  matamazom->order_pool_hits++;
+  matamazom->order_pool = order->next;
+  matamazom->order_pool_size--;
+  order->next = NULL;
+  order->order_id = order_id;
+  order->logged = false;
+  return order;
+}
 
-  if (matamazom == NULL || name == NULL || customData == NULL
-      || copyData == NULL || freeData == NULL || prodPrice == NULL) {
-    return MATAMAZOM_NULL_ARGUMENT;
+/* freeing the orders of the pool beyond the given number */
+static void trimOrderPool(Matamazom matamazom, size_t size) {
+  while (matamazom->order_pool_size > size) {
+    Order order = matamazom->order_pool;
+    matamazom->order_pool = order->next;
+    matamazom->order_pool_size--;
+    freeOrder(order);
   }
-  if (!isNameValid(name)) {
-    return MATAMAZOM_INVALID_NAME;
-  }
-  if (amount < 0) {
-    return MATAMAZOM_INVALID_AMOUNT;
+}
+
+/* making room in the log of the open transaction for 'count' more changes, so
+ * logging them can't fail. returns false if there isn't enough memory, and
+ * true if there is or if no transaction is open. */
+static bool reserveUndo(Matamazom matamazom, size_t count) {
+  Transaction *transaction = &matamazom->transaction;
+  if (transaction->depth == 0 ||
+      count <= transaction->log_capacity - transaction->log_size) {
+    return true;
   }
-  if (!isAmountValid(amount, amountType)) {
-    return MATAMAZOM_INVALID_AMOUNT;
+  size_t capacity = transaction->log_capacity > 0 ?
+                    transaction->log_capacity : UNDO_LOG_CAPACITY;
+  while (capacity - transaction->log_size < count) {
+    capacity *= 2;
   }
-  ProductInfo new_product = malloc(sizeof(*new_product));
-  //allocating a place for a new product_info (ASElement in out case)
-  if (new_product == NULL) {
-    return MATAMAZOM_OUT_OF_MEMORY;
+  UndoEntry *log = allocatorAllocate(&matamazom->allocator,
+                                     capacity * sizeof(*log));
+  if (log == NULL) {
+    return false;
   }
-  // initializing all fields
-  new_product->id = id;
-  new_product->copyData = copyData;
-  new_product->freeData = freeData;
-  new_product->prodPrice = prodPrice;
-  new_product->amountType = amountType;
-  new_product->total_income = 0;
-  new_product->customData = new_product->copyData(customData);
-  //using the user's copy function, since we need a copy of the customData
-  if (new_product->customData == NULL) {
-    free(new_product);
-    return MATAMAZOM_OUT_OF_MEMORY;
+  if (transaction->log_size > 0) {
+    memcpy(log, transaction->log, transaction->log_size * sizeof(*log));
   }
-  new_product->name = malloc(strlen(name) + 1);
-  // allocating memory for the name
-  if (new_product->name == NULL) {
-    freeProduct(new_product);
-    return MATAMAZOM_OUT_OF_MEMORY;
+  allocatorFree(&matamazom->allocator, transaction->log);
+  transaction->log = log;
+  transaction->log_capacity = capacity;
+  return true;
+}
+
+/* logging a change of the open transaction, in room reserved for it */
+static void logUndo(Matamazom matamazom, UndoEntry entry) {
+  Transaction *transaction = &matamazom->transaction;
+  assert(transaction->log_size < transaction->log_capacity);
+  transaction->log[transaction->log_size++] = entry;
+}
+
+/* logging a change of the stock index, if it has to be undone. an index built
+ * during the transaction is built again instead. */
+static void logIndexChange(Matamazom matamazom, UndoEntry entry) {
+  if (matamazom->transaction.depth > 0 &&
+      matamazom->transaction.stock_indexed) {
+    logUndo(matamazom, entry);
   }
-  new_product->name = strcpy(new_product->name, name);
+}
 
-  if (asContains(matamazom->products, new_product)) {
-    /* if the product already exist, we must undo what we did so far.
-     * we created the product_info so we could check if it existed. */
-    new_product->freeData(new_product->customData);
-    free(new_product->name);
-    free(new_product);
-    return MATAMAZOM_PRODUCT_ALREADY_EXIST;
+/* keeping the cart of an order as it is, before the open transaction changes
+ * it for the first time. returns false if there isn't enough memory. */
+static bool saveOrderCart(Matamazom matamazom, Order order) {
+  if (matamazom->transaction.depth == 0 || order->logged) {
+    return true;
   }
-  AmountSetResult result = asRegister(matamazom->products, new_product);
-  // sending a copy of it to the AS
-  if (result == AS_NULL_ARGUMENT) {
-    freeProduct(new_product); // asRegister uses a copy of product
-    return MATAMAZOM_NULL_ARGUMENT;
+  if (!reserveUndo(matamazom, 1)) {
+    return false;
   }
-  if (result == AS_OUT_OF_MEMORY) {
-    freeProduct(new_product); // asRegister uses a copy of product
-    return MATAMAZOM_OUT_OF_MEMORY;
+  // the saved cart shares the nodes of the cart until either one changes
+  AmountSet cart = asSnapshot(order->cart);
+  if (cart == NULL) {
+    return false;
   }
-  mtmChangeProductAmount(matamazom, new_product->id, amount);
-  // won't be NULL_ARGUMENT, all pointers checked before
-  freeProduct(new_product); // asRegister uses a copy of product
-  return MATAMAZOM_SUCCESS;
+  logUndo(matamazom, (UndoEntry) {.type = UNDO_ORDER_CART, .order = order,
+      .cart = cart});
+  order->logged = true;
+  return true;
 }
 
-MatamazomResult mtmChangeProductAmount(Matamazom matamazom,
-                                       const unsigned int id,
-                                       const double amount) {
-  if (matamazom == NULL) {
-    return MATAMAZOM_NULL_ARGUMENT;
+/* adding a new order to the end of the orders list, as adoptOrder does. room
+ * for logging it must have been reserved. */
+static void addOrder(Matamazom matamazom, Order order) {
+  Order previous = matamazom->last_order;
+  adoptOrder(matamazom, order);
+  if (matamazom->transaction.depth > 0) {
+    logUndo(matamazom, (UndoEntry) {.type = UNDO_ORDER_ADDED, .order = order,
+        .previous = previous});
+    // undoing the order undoes any change to its cart
+    order->logged = true;
   }
-  //finding the procuct_info's pointer
-  ProductInfo product_info = findProductInfo(matamazom->products, id);
-  if (product_info == NULL) {
-    return MATAMAZOM_PRODUCT_NOT_EXIST;
+}
+
+/* recycling an order which was detached from the list, unless the open
+ * transaction may still put it back. room for logging it must have been
+ * reserved. */
+static void retireOrder(Matamazom matamazom, Order order) {
+  if (matamazom->transaction.depth == 0) {
+    recycleOrder(matamazom, order);
+    return;
   }
-  //making sure the added amount is legal.
-  if (!isAmountValid(amount, product_info->amountType)) {
-    return MATAMAZOM_INVALID_AMOUNT;
+  logUndo(matamazom, (UndoEntry) {.type = UNDO_ORDER_REMOVED,
+      .order = order});
+}
+
+/* returns the columnar store of the products, rebuilding it first if it's out
+ * of date. returns NULL if there isn't enough memory to rebuild it. */
+static ProductStore *getProductStore(Matamazom matamazom) {
+  ProductStore *store = &matamazom->store;
+  if (store->valid) {
+    return store;
+  }
+  size_t names_size = 0;
+  AS_FOREACH(ProductInfo, product, matamazom->products) {
+    names_size += strlen(product->name) + 1;
+  }
+  if (!productStoreReset(store, (size_t) asGetSize(matamazom->products),
+                         names_size)) {
+    return NULL;
   }
-  AmountSetResult
-  // changing the amount in the AS
-      result = asChangeAmount(matamazom->products, product_info,
-                              amount);
-  if (result == AS_NULL_ARGUMENT) {
-    return MATAMAZOM_NULL_ARGUMENT;
+  double amount = 0;
+  AS_FOREACH(ProductInfo, product, matamazom->products) {
+    asGetAmount(matamazom->products, product, &amount);
+    productStoreAppend(store, product->id, product->name, amount,
+                       product->total_income,
+                       (unsigned char) product->amountType, product);
+  }
+  store->valid = true;
+  return store;
+}
+
+/* must be called whenever a product is added to or removed from products */
+static void invalidateProductStore(Matamazom matamazom) {
+  matamazom->store.valid = false;
+  matamazom->totals_valid = false;
+}
+
+/* updating the row of a product whose amount in products was just changed by
+ * 'amount' (and whose income may have changed) */
+static void updateStoredProduct(Matamazom matamazom, ProductInfo product,
+                                double amount) {
+  ProductStore *store = &matamazom->store;
+  matamazom->totals_valid = false;
+  if (!store->valid) {
+    return;
   }
-  if (result == AS_ITEM_DOES_NOT_EXIST) {
-    return MATAMAZOM_PRODUCT_NOT_EXIST;
+  if (matamazom->shared) {
+    /* the change may have copied elements shared with a snapshot, so the
+     * elements the rows point to may belong to the snapshot now */
+    invalidateProductStore(matamazom);
+    return;
   }
-  if (result == AS_INSUFFICIENT_AMOUNT) {
-    return MATAMAZOM_INSUFFICIENT_AMOUNT;
+  size_t row = 0;
+  bool found = productStoreFind(store, product->id, &row);
+  assert(found && store->infos[row] == product);
+  (void) found;
+  store->amounts[row] += amount;
+  store->incomes[row] = product->total_income;
+  if (amount != 0) {
+    store->values[row] = NAN; // priced again by the next mtmAggregate
   }
-  assert(result == AS_SUCCESS);
-  return MATAMAZOM_SUCCESS;
 }
 
-MatamazomResult mtmClearProduct(Matamazom matamazom, const unsigned int id) {
-  if (matamazom == NULL) {
-    return MATAMAZOM_NULL_ARGUMENT;
+/* logging a product as it is, before the open transaction changes its amount,
+ * income, reservation or demand. the product must already belong only to
+ * matamazom (@see getMutableProduct), so undoing the change can't fail. room
+ * for logging it must have been reserved. */
+static void logProductChange(Matamazom matamazom, ProductInfo product) {
+  if (matamazom->transaction.depth == 0) {
+    return;
   }
-  //finding the product_info's pointer
-  ProductInfo product_info_ptr = findProductInfo(matamazom->products, id);
-  if (product_info_ptr == NULL) {
-    return MATAMAZOM_PRODUCT_NOT_EXIST;
+  UndoEntry entry = {.type = UNDO_PRODUCT_CHANGED, .id = product->id,
+      .income = product->total_income, .reserved = product->reserved,
+      .on_order = product->on_order};
+  size_t row = 0;
+  if (matamazom->store.valid &&
+      productStoreFind(&matamazom->store, product->id, &row)) {
+    entry.amount = matamazom->store.amounts[row];
+  } else {
+    asGetAmount(matamazom->products, product, &entry.amount);
+  }
+  logUndo(matamazom, entry);
+}
+
+/* returns the low-stock index of the products, building it on first use.
+ * returns NULL if there isn't enough memory to build it. */
+static StockIndex *getStockIndex(Matamazom matamazom) {
+  if (matamazom->stock_indexed) {
+    return &matamazom->stock_index;
   }
-  //deleting the product from products (AS)
-  asDelete(matamazom->products, (ASElement) product_info_ptr);
-  LIST_FOREACH(Order, element, matamazom->orders) {
-    //going through every order and if the product is in it, it will be removed
-    product_info_ptr = findProductInfo(element->cart, id);
-    if (product_info_ptr != NULL) {
-      asDelete(element->cart, (ASElement) product_info_ptr);
+  double amount = 0;
+  AS_FOREACH(ProductInfo, product, matamazom->products) {
+    asGetAmount(matamazom->products, product, &amount);
+    if (!stockIndexInsert(&matamazom->stock_index, product->id, amount)) {
+      stockIndexRelease(&matamazom->stock_index);
+      return NULL;
     }
+  }
+  matamazom->stock_indexed = true;
+  return &matamazom->stock_index;
+}
 
+/* updating the index of a product whose amount in products was just changed
+ * by 'amount', and calling the callback of a watermark it dropped below. room
+ * for logging the change in an open transaction must have been reserved. */
+static void updateStockIndex(Matamazom matamazom, unsigned int id,
+                             double amount) {
+  double old_amount = 0;
+  if (!matamazom->stock_indexed ||
+      !stockIndexChangeAmount(&matamazom->stock_index, id, amount,
+                              &old_amount)) {
+    return;
+  }
+  logIndexChange(matamazom, (UndoEntry) {.type = UNDO_INDEX_CHANGED, .id = id,
+      .amount = amount});
+  double watermark = matamazom->low_stock_watermark;
+  MtmLowStockCallback callback = matamazom->low_stock_callback;
+  void *context = matamazom->low_stock_context;
+  // the product's own watermark, if it has one, replaces the global one
+  stockIndexGetWatermark(&matamazom->stock_index, id, &watermark, &callback,
+                         &context);
+  double new_amount = old_amount + amount;
+  if (callback != NULL && old_amount >= watermark && new_amount < watermark) {
+    callback(id, new_amount, context);
   }
-  return MATAMAZOM_SUCCESS;
 }
 
-unsigned int mtmCreateNewOrder(Matamazom matamazom) {
-  if (matamazom == NULL) {
-    return 0;
+/* allocating a warehouse without products and with an empty list of orders */
+static Matamazom allocateWarehouse(const Allocator *allocator) {
+  Matamazom new_warehouse = allocatorAllocate(allocator,
+                                              sizeof(*new_warehouse));
+  if (new_warehouse == NULL) {
+    return NULL;
   }
-  unsigned int max_id = matamazom->max_order_id;
-  /*making sure we won't initialize an order is that already deleted from
-  the List */
-  Order current_order = (Order) malloc(sizeof(*current_order));
-  // allocating memory for an order struct.
-  if (current_order == NULL) {
-    return 0;
+  new_warehouse->allocator = *allocator;
+  stringPoolInit(&new_warehouse->names, &new_warehouse->allocator);
+  new_warehouse->products = NULL;
+  new_warehouse->orders = NULL;
+  new_warehouse->last_order = NULL;
+  new_warehouse->order_pool = NULL;
+  new_warehouse->order_pool_size = 0;
+  new_warehouse->order_pool_capacity = ORDER_POOL_CAPACITY;
+  new_warehouse->order_pool_hits = 0;
+  new_warehouse->order_pool_misses = 0;
+  // initializing max order is, since there are no orders yet.
+  new_warehouse->max_order_id = 0;
+  new_warehouse->cart_arena_size = 0;
+  productStoreInit(&new_warehouse->store, &new_warehouse->allocator);
+  new_warehouse->totals_valid = false;
+  new_warehouse->shared = false;
+  new_warehouse->source = NULL;
+  new_warehouse->snapshots = 0;
+  new_warehouse->reservation_mode = false;
+  new_warehouse->report_demand = false;
+  stockIndexInit(&new_warehouse->stock_index, &new_warehouse->allocator);
+  new_warehouse->stock_indexed = false;
+  new_warehouse->low_stock_watermark = 0;
+  new_warehouse->low_stock_callback = NULL;
+  new_warehouse->low_stock_context = NULL;
+  new_warehouse->concurrent_mode = false;
+  stockCountersInit(&new_warehouse->counters, &new_warehouse->allocator);
+  shipmentLedgerInit(&new_warehouse->ledger, &new_warehouse->allocator);
+  memset(&new_warehouse->transaction, 0, sizeof(new_warehouse->transaction));
+#ifdef MTM_ENABLE_METRICS
+  memset(&new_warehouse->metrics, 0, sizeof(new_warehouse->metrics));
+#endif
+  return new_warehouse;
+}
+
+Matamazom matamazomCreate() {
+  return matamazomCreateWithAllocator(NULL);
+}
+
+Matamazom matamazomCreateWithAllocator(const Allocator *allocator) {
+  if (allocator == NULL) {
+    allocator = allocatorGetDefault();
   }
-  // assigning field.
-  current_order->order_id = max_id + 1;
-  //creating a shopping cart AS
-  current_order->cart =
-      asCreate(copyProductInfo, freeProduct, compareProductsID);
-  if (current_order->cart == NULL) {
-    free(current_order);
-    return 0;
+  Matamazom new_warehouse = allocateWarehouse(allocator);
+  if (new_warehouse == NULL) {
+    return NULL;
   }
-  ListResult
-      result = listInsertLast(matamazom->orders, (ListElement) current_order);
-  /* listInsertLast inserts a *copy* of the order, now we need to release the source,
-  no matter what is the value of result */
-  asDestroy(current_order->cart);
-  free(current_order);
-  if (result == LIST_OUT_OF_MEMORY || result == LIST_NULL_ARGUMENT) {
-    return 0;
+  // creating the AS for product
+  new_warehouse->products =
+      asCreateWithAllocator(copyProductInfo, freeProduct, compareProductsID,
+                            &new_warehouse->allocator);
+  if (new_warehouse->products == NULL) {
+    allocatorFree(allocator, new_warehouse);
+    return NULL;
   }
-  matamazom->max_order_id = max_id + 1;
-  //promoting the max_order_id field.
-  return max_id + 1;
+  return new_warehouse;
 }
 
-MatamazomResult mtmShipOrder(Matamazom matamazom, const unsigned int orderId) {
-  if (matamazom == NULL || matamazom->products == NULL
-      || matamazom->orders == NULL) {
-    return MATAMAZOM_NULL_ARGUMENT;
-  }
-  if (!isOrderExists(matamazom, orderId)) {
-    return MATAMAZOM_ORDER_NOT_EXIST;
+Matamazom mtmSnapshot(Matamazom matamazom) {
+  if (matamazom == NULL || matamazom->transaction.depth > 0 ||
+      matamazom->concurrent_mode) {
+    /* mtmAbort relies on the products it changed belonging only to
+     * matamazom, and in concurrent mode the amounts are in the counters */
+    return NULL;
   }
-  // fetching the order struct's pointer
-  Order order = getOrder(matamazom, orderId);
-  /* NULL cases already checked, and order is in the list,
-   * so 'order' shouldn't be NULL*/
-  assert(order != NULL);
-  ProductInfo current_product_in_order = asGetFirst(order->cart);
-  double amount_in_order = 0;
-  double amount_in_warehouse = 0;
-  AmountSetResult result;
-  /*going through all the products in the cart, checking the amount in the
-   * products AS is sufficient */
-  while (current_product_in_order != NULL) {
-    result =
-        asGetAmount(order->cart, current_product_in_order,
-                    &amount_in_order);
-    if (result != AS_SUCCESS) {
-      return MATAMAZOM_NULL_ARGUMENT;
-    }
-    result =
-        asGetAmount(matamazom->products,
-                    current_product_in_order,
-                    &amount_in_warehouse);
-    if (result != AS_SUCCESS) {
-      return MATAMAZOM_NULL_ARGUMENT;
-    }
-    if (amount_in_order > amount_in_warehouse) {
-      return MATAMAZOM_INSUFFICIENT_AMOUNT;
-    }
-    current_product_in_order = asGetNext(order->cart);
+  Matamazom snapshot = allocateWarehouse(&matamazom->allocator);
+  if (snapshot == NULL) {
+    return NULL;
   }
-  /*now we know the amount of every product is sufficient, so we can start
-  shipping the order */
-  double product_price_in_order = 0;
-  current_product_in_order = asGetFirst(order->cart);
-  ProductInfo current_product_in_products = NULL;
-  /*every product is removed from the products, by the amount in the order,
-   * and his income is updated in product_info */
-  while (current_product_in_order != NULL) {
-    current_product_in_products =
-        findProductInfo(matamazom->products,
-                        current_product_in_order->id);
-    asGetAmount(order->cart, current_product_in_order, &amount_in_order);
-    product_price_in_order =
-        current_product_in_order->prodPrice(
-            current_product_in_order->customData,
-            amount_in_order);
-    current_product_in_products->total_income += product_price_in_order;
-    asChangeAmount(matamazom->products,
-                   current_product_in_products,
-                   -(amount_in_order));
-    current_product_in_order = asGetNext(order->cart);
+  // the products are shared with the source until one of them changes
+  snapshot->products = asSnapshot(matamazom->products);
+  if (snapshot->products == NULL) {
+    allocatorFree(&matamazom->allocator, snapshot);
+    return NULL;
   }
-  return mtmCancelOrder(matamazom, orderId);
-  // should succeed because all condition were checked
+  snapshot->max_order_id = matamazom->max_order_id;
+  /* a snapshot of a snapshot shares nodes with the same warehouse, which
+   * counts all of them so it knows when nothing is shared anymore */
+  Matamazom source = matamazom->source != NULL ? matamazom->source : matamazom;
+  snapshot->source = source;
+  source->snapshots++;
+  snapshot->shared = true;
+  matamazom->shared = true;
+  source->shared = true;
+  snapshot->cart_arena_size = matamazom->cart_arena_size;
+  snapshot->report_demand = matamazom->report_demand;
+  return snapshot;
 }
 
-MatamazomResult mtmCancelOrder(Matamazom matamazom,
-                               const unsigned int orderId) {
-  if (matamazom == NULL || matamazom->orders == NULL) {
+MatamazomResult mtmBegin(Matamazom matamazom) {
+  if (matamazom == NULL) {
     return MATAMAZOM_NULL_ARGUMENT;
   }
-  if (!isOrderExists(matamazom, orderId)) {
+  if (matamazom->concurrent_mode) {
+    return MATAMAZOM_CONCURRENT_MODE;
+  }
+  Transaction *transaction = &matamazom->transaction;
+  if (transaction->depth > 0) {
+    // a nested transaction is a part of the outer one
+    transaction->depth++;
+    return MATAMAZOM_SUCCESS;
+  }
+  // nothing is copied, every change logs what undoing it takes as it's made
+  transaction->depth = 1;
+  transaction->max_order_id = matamazom->max_order_id;
+  transaction->reservation_mode = matamazom->reservation_mode;
+  transaction->stock_indexed = matamazom->stock_indexed;
+  transaction->index_lost = false;
+  transaction->ledger_count = shipmentLedgerCount(&matamazom->ledger);
+  transaction->ledger_reopened = false;
+  transaction->log_size = 0;
+  return MATAMAZOM_SUCCESS;
+}
+
+/* ending the open transaction: dropping the log, whose removed orders and
+ * products are released only now */
+static void endTransaction(Matamazom matamazom) {
+  Transaction *transaction = &matamazom->transaction;
+  for (size_t i = 0; i < transaction->log_size; i++) {
+    UndoEntry *entry = &transaction->log[i];
+    if (entry->type == UNDO_ORDER_ADDED) {
+      entry->order->logged = false;
+    } else if (entry->type == UNDO_ORDER_CART) {
+      asDestroy(entry->cart);
+      entry->order->logged = false;
+    } else if (entry->type == UNDO_ORDER_REMOVED) {
+      recycleOrder(matamazom, entry->order);
+    } else if (entry->type == UNDO_PRODUCT_REMOVED) {
+      asDestroy(entry->products);
+    }
+  }
+  transaction->log_size = 0;
+  transaction->depth = 0;
+}
+
+static MatamazomResult commit(Matamazom matamazom) {
+  if (matamazom == NULL) {
+    return MATAMAZOM_NULL_ARGUMENT;
+  }
+  Transaction *transaction = &matamazom->transaction;
+  if (transaction->depth == 0) {
+    return MATAMAZOM_SUCCESS;
+  }
+  // only the outermost transaction really ends
+  if (transaction->depth > 1) {
+    transaction->depth--;
+    return MATAMAZOM_SUCCESS;
+  }
+  endTransaction(matamazom);
+  return MATAMAZOM_SUCCESS;
+}
+
+MatamazomResult mtmCommit(Matamazom matamazom) {
+  MTM_METRICS_START(start);
+  MatamazomResult result = commit(matamazom);
+  MTM_METRICS_STOP(matamazom, MTM_METRICS_COMMIT, start,
+                   result != MATAMAZOM_SUCCESS);
+  return result;
+}
+
+/* putting a product back as it was when its change was logged, and its row of
+ * the store as well. the product was made to belong only to matamazom before
+ * the change, so nothing can fail. */
+static void restoreProduct(Matamazom matamazom, const UndoEntry *entry) {
+  // products are compared only by their ids
+  struct productInformation_t key = {.id = entry->id};
+  ProductInfo product = asGetMutable(matamazom->products, &key);
+  assert(product != NULL);
+  AmountSetResult result = asSetAmount(matamazom->products, product,
+                                       entry->amount);
+  assert(result == AS_SUCCESS);
+  (void) result;
+  product->total_income = entry->income;
+  product->reserved = entry->reserved;
+  product->on_order = entry->on_order;
+  ProductStore *store = &matamazom->store;
+  matamazom->totals_valid = false;
+  size_t row = 0;
+  if (store->valid && productStoreFind(store, entry->id, &row)) {
+    assert(store->infos[row] == product);
+    store->amounts[row] = entry->amount;
+    store->incomes[row] = entry->income;
+    store->values[row] = NAN; // priced again by the next mtmAggregate
+  }
+}
+
+/* undoing a single change of the log, which is the last one not undone */
+static void undoChange(Matamazom matamazom, UndoEntry *entry) {
+  StockIndex *index = &matamazom->stock_index;
+  struct productInformation_t key = {.id = entry->id};
+  if (entry->type == UNDO_ORDER_ADDED) {
+    // the orders added after it are already gone, so it's the last one
+    assert(matamazom->last_order == entry->order);
+    if (entry->previous == NULL) {
+      matamazom->orders = NULL;
+    } else {
+      entry->previous->next = NULL;
+    }
+    matamazom->last_order = entry->previous;
+    recycleOrder(matamazom, entry->order);
+  } else if (entry->type == UNDO_ORDER_REMOVED) {
+    insertOrder(matamazom, entry->order);
+  } else if (entry->type == UNDO_ORDER_CART) {
+    Order order = entry->order;
+    asDestroy(order->cart);
+    order->cart = asSnapshotAt(order->cart, entry->cart);
+    asDestroy(entry->cart);
+    order->logged = false;
+  } else if (entry->type == UNDO_INDEX_CHANGED) {
+    double old_amount = 0;
+    stockIndexChangeAmount(index, entry->id, -entry->amount, &old_amount);
+  } else if (entry->type == UNDO_INDEX_INSERTED) {
+    stockIndexRemove(index, entry->id);
+  } else if (entry->type == UNDO_INDEX_REMOVED) {
+    if (!stockIndexInsert(index, entry->id, entry->amount)) {
+      matamazom->transaction.index_lost = true;
+    } else if (entry->has_watermark) {
+      stockIndexSetWatermark(index, entry->id, entry->watermark,
+                             entry->callback, entry->context);
+    }
+  } else if (entry->type == UNDO_PRODUCT_ADDED) {
+    AmountSetResult result = asDelete(matamazom->products, &key);
+    assert(result == AS_SUCCESS);
+    (void) result;
+    invalidateProductStore(matamazom);
+  } else if (entry->type == UNDO_PRODUCT_REMOVED) {
+    // the product is moved back as it was, with nothing to allocate
+    AmountSetResult result = asMove(entry->products, matamazom->products,
+                                    &key);
+    assert(result == AS_SUCCESS);
+    (void) result;
+    asDestroy(entry->products);
+    invalidateProductStore(matamazom);
+  } else if (entry->type == UNDO_PRODUCT_CHANGED) {
+    restoreProduct(matamazom, entry);
+  }
+}
+
+static MatamazomResult abortTransaction(Matamazom matamazom) {
+  if (matamazom == NULL) {
+    return MATAMAZOM_NULL_ARGUMENT;
+  }
+  if (matamazom->concurrent_mode) {
+    return MATAMAZOM_CONCURRENT_MODE;
+  }
+  Transaction *transaction = &matamazom->transaction;
+  if (transaction->depth == 0) {
+    return MATAMAZOM_SUCCESS;
+  }
+  // the changes are undone from the last, so each finds what it changed
+  while (transaction->log_size > 0) {
+    undoChange(matamazom, &transaction->log[--transaction->log_size]);
+  }
+  matamazom->max_order_id = transaction->max_order_id;
+  matamazom->reservation_mode = transaction->reservation_mode;
+  if (!transaction->ledger_reopened &&
+      shipmentLedgerIsOpen(&matamazom->ledger)) {
+    shipmentLedgerTruncate(&matamazom->ledger, transaction->ledger_count);
+  }
+  if (matamazom->stock_indexed &&
+      (transaction->index_lost || !transaction->stock_indexed)) {
+    /* the index was built from the changed amounts, or is missing a product,
+     * so it's built again from the products. an index built meanwhile loses
+     * the watermarks of its products. */
+    stockIndexRelease(&matamazom->stock_index);
+    matamazom->stock_indexed = false;
+    if (matamazom->low_stock_callback != NULL) {
+      getStockIndex(matamazom);
+    }
+  }
+  transaction->depth = 0;
+  return MATAMAZOM_SUCCESS;
+}
+
+MatamazomResult mtmAbort(Matamazom matamazom) {
+  MTM_METRICS_START(start);
+  MatamazomResult result = abortTransaction(matamazom);
+  MTM_METRICS_STOP(matamazom, MTM_METRICS_ABORT, start,
+                   result != MATAMAZOM_SUCCESS);
+  return result;
+}
+
+// destroying the product (AS) and the orders
+void matamazomDestroy(Matamazom matamazom) {
+  if (matamazom == NULL) {
+    return;
+  }
+  if (matamazom->transaction.depth > 0) {
+    // the orders removed by the transaction are still kept in its log
+    endTransaction(matamazom);
+  }
+  allocatorFree(&matamazom->allocator, matamazom->transaction.log);
+  if (matamazom->products != NULL) {
+    asDestroy(matamazom->products);
+  }
+  if (matamazom->source != NULL && --matamazom->source->snapshots == 0) {
+    // the nodes the snapshots shared belong only to the source again
+    matamazom->source->shared = false;
+  }
+  Order order = matamazom->orders;
+  while (order != NULL) {
+    Order next = order->next;
+    freeOrder(order);
+    order = next;
+  }
+  trimOrderPool(matamazom, 0);
+  productStoreRelease(&matamazom->store);
+  stockIndexRelease(&matamazom->stock_index);
+  stockCountersRelease(&matamazom->counters);
+  shipmentLedgerClose(&matamazom->ledger);
+  stringPoolRelease(&matamazom->names);
+  Allocator allocator = matamazom->allocator;
+  allocatorFree(&allocator, matamazom);
+}
+
+MatamazomResult mtmSetCartArena(Matamazom matamazom, size_t blockSize) {
+  if (matamazom == NULL) {
+    return MATAMAZOM_NULL_ARGUMENT;
+  }
+  // existing orders keep the arena (or the lack of it) they were created with
+  if (blockSize != matamazom->cart_arena_size) {
+    // the pooled orders have carts for the old size
+    trimOrderPool(matamazom, 0);
+  }
+  matamazom->cart_arena_size = blockSize;
+  return MATAMAZOM_SUCCESS;
+}
+
+MatamazomResult mtmSetOrderPool(Matamazom matamazom, size_t capacity) {
+  if (matamazom == NULL) {
+    return MATAMAZOM_NULL_ARGUMENT;
+  }
+  trimOrderPool(matamazom, capacity);
+  matamazom->order_pool_capacity = capacity;
+  return MATAMAZOM_SUCCESS;
+}
+
+MatamazomResult mtmTrimOrderPool(Matamazom matamazom) {
+  if (matamazom == NULL) {
+    return MATAMAZOM_NULL_ARGUMENT;
+  }
+  trimOrderPool(matamazom, 0);
+  return MATAMAZOM_SUCCESS;
+}
+
+MatamazomResult mtmGetOrderPoolStats(Matamazom matamazom,
+                                     MtmOrderPoolStats *outStats) {
+  if (matamazom == NULL || outStats == NULL) {
+    return MATAMAZOM_NULL_ARGUMENT;
+  }
+  uint64_t orders = matamazom->order_pool_hits + matamazom->order_pool_misses;
+  outStats->size = matamazom->order_pool_size;
+  outStats->capacity = matamazom->order_pool_capacity;
+  outStats->hits = matamazom->order_pool_hits;
+  outStats->misses = matamazom->order_pool_misses;
+  outStats->hit_rate = orders > 0 ?
+                       (double) matamazom->order_pool_hits / (double) orders : 0;
+  return MATAMAZOM_SUCCESS;
+}
+
+/* creating a product which isn't in any set yet, taking ownership of
+ * customData. returns NULL (after freeing customData) if an allocation failed.
+ */
+static ProductInfo createProduct(Matamazom matamazom, const unsigned int id,
+                                 const char *name,
+                                 const MatamazomAmountType amountType,
+                                 MtmProductData customData,
+                                 MtmCopyData copyData, MtmFreeData freeData,
+                                 MtmGetProductPrice prodPrice) {
+  ProductInfo new_product = allocatorAllocate(&matamazom->allocator,
+                                              sizeof(*new_product));
+  //allocating a place for a new product_info (ASElement in out case)
+  if (new_product == NULL) {
+    freeData(customData);
+    return NULL;
+  }
+  // initializing all fields
+  new_product->allocator = &matamazom->allocator;
+  new_product->id = id;
+  new_product->copyData = copyData;
+  new_product->freeData = freeData;
+  new_product->prodPrice = prodPrice;
+  new_product->amountType = amountType;
+  new_product->total_income = 0;
+  new_product->reserved = 0;
+  new_product->on_order = 0;
+  new_product->customData = customData;
+  // the name is kept in the product, or shared through the warehouse's pool
+  if (!setProductName(new_product, &matamazom->names, name)) {
+    new_product->name = new_product->short_name;
+    freeProduct(new_product);
+    return NULL;
+  }
+  return new_product;
+}
+
+static MatamazomResult newProduct(Matamazom matamazom,
+                                  const unsigned int id,
+                                  const char *name,
+                                  const double amount,
+                                  const MatamazomAmountType amountType,
+                                  const MtmProductData customData,
+                                  MtmCopyData copyData,
+                                  MtmFreeData freeData,
+                                  MtmGetProductPrice prodPrice) {
+  /* ** if allocation fails at any level, we must free all the memory allocated
+  so far! **  */
+
+  if (matamazom == NULL || name == NULL || customData == NULL
+      || copyData == NULL || freeData == NULL || prodPrice == NULL) {
+    return MATAMAZOM_NULL_ARGUMENT;
+  }
+  if (matamazom->concurrent_mode) {
+    return MATAMAZOM_CONCURRENT_MODE;
+  }
+  if (!isNameValid(name)) {
+    return MATAMAZOM_INVALID_NAME;
+  }
+  if (amount < 0) {
+    return MATAMAZOM_INVALID_AMOUNT;
+  }
+  if (!isAmountValid(amount, amountType)) {
+    return MATAMAZOM_INVALID_AMOUNT;
+  }
+  //using the user's copy function, since we need a copy of the customData
+  MtmProductData data_copy = copyData(customData);
+  if (data_copy == NULL) {
+    return MATAMAZOM_OUT_OF_MEMORY;
+  }
+  ProductInfo new_product = createProduct(matamazom, id, name, amountType,
+                                          data_copy, copyData, freeData,
+                                          prodPrice);
+  if (new_product == NULL) {
+    return MATAMAZOM_OUT_OF_MEMORY;
+  }
+
+  if (asContains(matamazom->products, new_product)) {
+    /* if the product already exist, we must undo what we did so far.
+     * we created the product_info so we could check if it existed. */
+    freeProduct(new_product);
+    return MATAMAZOM_PRODUCT_ALREADY_EXIST;
+  }
+  // adding the product and its place in the index, and then its amount in both
+  if (!reserveUndo(matamazom, 4)) {
+    freeProduct(new_product);
+    return MATAMAZOM_OUT_OF_MEMORY;
+  }
+  AmountSetResult result = asRegister(matamazom->products, new_product);
+  // sending a copy of it to the AS
+  if (result == AS_NULL_ARGUMENT) {
+    freeProduct(new_product); // asRegister uses a copy of product
+    return MATAMAZOM_NULL_ARGUMENT;
+  }
+  if (result == AS_OUT_OF_MEMORY) {
+    freeProduct(new_product); // asRegister uses a copy of product
+    return MATAMAZOM_OUT_OF_MEMORY;
+  }
+  invalidateProductStore(matamazom);
+  if (matamazom->stock_indexed &&
+      !stockIndexInsert(&matamazom->stock_index, id, 0)) {
+    asDelete(matamazom->products, new_product);
+    freeProduct(new_product);
+    return MATAMAZOM_OUT_OF_MEMORY;
+  }
+  if (matamazom->transaction.depth > 0) {
+    logUndo(matamazom, (UndoEntry) {.type = UNDO_PRODUCT_ADDED, .id = id});
+  }
+  logIndexChange(matamazom, (UndoEntry) {.type = UNDO_INDEX_INSERTED,
+      .id = id});
+  changeProductAmount(matamazom, new_product->id, amount);
+  // won't be NULL_ARGUMENT, all pointers checked before
+  freeProduct(new_product); // asRegister uses a copy of product
+  return MATAMAZOM_SUCCESS;
+}
+
+MatamazomResult mtmNewProduct(Matamazom matamazom,
+                              const unsigned int id,
+                              const char *name,
+                              const double amount,
+                              const MatamazomAmountType amountType,
+                              const MtmProductData customData,
+                              MtmCopyData copyData,
+                              MtmFreeData freeData,
+                              MtmGetProductPrice prodPrice) {
+  MTM_METRICS_START(start);
+  MatamazomResult result = newProduct(matamazom, id, name, amount,
+                                      amountType, customData, copyData,
+                                      freeData, prodPrice);
+  MTM_METRICS_STOP(matamazom, MTM_METRICS_NEW_PRODUCT, start,
+                   result != MATAMAZOM_SUCCESS);
+  return result;
+}
+
+/* a valid row of an imported catalog */
+typedef struct importRow_t {
+  ProductInfo product;
+  double amount;
+  size_t line;
+} ImportRow;
+
+/* a row of an imported catalog which wasn't imported */
+typedef struct rejectedRow_t {
+  size_t line;
+  MatamazomResult reason;
+} RejectedRow;
+
+/* the rows of an import, read so far */
+typedef struct importRows_t {
+  const Allocator *allocator;
+  ImportRow *rows;
+  size_t size;
+  size_t capacity;
+  RejectedRow *rejected;
+  size_t rejected_size;
+  size_t rejected_capacity;
+} ImportRows;
+
+/* making room for one more item in an array of 'size' items of item_size
+ * bytes, doubling its capacity when it's full */
+static bool reserveItem(const Allocator *allocator, void **items, size_t size,
+                        size_t *capacity, size_t item_size) {
+  if (size < *capacity) {
+    return true;
+  }
+  size_t new_capacity = *capacity > 0 ? 2 * *capacity : IMPORT_CAPACITY;
+  void *new_items = allocatorAllocate(allocator, new_capacity * item_size);
+  if (new_items == NULL) {
+    return false;
+  }
+  if (size > 0) {
+    memcpy(new_items, *items, size * item_size);
+  }
+  allocatorFree(allocator, *items);
+  *items = new_items;
+  *capacity = new_capacity;
+  return true;
+}
+
+static bool rejectRow(ImportRows *rows, size_t line, MatamazomResult reason) {
+  if (!reserveItem(rows->allocator, (void **) &rows->rejected,
+                   rows->rejected_size, &rows->rejected_capacity,
+                   sizeof(*rows->rejected))) {
+    return false;
+  }
+  rows->rejected[rows->rejected_size++] = (RejectedRow) {.line = line,
+      .reason = reason};
+  return true;
+}
+
+static bool parseId(const char *field, unsigned int *outId) {
+  if (*field < '0' || *field > '9') {
+    return false;
+  }
+  char *end = NULL;
+  errno = 0;
+  unsigned long id = strtoul(field, &end, 10);
+  if (*end != '\0' || errno == ERANGE || id > UINT_MAX) {
+    return false;
+  }
+  *outId = (unsigned int) id;
+  return true;
+}
+
+static bool parseNumber(const char *field, double *outNumber) {
+  char *end = NULL;
+  *outNumber = strtod(field, &end);
+  return end != field && *end == '\0' && isfinite(*outNumber);
+}
+
+static bool parseAmountType(const char *field, MatamazomAmountType *outType) {
+  if (strcmp(field, "integer") == 0) {
+    *outType = MATAMAZOM_INTEGER_AMOUNT;
+  } else if (strcmp(field, "half_integer") == 0) {
+    *outType = MATAMAZOM_HALF_INTEGER_AMOUNT;
+  } else if (strcmp(field, "any") == 0) {
+    *outType = MATAMAZOM_ANY_AMOUNT;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+/* splitting a line (without its line break) into the fields of a row, and
+ * validating them as mtmNewProduct does. the name is a part of the line. */
+static MatamazomResult parseRow(char *line, unsigned int *outId,
+                                const char **outName, double *outAmount,
+                                MatamazomAmountType *outType,
+                                double *outPrice) {
+  char *fields[IMPORT_FIELDS];
+  int count = 0;
+  for (char *field = line; field != NULL; count++) {
+    char *comma = strchr(field, ',');
+    if (count == IMPORT_FIELDS) {
+      return MATAMAZOM_INVALID_FORMAT;
+    }
+    fields[count] = field;
+    if (comma != NULL) {
+      *comma = '\0';
+    }
+    field = comma != NULL ? comma + 1 : NULL;
+  }
+  if (count != IMPORT_FIELDS || !parseId(fields[0], outId) ||
+      !parseAmountType(fields[3], outType) ||
+      !parseNumber(fields[4], outPrice)) {
+    return MATAMAZOM_INVALID_FORMAT;
+  }
+  *outName = fields[1];
+  if (!isNameValid(*outName)) {
+    return MATAMAZOM_INVALID_NAME;
+  }
+  if (!parseNumber(fields[2], outAmount) || *outAmount < 0 ||
+      !isAmountValid(*outAmount, *outType)) {
+    return MATAMAZOM_INVALID_AMOUNT;
+  }
+  return MATAMAZOM_SUCCESS;
+}
+
+/* reading all the rows of a catalog, creating a product for every valid row.
+ * returns false if an allocation failed. */
+static bool readRows(Matamazom matamazom, FILE *input,
+                     const MtmImportSpec *spec, ImportRows *rows) {
+  char *line = NULL;
+  size_t line_capacity = 0;
+  ssize_t length;
+  size_t line_number = 0;
+  bool succeeded = true;
+  while (succeeded && (length = getline(&line, &line_capacity, input)) >= 0) {
+    line_number++;
+    while (length > 0 && (line[length - 1] == '\n' ||
+                          line[length - 1] == '\r')) {
+      line[--length] = '\0';
+    }
+    if (length == 0) {
+      continue;
+    }
+    unsigned int id = 0;
+    const char *name = NULL;
+    double amount = 0;
+    MatamazomAmountType type = MATAMAZOM_ANY_AMOUNT;
+    double price = 0;
+    MatamazomResult result = parseRow(line, &id, &name, &amount, &type,
+                                      &price);
+    if (result != MATAMAZOM_SUCCESS) {
+      succeeded = rejectRow(rows, line_number, result);
+      continue;
+    }
+    if (!reserveItem(rows->allocator, (void **) &rows->rows, rows->size,
+                     &rows->capacity, sizeof(*rows->rows))) {
+      succeeded = false;
+      break;
+    }
+    MtmProductData data = spec->makeData(price);
+    ProductInfo product = data == NULL ? NULL :
+                          createProduct(matamazom, id, name, type, data,
+                                        spec->copyData, spec->freeData,
+                                        spec->prodPrice);
+    if (product == NULL) {
+      succeeded = false;
+      break;
+    }
+    rows->rows[rows->size++] = (ImportRow) {.product = product,
+        .amount = amount, .line = line_number};
+  }
+  // getline's buffer is allocated by the C library, not by the allocator
+  free(line);
+  return succeeded;
+}
+
+/* sorting rows by id, and rows of the same id by their lines */
+static int compareImportRows(const void *row1, const void *row2) {
+  const ImportRow *first = row1;
+  const ImportRow *second = row2;
+  if (first->product->id != second->product->id) {
+    return first->product->id < second->product->id ? -1 : 1;
+  }
+  return (first->line > second->line) - (first->line < second->line);
+}
+
+static int compareRejectedRows(const void *row1, const void *row2) {
+  const RejectedRow *first = row1;
+  const RejectedRow *second = row2;
+  return (first->line > second->line) - (first->line < second->line);
+}
+
+/* rejecting the sorted rows whose ids appeared in an earlier row or are
+ * already in products, in a single merge, and moving the rest to the start
+ * of the rows. returns false if an allocation failed. */
+static bool rejectExistingIds(Matamazom matamazom, ImportRows *rows) {
+  size_t kept = 0;
+  ProductInfo existing = asGetFirst(matamazom->products);
+  for (size_t i = 0; i < rows->size; i++) {
+    ProductInfo product = rows->rows[i].product;
+    while (existing != NULL && existing->id < product->id) {
+      existing = asGetNext(matamazom->products);
+    }
+    bool duplicate = (existing != NULL && existing->id == product->id) ||
+        (kept > 0 && rows->rows[kept - 1].product->id == product->id);
+    if (!duplicate) {
+      rows->rows[kept++] = rows->rows[i];
+      continue;
+    }
+    if (!rejectRow(rows, rows->rows[i].line,
+                   MATAMAZOM_PRODUCT_ALREADY_EXIST)) {
+      // keeping the rows which weren't freed yet, for the caller to free
+      memmove(rows->rows + kept, rows->rows + i,
+              (rows->size - i) * sizeof(*rows->rows));
+      rows->size = kept + rows->size - i;
+      return false;
+    }
+    freeProduct(product);
+  }
+  rows->size = kept;
+  return true;
+}
+
+/* freeing the products of the rows which weren't imported, and the rows */
+static void releaseRows(ImportRows *rows) {
+  for (size_t i = 0; i < rows->size; i++) {
+    freeProduct(rows->rows[i].product);
+  }
+  allocatorFree(rows->allocator, rows->rows);
+  allocatorFree(rows->allocator, rows->rejected);
+}
+
+/* adding the products of the sorted rows to products and to the stock index,
+ * all at once */
+static MatamazomResult addImportedProducts(Matamazom matamazom,
+                                           ImportRows *rows) {
+  size_t count = rows->size;
+  if (count > INT_MAX) {
+    return MATAMAZOM_OUT_OF_MEMORY;
+  }
+  ASElement *elements = allocatorAllocate(&matamazom->allocator,
+                                          (count + 1) * sizeof(*elements));
+  double *amounts = allocatorAllocate(&matamazom->allocator,
+                                      (count + 1) * sizeof(*amounts));
+  MatamazomResult result = MATAMAZOM_SUCCESS;
+  size_t indexed = 0;
+  if (elements == NULL || amounts == NULL ||
+      !reserveUndo(matamazom, 2 * count)) {
+    result = MATAMAZOM_OUT_OF_MEMORY;
+  }
+  for (size_t i = 0; result == MATAMAZOM_SUCCESS && i < count; i++) {
+    elements[i] = rows->rows[i].product;
+    amounts[i] = rows->rows[i].amount;
+  }
+  while (result == MATAMAZOM_SUCCESS && matamazom->stock_indexed &&
+         indexed < count) {
+    if (!stockIndexInsert(&matamazom->stock_index,
+                          rows->rows[indexed].product->id,
+                          rows->rows[indexed].amount)) {
+      result = MATAMAZOM_OUT_OF_MEMORY;
+      break;
+    }
+    indexed++;
+  }
+  if (result == MATAMAZOM_SUCCESS &&
+      asRegisterSorted(matamazom->products, elements, amounts, (int) count)
+          != AS_SUCCESS) {
+    // the ids were checked, so only an allocation could fail
+    result = MATAMAZOM_OUT_OF_MEMORY;
+  }
+  if (result == MATAMAZOM_SUCCESS) {
+    // the products belong to products now
+    rows->size = 0;
+    invalidateProductStore(matamazom);
+    for (size_t i = 0; i < count && matamazom->transaction.depth > 0; i++) {
+      logUndo(matamazom, (UndoEntry) {.type = UNDO_PRODUCT_ADDED,
+          .id = rows->rows[i].product->id});
+    }
+    for (size_t i = 0; i < indexed; i++) {
+      logIndexChange(matamazom, (UndoEntry) {.type = UNDO_INDEX_INSERTED,
+          .id = rows->rows[i].product->id});
+    }
+  } else {
+    while (indexed > 0) {
+      stockIndexRemove(&matamazom->stock_index,
+                       rows->rows[--indexed].product->id);
+    }
+  }
+  allocatorFree(&matamazom->allocator, elements);
+  allocatorFree(&matamazom->allocator, amounts);
+  return result;
+}
+
+static MatamazomResult importProducts(Matamazom matamazom, FILE *input,
+                                      const MtmImportSpec *spec,
+                                      size_t *outImported,
+                                      size_t *outRejected) {
+  if (matamazom == NULL || input == NULL || spec == NULL ||
+      spec->makeData == NULL || spec->copyData == NULL ||
+      spec->freeData == NULL || spec->prodPrice == NULL) {
+    return MATAMAZOM_NULL_ARGUMENT;
+  }
+  if (matamazom->concurrent_mode) {
+    return MATAMAZOM_CONCURRENT_MODE;
+  }
+  ImportRows rows = {.allocator = &matamazom->allocator};
+  if (!readRows(matamazom, input, spec, &rows)) {
+    releaseRows(&rows);
+    return MATAMAZOM_OUT_OF_MEMORY;
+  }
+  qsort(rows.rows, rows.size, sizeof(*rows.rows), compareImportRows);
+  if (!rejectExistingIds(matamazom, &rows)) {
+    releaseRows(&rows);
+    return MATAMAZOM_OUT_OF_MEMORY;
+  }
+  size_t imported = rows.size;
+  MatamazomResult result = addImportedProducts(matamazom, &rows);
+  if (result != MATAMAZOM_SUCCESS) {
+    releaseRows(&rows);
+    return result;
+  }
+  if (spec->rejected != NULL) {
+    qsort(rows.rejected, rows.rejected_size, sizeof(*rows.rejected),
+          compareRejectedRows);
+    for (size_t i = 0; i < rows.rejected_size; i++) {
+      spec->rejected(rows.rejected[i].line, rows.rejected[i].reason,
+                     spec->context);
+    }
+  }
+  if (outImported != NULL) {
+    *outImported = imported;
+  }
+  if (outRejected != NULL) {
+    *outRejected = rows.rejected_size;
+  }
+  releaseRows(&rows);
+  return MATAMAZOM_SUCCESS;
+}
+
+MatamazomResult mtmImportProducts(Matamazom matamazom, FILE *input,
+                                  const MtmImportSpec *spec,
+                                  size_t *outImported, size_t *outRejected) {
+  MTM_METRICS_START(start);
+  MatamazomResult result = importProducts(matamazom, input, spec, outImported,
+                                          outRejected);
+  MTM_METRICS_STOP(matamazom, MTM_METRICS_IMPORT_PRODUCTS, start,
+                   result != MATAMAZOM_SUCCESS);
+  return result;
+}
+
+static MatamazomResult changeProductAmount(Matamazom matamazom,
+                                           const unsigned int id,
+                                           const double amount) {
+  if (matamazom == NULL) {
+    return MATAMAZOM_NULL_ARGUMENT;
+  }
+  //finding the procuct_info's pointer
+  ProductInfo product_info = findProductInfo(matamazom, matamazom->products,
+                                             id);
+  if (product_info == NULL) {
+    return MATAMAZOM_PRODUCT_NOT_EXIST;
+  }
+  //making sure the added amount is legal.
+  if (!isAmountValid(amount, product_info->amountType)) {
+    return MATAMAZOM_INVALID_AMOUNT;
+  }
+  if (matamazom->reservation_mode && amount < 0) {
+    // the amount reserved by orders can't be taken away from them
+    double amount_in_warehouse = 0;
+    asGetAmount(matamazom->products, product_info, &amount_in_warehouse);
+    if (amount_in_warehouse + amount < product_info->reserved - EPSILON) {
+      return MATAMAZOM_INSUFFICIENT_AMOUNT;
+    }
+  }
+  // the change of the product, and of its index
+  if (!reserveUndo(matamazom, 2)) {
+    return MATAMAZOM_OUT_OF_MEMORY;
+  }
+  if (matamazom->transaction.depth > 0 && amount != 0) {
+    product_info = getMutableProduct(matamazom, product_info);
+    if (product_info == NULL) {
+      return MATAMAZOM_OUT_OF_MEMORY;
+    }
+    logProductChange(matamazom, product_info);
+  }
+  AmountSetResult
+  // changing the amount in the AS
+      result = asChangeAmount(matamazom->products, product_info,
+                              amount);
+  if (result == AS_NULL_ARGUMENT) {
+    return MATAMAZOM_NULL_ARGUMENT;
+  }
+  if (result == AS_ITEM_DOES_NOT_EXIST) {
+    return MATAMAZOM_PRODUCT_NOT_EXIST;
+  }
+  if (result == AS_INSUFFICIENT_AMOUNT) {
+    return MATAMAZOM_INSUFFICIENT_AMOUNT;
+  }
+  if (result == AS_OUT_OF_MEMORY) {
+    return MATAMAZOM_OUT_OF_MEMORY;
+  }
+  assert(result == AS_SUCCESS);
+  updateStoredProduct(matamazom, product_info, amount);
+  updateStockIndex(matamazom, id, amount);
+  return MATAMAZOM_SUCCESS;
+}
+
+/* changing the amount of a product in concurrent mode, which may be done by
+ * many threads at once since nothing but the product's counter is written */
+static MatamazomResult changeProductAmountConcurrently(Matamazom matamazom,
+                                                       const unsigned int id,
+                                                       const double amount) {
+  StockCounter *counter = stockCountersFind(&matamazom->counters, id);
+  if (counter == NULL) {
+    return MATAMAZOM_PRODUCT_NOT_EXIST;
+  }
+  if (!isAmountValid(amount, counter->type)) {
+    return MATAMAZOM_INVALID_AMOUNT;
+  }
+  if (!stockCountersChange(counter, amount)) {
+    return MATAMAZOM_INSUFFICIENT_AMOUNT;
+  }
+  return MATAMAZOM_SUCCESS;
+}
+
+MatamazomResult mtmChangeProductAmount(Matamazom matamazom,
+                                       const unsigned int id,
+                                       const double amount) {
+  if (matamazom != NULL && matamazom->concurrent_mode) {
+    // the metrics aren't thread safe, so concurrent changes aren't recorded
+    return changeProductAmountConcurrently(matamazom, id, amount);
+  }
+  MTM_METRICS_START(start);
+  MatamazomResult result = changeProductAmount(matamazom, id, amount);
+  MTM_METRICS_STOP(matamazom, MTM_METRICS_CHANGE_PRODUCT_AMOUNT, start,
+                   result != MATAMAZOM_SUCCESS);
+  return result;
+}
+
+/* an entry of a batch of changes, sorted by id and then by its place in the
+ * batch */
+typedef struct BatchEntry_t {
+  unsigned int id;
+  size_t index;
+} BatchEntry;
+
+static int compareBatchEntries(const void *first, const void *second) {
+  const BatchEntry *first_entry = first;
+  const BatchEntry *second_entry = second;
+  if (first_entry->id != second_entry->id) {
+    return first_entry->id < second_entry->id ? -1 : 1;
+  }
+  return first_entry->index < second_entry->index ? -1 :
+         first_entry->index > second_entry->index;
+}
+
+/* checking the changes of a single product, in the order of the batch, as if
+ * each was made on its own. returns the total of those which can be made. */
+static double checkProductChanges(Matamazom matamazom, ProductInfo product,
+                                  double amount, const BatchEntry *entries,
+                                  size_t count, const double *amounts,
+                                  MatamazomResult *results) {
+  double total = 0;
+  for (size_t i = 0; i < count; i++) {
+    double change = amounts[entries[i].index];
+    MatamazomResult result = MATAMAZOM_SUCCESS;
+    if (!isAmountValid(change, product->amountType)) {
+      result = MATAMAZOM_INVALID_AMOUNT;
+    } else if (amount + total + change < 0 ||
+        (matamazom->reservation_mode && change < 0 &&
+         amount + total + change < product->reserved - EPSILON)) {
+      result = MATAMAZOM_INSUFFICIENT_AMOUNT;
+    } else {
+      total += change;
+    }
+    results[entries[i].index] = result;
+  }
+  return total;
+}
+
+/* logging the products, given as distinct products sorted by id, before the
+ * open transaction changes their amounts. those shared with a snapshot are
+ * copied first, and replaced in 'products'. returns false if copying failed.
+ * room for logging them must have been reserved. */
+static bool logProductChanges(Matamazom matamazom, ASElement *products,
+                              size_t count) {
+  for (size_t i = 0; i < count && matamazom->transaction.depth > 0; i++) {
+    if (matamazom->shared) {
+      products[i] = getMutableProduct(matamazom, products[i]);
+      if (products[i] == NULL) {
+        return false;
+      }
+    }
+    logProductChange(matamazom, products[i]);
+  }
+  return true;
+}
+
+/* changing the amounts of the products, given as distinct products sorted by
+ * id, all at once */
+static MatamazomResult applyProductChanges(Matamazom matamazom,
+                                           ASElement *products,
+                                           double *changes, size_t count) {
+  // the changes of the products, and of their index
+  if (!reserveUndo(matamazom, 2 * count)) {
+    return MATAMAZOM_OUT_OF_MEMORY;
+  }
+  size_t log_size = matamazom->transaction.log_size;
+  if (!logProductChanges(matamazom, products, count) ||
+      asChangeAmounts(matamazom->products, products, changes, (int) count)
+      != AS_SUCCESS) {
+    // the changes were checked, so only copying a shared node could fail
+    matamazom->transaction.log_size = log_size;
+    return MATAMAZOM_OUT_OF_MEMORY;
+  }
+  for (size_t i = 0; i < count; i++) {
+    ProductInfo product = products[i];
+    updateStoredProduct(matamazom, product, changes[i]);
+    updateStockIndex(matamazom, product->id, changes[i]);
+  }
+  return MATAMAZOM_SUCCESS;
+}
+
+static MatamazomResult changeProductAmounts(Matamazom matamazom,
+                                            const unsigned int *ids,
+                                            const double *amounts, size_t n,
+                                            MatamazomResult *results,
+                                            MtmBatchMode mode) {
+  if (matamazom == NULL || results == NULL ||
+      (n > 0 && (ids == NULL || amounts == NULL))) {
+    return MATAMAZOM_NULL_ARGUMENT;
+  }
+  if (matamazom->concurrent_mode) {
+    return MATAMAZOM_CONCURRENT_MODE;
+  }
+  if (n > INT_MAX) {
+    return MATAMAZOM_OUT_OF_MEMORY;
+  }
+  ProductStore *store = getProductStore(matamazom);
+  BatchEntry *entries = allocatorAllocate(&matamazom->allocator,
+                                          (n + 1) * sizeof(*entries));
+  ASElement *products = allocatorAllocate(&matamazom->allocator,
+                                          (n + 1) * sizeof(*products));
+  double *changes = allocatorAllocate(&matamazom->allocator,
+                                      (n + 1) * sizeof(*changes));
+  if (store == NULL || entries == NULL || products == NULL ||
+      changes == NULL) {
+    allocatorFree(&matamazom->allocator, entries);
+    allocatorFree(&matamazom->allocator, products);
+    allocatorFree(&matamazom->allocator, changes);
+    return MATAMAZOM_OUT_OF_MEMORY;
+  }
+  for (size_t i = 0; i < n; i++) {
+    entries[i] = (BatchEntry) {.id = ids[i], .index = i};
+  }
+  qsort(entries, n, sizeof(*entries), compareBatchEntries);
+  // the entries and the rows of the store are both sorted by id
+  size_t count = 0;
+  size_t row = 0;
+  for (size_t first = 0, last = 0; first < n; first = last) {
+    unsigned int id = entries[first].id;
+    while (last < n && entries[last].id == id) {
+      last++;
+    }
+    while (row < store->size && store->ids[row] < id) {
+      row++;
+    }
+    if (row == store->size || store->ids[row] != id) {
+      for (size_t i = first; i < last; i++) {
+        results[entries[i].index] = MATAMAZOM_PRODUCT_NOT_EXIST;
+      }
+      continue;
+    }
+    double change = checkProductChanges(matamazom, store->infos[row],
+                                        store->amounts[row], entries + first,
+                                        last - first, amounts, results);
+    if (change != 0) {
+      products[count] = store->infos[row];
+      changes[count++] = change;
+    }
+  }
+  MatamazomResult result = MATAMAZOM_SUCCESS;
+  for (size_t i = 0; i < n && mode == MTM_BATCH_ALL_OR_NOTHING; i++) {
+    if (results[i] != MATAMAZOM_SUCCESS) {
+      result = results[i];
+      break;
+    }
+  }
+  if (result == MATAMAZOM_SUCCESS) {
+    result = applyProductChanges(matamazom, products, changes, count);
+    for (size_t i = 0; i < n && result != MATAMAZOM_SUCCESS; i++) {
+      if (results[i] == MATAMAZOM_SUCCESS) {
+        results[i] = result;
+      }
+    }
+  }
+  allocatorFree(&matamazom->allocator, entries);
+  allocatorFree(&matamazom->allocator, products);
+  allocatorFree(&matamazom->allocator, changes);
+  return result;
+}
+
+MatamazomResult mtmChangeProductAmounts(Matamazom matamazom,
+                                        const unsigned int *ids,
+                                        const double *amounts, size_t n,
+                                        MatamazomResult *results,
+                                        MtmBatchMode mode) {
+  MTM_METRICS_START(start);
+  MatamazomResult result = changeProductAmounts(matamazom, ids, amounts, n,
+                                                results, mode);
+  MTM_METRICS_STOP(matamazom, MTM_METRICS_CHANGE_PRODUCT_AMOUNTS, start,
+                   result != MATAMAZOM_SUCCESS);
+  return result;
+}
+
+static MatamazomResult clearProduct(Matamazom matamazom,
+                                    const unsigned int id) {
+  if (matamazom == NULL) {
+    return MATAMAZOM_NULL_ARGUMENT;
+  }
+  if (matamazom->concurrent_mode) {
+    return MATAMAZOM_CONCURRENT_MODE;
+  }
+  //finding the product_info's pointer
+  ProductInfo product_info_ptr = findProductInfo(matamazom,
+                                                 matamazom->products, id);
+  if (product_info_ptr == NULL) {
+    return MATAMAZOM_PRODUCT_NOT_EXIST;
+  }
+  /* the carts are kept (in a transaction) before any of them changes, and the
+   * nodes they share are copied now, so removing the product from them later
+   * can't fail halfway */
+  for (Order order = matamazom->orders; order != NULL; order = order->next) {
+    ProductInfo in_cart = findProductInfo(matamazom, order->cart, id);
+    if (in_cart != NULL && (!saveOrderCart(matamazom, order) ||
+                            asGetMutable(order->cart, in_cart) == NULL)) {
+      return MATAMAZOM_OUT_OF_MEMORY;
+    }
+  }
+  if (matamazom->transaction.depth > 0) {
+    if (!reserveUndo(matamazom, 2)) {
+      return MATAMAZOM_OUT_OF_MEMORY;
+    }
+    /* the product itself is kept, with its amount, and moved back by
+     * mtmAbort. only a copy of a node shared with a snapshot may fail. */
+    AmountSet kept = asCreateWithAllocator(copyProductInfo, freeProduct,
+                                           compareProductsID,
+                                           &matamazom->allocator);
+    if (kept == NULL || asMove(matamazom->products, kept, product_info_ptr)
+        != AS_SUCCESS) {
+      asDestroy(kept);
+      return MATAMAZOM_OUT_OF_MEMORY;
+    }
+    logUndo(matamazom, (UndoEntry) {.type = UNDO_PRODUCT_REMOVED, .id = id,
+        .products = kept});
+    UndoEntry entry = {.type = UNDO_INDEX_REMOVED, .id = id};
+    if (matamazom->stock_indexed) {
+      asGetAmount(kept, asGetFirst(kept), &entry.amount);
+      entry.has_watermark =
+          stockIndexGetWatermark(&matamazom->stock_index, id,
+                                 &entry.watermark, &entry.callback,
+                                 &entry.context);
+    }
+    logIndexChange(matamazom, entry);
+  } else {
+    //deleting the product from products (AS)
+    if (asDelete(matamazom->products, (ASElement) product_info_ptr)
+        != AS_SUCCESS) {
+      return MATAMAZOM_OUT_OF_MEMORY;
+    }
+  }
+  invalidateProductStore(matamazom);
+  if (matamazom->stock_indexed) {
+    stockIndexRemove(&matamazom->stock_index, id);
+  }
+  for (Order element = matamazom->orders; element != NULL;
+       element = element->next) {
+    //going through every order and if the product is in it, it will be removed
+    product_info_ptr = findProductInfo(matamazom, element->cart, id);
+    if (product_info_ptr != NULL) {
+      AmountSetResult result = asDelete(element->cart,
+                                        (ASElement) product_info_ptr);
+      assert(result == AS_SUCCESS);
+      (void) result;
+    }
+
+  }
+  return MATAMAZOM_SUCCESS;
+}
+
+MatamazomResult mtmClearProduct(Matamazom matamazom, const unsigned int id) {
+  MTM_METRICS_START(start);
+  MatamazomResult result = clearProduct(matamazom, id);
+  MTM_METRICS_STOP(matamazom, MTM_METRICS_CLEAR_PRODUCT, start,
+                   result != MATAMAZOM_SUCCESS);
+  return result;
+}
+
+/* returns the element of a product in products, which may be changed in place
+ * since it was copied if it was shared with a snapshot. returns NULL if the
+ * copy failed. */
+static ProductInfo getMutableProduct(Matamazom matamazom, ProductInfo product) {
+  if (matamazom->shared) {
+    // the rows of the store may point to the element the snapshot keeps
+    invalidateProductStore(matamazom);
+  }
+  return asGetMutable(matamazom->products, product);
+}
+
+/* adding 'amount' to the total amount of a product in all the open orders */
+static MatamazomResult addDemand(Matamazom matamazom, ProductInfo product,
+                                 double amount) {
+  if (amount == 0) {
+    return MATAMAZOM_SUCCESS;
+  }
+  product = getMutableProduct(matamazom, product);
+  if (product == NULL) {
+    return MATAMAZOM_OUT_OF_MEMORY;
+  }
+  logProductChange(matamazom, product);
+  product->on_order += amount;
+  if (product->on_order < EPSILON) {
+    // what rounding errors leave once all the orders are gone
+    product->on_order = 0;
+  }
+  return MATAMAZOM_SUCCESS;
+}
+
+/* reserving 'amount' more of a product for an order (or releasing it, if
+ * amount is negative). fails if there isn't enough unreserved amount. */
+static MatamazomResult reserveProduct(Matamazom matamazom, ProductInfo product,
+                                      double amount) {
+  if (amount > 0) {
+    double amount_in_warehouse = 0;
+    asGetAmount(matamazom->products, product, &amount_in_warehouse);
+    if (product->reserved + amount > amount_in_warehouse + EPSILON) {
+      return MATAMAZOM_INSUFFICIENT_AMOUNT;
+    }
+  }
+  product = getMutableProduct(matamazom, product);
+  if (product == NULL) {
+    return MATAMAZOM_OUT_OF_MEMORY;
+  }
+  logProductChange(matamazom, product);
+  product->reserved += amount;
+  return MATAMAZOM_SUCCESS;
+}
+
+/* releasing the demand for the products of an order which is about to be
+ * canceled, and everything reserved for it. the products must already belong
+ * only to matamazom, so nothing can fail. */
+static void releaseOrder(Matamazom matamazom, Order order) {
+  double amount_in_order = 0;
+  AS_FOREACH(ProductInfo, product_in_order, order->cart) {
+    asGetAmount(order->cart, product_in_order, &amount_in_order);
+    ProductInfo product = findProductInfo(matamazom, matamazom->products,
+                                          product_in_order->id);
+    if (product == NULL) {
+      continue;
+    }
+    MatamazomResult result = addDemand(matamazom, product, -amount_in_order);
+    if (matamazom->reservation_mode && result == MATAMAZOM_SUCCESS) {
+      result = reserveProduct(matamazom, product, -amount_in_order);
+    }
+    assert(result == MATAMAZOM_SUCCESS);
+    (void) result;
+  }
+}
+
+/* zeroing the reservations of all the products */
+static MatamazomResult resetReservations(Matamazom matamazom) {
+  AS_FOREACH(ProductInfo, product, matamazom->products) {
+    if (product->reserved == 0) {
+      continue;
+    }
+    ProductInfo mutable_product = getMutableProduct(matamazom, product);
+    if (mutable_product == NULL) {
+      return MATAMAZOM_OUT_OF_MEMORY;
+    }
+    logProductChange(matamazom, mutable_product);
+    mutable_product->reserved = 0;
+  }
+  return MATAMAZOM_SUCCESS;
+}
+
+/* reserving the contents of all the existing orders, from scratch */
+static MatamazomResult reserveAllOrders(Matamazom matamazom) {
+  MatamazomResult result = resetReservations(matamazom);
+  double amount_in_order = 0;
+  for (Order order = matamazom->orders;
+       order != NULL && result == MATAMAZOM_SUCCESS; order = order->next) {
+    AS_FOREACH(ProductInfo, product_in_order, order->cart) {
+      asGetAmount(order->cart, product_in_order, &amount_in_order);
+      result = reserveProduct(matamazom,
+                              findProductInfo(matamazom, matamazom->products,
+                                              product_in_order->id),
+                              amount_in_order);
+      if (result != MATAMAZOM_SUCCESS) {
+        break;
+      }
+    }
+  }
+  return result;
+}
+
+MatamazomResult mtmSetReservationMode(Matamazom matamazom, bool enabled) {
+  if (matamazom == NULL) {
+    return MATAMAZOM_NULL_ARGUMENT;
+  }
+  if (matamazom->concurrent_mode) {
+    return MATAMAZOM_CONCURRENT_MODE;
+  }
+  if (enabled == matamazom->reservation_mode) {
+    return MATAMAZOM_SUCCESS;
+  }
+  if (matamazom->transaction.depth > 0) {
+    // every product may be reset twice, and every line of an order reserved
+    size_t changes = 2 * (size_t) asGetSize(matamazom->products);
+    for (Order order = matamazom->orders; order != NULL && enabled;
+         order = order->next) {
+      changes += (size_t) asGetSize(order->cart);
+    }
+    if (!reserveUndo(matamazom, changes)) {
+      return MATAMAZOM_OUT_OF_MEMORY;
+    }
+  }
+  if (!enabled) {
+    MatamazomResult result = resetReservations(matamazom);
+    if (result == MATAMAZOM_SUCCESS) {
+      matamazom->reservation_mode = false;
+    }
+    return result;
+  }
+  MatamazomResult result = reserveAllOrders(matamazom);
+  if (result != MATAMAZOM_SUCCESS) {
+    // leaving the products as they were, i.e. without reservations
+    resetReservations(matamazom);
+    return result;
+  }
+  matamazom->reservation_mode = true;
+  return MATAMAZOM_SUCCESS;
+}
+
+MatamazomResult mtmGetReservedAmount(Matamazom matamazom,
+                                     const unsigned int id,
+                                     double *outAmount) {
+  if (matamazom == NULL || outAmount == NULL) {
+    return MATAMAZOM_NULL_ARGUMENT;
+  }
+  ProductInfo product = findProductInfo(matamazom, matamazom->products, id);
+  if (product == NULL) {
+    return MATAMAZOM_PRODUCT_NOT_EXIST;
+  }
+  *outAmount = matamazom->reservation_mode ? product->reserved : 0;
+  return MATAMAZOM_SUCCESS;
+}
+
+/* moving the amounts of all the products to counters */
+static MatamazomResult enableConcurrentMode(Matamazom matamazom) {
+  if (!stockCountersReset(&matamazom->counters,
+                          (size_t) asGetSize(matamazom->products))) {
+    return MATAMAZOM_OUT_OF_MEMORY;
+  }
+  double amount = 0;
+  AS_FOREACH(ProductInfo, product, matamazom->products) {
+    asGetAmount(matamazom->products, product, &amount);
+    if (amount > STOCK_COUNTERS_MAX_AMOUNT) {
+      return MATAMAZOM_INVALID_AMOUNT;
+    }
+    stockCountersAppend(&matamazom->counters, product->id, amount,
+                        matamazom->reservation_mode ? product->reserved : 0,
+                        product->amountType);
+  }
+  matamazom->concurrent_mode = true;
+  return MATAMAZOM_SUCCESS;
+}
+
+/* applying the changes of the counters to the products, all at once */
+static MatamazomResult disableConcurrentMode(Matamazom matamazom) {
+  StockCounters *counters = &matamazom->counters;
+  ASElement *changed = allocatorAllocate(&matamazom->allocator,
+                                         (counters->size + 1) *
+                                         sizeof(*changed));
+  double *changes = allocatorAllocate(&matamazom->allocator,
+                                      (counters->size + 1) * sizeof(*changes));
+  if (changed == NULL || changes == NULL) {
+    allocatorFree(&matamazom->allocator, changed);
+    allocatorFree(&matamazom->allocator, changes);
+    return MATAMAZOM_OUT_OF_MEMORY;
+  }
+  /* nothing but the counters may change in concurrent mode, so the products
+   * are still in the counters' order */
+  int count = 0;
+  size_t row = 0;
+  double amount = 0;
+  AS_FOREACH(ProductInfo, product, matamazom->products) {
+    double change = stockCountersGetChange(&counters->counters[row++]);
+    if (change == 0) {
+      continue;
+    }
+    asGetAmount(matamazom->products, product, &amount);
+    // amounts finer than the counters' may have been rounded up
+    changed[count] = product;
+    changes[count++] = amount + change < 0 ? -amount : change;
+  }
+  MatamazomResult result = MATAMAZOM_SUCCESS;
+  size_t log_size = matamazom->transaction.log_size;
+  if (!reserveUndo(matamazom, 2 * (size_t) count)) {
+    result = MATAMAZOM_OUT_OF_MEMORY;
+  } else if (!logProductChanges(matamazom, changed, (size_t) count) ||
+      asChangeAmounts(matamazom->products, changed, changes, count)
+          != AS_SUCCESS) {
+    // the changes were checked by the counters, so only copying a node failed
+    matamazom->transaction.log_size = log_size;
+    result = MATAMAZOM_OUT_OF_MEMORY;
+  } else {
+    matamazom->concurrent_mode = false;
+    for (int i = 0; i < count; i++) {
+      ProductInfo product = changed[i];
+      updateStoredProduct(matamazom, product, changes[i]);
+      updateStockIndex(matamazom, product->id, changes[i]);
+    }
+  }
+  allocatorFree(&matamazom->allocator, changed);
+  allocatorFree(&matamazom->allocator, changes);
+  return result;
+}
+
+MatamazomResult mtmGetProductDemand(Matamazom matamazom,
+                                    const unsigned int id,
+                                    double *outAmount) {
+  if (matamazom == NULL || outAmount == NULL) {
+    return MATAMAZOM_NULL_ARGUMENT;
+  }
+  ProductStore *store = getProductStore(matamazom);
+  if (store == NULL) {
+    return MATAMAZOM_OUT_OF_MEMORY;
+  }
+  size_t row = 0;
+  if (!productStoreFind(store, id, &row)) {
+    return MATAMAZOM_PRODUCT_NOT_EXIST;
+  }
+  *outAmount = ((ProductInfo) store->infos[row])->on_order;
+  return MATAMAZOM_SUCCESS;
+}
+
+MatamazomResult mtmSetReportDemand(Matamazom matamazom, bool enabled) {
+  if (matamazom == NULL) {
+    return MATAMAZOM_NULL_ARGUMENT;
+  }
+  matamazom->report_demand = enabled;
+  return MATAMAZOM_SUCCESS;
+}
+
+MatamazomResult mtmSetConcurrentMode(Matamazom matamazom, bool enabled) {
+  if (matamazom == NULL) {
+    return MATAMAZOM_NULL_ARGUMENT;
+  }
+  if (enabled == matamazom->concurrent_mode) {
+    return MATAMAZOM_SUCCESS;
+  }
+  return enabled ? enableConcurrentMode(matamazom)
+                 : disableConcurrentMode(matamazom);
+}
+
+static unsigned int createNewOrder(Matamazom matamazom) {
+  if (matamazom == NULL || matamazom->concurrent_mode) {
+    return 0;
+  }
+  unsigned int max_id = matamazom->max_order_id;
+  if (!reserveUndo(matamazom, 1)) {
+    return 0;
+  }
+  /*making sure we won't initialize an order is that already deleted from
+  the list */
+  Order current_order = newOrder(matamazom, max_id + 1);
+  // the order and its empty cart are a single block, which may be recycled
+  if (current_order == NULL) {
+    return 0;
+  }
+  // the list takes the order itself, nothing is copied.
+  addOrder(matamazom, current_order);
+  matamazom->max_order_id = max_id + 1;
+  //promoting the max_order_id field.
+  return max_id + 1;
+}
+
+unsigned int mtmCreateNewOrder(Matamazom matamazom) {
+  MTM_METRICS_START(start);
+  unsigned int id = createNewOrder(matamazom);
+  MTM_METRICS_STOP(matamazom, MTM_METRICS_CREATE_NEW_ORDER, start, id == 0);
+  return id;
+}
+
+/* returns the row of a product of a cart in the store, by binary search. the
+ * carts only contain existing products. */
+static size_t findStoredRow(const ProductStore *store,
+                            ProductInfo product_in_order) {
+  size_t row = 0;
+  bool found = productStoreFind(store, product_in_order->id, &row);
+  assert(found);
+  (void) found;
+  return row;
+}
+
+static unsigned int cloneOrder(Matamazom matamazom,
+                               const unsigned int sourceOrderId) {
+  if (matamazom == NULL || matamazom->concurrent_mode) {
+    return 0;
+  }
+  Order source = getOrder(matamazom, sourceOrderId);
+  // the new order, and a change of every product in its cart
+  if (source == NULL ||
+      !reserveUndo(matamazom, 1 + (size_t) asGetSize(source->cart))) {
+    return 0;
+  }
+  /* the demand for the products (and what's reserved of them) is about to
+   * grow, so those shared with a snapshot are copied now. the store is then
+   * rebuilt from products which belong only to matamazom, so the products it
+   * points to may be changed in place. */
+  if (matamazom->shared) {
+    AS_FOREACH(ProductInfo, product_in_order, source->cart) {
+      if (getMutableProduct(matamazom, product_in_order) == NULL) {
+        return 0;
+      }
+    }
+  }
+  ProductStore *store = getProductStore(matamazom);
+  if (store == NULL) {
+    return 0;
+  }
+  double amount_in_order = 0;
+  if (matamazom->reservation_mode) {
+    AS_FOREACH(ProductInfo, product_in_order, source->cart) {
+      asGetAmount(source->cart, product_in_order, &amount_in_order);
+      size_t row = findStoredRow(store, product_in_order);
+      ProductInfo product = store->infos[row];
+      if (product->reserved + amount_in_order
+          > store->amounts[row] + EPSILON) {
+        return 0;
+      }
+    }
+  }
+  unsigned int order_id = matamazom->max_order_id + 1;
+  Order order = newOrder(matamazom, order_id);
+  if (order == NULL) {
+    return 0;
+  }
+  /* without arenas both carts take their memory from the same allocator, so
+   * the new cart (which is empty) is replaced by one which shares the nodes
+   * of the source until either one changes. otherwise the cart is copied, in
+   * a single pass since it's sorted. */
+  if (source->arena == NULL && order->arena == NULL) {
+    order->cart = asSnapshotAt(order->cart, source->cart);
+  } else if (asMergeAdd(order->cart, source->cart) != AS_SUCCESS) {
+    recycleOrder(matamazom, order);
+    return 0;
+  }
+  AS_FOREACH(ProductInfo, product_in_order, source->cart) {
+    asGetAmount(source->cart, product_in_order, &amount_in_order);
+    ProductInfo product = store->infos[findStoredRow(store, product_in_order)];
+    logProductChange(matamazom, product);
+    product->on_order += amount_in_order;
+    if (matamazom->reservation_mode) {
+      product->reserved += amount_in_order;
+    }
+  }
+  addOrder(matamazom, order);
+  matamazom->max_order_id = order_id;
+  return order_id;
+}
+
+unsigned int mtmCloneOrder(Matamazom matamazom,
+                           const unsigned int sourceOrderId) {
+  MTM_METRICS_START(start);
+  unsigned int id = cloneOrder(matamazom, sourceOrderId);
+  MTM_METRICS_STOP(matamazom, MTM_METRICS_CLONE_ORDER, start, id == 0);
+  return id;
+}
+
+/* going through all the products in the cart, checking the amount in the
+ * products AS is sufficient */
+static MatamazomResult validateOrder(Matamazom matamazom, Order order) {
+  double amount_in_order = 0;
+  double amount_in_warehouse = 0;
+  AS_FOREACH(ProductInfo, product_in_order, order->cart) {
+    if (asGetAmount(order->cart, product_in_order, &amount_in_order)
+        != AS_SUCCESS ||
+        asGetAmount(matamazom->products, product_in_order,
+                    &amount_in_warehouse) != AS_SUCCESS) {
+      return MATAMAZOM_NULL_ARGUMENT;
+    }
+    if (amount_in_order > amount_in_warehouse) {
+      return MATAMAZOM_INSUFFICIENT_AMOUNT;
+    }
+  }
+  return MATAMAZOM_SUCCESS;
+}
+
+MatamazomResult mtmCanShipOrder(Matamazom matamazom,
+                                const unsigned int orderId) {
+  if (matamazom == NULL) {
+    return MATAMAZOM_NULL_ARGUMENT;
+  }
+  Order order = getOrder(matamazom, orderId);
+  if (order == NULL) {
+    return MATAMAZOM_ORDER_NOT_EXIST;
+  }
+  return matamazom->reservation_mode ? MATAMAZOM_SUCCESS
+                                     : validateOrder(matamazom, order);
+}
+
+/* the next line of a cart in the merge of all the carts of mtmCheckOrders */
+typedef struct cartCursor_t {
+  ProductInfo product;
+  Order order;
+  MtmOrderCheck *check; // the results of the order
+} CartCursor;
+
+/* restores the order of a heap of cursors, sorted by product id, after the
+ * cursor at 'position' got a bigger id */
+static void siftCursorDown(CartCursor *heap, size_t size, size_t position) {
+  while (true) {
+    size_t smallest = position;
+    for (size_t child = 2 * position + 1;
+         child <= 2 * position + 2 && child < size; child++) {
+      if (heap[child].product->id < heap[smallest].product->id) {
+        smallest = child;
+      }
+    }
+    if (smallest == position) {
+      return;
+    }
+    CartCursor cursor = heap[position];
+    heap[position] = heap[smallest];
+    heap[smallest] = cursor;
+    position = smallest;
+  }
+}
+
+void mtmReleaseOrderChecks(MtmOrderChecks *results) {
+  if (results == NULL) {
+    return;
+  }
+  // the checks and all of their shortfalls are a single block
+  allocatorFree(&results->allocator, results->orders);
+  results->orders = NULL;
+  results->count = 0;
+}
+
+static MatamazomResult checkOrders(Matamazom matamazom,
+                                   MtmOrderChecks *results) {
+  if (matamazom == NULL || results == NULL) {
+    return MATAMAZOM_NULL_ARGUMENT;
+  }
+  results->allocator = matamazom->allocator;
+  results->orders = NULL;
+  results->count = 0;
+  size_t orders_count = 0;
+  size_t lines_count = 0;
+  for (Order order = matamazom->orders; order != NULL; order = order->next) {
+    orders_count++;
+    lines_count += (size_t) asGetSize(order->cart);
+  }
+  ProductStore *store = getProductStore(matamazom);
+  /* every order may be short of all of its lines, so each gets room for as
+   * many shortfalls as it has lines, right after the checks */
+  size_t checks_size = ALIGN_UP(orders_count * sizeof(MtmOrderCheck));
+  MtmOrderCheck *checks = store == NULL ? NULL : allocatorAllocate(
+      &matamazom->allocator, checks_size + lines_count * sizeof(MtmShortfall)
+                             + 1);
+  CartCursor *heap = checks == NULL ? NULL : allocatorAllocate(
+      &matamazom->allocator, orders_count * sizeof(*heap) + 1);
+  if (heap == NULL) {
+    allocatorFree(&matamazom->allocator, checks);
+    return MATAMAZOM_OUT_OF_MEMORY;
+  }
+  MtmShortfall *shortfalls = (MtmShortfall *) ((char *) checks + checks_size);
+  size_t heap_size = 0;
+  size_t index = 0;
+  for (Order order = matamazom->orders; order != NULL;
+       order = order->next, index++) {
+    checks[index] = (MtmOrderCheck) {.order_id = order->order_id,
+        .can_ship = true, .shortfalls = shortfalls};
+    shortfalls += asGetSize(order->cart);
+    ProductInfo first = asGetFirst(order->cart);
+    if (first != NULL) {
+      heap[heap_size++] = (CartCursor) {.product = first, .order = order,
+          .check = &checks[index]};
+    }
+  }
+  for (size_t position = heap_size / 2; position-- > 0;) {
+    siftCursorDown(heap, heap_size, position);
+  }
+  /* the lines of all the carts come out of the heap sorted by id, and are
+   * merged with the products, which are sorted by id as well */
+  size_t row = 0;
+  while (heap_size > 0) {
+    CartCursor *cursor = &heap[0];
+    MtmOrderCheck *check = cursor->check;
+    unsigned int id = cursor->product->id;
+    while (row < store->size && store->ids[row] < id) {
+      row++;
+    }
+    double amount_in_warehouse = row < store->size && store->ids[row] == id ?
+                                 store->amounts[row] : 0;
+    double amount_in_order = 0;
+    asGetAmount(cursor->order->cart, cursor->product, &amount_in_order);
+    if (amount_in_order > amount_in_warehouse) {
+      check->can_ship = false;
+      check->shortfalls[check->shortfalls_count++] = (MtmShortfall) {
+          .product_id = id, .amount = amount_in_order - amount_in_warehouse};
+    }
+    cursor->product = asGetNext(cursor->order->cart);
+    if (cursor->product == NULL) {
+      heap[0] = heap[--heap_size];
+    }
+    siftCursorDown(heap, heap_size, 0);
+  }
+  allocatorFree(&matamazom->allocator, heap);
+  results->orders = checks;
+  results->count = orders_count;
+  return MATAMAZOM_SUCCESS;
+}
+
+MatamazomResult mtmCheckOrders(Matamazom matamazom, MtmOrderChecks *results) {
+  MTM_METRICS_START(start);
+  MatamazomResult result = checkOrders(matamazom, results);
+  MTM_METRICS_STOP(matamazom, MTM_METRICS_CHECK_ORDERS, start,
+                   result != MATAMAZOM_SUCCESS);
+  return result;
+}
+
+static MatamazomResult shipOrder(Matamazom matamazom,
+                                 const unsigned int orderId) {
+  if (matamazom == NULL || matamazom->products == NULL) {
+    return MATAMAZOM_NULL_ARGUMENT;
+  }
+  if (matamazom->concurrent_mode) {
+    return MATAMAZOM_CONCURRENT_MODE;
+  }
+  if (!isOrderExists(matamazom, orderId)) {
     return MATAMAZOM_ORDER_NOT_EXIST;
   }
-  Order order = getOrder(matamazom, orderId); /*set internal iterator to the
- * order that needs to be canceled */
+  // fetching the order struct's pointer
+  Order order = getOrder(matamazom, orderId);
+  /* NULL cases already checked, and order is in the list,
+   * so 'order' shouldn't be NULL*/
+  assert(order != NULL);
+  /* in reservation mode the amounts were already checked when they were
+   * reserved, so only products shared with a snapshot need a first pass. */
+  if (!matamazom->reservation_mode) {
+    MatamazomResult result = validateOrder(matamazom, order);
+    if (result != MATAMAZOM_SUCCESS) {
+      return result;
+    }
+  }
+  // every line of the order is recorded, in room the ledger already has
+  bool record = shipmentLedgerIsOpen(&matamazom->ledger);
+  if (record && !shipmentLedgerHasRoom(&matamazom->ledger,
+                                       (size_t) asGetSize(order->cart))) {
+    return MATAMAZOM_OUT_OF_MEMORY;
+  }
+  uint64_t shipped_at = record ? shipmentLedgerNow(&matamazom->ledger) : 0;
+  // removing the order, and changing a product and its index for every line
+  if (!reserveUndo(matamazom, 1 + 2 * (size_t) asGetSize(order->cart))) {
+    return MATAMAZOM_OUT_OF_MEMORY;
+  }
+  /* the products are about to be changed, so those shared with a snapshot are
+   * copied now, while the order can still be left untouched. */
+  ProductInfo current_product_in_order =
+      matamazom->shared ? asGetFirst(order->cart) : NULL;
+  while (current_product_in_order != NULL) {
+    if (getMutableProduct(matamazom, current_product_in_order) == NULL) {
+      return MATAMAZOM_OUT_OF_MEMORY;
+    }
+    current_product_in_order = asGetNext(order->cart);
+  }
+  double amount_in_order = 0;
+  bool validate = !matamazom->reservation_mode;
+  /*now we know the amount of every product is sufficient, so we can start
+  shipping the order */
+  double product_price_in_order = 0;
+  current_product_in_order = asGetFirst(order->cart);
+  ProductInfo current_product_in_products = NULL;
+  /*every product is removed from the products, by the amount in the order,
+   * and his income is updated in product_info */
+  while (current_product_in_order != NULL) {
+    current_product_in_products =
+        asGetMutable(matamazom->products, current_product_in_order);
+    logProductChange(matamazom, current_product_in_products);
+    asGetAmount(order->cart, current_product_in_order, &amount_in_order);
+    product_price_in_order =
+        current_product_in_order->prodPrice(
+            current_product_in_order->customData,
+            amount_in_order);
+    current_product_in_products->total_income += product_price_in_order;
+    if (record) {
+      shipmentLedgerAppend(&matamazom->ledger, orderId,
+                           current_product_in_products->id, amount_in_order,
+                           product_price_in_order, shipped_at);
+    }
+    if (!validate) {
+      // the reservation turns into the actual decrease of the amount
+      current_product_in_products->reserved -= amount_in_order;
+    }
+    current_product_in_products->on_order -= amount_in_order;
+    if (current_product_in_products->on_order < EPSILON) {
+      current_product_in_products->on_order = 0;
+    }
+    asChangeAmount(matamazom->products,
+                   current_product_in_products,
+                   -(amount_in_order));
+    updateStoredProduct(matamazom, current_product_in_products,
+                        -(amount_in_order));
+    updateStockIndex(matamazom, current_product_in_products->id,
+                     -(amount_in_order));
+    current_product_in_order = asGetNext(order->cart);
+  }
+  // the order is removed without releasing its reservations, which were used
+  retireOrder(matamazom, detachOrder(matamazom, orderId));
+  return MATAMAZOM_SUCCESS;
+}
+
+MatamazomResult mtmShipOrder(Matamazom matamazom, const unsigned int orderId) {
+  MTM_METRICS_START(start);
+  MatamazomResult result = shipOrder(matamazom, orderId);
+  MTM_METRICS_STOP(matamazom, MTM_METRICS_SHIP_ORDER, start,
+                   result != MATAMAZOM_SUCCESS);
+  return result;
+}
+
+static MatamazomResult cancelOrder(Matamazom matamazom,
+                                   const unsigned int orderId) {
+  if (matamazom == NULL) {
+    return MATAMAZOM_NULL_ARGUMENT;
+  }
+  if (matamazom->concurrent_mode) {
+    return MATAMAZOM_CONCURRENT_MODE;
+  }
+  Order order = getOrder(matamazom, orderId);
   if (order == NULL) {
     return MATAMAZOM_ORDER_NOT_EXIST;
-  } // item exist, pointer shouldn't be NULL
-  ListResult result = listRemoveCurrent(matamazom->orders);
-  if (result != LIST_SUCCESS) {
-    return MATAMAZOM_PRODUCT_NOT_EXIST;
-    //orders isn't NULL, checked at the beginning
-    //listRemove should succeed, this is just for safety
   }
+  // removing the order, and releasing its demand and reservations
+  if (!reserveUndo(matamazom, 1 + 2 * (size_t) asGetSize(order->cart))) {
+    return MATAMAZOM_OUT_OF_MEMORY;
+  }
+  /* the demand for the products is about to be released, so those shared
+   * with a snapshot are copied now, while the order can still be kept. */
+  if (matamazom->shared) {
+    AS_FOREACH(ProductInfo, product_in_order, order->cart) {
+      if (getMutableProduct(matamazom, product_in_order) == NULL) {
+        return MATAMAZOM_OUT_OF_MEMORY;
+      }
+    }
+  }
+  // unlinking the order from the list, and only then recycling it
+  detachOrder(matamazom, orderId);
+  releaseOrder(matamazom, order);
+  retireOrder(matamazom, order);
   assert(isOrderExists(matamazom, orderId) == false);
   return MATAMAZOM_SUCCESS;
 }
 
+MatamazomResult mtmCancelOrder(Matamazom matamazom,
+                               const unsigned int orderId) {
+  MTM_METRICS_START(start);
+  MatamazomResult result = cancelOrder(matamazom, orderId);
+  MTM_METRICS_STOP(matamazom, MTM_METRICS_CANCEL_ORDER, start,
+                   result != MATAMAZOM_SUCCESS);
+  return result;
+}
+
+MatamazomResult mtmOpenLedger(Matamazom matamazom, const char *path,
+                              size_t capacity) {
+  if (matamazom == NULL) {
+    return MATAMAZOM_NULL_ARGUMENT;
+  }
+  // the records of another ledger aren't removed by mtmAbort
+  matamazom->transaction.ledger_reopened = true;
+  shipmentLedgerClose(&matamazom->ledger);
+  ShipmentLedgerResult result = shipmentLedgerOpen(&matamazom->ledger, path,
+                                                   capacity);
+  if (result == SHIPMENT_LEDGER_NOT_A_LEDGER) {
+    return MATAMAZOM_INVALID_FORMAT;
+  }
+  return result == SHIPMENT_LEDGER_SUCCESS ? MATAMAZOM_SUCCESS
+                                           : MATAMAZOM_OUT_OF_MEMORY;
+}
+
+MatamazomResult mtmCloseLedger(Matamazom matamazom) {
+  if (matamazom == NULL) {
+    return MATAMAZOM_NULL_ARGUMENT;
+  }
+  matamazom->transaction.ledger_reopened = true;
+  shipmentLedgerClose(&matamazom->ledger);
+  return MATAMAZOM_SUCCESS;
+}
+
+uint64_t mtmGetLedgerTime(Matamazom matamazom) {
+  if (matamazom == NULL) {
+    return 0;
+  }
+  return shipmentLedgerNow(&matamazom->ledger);
+}
+
+MatamazomResult mtmGetLedgerRevenue(Matamazom matamazom,
+                                    const MtmLedgerQuery *query,
+                                    double *outRevenue,
+                                    size_t *outShipments) {
+  if (matamazom == NULL || query == NULL || outRevenue == NULL) {
+    return MATAMAZOM_NULL_ARGUMENT;
+  }
+  size_t shipments = 0;
+  *outRevenue = shipmentLedgerRevenue(&matamazom->ledger, query->all_products,
+                                      query->product_id, query->from_time,
+                                      query->to_time, &shipments);
+  if (outShipments != NULL) {
+    *outShipments = shipments;
+  }
+  return MATAMAZOM_SUCCESS;
+}
+
+static MatamazomResult mergeOrders(Matamazom matamazom,
+                                   const unsigned int toOrderId,
+                                   const unsigned int fromOrderId) {
+  if (matamazom == NULL) {
+    return MATAMAZOM_NULL_ARGUMENT;
+  }
+  if (matamazom->concurrent_mode) {
+    return MATAMAZOM_CONCURRENT_MODE;
+  }
+  Order to_order = getOrder(matamazom, toOrderId);
+  Order from_order = getOrder(matamazom, fromOrderId);
+  if (to_order == NULL || from_order == NULL) {
+    return MATAMAZOM_ORDER_NOT_EXIST;
+  }
+  if (to_order == from_order) {
+    return MATAMAZOM_SUCCESS;
+  }
+  if (!saveOrderCart(matamazom, to_order) || !reserveUndo(matamazom, 1)) {
+    return MATAMAZOM_OUT_OF_MEMORY;
+  }
+  /* both carts are sorted by id, so they're merged in one pass. the amounts
+   * only move between orders, so nothing reserved changes. */
+  if (asMergeAdd(to_order->cart, from_order->cart) != AS_SUCCESS) {
+    return MATAMAZOM_OUT_OF_MEMORY;
+  }
+  retireOrder(matamazom, detachOrder(matamazom, fromOrderId));
+  return MATAMAZOM_SUCCESS;
+}
+
+MatamazomResult mtmMergeOrders(Matamazom matamazom,
+                               const unsigned int toOrderId,
+                               const unsigned int fromOrderId) {
+  MTM_METRICS_START(start);
+  MatamazomResult result = mergeOrders(matamazom, toOrderId, fromOrderId);
+  MTM_METRICS_STOP(matamazom, MTM_METRICS_MERGE_ORDERS, start,
+                   result != MATAMAZOM_SUCCESS);
+  return result;
+}
+
+/* printing the products of the given rows of the store, with their demand
+ * if 'demand' is true */
+static void printStoredProducts(const ProductStore *store, size_t begin,
+                                size_t end, bool demand, FILE *output) {
+  for (size_t row = begin; row < end; row++) {
+    ProductInfo product = store->infos[row];
+    double price = product->prodPrice(product->customData, 1);
+    if (demand) {
+      mtmPrintProductDemandDetails(productStoreGetName(store, row),
+                                   store->ids[row], store->amounts[row], price,
+                                   product->on_order, output);
+    } else {
+      mtmPrintProductDetails(productStoreGetName(store, row), store->ids[row],
+                             store->amounts[row], price, output);
+    }
+  }
+}
+
+static MatamazomResult printInventory(Matamazom matamazom, FILE *output) {
+  if (matamazom == NULL || output == NULL) {
+    return MATAMAZOM_NULL_ARGUMENT;
+  }
+  ProductStore *store = getProductStore(matamazom);
+  if (store == NULL) {
+    return MATAMAZOM_OUT_OF_MEMORY;
+  }
+  fprintf(output, "Inventory Status:\n");
+  printStoredProducts(store, 0, store->size, matamazom->report_demand,
+                      output);
+  return MATAMAZOM_SUCCESS;
+}
+
 MatamazomResult mtmPrintInventory(Matamazom matamazom, FILE *output) {
+  MTM_METRICS_START(start);
+  MatamazomResult result = printInventory(matamazom, output);
+  MTM_METRICS_STOP(matamazom, MTM_METRICS_PRINT_INVENTORY, start,
+                   result != MATAMAZOM_SUCCESS);
+  return result;
+}
+
+static MatamazomResult printInventoryRange(Matamazom matamazom,
+                                           unsigned int from_id,
+                                           unsigned int to_id, FILE *output) {
   if (matamazom == NULL || output == NULL) {
     return MATAMAZOM_NULL_ARGUMENT;
   }
+  ProductStore *store = getProductStore(matamazom);
+  if (store == NULL) {
+    return MATAMAZOM_OUT_OF_MEMORY;
+  }
   fprintf(output, "Inventory Status:\n");
-  ProductInfo product = (ProductInfo) asGetFirst(matamazom->products);
-  if (product == NULL) {
-    //if products is empty
-    return MATAMAZOM_SUCCESS;
+  if (from_id < to_id) {
+    printStoredProducts(store, productStoreLowerBound(store, from_id),
+                        productStoreLowerBound(store, to_id),
+                        matamazom->report_demand, output);
   }
-  double amount = 0;
-  while (product != NULL) {
-    AmountSetResult result = asGetAmount(matamazom->products, product,
-                                         &amount);
-    if (result == AS_NULL_ARGUMENT) {
-      return MATAMAZOM_NULL_ARGUMENT;
+  return MATAMAZOM_SUCCESS;
+}
+
+MatamazomResult mtmPrintInventoryRange(Matamazom matamazom,
+                                       const unsigned int fromId,
+                                       const unsigned int toId, FILE *output) {
+  MTM_METRICS_START(start);
+  MatamazomResult result = printInventoryRange(matamazom, fromId, toId,
+                                               output);
+  MTM_METRICS_STOP(matamazom, MTM_METRICS_PRINT_INVENTORY_RANGE, start,
+                   result != MATAMAZOM_SUCCESS);
+  return result;
+}
+
+/* a contiguous range of products printed by a single worker into its own
+ * memory stream */
+typedef struct printChunk_t {
+  const ProductStore *store;
+  size_t begin;
+  size_t end;
+  bool demand;
+  char *buffer;
+  size_t length;
+  bool failed;
+} PrintChunk;
+
+static void *printChunk(void *argument) {
+  PrintChunk *chunk = argument;
+  FILE *stream = open_memstream(&chunk->buffer, &chunk->length);
+  if (stream == NULL) {
+    chunk->failed = true;
+    return NULL;
+  }
+  printStoredProducts(chunk->store, chunk->begin, chunk->end, chunk->demand,
+                      stream);
+  chunk->failed = fclose(stream) != 0;
+  return NULL;
+}
+
+static MatamazomResult printInventoryParallel(Matamazom matamazom,
+                                              FILE *output,
+                                              unsigned int workers) {
+  if (matamazom == NULL || output == NULL) {
+    return MATAMAZOM_NULL_ARGUMENT;
+  }
+  ProductStore *store = getProductStore(matamazom);
+  if (store == NULL) {
+    return MATAMAZOM_OUT_OF_MEMORY;
+  }
+  size_t size = store->size;
+  if (workers <= 1 || size <= 1) {
+    return printInventory(matamazom, output);
+  }
+  if (workers > size) {
+    workers = (unsigned int) size;
+  }
+  PrintChunk *chunks = allocatorAllocate(&matamazom->allocator,
+                                         workers * sizeof(*chunks));
+  pthread_t *threads = allocatorAllocate(&matamazom->allocator,
+                                         workers * sizeof(*threads));
+  bool *started = allocatorAllocate(&matamazom->allocator,
+                                    workers * sizeof(*started));
+  if (chunks == NULL || threads == NULL || started == NULL) {
+    allocatorFree(&matamazom->allocator, chunks);
+    allocatorFree(&matamazom->allocator, threads);
+    allocatorFree(&matamazom->allocator, started);
+    return MATAMAZOM_OUT_OF_MEMORY;
+  }
+  for (unsigned int worker = 0; worker < workers; worker++) {
+    chunks[worker] = (PrintChunk) {.store = store,
+        .begin = size * worker / workers,
+        .end = size * (worker + 1) / workers,
+        .demand = matamazom->report_demand};
+  }
+  // the calling thread prints the first chunk itself
+  for (unsigned int worker = 1; worker < workers; worker++) {
+    started[worker] = pthread_create(&threads[worker], NULL, printChunk,
+                                     &chunks[worker]) == 0;
+  }
+  printChunk(&chunks[0]);
+  bool failed = false;
+  for (unsigned int worker = 1; worker < workers; worker++) {
+    if (started[worker]) {
+      pthread_join(threads[worker], NULL);
+    } else {
+      // couldn't create the thread, so its chunk is printed here instead
+      printChunk(&chunks[worker]);
+    }
+  }
+  for (unsigned int worker = 0; worker < workers; worker++) {
+    failed = failed || chunks[worker].failed;
+  }
+  if (!failed) {
+    fprintf(output, "Inventory Status:\n");
+    for (unsigned int worker = 0; worker < workers; worker++) {
+      fwrite(chunks[worker].buffer, 1, chunks[worker].length, output);
+    }
+  }
+  // the streams' buffers are allocated by the C library, not by 'allocator'
+  for (unsigned int worker = 0; worker < workers; worker++) {
+    free(chunks[worker].buffer);
+  }
+  allocatorFree(&matamazom->allocator, chunks);
+  allocatorFree(&matamazom->allocator, threads);
+  allocatorFree(&matamazom->allocator, started);
+  return failed ? MATAMAZOM_OUT_OF_MEMORY : MATAMAZOM_SUCCESS;
+}
+
+MatamazomResult mtmPrintInventoryParallel(Matamazom matamazom, FILE *output,
+                                          unsigned int workers) {
+  MTM_METRICS_START(start);
+  MatamazomResult result = printInventoryParallel(matamazom, output, workers);
+  MTM_METRICS_STOP(matamazom, MTM_METRICS_PRINT_INVENTORY_PARALLEL, start,
+                   result != MATAMAZOM_SUCCESS);
+  return result;
+}
+
+/* a compensated (Neumaier) sum: 'compensation' is what rounding 'sum' lost */
+typedef struct CompensatedSum_t {
+  double sum;
+  double compensation;
+} CompensatedSum;
+
+static void compensatedAdd(CompensatedSum *total, double value) {
+  double sum = total->sum + value;
+  total->compensation += fabs(total->sum) >= fabs(value) ?
+                         (total->sum - sum) + value :
+                         (value - sum) + total->sum;
+  total->sum = sum;
+}
+
+/* adding a sum made separately, such as that of another range */
+static void compensatedMerge(CompensatedSum *total, CompensatedSum other) {
+  compensatedAdd(total, other.sum);
+  total->compensation += other.compensation;
+}
+
+/* summing the rows [begin, end) of a column, or only those of the given
+ * amount type unless type is negative. the rows are summed in SUM_LANES
+ * independent lanes, which the compiler can keep in a single vector. */
+static CompensatedSum sumColumn(const double *column,
+                                const unsigned char *types, int type,
+                                size_t begin, size_t end) {
+  double sums[SUM_LANES] = {0};
+  double compensations[SUM_LANES] = {0};
+  size_t row = begin;
+  for (; row + SUM_LANES <= end; row += SUM_LANES) {
+    for (int lane = 0; lane < SUM_LANES; lane++) {
+      double value = type < 0 || types[row + lane] == type ?
+                     column[row + lane] : 0;
+      double sum = sums[lane] + value;
+      compensations[lane] += fabs(sums[lane]) >= fabs(value) ?
+                             (sums[lane] - sum) + value :
+                             (value - sum) + sums[lane];
+      sums[lane] = sum;
+    }
+  }
+  CompensatedSum total = {0, 0};
+  for (int lane = 0; lane < SUM_LANES; lane++) {
+    compensatedMerge(&total, (CompensatedSum) {sums[lane],
+                                               compensations[lane]});
+  }
+  for (; row < end; row++) {
+    compensatedAdd(&total, type < 0 || types[row] == type ? column[row] : 0);
+  }
+  return total;
+}
+
+/* the sums of the rows [begin, end) of the store */
+typedef struct AggregateChunk_t {
+  ProductStore *store;
+  size_t begin;
+  size_t end;
+  CompensatedSum income;
+  CompensatedSum units[MATAMAZOM_ANY_AMOUNT + 1];
+  CompensatedSum value;
+} AggregateChunk;
+
+static void *aggregateChunk(void *argument) {
+  AggregateChunk *chunk = argument;
+  ProductStore *store = chunk->store;
+  // only the rows whose amounts changed since they were priced are priced
+  for (size_t row = chunk->begin; row < chunk->end; row++) {
+    if (isnan(store->values[row])) {
+      ProductInfo product = store->infos[row];
+      store->values[row] = product->prodPrice(product->customData,
+                                              store->amounts[row]);
+    }
+  }
+  chunk->income = sumColumn(store->incomes, NULL, -1, chunk->begin,
+                            chunk->end);
+  for (int type = 0; type <= MATAMAZOM_ANY_AMOUNT; type++) {
+    chunk->units[type] = sumColumn(store->amounts, store->types, type,
+                                   chunk->begin, chunk->end);
+  }
+  chunk->value = sumColumn(store->values, NULL, -1, chunk->begin, chunk->end);
+  return NULL;
+}
+
+/* summing the store in 'workers' chunks into matamazom->totals */
+static MatamazomResult computeTotals(Matamazom matamazom, ProductStore *store,
+                                     unsigned int workers) {
+  size_t size = store->size;
+  if (workers > size) {
+    workers = (unsigned int) size;
+  }
+  if (workers == 0) {
+    workers = 1;
+  }
+  AggregateChunk single_chunk;
+  AggregateChunk *chunks = &single_chunk;
+  pthread_t *threads = NULL;
+  bool *started = NULL;
+  if (workers > 1) {
+    chunks = allocatorAllocate(&matamazom->allocator,
+                               workers * sizeof(*chunks));
+    threads = allocatorAllocate(&matamazom->allocator,
+                                workers * sizeof(*threads));
+    started = allocatorAllocate(&matamazom->allocator,
+                                workers * sizeof(*started));
+    if (chunks == NULL || threads == NULL || started == NULL) {
+      allocatorFree(&matamazom->allocator, chunks);
+      allocatorFree(&matamazom->allocator, threads);
+      allocatorFree(&matamazom->allocator, started);
+      return MATAMAZOM_OUT_OF_MEMORY;
+    }
+  }
+  for (unsigned int worker = 0; worker < workers; worker++) {
+    chunks[worker] = (AggregateChunk) {.store = store,
+        .begin = size * worker / workers,
+        .end = size * (worker + 1) / workers};
+  }
+  // the calling thread sums the first chunk itself
+  for (unsigned int worker = 1; worker < workers; worker++) {
+    started[worker] = pthread_create(&threads[worker], NULL, aggregateChunk,
+                                     &chunks[worker]) == 0;
+  }
+  aggregateChunk(&chunks[0]);
+  for (unsigned int worker = 1; worker < workers; worker++) {
+    if (started[worker]) {
+      pthread_join(threads[worker], NULL);
+    } else {
+      // couldn't create the thread, so its chunk is summed here instead
+      aggregateChunk(&chunks[worker]);
+    }
+  }
+  AggregateChunk total = {.store = store};
+  for (unsigned int worker = 0; worker < workers; worker++) {
+    compensatedMerge(&total.income, chunks[worker].income);
+    for (int type = 0; type <= MATAMAZOM_ANY_AMOUNT; type++) {
+      compensatedMerge(&total.units[type], chunks[worker].units[type]);
     }
-    double product_price = product->prodPrice(product->customData, 1);
-    mtmPrintProductDetails(product->name,
-                           product->id,
-                           amount,
-                           product_price,
-                           output);
-    product = asGetNext(matamazom->products);
+    compensatedMerge(&total.value, chunks[worker].value);
+  }
+  MtmTotals *totals = &matamazom->totals;
+  totals->income = total.income.sum + total.income.compensation;
+  for (int type = 0; type <= MATAMAZOM_ANY_AMOUNT; type++) {
+    totals->units[type] = total.units[type].sum
+        + total.units[type].compensation;
+  }
+  totals->stock_value = total.value.sum + total.value.compensation;
+  matamazom->totals_valid = true;
+  if (workers > 1) {
+    allocatorFree(&matamazom->allocator, chunks);
+    allocatorFree(&matamazom->allocator, threads);
+    allocatorFree(&matamazom->allocator, started);
   }
   return MATAMAZOM_SUCCESS;
 }
 
-MatamazomResult
-mtmChangeProductAmountInOrder(Matamazom matamazom, const unsigned int orderId,
-                              const unsigned int productId,
-                              const double amount) {
+static MatamazomResult aggregate(Matamazom matamazom, MtmTotals *totals,
+                                 unsigned int workers) {
+  if (matamazom == NULL || totals == NULL) {
+    return MATAMAZOM_NULL_ARGUMENT;
+  }
+  if (!matamazom->totals_valid) {
+    ProductStore *store = getProductStore(matamazom);
+    if (store == NULL) {
+      return MATAMAZOM_OUT_OF_MEMORY;
+    }
+    MatamazomResult result = computeTotals(matamazom, store, workers);
+    if (result != MATAMAZOM_SUCCESS) {
+      return result;
+    }
+  }
+  *totals = matamazom->totals;
+  return MATAMAZOM_SUCCESS;
+}
+
+MatamazomResult mtmAggregate(Matamazom matamazom, MtmTotals *outTotals,
+                             unsigned int workers) {
+  MTM_METRICS_START(start);
+  MatamazomResult result = aggregate(matamazom, outTotals, workers);
+  MTM_METRICS_STOP(matamazom, MTM_METRICS_AGGREGATE, start,
+                   result != MATAMAZOM_SUCCESS);
+  return result;
+}
+
+static MatamazomResult
+changeProductAmountInOrder(Matamazom matamazom, const unsigned int orderId,
+                           const unsigned int productId,
+                           const double amount) {
   if (matamazom == NULL) {
     return MATAMAZOM_NULL_ARGUMENT;
   }
+  if (matamazom->concurrent_mode) {
+    return MATAMAZOM_CONCURRENT_MODE;
+  }
   if (isOrderExists(matamazom, orderId) == false) {
     return MATAMAZOM_ORDER_NOT_EXIST;
   }
-  if (asContains(matamazom->products, findProductInfo(matamazom->products,
-                                                      productId)) == false) {
+  if (asContains(matamazom->products,
+                 findProductInfo(matamazom, matamazom->products,
+                                 productId)) == false) {
     return MATAMAZOM_PRODUCT_NOT_EXIST;
   }
   bool amount_check = isAmountValid(amount, getAmountType(productId,
@@ -556,30 +3032,87 @@ mtmChangeProductAmountInOrder(Matamazom matamazom, const unsigned int orderId,
 
   //fetching the order's pointer in the list
   Order order_ptr = getOrder(matamazom, orderId);
-  ProductInfo product_info = findProductInfo(matamazom->products, productId);
+  // reserving and adding demand, and taking both back if the cart can't change
+  if (!saveOrderCart(matamazom, order_ptr) || !reserveUndo(matamazom, 4)) {
+    return MATAMAZOM_OUT_OF_MEMORY;
+  }
+  ProductInfo product_info = findProductInfo(matamazom, matamazom->products,
+                                             productId);
   asGetAmount(order_ptr->cart, product_info, &outamount);
   // now 'outamount' holds the product's amount in the order
   double amount_after_change = outamount + amount;
+  // how much the amount in the cart actually changes, as it can't be negative
+  double cart_change = (amount_after_change > 0 ? amount_after_change : 0)
+      - outamount;
+  if (matamazom->reservation_mode) {
+    // the change in the cart is reserved (or released) in products right away
+    MatamazomResult result = reserveProduct(matamazom, product_info,
+                                            cart_change);
+    if (result != MATAMAZOM_SUCCESS) {
+      return result;
+    }
+  }
+  if (addDemand(matamazom, product_info, cart_change) != MATAMAZOM_SUCCESS) {
+    // only possible if reserving didn't copy the product already
+    assert(!matamazom->reservation_mode);
+    return MATAMAZOM_OUT_OF_MEMORY;
+  }
+  // both may have replaced a product shared with a snapshot
+  product_info = findProductInfo(matamazom, matamazom->products, productId);
+  /* the cart may share its nodes with a clone or a transaction, so changing it
+   * may fail on copying them */
+  AmountSetResult cart_result = AS_SUCCESS;
   //checking the amount is valid
   if (amount_after_change > 0) {
-    if (asContains(order_ptr->cart, product_info)) {
-      asChangeAmount(order_ptr->cart, product_info, amount);
-      return MATAMAZOM_SUCCESS;
+    bool registered = false;
+    if (!asContains(order_ptr->cart, product_info)) {
+      // in case the product isn't in the order, we add it
+      cart_result = asRegister(order_ptr->cart, (ASElement) product_info);
+      registered = cart_result == AS_SUCCESS;
     }
-    // in case the orders doesn't exist, we create it
-    asRegister(order_ptr->cart, (ASElement) product_info);
-    asChangeAmount(order_ptr->cart, product_info, amount);
-    return MATAMAZOM_SUCCESS;
+    if (cart_result == AS_SUCCESS) {
+      cart_result = asChangeAmount(order_ptr->cart, product_info, amount);
+    }
+    if (cart_result != AS_SUCCESS && registered) {
+      // the node was just created, so deleting it copies nothing
+      asDelete(order_ptr->cart, product_info);
+    }
+  } else {
+    /* we will get here if the amount_after_change isn't positive,
+     * which means we need to remove it. */
+    cart_result = asDelete(order_ptr->cart, product_info);
+  }
+  if (cart_result != AS_SUCCESS) {
+    /* taking back the reservation and the demand. the product is no longer
+     * shared, so neither can fail. */
+    MatamazomResult result = MATAMAZOM_SUCCESS;
+    if (matamazom->reservation_mode) {
+      result = reserveProduct(matamazom, product_info, -cart_change);
+    }
+    if (result == MATAMAZOM_SUCCESS) {
+      result = addDemand(matamazom, product_info, -cart_change);
+    }
+    assert(result == MATAMAZOM_SUCCESS);
+    (void) result;
+    return MATAMAZOM_OUT_OF_MEMORY;
   }
-  /* we will get here if the amount_after_change isn't positive,
-   * which means we need to remove it. */
-  asDelete(order_ptr->cart, product_info);
   return MATAMAZOM_SUCCESS;
-
 }
 
 MatamazomResult
-mtmPrintOrder(Matamazom matamazom, const unsigned int orderId, FILE *output) {
+mtmChangeProductAmountInOrder(Matamazom matamazom, const unsigned int orderId,
+                              const unsigned int productId,
+                              const double amount) {
+  MTM_METRICS_START(start);
+  MatamazomResult result = changeProductAmountInOrder(matamazom, orderId,
+                                                      productId, amount);
+  MTM_METRICS_STOP(matamazom, MTM_METRICS_CHANGE_PRODUCT_AMOUNT_IN_ORDER, start,
+                   result != MATAMAZOM_SUCCESS);
+  return result;
+}
+
+static MatamazomResult
+printOrder(Matamazom matamazom, const unsigned int orderId, FILE *output) {
   if (matamazom == NULL || output == NULL) {
     return MATAMAZOM_NULL_ARGUMENT;
   }
@@ -606,60 +3139,294 @@ mtmPrintOrder(Matamazom matamazom, const unsigned int orderId, FILE *output) {
   return MATAMAZOM_SUCCESS;
 }
 
-MatamazomResult mtmPrintBestSelling(Matamazom matamazom, FILE *output) {
+MatamazomResult
+mtmPrintOrder(Matamazom matamazom, const unsigned int orderId, FILE *output) {
+  MTM_METRICS_START(start);
+  MatamazomResult result = printOrder(matamazom, orderId, output);
+  MTM_METRICS_STOP(matamazom, MTM_METRICS_PRINT_ORDER, start,
+                   result != MATAMAZOM_SUCCESS);
+  return result;
+}
+
+static MatamazomResult printBestSelling(Matamazom matamazom, FILE *output) {
   if (matamazom == NULL || output == NULL) {
     return MATAMAZOM_NULL_ARGUMENT;
   }
-  ProductInfo product = asGetFirst(matamazom->products);
-  ProductInfo best_selling_product = product;
-  double max_income = 0;
-  if (product == NULL) {
+  ProductStore *store = getProductStore(matamazom);
+  if (store == NULL) {
+    return MATAMAZOM_OUT_OF_MEMORY;
+  }
+  if (store->size == 0) {
     return MATAMAZOM_ORDER_NOT_EXIST;
   }
-  while (product != NULL) {
-    if (product->total_income == best_selling_product->total_income) {
-      // if incomes are equal, the one with the lower is will be selected
-      if (product->id < best_selling_product->id) {
-        best_selling_product = product;
-        max_income = best_selling_product->total_income;
-      }
-    } else if (product->total_income > best_selling_product->total_income) {
-      //promoting the best selling through the entire list
-      best_selling_product = product;
-      max_income = best_selling_product->total_income;
+  /* the rows are sorted by id, so if incomes are equal the one with the lower
+   * id is kept */
+  size_t best_selling = 0;
+  for (size_t row = 1; row < store->size; row++) {
+    if (store->incomes[row] > store->incomes[best_selling]) {
+      best_selling = row;
     }
-    // promotion
-    product = asGetNext(matamazom->products);
   }
-  if (max_income == 0) {
+  if (store->incomes[best_selling] == 0) {
     fprintf(output, "Best Selling Product:\n"
                     "none\n");
     return MATAMAZOM_SUCCESS;
   }
   fprintf(output, "Best Selling Product:\n");
-  mtmPrintIncomeLine(best_selling_product->name,
-                     best_selling_product->id,
-                     max_income, output);
+  mtmPrintIncomeLine(productStoreGetName(store, best_selling),
+                     store->ids[best_selling],
+                     store->incomes[best_selling], output);
+  return MATAMAZOM_SUCCESS;
+}
+
+MatamazomResult mtmPrintBestSelling(Matamazom matamazom, FILE *output) {
+  MTM_METRICS_START(start);
+  MatamazomResult result = printBestSelling(matamazom, output);
+  MTM_METRICS_STOP(matamazom, MTM_METRICS_PRINT_BEST_SELLING, start,
+                   result != MATAMAZOM_SUCCESS);
+  return result;
+}
+
+static MatamazomResult
+printFiltered(Matamazom matamazom, MtmFilterProduct customFilter,
+              FILE *output) {
+  if (matamazom == NULL || output == NULL || customFilter == NULL) {
+    return MATAMAZOM_NULL_ARGUMENT;
+  }
+  ProductStore *store = getProductStore(matamazom);
+  if (store == NULL) {
+    return MATAMAZOM_OUT_OF_MEMORY;
+  }
+  //printing according to customFilter function by the user
+  for (size_t row = 0; row < store->size; row++) {
+    ProductInfo product = store->infos[row];
+    const char *name = productStoreGetName(store, row);
+    if (customFilter(store->ids[row], name, store->amounts[row],
+                     product->customData) == true) {
+      mtmPrintProductDetails(name, store->ids[row], store->amounts[row],
+                             product->prodPrice(product->customData, 1),
+                             output);
+    }
+  }
   return MATAMAZOM_SUCCESS;
 }
 
 MatamazomResult
 mtmPrintFiltered(Matamazom matamazom, MtmFilterProduct customFilter,
                  FILE *output) {
-  if (matamazom == NULL || output == NULL || customFilter == NULL) {
+  MTM_METRICS_START(start);
+  MatamazomResult result = printFiltered(matamazom, customFilter, output);
+  MTM_METRICS_STOP(matamazom, MTM_METRICS_PRINT_FILTERED, start,
+                   result != MATAMAZOM_SUCCESS);
+  return result;
+}
+
+/* each simple predicate of a filter is a branchless loop over a single column
+ * of the store, which the compiler can vectorize. 'matches' holds 1 for the
+ * rows that passed the predicates so far. */
+static void filterAmountBelow(const ProductStore *store,
+                              unsigned char *restrict matches, double bound) {
+  const double *restrict amounts = store->amounts;
+  for (size_t i = 0; i < store->size; i++) {
+    matches[i] &= amounts[i] < bound;
+  }
+}
+
+static void filterIdRange(const ProductStore *store,
+                          unsigned char *restrict matches,
+                          unsigned int min_id, unsigned int max_id) {
+  const unsigned int *restrict ids = store->ids;
+  if (min_id > max_id) {
+    memset(matches, 0, store->size);
+    return;
+  }
+  // a single unsigned comparison: ids below min_id wrap around to big numbers
+  unsigned int span = max_id - min_id;
+  for (size_t i = 0; i < store->size; i++) {
+    matches[i] &= (ids[i] - min_id) <= span;
+  }
+}
+
+static void filterAmountType(const ProductStore *store,
+                             unsigned char *restrict matches,
+                             MatamazomAmountType amount_type) {
+  const unsigned char *restrict types = store->types;
+  unsigned char type = (unsigned char) amount_type;
+  for (size_t i = 0; i < store->size; i++) {
+    matches[i] &= types[i] == type;
+  }
+}
+
+static MatamazomResult filterProducts(Matamazom matamazom,
+                                      const MtmFilterSpec *spec,
+                                      unsigned int *outIds, size_t maxIds,
+                                      size_t *outCount) {
+  if (matamazom == NULL || spec == NULL || outCount == NULL ||
+      (outIds == NULL && maxIds > 0) ||
+      ((spec->predicates & MTM_FILTER_NAME_PREFIX) &&
+       spec->name_prefix == NULL)) {
     return MATAMAZOM_NULL_ARGUMENT;
   }
-  double price_of_each = 0;
-  double amount_of_each = 0;
-  //printing according to customFilter function by the user
-  AS_FOREACH(ProductInfo, iterator, matamazom->products) {
-    asGetAmount(matamazom->products, iterator, &amount_of_each);
-    price_of_each = iterator->prodPrice(iterator->customData, 1);
-    if (customFilter(iterator->id, iterator->name, amount_of_each,
-                     iterator->customData) == true) {
-      mtmPrintProductDetails(iterator->name, iterator->id,
-                             amount_of_each, price_of_each, output);
+  ProductStore *store = getProductStore(matamazom);
+  if (store == NULL) {
+    return MATAMAZOM_OUT_OF_MEMORY;
+  }
+  unsigned char *matches = allocatorAllocate(&matamazom->allocator,
+                                             store->size + 1);
+  if (matches == NULL) {
+    return MATAMAZOM_OUT_OF_MEMORY;
+  }
+  memset(matches, 1, store->size);
+  if (spec->predicates & MTM_FILTER_AMOUNT_BELOW) {
+    filterAmountBelow(store, matches, spec->amount_below);
+  }
+  if (spec->predicates & MTM_FILTER_ID_RANGE) {
+    filterIdRange(store, matches, spec->min_id, spec->max_id);
+  }
+  if (spec->predicates & MTM_FILTER_AMOUNT_TYPE) {
+    filterAmountType(store, matches, spec->amount_type);
+  }
+  // the rest of the predicates are checked only for the remaining products
+  size_t prefix_length = (spec->predicates & MTM_FILTER_NAME_PREFIX) ?
+                         strlen(spec->name_prefix) : 0;
+  size_t count = 0;
+  for (size_t row = 0; row < store->size; row++) {
+    if (matches[row] == 0) {
+      continue;
+    }
+    const char *name = productStoreGetName(store, row);
+    if (prefix_length > 0 &&
+        strncmp(name, spec->name_prefix, prefix_length) != 0) {
+      continue;
+    }
+    ProductInfo product = store->infos[row];
+    if (spec->residual != NULL &&
+        spec->residual(store->ids[row], name, store->amounts[row],
+                       product->customData) == false) {
+      continue;
+    }
+    if (count < maxIds) {
+      outIds[count] = store->ids[row];
+    }
+    count++;
+  }
+  allocatorFree(&matamazom->allocator, matches);
+  *outCount = count;
+  return MATAMAZOM_SUCCESS;
+}
+
+MatamazomResult mtmFilterProducts(Matamazom matamazom, const MtmFilterSpec *spec,
+                                  unsigned int *outIds, size_t maxIds,
+                                  size_t *outCount) {
+  MTM_METRICS_START(start);
+  MatamazomResult result = filterProducts(matamazom, spec, outIds, maxIds,
+                                          outCount);
+  MTM_METRICS_STOP(matamazom, MTM_METRICS_FILTER_PRODUCTS, start,
+                   result != MATAMAZOM_SUCCESS);
+  return result;
+}
+
+MatamazomResult mtmForEachProduct(Matamazom matamazom,
+                                  MtmProductVisitor visitor, void *context) {
+  if (matamazom == NULL || visitor == NULL) {
+    return MATAMAZOM_NULL_ARGUMENT;
+  }
+  ProductStore *store = getProductStore(matamazom);
+  if (store == NULL) {
+    return MATAMAZOM_OUT_OF_MEMORY;
+  }
+  for (size_t row = 0; row < store->size; row++) {
+    ProductInfo product = store->infos[row];
+    if (!visitor(store->ids[row], productStoreGetName(store, row),
+                 store->amounts[row],
+                 product->prodPrice(product->customData, 1),
+                 store->incomes[row], context)) {
+      break;
     }
   }
   return MATAMAZOM_SUCCESS;
+}
+
+static MatamazomResult getLowStock(Matamazom matamazom, const double threshold,
+                                   unsigned int *outIds, size_t maxIds,
+                                   size_t *outCount) {
+  if (matamazom == NULL || outCount == NULL ||
+      (outIds == NULL && maxIds > 0)) {
+    return MATAMAZOM_NULL_ARGUMENT;
+  }
+  StockIndex *index = getStockIndex(matamazom);
+  if (index == NULL ||
+      !stockIndexQuery(index, threshold, outIds, maxIds, outCount)) {
+    return MATAMAZOM_OUT_OF_MEMORY;
+  }
+  return MATAMAZOM_SUCCESS;
+}
+
+MatamazomResult mtmGetLowStock(Matamazom matamazom, const double threshold,
+                               unsigned int *outIds, size_t maxIds,
+                               size_t *outCount) {
+  MTM_METRICS_START(start);
+  MatamazomResult result = getLowStock(matamazom, threshold, outIds, maxIds,
+                                       outCount);
+  MTM_METRICS_STOP(matamazom, MTM_METRICS_GET_LOW_STOCK, start,
+                   result != MATAMAZOM_SUCCESS);
+  return result;
+}
+
+MatamazomResult mtmSetLowStockWatermark(Matamazom matamazom,
+                                        const double watermark,
+                                        MtmLowStockCallback callback,
+                                        void *context) {
+  if (matamazom == NULL) {
+    return MATAMAZOM_NULL_ARGUMENT;
+  }
+  // crossing a watermark is noticed by the index, which knows the old amounts
+  if (callback != NULL && getStockIndex(matamazom) == NULL) {
+    return MATAMAZOM_OUT_OF_MEMORY;
+  }
+  matamazom->low_stock_watermark = watermark;
+  matamazom->low_stock_callback = callback;
+  matamazom->low_stock_context = context;
+  return MATAMAZOM_SUCCESS;
+}
+
+MatamazomResult mtmSetProductLowStockWatermark(Matamazom matamazom,
+                                               const unsigned int id,
+                                               const double watermark,
+                                               MtmLowStockCallback callback,
+                                               void *context) {
+  if (matamazom == NULL) {
+    return MATAMAZOM_NULL_ARGUMENT;
+  }
+  if (findProductInfo(matamazom, matamazom->products, id) == NULL) {
+    return MATAMAZOM_PRODUCT_NOT_EXIST;
+  }
+  StockIndex *index = getStockIndex(matamazom);
+  if (index == NULL) {
+    return MATAMAZOM_OUT_OF_MEMORY;
+  }
+  stockIndexSetWatermark(index, id, watermark, callback, context);
+  return MATAMAZOM_SUCCESS;
+}
+
+MatamazomResult mtmGetMetrics(Matamazom matamazom, MtmMetrics *outMetrics) {
+  if (matamazom == NULL || outMetrics == NULL) {
+    return MATAMAZOM_NULL_ARGUMENT;
+  }
+#ifdef MTM_ENABLE_METRICS
+  *outMetrics = matamazom->metrics;
+#else
+  memset(outMetrics, 0, sizeof(*outMetrics));
+#endif
+  return MATAMAZOM_SUCCESS;
+}
+
+MatamazomResult mtmPrintMetrics(Matamazom matamazom, FILE *output) {
+  if (matamazom == NULL || output == NULL) {
+    return MATAMAZOM_NULL_ARGUMENT;
+  }
+  MtmMetrics metrics;
+  mtmGetMetrics(matamazom, &metrics);
+  mtmMetricsPrint(&metrics, output);
+  return MATAMAZOM_SUCCESS;
 }
\ No newline at end of file
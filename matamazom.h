@@ -3,6 +3,8 @@
 
 #include <stdio.h>
 #include <stdbool.h>
+#include <stdint.h>
+#include "allocator.h"
 
 typedef enum MatamazomResult_t {
     MATAMAZOM_SUCCESS = 0,
@@ -14,6 +16,8 @@ typedef enum MatamazomResult_t {
     MATAMAZOM_PRODUCT_NOT_EXIST,
     MATAMAZOM_ORDER_NOT_EXIST,
     MATAMAZOM_INSUFFICIENT_AMOUNT,
+    MATAMAZOM_CONCURRENT_MODE,
+    MATAMAZOM_INVALID_FORMAT,
 } MatamazomResult;
 
 /** Type for specifying what is a valid amount for a product.
@@ -101,6 +105,199 @@ typedef bool (*MtmFilterProduct)(const unsigned int id, const char *name,
                                  const double amount,
                                  MtmProductData customData);
 
+/**
+ * Type of function called when the amount of a product drops below a low-stock
+ * watermark (@see mtmSetLowStockWatermark).
+ *
+ * @param id - the id of the product.
+ * @param amount - the new amount of the product.
+ * @param context - the context given when the watermark was set.
+ */
+typedef void (*MtmLowStockCallback)(const unsigned int id, const double amount,
+                                    void *context);
+
+/**
+ * Type of function called for every product by mtmForEachProduct.
+ *
+ * @param id - the id of the product.
+ * @param name - the name of the product. Valid only until the products are
+ *     changed.
+ * @param amount - the amount of the product.
+ * @param price - the price of a single unit of the product.
+ * @param income - the total income from the product.
+ * @param context - the context given to mtmForEachProduct.
+ * @return true to continue to the next product, false to stop.
+ */
+typedef bool (*MtmProductVisitor)(const unsigned int id, const char *name,
+                                  const double amount, const double price,
+                                  const double income, void *context);
+
+/**
+ * Type of function for creating a product's custom data from the price of a
+ * single unit of it, used by mtmImportProducts. Returns NULL if it fails.
+ */
+typedef MtmProductData (*MtmMakeProductData)(const double price);
+
+/**
+ * Type of function called by mtmImportProducts for every row which wasn't
+ * imported.
+ *
+ * @param line - the number of the row's line, starting from 1.
+ * @param reason - why the row wasn't imported (@see mtmImportProducts).
+ * @param context - the context of the import.
+ */
+typedef void (*MtmRejectedRow)(const size_t line, const MatamazomResult reason,
+                               void *context);
+
+/** How mtmImportProducts creates products from the rows of a catalog */
+typedef struct MtmImportSpec_t {
+    MtmMakeProductData makeData; /* makes the custom data from the price */
+    MtmCopyData copyData;
+    MtmFreeData freeData;
+    MtmGetProductPrice prodPrice;
+    MtmRejectedRow rejected; /* may be NULL */
+    void *context; /* passed to rejected */
+} MtmImportSpec;
+
+/** Simple predicates of a declarative filter (@see MtmFilterSpec) */
+typedef enum MtmFilterPredicate_t {
+    MTM_FILTER_AMOUNT_BELOW = 1 << 0,
+    MTM_FILTER_ID_RANGE = 1 << 1,
+    MTM_FILTER_NAME_PREFIX = 1 << 2,
+    MTM_FILTER_AMOUNT_TYPE = 1 << 3
+} MtmFilterPredicate;
+
+/**
+ * A declarative filter of products: a product passes the filter if it
+ * satisfies all of the predicates set in 'predicates' and, if 'residual' is
+ * not NULL, also the residual filter. Fields of predicates that aren't set
+ * are ignored.
+ *
+ * For example, all the products with ids 100-199 of which less than 10 are
+ * left in the warehouse:
+ * @code
+ * MtmFilterSpec spec = { .predicates = MTM_FILTER_ID_RANGE | MTM_FILTER_AMOUNT_BELOW,
+ *                        .min_id = 100, .max_id = 199, .amount_below = 10 };
+ * @endcode
+ */
+typedef struct MtmFilterSpec_t {
+    unsigned int predicates; /* bitwise or of MtmFilterPredicate values */
+    double amount_below; /* MTM_FILTER_AMOUNT_BELOW: amount < amount_below */
+    unsigned int min_id; /* MTM_FILTER_ID_RANGE: min_id <= id <= max_id */
+    unsigned int max_id;
+    const char *name_prefix; /* MTM_FILTER_NAME_PREFIX: name starts with it */
+    MatamazomAmountType amount_type; /* MTM_FILTER_AMOUNT_TYPE */
+    MtmFilterProduct residual; /* called only for products passing the rest */
+} MtmFilterSpec;
+
+/** How much more of a product an order needs than there is (@see mtmCheckOrders) */
+typedef struct MtmShortfall_t {
+    unsigned int product_id;
+    double amount;
+} MtmShortfall;
+
+/** Whether an order can be shipped now, and if not, what it's short of */
+typedef struct MtmOrderCheck_t {
+    unsigned int order_id;
+    bool can_ship;
+    size_t shortfalls_count;
+    MtmShortfall *shortfalls; /* sorted by product id */
+} MtmOrderCheck;
+
+/** The results of mtmCheckOrders, released by mtmReleaseOrderChecks */
+typedef struct MtmOrderChecks_t {
+    size_t count;
+    MtmOrderCheck *orders; /* sorted by order id */
+    Allocator allocator; /* the memory of orders and of their shortfalls */
+} MtmOrderChecks;
+
+/**
+ * A query of the shipment ledger (@see mtmGetLedgerRevenue): the shipments
+ * made in the time window [from_time, to_time), of all the products or of a
+ * single one. The times are those returned by mtmGetLedgerTime.
+ */
+typedef struct MtmLedgerQuery_t {
+    bool all_products; /* false to only count the shipments of product_id */
+    unsigned int product_id;
+    uint64_t from_time;
+    uint64_t to_time;
+} MtmLedgerQuery;
+
+/** The totals of all the products of a Matamazom products (@see mtmAggregate) */
+typedef struct MtmTotals_t {
+    double income; /* the total income of all the products */
+    double units[3]; /* the total amount in stock, per MatamazomAmountType */
+    double stock_value; /* the total price of the amounts in stock */
+} MtmTotals;
+
+/** How mtmChangeProductAmounts treats changes which can't be made */
+typedef enum MtmBatchMode_t {
+    MTM_BATCH_ALL_OR_NOTHING, /* nothing is changed if any change can't be made */
+    MTM_BATCH_BEST_EFFORT /* all the changes which can be made are made */
+} MtmBatchMode;
+
+/** The state of the pool of orders kept for reuse (@see mtmSetOrderPool) */
+typedef struct MtmOrderPoolStats_t {
+    size_t size; /* the orders in the pool now */
+    size_t capacity;
+    uint64_t hits; /* new orders taken from the pool */
+    uint64_t misses; /* new orders allocated since the pool was empty */
+    double hit_rate; /* hits out of all the new orders, 0 if there were none */
+} MtmOrderPoolStats;
+
+/** Public functions tracked by the metrics mechanism (@see mtmGetMetrics) */
+typedef enum MtmMetricsApi_t {
+    MTM_METRICS_NEW_PRODUCT,
+    MTM_METRICS_CHANGE_PRODUCT_AMOUNT,
+    MTM_METRICS_CLEAR_PRODUCT,
+    MTM_METRICS_CREATE_NEW_ORDER,
+    MTM_METRICS_CHANGE_PRODUCT_AMOUNT_IN_ORDER,
+    MTM_METRICS_SHIP_ORDER,
+    MTM_METRICS_CANCEL_ORDER,
+    MTM_METRICS_PRINT_INVENTORY,
+    MTM_METRICS_PRINT_INVENTORY_PARALLEL,
+    MTM_METRICS_PRINT_ORDER,
+    MTM_METRICS_PRINT_BEST_SELLING,
+    MTM_METRICS_PRINT_FILTERED,
+    MTM_METRICS_FILTER_PRODUCTS,
+    MTM_METRICS_GET_LOW_STOCK,
+    MTM_METRICS_IMPORT_PRODUCTS,
+    MTM_METRICS_PRINT_INVENTORY_RANGE,
+    MTM_METRICS_MERGE_ORDERS,
+    MTM_METRICS_CHECK_ORDERS,
+    MTM_METRICS_AGGREGATE,
+    MTM_METRICS_CLONE_ORDER,
+    MTM_METRICS_CHANGE_PRODUCT_AMOUNTS,
+    MTM_METRICS_COMMIT,
+    MTM_METRICS_ABORT,
+    MTM_METRICS_API_COUNT
+} MtmMetricsApi;
+
+/** Number of latency buckets. Bucket i counts calls that took between 2^i and
+ * 2^(i+1) - 1 nanoseconds, the last bucket also counts anything slower. */
+#define MTM_METRICS_LATENCY_BUCKETS 32
+
+/** Counters collected for a single public function */
+typedef struct MtmApiMetrics_t {
+    uint64_t calls;
+    uint64_t errors; /* calls that returned anything but MATAMAZOM_SUCCESS */
+    uint64_t latency[MTM_METRICS_LATENCY_BUCKETS];
+} MtmApiMetrics;
+
+/** Counters collected for the internal linear searches */
+typedef struct MtmWalkMetrics_t {
+    uint64_t lookups;
+    uint64_t steps; /* total number of elements visited by all lookups */
+    uint64_t max_steps;
+} MtmWalkMetrics;
+
+/** All the metrics of a Matamazom products */
+typedef struct MtmMetrics_t {
+    MtmApiMetrics api[MTM_METRICS_API_COUNT];
+    MtmWalkMetrics product_walks;
+    MtmWalkMetrics order_walks;
+} MtmMetrics;
+
 /**
  * matamazomCreate: create an empty Matamazom products.
  *
@@ -109,15 +306,297 @@ typedef bool (*MtmFilterProduct)(const unsigned int id, const char *name,
  */
 Matamazom matamazomCreate();
 
+/**
+ * matamazomCreateWithAllocator: create an empty Matamazom products, which
+ * allocates all of its memory (products, names, orders and carts) using the
+ * given allocator.
+ *
+ * Custom data of products is still allocated by the user's copyData function.
+ *
+ * @param allocator - the allocator to use. NULL means malloc and free. The
+ *     allocator is copied, but its context must outlive the Matamazom products.
+ * @return A new Matamazom products in case of success, and NULL otherwise (e.g.
+ *     in case of an allocation error)
+ */
+Matamazom matamazomCreateWithAllocator(const Allocator *allocator);
+
+/**
+ * mtmSetCartArena: set whether the carts of new orders are allocated from a
+ * bump arena of their own.
+ *
+ * Carts are short-lived, so instead of allocating and freeing every line of a
+ * cart separately, the lines are taken from blocks of blockSize bytes which
+ * are all released together when the order is shipped or canceled (except
+ * for a block kept with the order if it's kept for reuse, @see
+ * mtmSetOrderPool). Removing a product from a cart doesn't return its memory
+ * until then. Existing orders are not affected.
+ *
+ * @param matamazom - a Matamazom products.
+ * @param blockSize - size of each block of the arena in bytes, or 0 to
+ *     allocate the lines of new carts directly from the Matamazom allocator.
+ * @return
+ *     MATAMAZOM_NULL_ARGUMENT - if a NULL argument is passed.
+ *     MATAMAZOM_SUCCESS - otherwise.
+ */
+MatamazomResult mtmSetCartArena(Matamazom matamazom, size_t blockSize);
+
+/**
+ * mtmSetOrderPool: set how many removed orders are kept for reuse.
+ *
+ * An order which is shipped, canceled or merged into another is kept with an
+ * empty cart (and if it has an arena, with a block of it) in a pool, as long
+ * as the pool has fewer than 'capacity' orders. New orders are taken from the
+ * pool before any memory is allocated for them. The pool is emptied whenever
+ * the block size of cart arenas changes (@see mtmSetCartArena). By default
+ * the capacity is 64.
+ *
+ * @param matamazom - a Matamazom products.
+ * @param capacity - the most orders to keep, or 0 to free every order as soon
+ *     as it's removed. Orders beyond it are freed right away.
+ * @return
+ *     MATAMAZOM_NULL_ARGUMENT - if a NULL argument is passed.
+ *     MATAMAZOM_SUCCESS - otherwise.
+ */
+MatamazomResult mtmSetOrderPool(Matamazom matamazom, size_t capacity);
+
+/**
+ * mtmTrimOrderPool: free all the orders kept for reuse, without changing the
+ * capacity of the pool (@see mtmSetOrderPool).
+ *
+ * @param matamazom - a Matamazom products.
+ * @return
+ *     MATAMAZOM_NULL_ARGUMENT - if a NULL argument is passed.
+ *     MATAMAZOM_SUCCESS - otherwise.
+ */
+MatamazomResult mtmTrimOrderPool(Matamazom matamazom);
+
+/**
+ * mtmGetOrderPoolStats: get the size of the pool of orders kept for reuse,
+ * and how many new orders were taken from it (@see mtmSetOrderPool).
+ *
+ * @param matamazom - a Matamazom products.
+ * @param outStats - returns the state of the pool.
+ * @return
+ *     MATAMAZOM_NULL_ARGUMENT - if a NULL argument is passed.
+ *     MATAMAZOM_SUCCESS - otherwise.
+ */
+MatamazomResult mtmGetOrderPoolStats(Matamazom matamazom,
+                                     MtmOrderPoolStats *outStats);
+
+/**
+ * mtmSetReservationMode: set whether the contents of orders are reserved in
+ * the products as soon as they are added to the orders.
+ *
+ * In reservation mode every product has a reserved amount, which is the total
+ * amount of it in all of the orders. mtmChangeProductAmountInOrder fails if
+ * the reserved amount would become larger than the product's amount, and
+ * mtmChangeProductAmount fails if it would make the product's amount smaller
+ * than its reserved amount. Therefore mtmShipOrder never fails because of
+ * insufficient amounts, and doesn't need to check them. mtmCancelOrder
+ * releases the reservations of the order.
+ *
+ * Enabling the mode reserves the contents of all the existing orders, and
+ * disabling it releases all the reservations.
+ *
+ * @param matamazom - a Matamazom products.
+ * @param enabled - true to enable reservation mode, false to disable it.
+ * @return
+ *     MATAMAZOM_NULL_ARGUMENT - if a NULL argument is passed.
+ *     MATAMAZOM_INSUFFICIENT_AMOUNT - if enabling the mode and the existing
+ *         orders contain more of some product than its amount in matamazom.
+ *         The mode stays disabled.
+ *     MATAMAZOM_OUT_OF_MEMORY - in case of memory allocation failure.
+ *     MATAMAZOM_CONCURRENT_MODE - if concurrent mode is enabled.
+ *     MATAMAZOM_SUCCESS - otherwise.
+ */
+MatamazomResult mtmSetReservationMode(Matamazom matamazom, bool enabled);
+
+/**
+ * mtmGetReservedAmount: get the amount of a product which is reserved by
+ * orders (@see mtmSetReservationMode).
+ *
+ * @param matamazom - a Matamazom products.
+ * @param id - id of the product.
+ * @param outAmount - returns the reserved amount, which is 0 if reservation
+ *     mode isn't enabled.
+ * @return
+ *     MATAMAZOM_NULL_ARGUMENT - if a NULL argument is passed.
+ *     MATAMAZOM_PRODUCT_NOT_EXIST - if matamazom does not contain a product with
+ *         the given id.
+ *     MATAMAZOM_SUCCESS - otherwise.
+ */
+MatamazomResult mtmGetReservedAmount(Matamazom matamazom, const unsigned int id,
+                                     double *outAmount);
+
+/**
+ * mtmGetProductDemand: get the total amount of a product in all the open
+ * orders of a Matamazom products.
+ *
+ * The total is kept up to date by every change to the orders, so getting it
+ * doesn't walk the orders, only finds the product (in O(log n), except when
+ * products were added or removed since it was last found). A snapshot has
+ * the demand as it was when the snapshot was taken.
+ *
+ * @param matamazom - a Matamazom products.
+ * @param id - the id of the product.
+ * @param outAmount - returns the amount of the product in all the orders.
+ * @return
+ *     MATAMAZOM_NULL_ARGUMENT - if a NULL argument is passed.
+ *     MATAMAZOM_PRODUCT_NOT_EXIST - if matamazom does not contain a product
+ *         with the given id.
+ *     MATAMAZOM_OUT_OF_MEMORY - in case of memory allocation failure.
+ *     MATAMAZOM_SUCCESS - otherwise.
+ */
+MatamazomResult mtmGetProductDemand(Matamazom matamazom, const unsigned int id,
+                                    double *outAmount);
+
+/**
+ * mtmSetReportDemand: set whether the inventory reports (mtmPrintInventory,
+ * mtmPrintInventoryParallel and mtmPrintInventoryRange) show the demand for
+ * every product (@see mtmGetProductDemand), as an "on order" column at the
+ * end of its line. It is off by default.
+ *
+ * @param matamazom - a Matamazom products.
+ * @param enabled - true to show the demand, false to print the reports as
+ *     usual.
+ * @return
+ *     MATAMAZOM_NULL_ARGUMENT - if a NULL argument is passed.
+ *     MATAMAZOM_SUCCESS - otherwise.
+ */
+MatamazomResult mtmSetReportDemand(Matamazom matamazom, bool enabled);
+
+/**
+ * mtmSetConcurrentMode: set whether the amounts of products may be changed by
+ * many threads at once.
+ *
+ * In concurrent mode mtmChangeProductAmount may be called by any number of
+ * threads at the same time, without a lock, even for the same product: the
+ * amount of every product is kept in an atomic fixed-point counter, in
+ * thousandths of a unit, which is changed by a compare-and-swap. Changes are
+ * rounded to thousandths, and aren't recorded by the metrics.
+ *
+ * No other function may be called on matamazom while threads are changing
+ * amounts. While the mode is enabled, the functions which change the products
+ * or the orders (or begin or abort a transaction) fail with
+ * MATAMAZOM_CONCURRENT_MODE, mtmCreateNewOrder and mtmCloneOrder return 0 and
+ * mtmSnapshot returns NULL, so that the products stay as the counters were
+ * made for them. Functions which read matamazom see the amounts from before
+ * the mode was enabled.
+ * Disabling the mode applies the changes of the counters to the products, and
+ * only then are the low-stock callbacks of the changed products called (@see
+ * mtmSetLowStockWatermark).
+ *
+ * @param matamazom - a Matamazom products.
+ * @param enabled - true to enable concurrent mode, false to disable it.
+ * @return
+ *     MATAMAZOM_NULL_ARGUMENT - if a NULL argument is passed.
+ *     MATAMAZOM_INVALID_AMOUNT - if enabling the mode and the amount of some
+ *         product is too large for a counter. The mode stays disabled.
+ *     MATAMAZOM_OUT_OF_MEMORY - in case of memory allocation failure. The mode
+ *         stays as it was.
+ *     MATAMAZOM_SUCCESS - otherwise.
+ */
+MatamazomResult mtmSetConcurrentMode(Matamazom matamazom, bool enabled);
+
 /**
  * matamazomDestroy: free a Matamazom products, and all its contents, from
  * memory.
  *
+ * A transaction which is still open is committed (@see mtmBegin).
+ *
  * @param matamazom - the products to free from memory. A NULL value is
  *     allowed, and in that case the function does nothing.
  */
 void matamazomDestroy(Matamazom matamazom);
 
+/**
+ * mtmSnapshot: create a frozen view of a Matamazom products in O(1), e.g. for
+ * printing reports while the products keep changing.
+ *
+ * The snapshot contains the products of matamazom, with their amounts and
+ * incomes, as they are at the time of the call, but none of its orders.
+ * It shares its memory with matamazom, and a product is copied (using its
+ * copyData function) only when either of them changes it. Once the last
+ * snapshot of matamazom (or of its snapshots) is destroyed, nothing is shared
+ * and matamazom is changed in place again.
+ *
+ * The snapshot may be read (e.g. by mtmPrintInventory) from another thread
+ * while matamazom is modified, but creating or destroying a snapshot must not
+ * run concurrently with changes to matamazom. The snapshot must be destroyed,
+ * using matamazomDestroy, before matamazom is. A snapshot can't be taken while
+ * a transaction is open (@see mtmBegin).
+ *
+ * @param matamazom - the Matamazom products to take a snapshot of.
+ * @return A new Matamazom products in case of success, and NULL otherwise (e.g.
+ *     in case of an allocation error, a NULL argument, an open transaction or
+ *     in concurrent mode)
+ */
+Matamazom mtmSnapshot(Matamazom matamazom);
+
+/**
+ * mtmBegin: start a transaction, so that the changes made to a Matamazom
+ * products until mtmCommit is called may all be undone at once by mtmAbort.
+ *
+ * Beginning takes O(1), as nothing is copied: every change (to products and
+ * their amounts, incomes, demand and reservations, to the orders and their
+ * carts and to the low-stock index) is logged with what undoing it takes. The
+ * changes themselves are made and checked as usual, so each call still either
+ * succeeds or changes nothing, and committing doesn't check anything again.
+ *
+ * Transactions may be nested, in which case the inner ones are a part of the
+ * outermost one: only its mtmCommit ends the transaction, and mtmAbort always
+ * undoes all of it.
+ *
+ * The settings of matamazom (e.g. the cart arena, the order pool, the ledger
+ * and the low-stock watermarks) aren't undone, except for the reservation
+ * mode. Concurrent mode must not be changed during a transaction (@see
+ * mtmSetConcurrentMode).
+ *
+ * @param matamazom - a Matamazom products.
+ * @return
+ *     MATAMAZOM_NULL_ARGUMENT - if a NULL argument is passed.
+ *     MATAMAZOM_CONCURRENT_MODE - if concurrent mode is enabled.
+ *     MATAMAZOM_SUCCESS - otherwise.
+ * @note While a transaction is open, any change may fail with
+ *     MATAMAZOM_OUT_OF_MEMORY if there's no memory to log it (in which case
+ *     nothing is changed, as usual).
+ */
+MatamazomResult mtmBegin(Matamazom matamazom);
+
+/**
+ * mtmCommit: end the transaction started by mtmBegin, keeping its changes.
+ * Takes time proportional to the number of changes, not to the size of
+ * matamazom. If the transaction is nested, only the outermost one ends.
+ *
+ * @param matamazom - a Matamazom products.
+ * @return
+ *     MATAMAZOM_NULL_ARGUMENT - if a NULL argument is passed.
+ *     MATAMAZOM_SUCCESS - otherwise, even if no transaction is open.
+ */
+MatamazomResult mtmCommit(Matamazom matamazom);
+
+/**
+ * mtmAbort: end the transaction started by mtmBegin, undoing all the changes
+ * made since: products, amounts, incomes, orders and their carts, demand and
+ * reservations, the order ids given and the shipments recorded in the ledger
+ * (@see mtmOpenLedger). Takes time proportional to the number of changes, not
+ * to the size of matamazom, and can't fail unless concurrent mode is enabled.
+ *
+ * If the transaction is nested, the outermost one is aborted as well, and the
+ * mtmCommit or mtmAbort calls which would end the outer ones do nothing.
+ * If the ledger was opened or closed during the transaction, its records are
+ * kept. If the low-stock index was built during the transaction, the
+ * watermarks of products set meanwhile are lost (@see
+ * mtmSetProductLowStockWatermark).
+ *
+ * @param matamazom - a Matamazom products.
+ * @return
+ *     MATAMAZOM_NULL_ARGUMENT - if a NULL argument is passed.
+ *     MATAMAZOM_CONCURRENT_MODE - if concurrent mode is enabled.
+ *     MATAMAZOM_SUCCESS - otherwise, even if no transaction is open.
+ */
+MatamazomResult mtmAbort(Matamazom matamazom);
+
 /**
  * mtmNewProduct: add a new product to a Matamazom products.
  *
@@ -140,6 +619,7 @@ void matamazomDestroy(Matamazom matamazom);
  *     MATAMAZOM_INVALID_AMOUNT - if amount < 0, or is not consistent with amountType
  *         (@see MatamazomAmountType documentation above)
  *     MATAMAZOM_PRODUCT_ALREADY_EXIST - if a product with the given id already exist.
+ *     MATAMAZOM_CONCURRENT_MODE - if concurrent mode is enabled.
  *     MATAMAZOM_SUCCESS - if product was added successfully.
  */
 MatamazomResult
@@ -148,6 +628,49 @@ mtmNewProduct(Matamazom matamazom, const unsigned int id, const char *name,
               const MtmProductData customData, MtmCopyData copyData,
               MtmFreeData freeData, MtmGetProductPrice prodPrice);
 
+/**
+ * mtmImportProducts: add the products of a catalog, read from a CSV stream,
+ * to a Matamazom products.
+ *
+ * Every line of the catalog is a row of 5 fields separated by commas:
+ *   id,name,amount,type,price
+ * where type is one of "integer", "half_integer" or "any" (@see
+ * MatamazomAmountType), and price is the price of a single unit, from which
+ * spec->makeData makes the product's custom data. Names can't contain commas.
+ * Empty lines are skipped.
+ *
+ * Rows which mtmNewProduct would reject aren't imported, and neither are
+ * malformed rows. The rest are sorted and added at once, which takes
+ * O(n log n) for a catalog of n rows, instead of the O(n^2) of calling
+ * mtmNewProduct for every row.
+ *
+ * @param matamazom - a Matamazom products.
+ * @param input - an open, readable stream of the catalog. It is read until its
+ *     end.
+ * @param spec - the functions of the new products, and the function to call
+ *     for every rejected row, in the order of the lines, with the number of
+ *     the row's line and the reason:
+ *     MATAMAZOM_INVALID_FORMAT - if the row is malformed: it has a missing or
+ *         an extra field, or its id, type or price can't be parsed.
+ *     MATAMAZOM_INVALID_NAME - if the name is invalid, as in mtmNewProduct.
+ *     MATAMAZOM_INVALID_AMOUNT - if the amount can't be parsed, or is invalid
+ *         as in mtmNewProduct.
+ *     MATAMAZOM_PRODUCT_ALREADY_EXIST - if a product with the row's id
+ *         already exists, or appeared in an earlier row.
+ * @param outImported - returns the number of imported rows. May be NULL.
+ * @param outRejected - returns the number of rejected rows. May be NULL.
+ * @return
+ *     MATAMAZOM_NULL_ARGUMENT - if a NULL argument is passed (including NULL
+ *         functions in spec, except for rejected).
+ *     MATAMAZOM_OUT_OF_MEMORY - in case of memory allocation failure, in which
+ *         case no product is added.
+ *     MATAMAZOM_CONCURRENT_MODE - if concurrent mode is enabled.
+ *     MATAMAZOM_SUCCESS - otherwise, even if some rows were rejected.
+ */
+MatamazomResult mtmImportProducts(Matamazom matamazom, FILE *input,
+                                  const MtmImportSpec *spec,
+                                  size_t *outImported, size_t *outRejected);
+
 /**
  * mtmChangeProductAmount: increase or decrease the amount of an *existing* product in a Matamazom products.
  * if 'amount' < 0 then this amount should be decreased from the matamazom products.
@@ -160,6 +683,8 @@ mtmNewProduct(Matamazom matamazom, const unsigned int id, const char *name,
  * If the amount is equal to the product's amount in the
  * products,then the product will remain inside the products
  * with amount of zero.
+ * In concurrent mode, many threads may call this function at once (@see
+ * mtmSetConcurrentMode).
  *
  * @param matamazom - products to add the product to. Must be non-NULL.
  * @param id - existing product id. Must exist in the products.
@@ -171,7 +696,8 @@ mtmNewProduct(Matamazom matamazom, const unsigned int id, const char *name,
  *     MATAMAZOM_INVALID_AMOUNT - if amount is not consistent with product's amount type
  *         (@see parameter amountType in mtmNewProduct).
  *     MATAMAZOM_INSUFFICIENT_AMOUNT - if 'amount' < 0 and the amount to be decreased
- *         is bigger than product's amount in the products.
+ *         is bigger than product's amount in the products, or in reservation
+ *         mode, bigger than its unreserved amount (@see mtmSetReservationMode).
  *     MATAMAZOM_SUCCESS - if product amount was increased/decreased successfully.
  * @note Even if amount is 0 (thus the function will change nothing), still a proper
  *    error code is returned if one of the parameters is invalid, and MATAMAZOM_SUCCESS
@@ -181,6 +707,44 @@ MatamazomResult
 mtmChangeProductAmount(Matamazom matamazom, const unsigned int id,
                        const double amount);
 
+/**
+ * mtmChangeProductAmounts: change the amounts of many products in a Matamazom
+ * products at once, e.g. when a delivery is received.
+ *
+ * Every change is made as mtmChangeProductAmount would, in the order of the
+ * batch, so the same product may be changed several times. The batch is
+ * sorted by id and made in a single pass over the products, so a batch of m
+ * changes to n products takes O(n + m log m) instead of O(n * m).
+ *
+ * Unlike mtmChangeProductAmount, this function must not run concurrently with
+ * other calls, even in concurrent mode (@see mtmSetConcurrentMode).
+ *
+ * @param matamazom - products containing the products.
+ * @param ids - the ids of the products to change.
+ * @param amounts - the amounts to add to the products, as in
+ *     mtmChangeProductAmount.
+ * @param n - the number of changes.
+ * @param results - returns the result of each change: MATAMAZOM_SUCCESS if it
+ *     was made (or, with MTM_BATCH_ALL_OR_NOTHING, if only other changes
+ *     failed), or the error mtmChangeProductAmount would have returned for it.
+ * @param mode - whether the changes which can be made are made when others
+ *     can't (@see MtmBatchMode).
+ * @return
+ *     MATAMAZOM_NULL_ARGUMENT - if a NULL argument is passed.
+ *     MATAMAZOM_OUT_OF_MEMORY - in case of memory allocation failure, in which
+ *         case nothing is changed.
+ *     The error of the first change which failed - with
+ *         MTM_BATCH_ALL_OR_NOTHING, in which case nothing is changed.
+ *     MATAMAZOM_CONCURRENT_MODE - if concurrent mode is enabled.
+ *     MATAMAZOM_SUCCESS - otherwise, even if some changes failed with
+ *         MTM_BATCH_BEST_EFFORT.
+ */
+MatamazomResult mtmChangeProductAmounts(Matamazom matamazom,
+                                        const unsigned int *ids,
+                                        const double *amounts, size_t n,
+                                        MatamazomResult *results,
+                                        MtmBatchMode mode);
+
 /**
  * mtmClearProduct: clear a product from a Matamazom products.
  *
@@ -196,6 +760,7 @@ mtmChangeProductAmount(Matamazom matamazom, const unsigned int id,
  *     MATAMAZOM_NULL_ARGUMENT - if a NULL argument is passed.
  *     MATAMAZOM_PRODUCT_NOT_EXIST - if matamazom does not contain a product with
  *         the given id.
+ *     MATAMAZOM_CONCURRENT_MODE - if concurrent mode is enabled.
  *     MATAMAZOM_SUCCESS - if product was cleared successfully.
  */
 MatamazomResult mtmClearProduct(Matamazom matamazom, const unsigned int id);
@@ -207,10 +772,34 @@ MatamazomResult mtmClearProduct(Matamazom matamazom, const unsigned int id);
  * @param matamazom - a Matamazom products
  * @return
  *     Positive id of the new order, if successful.
- *     0 in case of failure.
+ *     0 in case of failure, or if concurrent mode is enabled.
  */
 unsigned int mtmCreateNewOrder(Matamazom matamazom);
 
+/**
+ * mtmCloneOrder: create a new order in a Matamazom products with the same
+ * contents as an existing order, and return the new order's id.
+ *
+ * The copy takes O(k log n) for an order of k products out of n products:
+ * unless carts are allocated from arenas (@see mtmSetCartArena) the new order
+ * shares the contents of the existing one until either of them is changed,
+ * and otherwise they are copied in a single pass. Like adding the products to
+ * the order one by one, the new order adds to the demand for the products
+ * (@see mtmGetProductDemand), and in reservation mode it reserves them.
+ *
+ * @param matamazom - products containing the order.
+ * @param sourceOrderId - id of the order to clone.
+ * @return
+ *     Positive id of the new order, if successful.
+ *     0 if a NULL argument is passed, if matamazom does not contain an order
+ *     with the given id, in reservation mode if the unreserved amount of one of
+ *     the products is smaller than its amount in the order
+ *     (@see mtmSetReservationMode), if concurrent mode is enabled, or in case of
+ *     memory allocation failure.
+ */
+unsigned int mtmCloneOrder(Matamazom matamazom,
+                           const unsigned int sourceOrderId);
+
 /**
  * mtmChangeProductAmountInOrder: add/increase/remove/decrease products to an existing order.
  * Only products that exist inside the matamazom can be added to an order.
@@ -235,6 +824,11 @@ unsigned int mtmCreateNewOrder(Matamazom matamazom);
  *         the given productId.
  *     MATAMAZOM_INVALID_AMOUNT - if amount is not consistent with product's amount type
  *         (@see parameter amountType in mtmNewProduct).
+ *     MATAMAZOM_INSUFFICIENT_AMOUNT - in reservation mode, if the amount to add
+ *         is larger than the product's unreserved amount
+ *         (@see mtmSetReservationMode).
+ *     MATAMAZOM_OUT_OF_MEMORY - in case of memory allocation failure.
+ *     MATAMAZOM_CONCURRENT_MODE - if concurrent mode is enabled.
  *     MATAMAZOM_SUCCESS - if product was added/removed/increased/decreased to the order successfully.
  * @note Even if amount is 0 (thus the function will change nothing), still a proper
  *    error code is returned if one of the parameters is invalid, and MATAMAZOM_SUCCESS
@@ -256,7 +850,9 @@ mtmChangeProductAmountInOrder(Matamazom, const unsigned int orderId,
  * If the order cannot be shipped for any reason, e.g. some product's amount in
  * the order is larger than its amount in the products, then the entire
  * operation is canceled - the order remains in the products, and the
- * products contents are not modified.
+ * products contents are not modified. In reservation mode the amounts were
+ * already checked when they were reserved, so they aren't checked again
+ * (@see mtmSetReservationMode).
  *
  * @param matamazom - products containing the order and all the products.
  * @param orderId - id of the order being shipped.
@@ -266,15 +862,71 @@ mtmChangeProductAmountInOrder(Matamazom, const unsigned int orderId,
  *         the given orderId.
  *     MATAMAZOM_INSUFFICIENT_AMOUNT - if the order contains a product with an amount
  *         that is larger than its amount in matamazom.
+ *     MATAMAZOM_OUT_OF_MEMORY - if the products are shared with a snapshot
+ *         (@see mtmSnapshot) and copying them failed.
+ *     MATAMAZOM_CONCURRENT_MODE - if concurrent mode is enabled.
  *     MATAMAZOM_SUCCESS - if the order was shipped successfully.
  */
 MatamazomResult mtmShipOrder(Matamazom matamazom, const unsigned int orderId);
 
+/**
+ * mtmCanShipOrder: check whether an order could be shipped now, without
+ * shipping it.
+ *
+ * As long as the products and the order aren't changed, mtmShipOrder of an
+ * order for which this returned MATAMAZOM_SUCCESS can only fail with
+ * MATAMAZOM_OUT_OF_MEMORY, and only if the products are shared with a
+ * snapshot.
+ *
+ * @param matamazom - products containing the order and all the products.
+ * @param orderId - id of the order to check.
+ * @return
+ *     MATAMAZOM_NULL_ARGUMENT - if a NULL argument is passed.
+ *     MATAMAZOM_ORDER_NOT_EXIST - if matamazom does not contain an order with
+ *         the given orderId.
+ *     MATAMAZOM_INSUFFICIENT_AMOUNT - if the order contains a product with an amount
+ *         that is larger than its amount in matamazom.
+ *     MATAMAZOM_SUCCESS - if the order can be shipped.
+ */
+MatamazomResult mtmCanShipOrder(Matamazom matamazom,
+                                const unsigned int orderId);
+
+/**
+ * mtmCheckOrders: check which of the orders of a Matamazom products could be
+ * shipped now, and what each of the others is short of, without changing
+ * anything.
+ *
+ * Every order is checked on its own against the current amounts of the
+ * products, as mtmCanShipOrder does, but all of them are checked in a single
+ * merge of the carts against the products. That takes O(n + L log k) for n
+ * products and k orders with L lines in total, instead of O(n * L).
+ *
+ * @param matamazom - products containing the orders.
+ * @param results - filled with a check per order, which has a shortfall for
+ *     every product of the order whose amount in the order is larger than its
+ *     amount in matamazom. Must be released using mtmReleaseOrderChecks.
+ * @return
+ *     MATAMAZOM_NULL_ARGUMENT - if a NULL argument is passed.
+ *     MATAMAZOM_OUT_OF_MEMORY - in case of memory allocation failure, in which
+ *         case results is empty.
+ *     MATAMAZOM_SUCCESS - if the orders were checked.
+ */
+MatamazomResult mtmCheckOrders(Matamazom matamazom, MtmOrderChecks *results);
+
+/**
+ * mtmReleaseOrderChecks: free the memory of the results of mtmCheckOrders,
+ * which are left empty.
+ *
+ * @param results - the results to release. If NULL nothing will be done.
+ */
+void mtmReleaseOrderChecks(MtmOrderChecks *results);
+
 /**
  * mtmCancelOrder: cancel an order and remove it from a Matamazom products.
  *
  * The order is deleted from the products. The products and their amounts in
- * the products is not changed.
+ * the products is not changed. In reservation mode the amounts reserved by
+ * the order are released (@see mtmSetReservationMode).
  *
  * @param matamazom - products containing the order.
  * @param orderId - id of the order being canceled.
@@ -282,10 +934,112 @@ MatamazomResult mtmShipOrder(Matamazom matamazom, const unsigned int orderId);
  *     MATAMAZOM_NULL_ARGUMENT - if a NULL argument is passed.
  *     MATAMAZOM_ORDER_NOT_EXIST - if matamazom does not contain an order with
  *         the given orderId.
+ *     MATAMAZOM_CONCURRENT_MODE - if concurrent mode is enabled.
  *     MATAMAZOM_SUCCESS - if the order was shipped successfully.
  */
 MatamazomResult mtmCancelOrder(Matamazom matamazom, const unsigned int orderId);
 
+/**
+ * mtmMergeOrders: move the contents of an order into another order, and
+ * remove it from a Matamazom products.
+ *
+ * The amount of every product in the merged order is added to its amount in
+ * the target order, in a single pass over both orders. The products and their
+ * amounts in the products are not changed, and neither are the amounts
+ * reserved in reservation mode.
+ *
+ * @param matamazom - products containing the orders.
+ * @param toOrderId - id of the order to which the contents are added.
+ * @param fromOrderId - id of the order being merged, which is removed. If it
+ *     equals toOrderId nothing is done.
+ * @return
+ *     MATAMAZOM_NULL_ARGUMENT - if a NULL argument is passed.
+ *     MATAMAZOM_ORDER_NOT_EXIST - if matamazom does not contain an order with
+ *         either of the given ids.
+ *     MATAMAZOM_OUT_OF_MEMORY - in case of memory allocation failure, in which
+ *         case both orders are unchanged.
+ *     MATAMAZOM_CONCURRENT_MODE - if concurrent mode is enabled.
+ *     MATAMAZOM_SUCCESS - if the orders were merged successfully.
+ */
+MatamazomResult mtmMergeOrders(Matamazom matamazom,
+                               const unsigned int toOrderId,
+                               const unsigned int fromOrderId);
+
+/**
+ * mtmOpenLedger: start recording every product shipped by mtmShipOrder in a
+ * shipment ledger: the order's id, the product's id, the amount shipped, its
+ * price and the time it was shipped (@see mtmGetLedgerTime).
+ *
+ * The ledger is made of fixed-size chunks of columns, held in a single mapping
+ * of a file (or in memory) with a fixed capacity, so shipping never allocates
+ * memory for it. If the file is an existing ledger, its shipments are kept
+ * and new ones are appended to them. Once the ledger is full, mtmShipOrder
+ * fails with MATAMAZOM_OUT_OF_MEMORY, until a bigger ledger is opened.
+ * An open ledger is closed first.
+ *
+ * @param matamazom - a Matamazom products.
+ * @param path - the file of the ledger, which is created if it doesn't exist,
+ *     or NULL to keep the ledger in memory only.
+ * @param capacity - the number of shipped products the ledger can hold.
+ * @return
+ *     MATAMAZOM_NULL_ARGUMENT - if matamazom is NULL.
+ *     MATAMAZOM_OUT_OF_MEMORY - if the ledger couldn't be allocated, or the
+ *         file couldn't be opened or mapped. No ledger is open then.
+ *     MATAMAZOM_INVALID_FORMAT - if the file exists but isn't a ledger. The
+ *         file isn't changed, and no ledger is open.
+ *     MATAMAZOM_SUCCESS - otherwise.
+ */
+MatamazomResult mtmOpenLedger(Matamazom matamazom, const char *path,
+                              size_t capacity);
+
+/**
+ * mtmCloseLedger: stop recording shipments, writing the ledger to its file
+ * first. Also done by matamazomDestroy.
+ *
+ * @param matamazom - a Matamazom products.
+ * @return
+ *     MATAMAZOM_NULL_ARGUMENT - if a NULL argument is passed.
+ *     MATAMAZOM_SUCCESS - otherwise, even if no ledger was open.
+ */
+MatamazomResult mtmCloseLedger(Matamazom matamazom);
+
+/**
+ * mtmGetLedgerTime: get the current time of the shipment ledger, to make the
+ * windows of queries with. Shipments recorded from now on will have at least
+ * this time.
+ *
+ * The time is that of the real time clock (CLOCK_REALTIME), in nanoseconds
+ * since the epoch, rather than of a monotonic clock, which restarts on every
+ * boot: a ledger in a file outlives the process, and its times must keep
+ * increasing when it's opened after a reboot. If the clock is set back, the
+ * time stays at that of the last shipment recorded until the clock passes it.
+ *
+ * @param matamazom - a Matamazom products.
+ * @return The time, or 0 if matamazom is NULL.
+ */
+uint64_t mtmGetLedgerTime(Matamazom matamazom);
+
+/**
+ * mtmGetLedgerRevenue: sum the prices of the shipments recorded in the
+ * shipment ledger that match a query.
+ *
+ * The shipments are sorted by time, so only the chunks of the ledger that
+ * overlap the query's window are scanned, and only their columns of product
+ * ids and prices.
+ *
+ * @param matamazom - a Matamazom products.
+ * @param query - which shipments to sum.
+ * @param outRevenue - returns the sum of their prices.
+ * @param outShipments - returns how many shipments were summed. May be NULL.
+ * @return
+ *     MATAMAZOM_NULL_ARGUMENT - if a NULL argument is passed.
+ *     MATAMAZOM_SUCCESS - otherwise. If no ledger is open, the revenue is 0.
+ */
+MatamazomResult mtmGetLedgerRevenue(Matamazom matamazom,
+                                    const MtmLedgerQuery *query,
+                                    double *outRevenue,
+                                    size_t *outShipments);
+
 /**
  * mtmPrintInventory: print a Matamazom products and its contents as
  * explained in the *.pdf
@@ -294,10 +1048,89 @@ MatamazomResult mtmCancelOrder(Matamazom matamazom, const unsigned int orderId);
  * @param output - an open, writable output stream, to which the contents are printed.
  * @return
  *     MATAMAZOM_NULL_ARGUMENT - if a NULL argument is passed.
+ *     MATAMAZOM_OUT_OF_MEMORY - in case of memory allocation failure.
  *     MATAMAZOM_SUCCESS - if printed successfully.
  */
 MatamazomResult mtmPrintInventory(Matamazom matamazom, FILE *output);
 
+/**
+ * mtmPrintInventoryRange: print the products of a Matamazom products whose ids
+ * are in the range [fromId, toId), in the same format as mtmPrintInventory
+ * (including its heading).
+ *
+ * The range is found by binary search over the products, so printing k
+ * products takes O(log n + k), except when products were added or removed
+ * since the last print, which takes a single pass over all of them.
+ *
+ * @param matamazom - a Matamazom products to print.
+ * @param fromId - the smallest id to print.
+ * @param toId - the id following the biggest id to print. If it isn't bigger
+ *     than fromId, only the heading is printed.
+ * @param output - an open, writable output stream, to which the contents are printed.
+ * @return
+ *     MATAMAZOM_NULL_ARGUMENT - if a NULL argument is passed.
+ *     MATAMAZOM_OUT_OF_MEMORY - in case of memory allocation failure.
+ *     MATAMAZOM_SUCCESS - if printed successfully.
+ */
+MatamazomResult mtmPrintInventoryRange(Matamazom matamazom,
+                                       const unsigned int fromId,
+                                       const unsigned int toId, FILE *output);
+
+/**
+ * mtmPrintInventoryParallel: print a Matamazom products and its contents
+ * exactly as mtmPrintInventory does, using several threads.
+ *
+ * The products are split into consecutive ranges of ids, one per worker, and
+ * each worker formats its range (including calling the products'
+ * MtmGetProductPrice functions) into a buffer of its own. The buffers are then
+ * written to output in order, so the output is identical to that of
+ * mtmPrintInventory. Nothing is printed if the function fails.
+ *
+ * The MtmGetProductPrice functions of the products are called concurrently, so
+ * they must be thread safe, and the Matamazom products must not be changed
+ * while it is printed.
+ *
+ * @param matamazom - a Matamazom products to print.
+ * @param output - an open, writable output stream, to which the contents are printed.
+ * @param workers - the number of threads to use, including the calling thread.
+ *     0 or 1 print in the calling thread only.
+ * @return
+ *     MATAMAZOM_NULL_ARGUMENT - if a NULL argument is passed.
+ *     MATAMAZOM_OUT_OF_MEMORY - in case of memory allocation failure.
+ *     MATAMAZOM_SUCCESS - if printed successfully.
+ */
+MatamazomResult mtmPrintInventoryParallel(Matamazom matamazom, FILE *output,
+                                          unsigned int workers);
+
+/**
+ * mtmAggregate: get the totals of all the products of a Matamazom products:
+ * their total income, the total amount in stock of each amount type, and the
+ * value of the stock (the sum of the prices of the amounts in stock, as given
+ * by the products' MtmGetProductPrice functions).
+ *
+ * The sums are compensated, so they don't lose precision over many products.
+ * The totals are kept until a product changes, so asking for them again costs
+ * nothing, and the price of each product's stock is kept until its amount
+ * changes, so only the products which changed are priced again. The sums are
+ * made in consecutive ranges of products, one per worker.
+ *
+ * The MtmGetProductPrice functions of the products are called concurrently if
+ * there is more than one worker, so they must be thread safe. In concurrent
+ * mode (@see mtmSetConcurrentMode) the amounts are those from before it was
+ * enabled.
+ *
+ * @param matamazom - a Matamazom products.
+ * @param outTotals - returns the totals.
+ * @param workers - the number of threads to use, including the calling thread.
+ *     0 or 1 sum in the calling thread only.
+ * @return
+ *     MATAMAZOM_NULL_ARGUMENT - if a NULL argument is passed.
+ *     MATAMAZOM_OUT_OF_MEMORY - in case of memory allocation failure.
+ *     MATAMAZOM_SUCCESS - otherwise.
+ */
+MatamazomResult mtmAggregate(Matamazom matamazom, MtmTotals *outTotals,
+                             unsigned int workers);
+
 /**
  * matamazomPrintOrder: print a summary of an order from a Matamazom products,
  * as explained in the *.pdf
@@ -324,6 +1157,7 @@ mtmPrintOrder(Matamazom matamazom, const unsigned int orderId, FILE *output);
  * @param output - an open, writable output stream, to which the order is printed.
  * @return
  *     MATAMAZOM_NULL_ARGUMENT - if a NULL argument is passed.
+ *     MATAMAZOM_OUT_OF_MEMORY - in case of memory allocation failure.
  *     MATAMAZOM_SUCCESS - if printed successfully.
  */
 MatamazomResult mtmPrintBestSelling(Matamazom matamazom, FILE *output);
@@ -342,10 +1176,157 @@ MatamazomResult mtmPrintBestSelling(Matamazom matamazom, FILE *output);
  * @param output - an open, writable output stream, to which the order is printed.
  * @return
  *     MATAMAZOM_NULL_ARGUMENT - if a NULL argument is passed.
+ *     MATAMAZOM_OUT_OF_MEMORY - in case of memory allocation failure.
  *     MATAMAZOM_SUCCESS - if printed successfully.
  */
 MatamazomResult
 mtmPrintFiltered(Matamazom matamazom, MtmFilterProduct customFilter,
                  FILE *output);
 
+/**
+ * mtmFilterProducts: find the products of a Matamazom products which pass a
+ * declarative filter.
+ *
+ * The simple predicates of the filter are evaluated together over all of the
+ * products, which is much faster than calling a MtmFilterProduct for each
+ * product. The residual filter, if there is one, is called only for products
+ * which passed all of the simple predicates.
+ *
+ * @param matamazom - a Matamazom products.
+ * @param spec - the filter to apply.
+ * @param outIds - a buffer of maxIds ids, to which the ids of the matching
+ *     products are written in increasing order. May be NULL if maxIds is 0.
+ * @param maxIds - the capacity of outIds. Matching products beyond it are
+ *     counted but not written.
+ * @param outCount - returns the number of matching products, which may be
+ *     larger than maxIds.
+ * @return
+ *     MATAMAZOM_NULL_ARGUMENT - if a NULL argument is passed (including a NULL
+ *         name_prefix when MTM_FILTER_NAME_PREFIX is set).
+ *     MATAMAZOM_OUT_OF_MEMORY - in case of memory allocation failure.
+ *     MATAMAZOM_SUCCESS - if the products were filtered successfully.
+ */
+MatamazomResult mtmFilterProducts(Matamazom matamazom, const MtmFilterSpec *spec,
+                                  unsigned int *outIds, size_t maxIds,
+                                  size_t *outCount);
+
+/**
+ * mtmForEachProduct: call a function for every product of a Matamazom
+ * products, in increasing order of ids.
+ *
+ * The products must not be changed by the visitor.
+ *
+ * @param matamazom - a Matamazom products.
+ * @param visitor - the function to call for every product.
+ * @param context - passed to every call of visitor.
+ * @return
+ *     MATAMAZOM_NULL_ARGUMENT - if a NULL argument is passed.
+ *     MATAMAZOM_OUT_OF_MEMORY - in case of memory allocation failure.
+ *     MATAMAZOM_SUCCESS - if all the products were visited, or the visitor
+ *         stopped.
+ */
+MatamazomResult mtmForEachProduct(Matamazom matamazom,
+                                  MtmProductVisitor visitor, void *context);
+
+/**
+ * mtmGetLowStock: find the products of a Matamazom products with the smallest
+ * amounts, e.g. to know what to restock.
+ *
+ * The amounts of the products are kept in an index which is built on the first
+ * call (or when the first watermark is set), and which is then updated by every
+ * change of an amount. Finding k products takes O(k log k).
+ *
+ * @param matamazom - a Matamazom products.
+ * @param threshold - only products whose amount is smaller than threshold are
+ *     found.
+ * @param outIds - a buffer of maxIds ids, to which the ids of the found
+ *     products are written in increasing order of amounts (and of ids, for
+ *     equal amounts). May be NULL if maxIds is 0.
+ * @param maxIds - the maximal number of products to find.
+ * @param outCount - returns the number of products found, at most maxIds.
+ * @return
+ *     MATAMAZOM_NULL_ARGUMENT - if a NULL argument is passed.
+ *     MATAMAZOM_OUT_OF_MEMORY - in case of memory allocation failure.
+ *     MATAMAZOM_SUCCESS - otherwise.
+ */
+MatamazomResult mtmGetLowStock(Matamazom matamazom, const double threshold,
+                               unsigned int *outIds, size_t maxIds,
+                               size_t *outCount);
+
+/**
+ * mtmSetLowStockWatermark: set a low-stock watermark for all the products of a
+ * Matamazom products.
+ *
+ * Whenever mtmChangeProductAmount or mtmShipOrder makes the amount of a
+ * product drop from at least watermark to below it, callback is called with
+ * the product's id and new amount. Products with a watermark of their own
+ * (@see mtmSetProductLowStockWatermark) use it instead. The callback must not
+ * change the Matamazom products.
+ *
+ * @param matamazom - a Matamazom products.
+ * @param watermark - the watermark.
+ * @param callback - the function to call, or NULL to remove the watermark.
+ * @param context - passed to callback as is.
+ * @return
+ *     MATAMAZOM_NULL_ARGUMENT - if a NULL matamazom is passed.
+ *     MATAMAZOM_OUT_OF_MEMORY - in case of memory allocation failure.
+ *     MATAMAZOM_SUCCESS - otherwise.
+ */
+MatamazomResult mtmSetLowStockWatermark(Matamazom matamazom,
+                                        const double watermark,
+                                        MtmLowStockCallback callback,
+                                        void *context);
+
+/**
+ * mtmSetProductLowStockWatermark: set a low-stock watermark for a single
+ * product, which replaces the watermark set by mtmSetLowStockWatermark for
+ * it. The watermark is removed when the product is cleared.
+ *
+ * @param matamazom - a Matamazom products.
+ * @param id - the id of the product.
+ * @param watermark - the watermark.
+ * @param callback - the function to call, or NULL to remove the watermark of
+ *     the product.
+ * @param context - passed to callback as is.
+ * @return
+ *     MATAMAZOM_NULL_ARGUMENT - if a NULL matamazom is passed.
+ *     MATAMAZOM_PRODUCT_NOT_EXIST - if matamazom does not contain a product with
+ *         the given id.
+ *     MATAMAZOM_OUT_OF_MEMORY - in case of memory allocation failure.
+ *     MATAMAZOM_SUCCESS - otherwise.
+ */
+MatamazomResult mtmSetProductLowStockWatermark(Matamazom matamazom,
+                                               const unsigned int id,
+                                               const double watermark,
+                                               MtmLowStockCallback callback,
+                                               void *context);
+
+/**
+ * mtmGetMetrics: copy the metrics collected so far for a Matamazom products.
+ *
+ * Metrics are collected only when the library is built with
+ * MTM_ENABLE_METRICS defined. Otherwise the instrumentation is compiled out
+ * and all the returned counters are zero.
+ *
+ * @param matamazom - a Matamazom products.
+ * @param outMetrics - pointer to where the metrics are copied.
+ * @return
+ *     MATAMAZOM_NULL_ARGUMENT - if a NULL argument is passed.
+ *     MATAMAZOM_SUCCESS - if the metrics were copied successfully.
+ */
+MatamazomResult mtmGetMetrics(Matamazom matamazom, MtmMetrics *outMetrics);
+
+/**
+ * mtmPrintMetrics: print the metrics collected so far for a Matamazom
+ * products, one line per public function followed by its non-empty latency
+ * buckets, and a summary of the internal linear searches.
+ *
+ * @param matamazom - a Matamazom products.
+ * @param output - an open, writable output stream, to which the metrics are printed.
+ * @return
+ *     MATAMAZOM_NULL_ARGUMENT - if a NULL argument is passed.
+ *     MATAMAZOM_SUCCESS - if printed successfully.
+ */
+MatamazomResult mtmPrintMetrics(Matamazom matamazom, FILE *output);
+
 #endif /* MATAMAZOM_H_ */
@@ -0,0 +1,182 @@
+/* clock_gettime is POSIX, and isn't declared by a strict C99 <time.h> */
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <time.h>
+#include <pthread.h>
+#include "matamazom.h"
+
+/**
+ * matamazom_bench - measures how concurrent amount changes scale with threads
+ *
+ * usage: matamazom_bench [products] [changes per thread] [max threads]
+ *
+ * For 1, 2, 4, ... up to 'max threads' threads, every thread changes the
+ * amounts of products, adding and then taking back a unit each time:
+ *   locked   - a mutex around mtmChangeProductAmount, of random products
+ *   spread   - concurrent mode (@see mtmSetConcurrentMode), random products
+ *   hot      - concurrent mode, all the threads change the same product
+ * and the total number of changes per second is printed for each.
+ */
+
+#define DEFAULT_PRODUCTS 1000
+#define DEFAULT_CHANGES 1000000
+#define DEFAULT_MAX_THREADS 8
+#define INITIAL_AMOUNT 1e6
+#define NANO_IN_SECOND 1e9
+
+typedef enum BenchMode_t {
+  BENCH_LOCKED,
+  BENCH_SPREAD,
+  BENCH_HOT
+} BenchMode;
+
+typedef struct Worker_t {
+  Matamazom matamazom;
+  pthread_mutex_t *lock;
+  BenchMode mode;
+  unsigned int products;
+  unsigned int changes;
+  unsigned int seed;
+  bool failed;
+} Worker;
+
+static MtmProductData copyPrice(MtmProductData price) {
+  double *copy = malloc(sizeof(*copy));
+  if (copy != NULL) {
+    *copy = *(double *) price;
+  }
+  return copy;
+}
+
+static void freePrice(MtmProductData price) {
+  free(price);
+}
+
+static double getPrice(MtmProductData price, const double amount) {
+  return *(double *) price * amount;
+}
+
+static double now() {
+  struct timespec time;
+  clock_gettime(CLOCK_MONOTONIC, &time);
+  return (double) time.tv_sec + (double) time.tv_nsec / NANO_IN_SECOND;
+}
+
+static void *runWorker(void *argument) {
+  Worker *worker = argument;
+  for (unsigned int change = 0; change < worker->changes; change++) {
+    unsigned int id = worker->mode == BENCH_HOT ? 1 :
+                      (unsigned int) rand_r(&worker->seed) % worker->products
+                      + 1;
+    // the unit added is taken back by the next change
+    double amount = change % 2 == 0 ? 1 : -1;
+    if (worker->lock != NULL) {
+      pthread_mutex_lock(worker->lock);
+    }
+    MatamazomResult result = mtmChangeProductAmount(worker->matamazom, id,
+                                                    amount);
+    if (worker->lock != NULL) {
+      pthread_mutex_unlock(worker->lock);
+    }
+    worker->failed = worker->failed || result != MATAMAZOM_SUCCESS;
+  }
+  return NULL;
+}
+
+/* returns the number of changes per second, or a negative number if some
+ * change failed */
+static double runBenchmark(Matamazom matamazom, BenchMode mode,
+                           unsigned int threads, unsigned int products,
+                           unsigned int changes) {
+  pthread_mutex_t lock;
+  pthread_mutex_init(&lock, NULL);
+  Worker *workers = calloc(threads, sizeof(*workers));
+  pthread_t *ids = calloc(threads, sizeof(*ids));
+  if (workers == NULL || ids == NULL) {
+    free(workers);
+    free(ids);
+    return -1;
+  }
+  if (mode != BENCH_LOCKED) {
+    mtmSetConcurrentMode(matamazom, true);
+  }
+  double start = now();
+  unsigned int started = 0;
+  for (unsigned int i = 0; i < threads; i++) {
+    workers[i] = (Worker) {.matamazom = matamazom,
+        .lock = mode == BENCH_LOCKED ? &lock : NULL, .mode = mode,
+        .products = products, .changes = changes, .seed = i + 1};
+    if (pthread_create(&ids[i], NULL, runWorker, &workers[i]) != 0) {
+      break;
+    }
+    started++;
+  }
+  bool failed = started < threads;
+  for (unsigned int i = 0; i < started; i++) {
+    pthread_join(ids[i], NULL);
+    failed = failed || workers[i].failed;
+  }
+  double seconds = now() - start;
+  if (mode != BENCH_LOCKED) {
+    failed = failed ||
+        mtmSetConcurrentMode(matamazom, false) != MATAMAZOM_SUCCESS;
+  }
+  pthread_mutex_destroy(&lock);
+  free(workers);
+  free(ids);
+  return failed ? -1 : (double) threads * changes / seconds;
+}
+
+static unsigned int argumentOr(int argc, char **argv, int index,
+                               unsigned int default_value) {
+  return argc > index && atoi(argv[index]) > 0 ? (unsigned int) atoi(argv[index])
+                                               : default_value;
+}
+
+int main(int argc, char **argv) {
+  unsigned int products = argumentOr(argc, argv, 1, DEFAULT_PRODUCTS);
+  unsigned int changes = argumentOr(argc, argv, 2, DEFAULT_CHANGES);
+  unsigned int max_threads = argumentOr(argc, argv, 3, DEFAULT_MAX_THREADS);
+  Matamazom matamazom = matamazomCreate();
+  if (matamazom == NULL) {
+    fprintf(stderr, "matamazom_bench: out of memory\n");
+    return 1;
+  }
+  // the products are added in decreasing order, for the list's sake
+  for (unsigned int id = products; id >= 1; id--) {
+    double price = 1 + id % 100;
+    if (mtmNewProduct(matamazom, id, "Product", INITIAL_AMOUNT,
+                      MATAMAZOM_INTEGER_AMOUNT, &price, copyPrice, freePrice,
+                      getPrice) != MATAMAZOM_SUCCESS) {
+      fprintf(stderr, "matamazom_bench: can't add the products\n");
+      matamazomDestroy(matamazom);
+      return 1;
+    }
+  }
+  const char *names[] = {"locked", "spread", "hot"};
+  printf("%u products, %u changes per thread, changes/s:\n", products,
+         changes);
+  printf("threads %14s %14s %14s\n", names[0], names[1], names[2]);
+  for (unsigned int threads = 1; threads <= max_threads; threads *= 2) {
+    printf("%7u", threads);
+    for (BenchMode mode = BENCH_LOCKED; mode <= BENCH_HOT; mode++) {
+      // the locked changes search a list, so fewer of them are made
+      unsigned int mode_changes = mode == BENCH_LOCKED ?
+                                  changes / 100 + 1 : changes;
+      double rate = runBenchmark(matamazom, mode, threads, products,
+                                 mode_changes);
+      if (rate < 0) {
+        printf("\nmatamazom_bench: a change failed\n");
+        matamazomDestroy(matamazom);
+        return 1;
+      }
+      printf(" %14.0f", rate);
+    }
+    printf("\n");
+  }
+  matamazomDestroy(matamazom);
+  return 0;
+}
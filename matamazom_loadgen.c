@@ -0,0 +1,295 @@
+/* sockets and clock_gettime are POSIX, and aren't declared by a strict C99
+ * library */
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "matamazom.h"
+#include "matamazom_protocol.h"
+
+/**
+ * matamazom_loadgen - measures the throughput and latency of matamazomd
+ *
+ * usage: matamazom_loadgen [socket path] [connections] [frames per connection]
+ *                          [frames in flight] [requests per frame]
+ *
+ * Adds PRODUCT_COUNT products, and then every connection (in a thread of its
+ * own) sends frames of requests which add to and take from the amounts of
+ * random products, keeping up to 'frames in flight' frames unanswered. The
+ * latency of a frame is the time from sending it until its responses were
+ * received, so with a single request per frame it's the latency of a request.
+ */
+
+#define DEFAULT_SOCKET_PATH "/tmp/matamazomd.sock"
+#define DEFAULT_CONNECTIONS 4
+#define DEFAULT_FRAMES 20000
+#define DEFAULT_IN_FLIGHT 16
+#define DEFAULT_BATCH 8
+#define PRODUCT_COUNT 1000
+#define INITIAL_AMOUNT 1e9
+#define READ_SIZE 65536
+#define NANO_IN_SECOND 1000000000ULL
+
+typedef struct Client_t {
+  const char *path;
+  unsigned int frames;
+  unsigned int in_flight;
+  unsigned int batch;
+  unsigned int seed;
+  uint64_t *latencies; // of every frame, in nanoseconds
+  unsigned long failures;
+  bool failed;
+} Client;
+
+static uint64_t now() {
+  struct timespec time;
+  clock_gettime(CLOCK_MONOTONIC, &time);
+  return (uint64_t) time.tv_sec * NANO_IN_SECOND + (uint64_t) time.tv_nsec;
+}
+
+static int connectTo(const char *path) {
+  struct sockaddr_un address;
+  memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  strncpy(address.sun_path, path, sizeof(address.sun_path) - 1);
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd >= 0 &&
+      connect(fd, (struct sockaddr *) &address, sizeof(address)) != 0) {
+    close(fd);
+    fd = -1;
+  }
+  return fd;
+}
+
+static bool sendAll(int fd, const char *data, size_t size) {
+  while (size > 0) {
+    ssize_t result = send(fd, data, size, MSG_NOSIGNAL);
+    if (result < 0 && errno == EINTR) {
+      continue;
+    }
+    if (result <= 0) {
+      return false;
+    }
+    data += result;
+    size -= (size_t) result;
+  }
+  return true;
+}
+
+/* receiving until the buffer starts with a complete frame, and returning its
+ * length, or 0 on failure */
+static size_t receiveFrame(int fd, MtmBuffer *input) {
+  size_t length;
+  while ((length = mtmFrameLength(input->data, input->size)) == 0) {
+    if (!mtmBufferReserve(input, READ_SIZE)) {
+      return 0;
+    }
+    ssize_t result = recv(fd, input->data + input->size, READ_SIZE, 0);
+    if (result < 0 && errno == EINTR) {
+      continue;
+    }
+    if (result <= 0) {
+      return 0;
+    }
+    input->size += (size_t) result;
+  }
+  return length;
+}
+
+/* counting the failed responses of a frame */
+static unsigned long countFailures(const char *frame, size_t length) {
+  MtmReader reader;
+  uint32_t count = 0;
+  mtmReaderInit(&reader, frame, length, &count);
+  unsigned long failures = 0;
+  MtmMessage message;
+  for (uint32_t index = 0; index < count; index++) {
+    if (!mtmReadMessage(&reader, &message)) {
+      return failures + count - index;
+    }
+    failures += message.code != MATAMAZOM_SUCCESS;
+  }
+  return failures;
+}
+
+static bool appendChange(MtmBuffer *output, size_t start, uint32_t tag,
+                         uint32_t id, double amount) {
+  char arguments[2 * sizeof(uint32_t) + sizeof(double)];
+  const uint32_t reserved = 0;
+  memcpy(arguments, &id, sizeof(id));
+  memcpy(arguments + sizeof(id), &reserved, sizeof(reserved));
+  memcpy(arguments + 2 * sizeof(uint32_t), &amount, sizeof(amount));
+  return mtmFrameMessage(output, start, tag, MTM_OP_CHANGE_PRODUCT_AMOUNT,
+                         arguments, sizeof(arguments));
+}
+
+static void *runClient(void *argument) {
+  Client *client = argument;
+  client->failed = true;
+  int fd = connectTo(client->path);
+  if (fd < 0) {
+    return NULL;
+  }
+  MtmBuffer output;
+  MtmBuffer input;
+  mtmBufferInit(&output);
+  mtmBufferInit(&input);
+  // the sending times of the unanswered frames, in a ring
+  uint64_t *sent = malloc(client->in_flight * sizeof(*sent));
+  unsigned int next_sent = 0;
+  unsigned int received = 0;
+  uint32_t tag = 0;
+  while (sent != NULL && received < client->frames) {
+    // keeping the pipeline full
+    while (next_sent < client->frames &&
+           next_sent - received < client->in_flight) {
+      size_t start;
+      output.size = 0;
+      if (!mtmFrameBegin(&output, &start)) {
+        goto done;
+      }
+      for (unsigned int request = 0; request < client->batch; request++) {
+        uint32_t id = (uint32_t) (rand_r(&client->seed) % PRODUCT_COUNT) + 1;
+        // the amounts are taken back by the next frame, so they never run out
+        double amount = next_sent % 2 == 0 ? 1 : -1;
+        if (!appendChange(&output, start, tag++, id, amount)) {
+          goto done;
+        }
+      }
+      mtmFrameEnd(&output, start);
+      sent[next_sent % client->in_flight] = now();
+      if (!sendAll(fd, output.data, output.size)) {
+        goto done;
+      }
+      next_sent++;
+    }
+    size_t length = receiveFrame(fd, &input);
+    if (length == 0) {
+      goto done;
+    }
+    client->latencies[received] = now() - sent[received % client->in_flight];
+    client->failures += countFailures(input.data, length);
+    mtmBufferConsume(&input, length);
+    received++;
+  }
+  client->failed = sent == NULL;
+done:
+  free(sent);
+  mtmBufferRelease(&output);
+  mtmBufferRelease(&input);
+  close(fd);
+  return NULL;
+}
+
+/* adding the products, in a single frame */
+static bool addProducts(const char *path) {
+  int fd = connectTo(path);
+  if (fd < 0) {
+    return false;
+  }
+  MtmBuffer buffer;
+  mtmBufferInit(&buffer);
+  size_t start;
+  bool succeeded = mtmFrameBegin(&buffer, &start);
+  for (uint32_t id = 1; succeeded && id <= PRODUCT_COUNT; id++) {
+    char arguments[2 * sizeof(uint32_t) + 2 * sizeof(double) + 32];
+    const uint32_t type = MATAMAZOM_INTEGER_AMOUNT;
+    const double amount = INITIAL_AMOUNT;
+    const double price = 1 + id % 100;
+    int name_length = sprintf(arguments + 2 * sizeof(uint32_t) +
+                              2 * sizeof(double), "Product %u", id);
+    memcpy(arguments, &id, sizeof(id));
+    memcpy(arguments + sizeof(id), &type, sizeof(type));
+    memcpy(arguments + 2 * sizeof(uint32_t), &amount, sizeof(amount));
+    memcpy(arguments + 2 * sizeof(uint32_t) + sizeof(double), &price,
+           sizeof(price));
+    succeeded = mtmFrameMessage(&buffer, start, id, MTM_OP_NEW_PRODUCT,
+                                arguments, (uint32_t) (2 * sizeof(uint32_t) +
+                                                       2 * sizeof(double) +
+                                                       name_length));
+  }
+  mtmFrameEnd(&buffer, start);
+  succeeded = succeeded && sendAll(fd, buffer.data, buffer.size);
+  buffer.size = 0;
+  // products left by an earlier run already exist, which is fine
+  succeeded = succeeded && receiveFrame(fd, &buffer) > 0;
+  mtmBufferRelease(&buffer);
+  close(fd);
+  return succeeded;
+}
+
+static int compareLatencies(const void *latency1, const void *latency2) {
+  uint64_t value1 = *(const uint64_t *) latency1;
+  uint64_t value2 = *(const uint64_t *) latency2;
+  return (value1 > value2) - (value1 < value2);
+}
+
+static unsigned int argumentOr(int argc, char **argv, int index,
+                               unsigned int default_value) {
+  return argc > index && atoi(argv[index]) > 0 ? (unsigned int) atoi(argv[index])
+                                               : default_value;
+}
+
+int main(int argc, char **argv) {
+  const char *path = argc > 1 ? argv[1] : DEFAULT_SOCKET_PATH;
+  unsigned int connections = argumentOr(argc, argv, 2, DEFAULT_CONNECTIONS);
+  unsigned int frames = argumentOr(argc, argv, 3, DEFAULT_FRAMES);
+  unsigned int in_flight = argumentOr(argc, argv, 4, DEFAULT_IN_FLIGHT);
+  unsigned int batch = argumentOr(argc, argv, 5, DEFAULT_BATCH);
+  if (!addProducts(path)) {
+    fprintf(stderr, "matamazom_loadgen: can't reach %s\n", path);
+    return 1;
+  }
+  Client *clients = calloc(connections, sizeof(*clients));
+  pthread_t *threads = calloc(connections, sizeof(*threads));
+  uint64_t *latencies = malloc((size_t) connections * frames *
+                               sizeof(*latencies));
+  if (clients == NULL || threads == NULL || latencies == NULL) {
+    fprintf(stderr, "matamazom_loadgen: out of memory\n");
+    return 1;
+  }
+  uint64_t start = now();
+  for (unsigned int index = 0; index < connections; index++) {
+    clients[index] = (Client) {.path = path, .frames = frames,
+        .in_flight = in_flight, .batch = batch, .seed = index + 1,
+        .latencies = latencies + (size_t) index * frames};
+    if (pthread_create(&threads[index], NULL, runClient,
+                       &clients[index]) != 0) {
+      fprintf(stderr, "matamazom_loadgen: can't create a thread\n");
+      return 1;
+    }
+  }
+  unsigned long failures = 0;
+  bool failed = false;
+  for (unsigned int index = 0; index < connections; index++) {
+    pthread_join(threads[index], NULL);
+    failures += clients[index].failures;
+    failed = failed || clients[index].failed;
+  }
+  double seconds = (double) (now() - start) / NANO_IN_SECOND;
+  if (failed) {
+    fprintf(stderr, "matamazom_loadgen: a connection failed\n");
+    return 1;
+  }
+  size_t count = (size_t) connections * frames;
+  qsort(latencies, count, sizeof(*latencies), compareLatencies);
+  double requests = (double) count * batch;
+  printf("connections: %u, frames in flight: %u, requests per frame: %u\n",
+         connections, in_flight, batch);
+  printf("requests: %.0f in %.3f s, %.0f requests/s, %lu failed\n",
+         requests, seconds, requests / seconds, failures);
+  printf("frame latency: p50 %.1f us, p99 %.1f us, max %.1f us\n",
+         latencies[count / 2] / 1e3, latencies[count * 99 / 100] / 1e3,
+         latencies[count - 1] / 1e3);
+  free(clients);
+  free(threads);
+  free(latencies);
+  return 0;
+}
@@ -0,0 +1,105 @@
+/* clock_gettime is POSIX, and isn't declared by a strict C99 <time.h> */
+#define _POSIX_C_SOURCE 199309L
+
+#include "matamazom_metrics.h"
+#include <time.h>
+
+#define NANO_IN_SECOND 1000000000ULL
+
+static const char *const api_names[MTM_METRICS_API_COUNT] = {
+    "mtmNewProduct",
+    "mtmChangeProductAmount",
+    "mtmClearProduct",
+    "mtmCreateNewOrder",
+    "mtmChangeProductAmountInOrder",
+    "mtmShipOrder",
+    "mtmCancelOrder",
+    "mtmPrintInventory",
+    "mtmPrintInventoryParallel",
+    "mtmPrintOrder",
+    "mtmPrintBestSelling",
+    "mtmPrintFiltered",
+    "mtmFilterProducts",
+    "mtmGetLowStock",
+    "mtmImportProducts",
+    "mtmPrintInventoryRange",
+    "mtmMergeOrders",
+    "mtmCheckOrders",
+    "mtmAggregate",
+    "mtmCloneOrder",
+    "mtmChangeProductAmounts",
+    "mtmCommit",
+    "mtmAbort"
+};
+
+#ifdef MTM_ENABLE_METRICS
+
+uint64_t mtmMetricsNow() {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t) now.tv_sec * NANO_IN_SECOND + (uint64_t) now.tv_nsec;
+}
+
+/* the index of the highest set bit, which is the log-2 bucket of the value */
+static int latencyBucket(uint64_t elapsed) {
+  int bucket = 0;
+  while (elapsed > 1 && bucket < MTM_METRICS_LATENCY_BUCKETS - 1) {
+    elapsed >>= 1;
+    bucket++;
+  }
+  return bucket;
+}
+
+void mtmMetricsRecordCall(MtmMetrics *metrics, MtmMetricsApi api,
+                          uint64_t start, bool failed) {
+  uint64_t elapsed = mtmMetricsNow() - start;
+  MtmApiMetrics *api_metrics = &metrics->api[api];
+  api_metrics->calls++;
+  if (failed) {
+    api_metrics->errors++;
+  }
+  api_metrics->latency[latencyBucket(elapsed)]++;
+}
+
+void mtmMetricsRecordWalk(MtmWalkMetrics *walk, uint64_t steps) {
+  walk->lookups++;
+  walk->steps += steps;
+  if (steps > walk->max_steps) {
+    walk->max_steps = steps;
+  }
+}
+
+#endif /* MTM_ENABLE_METRICS */
+
+static void printWalk(const char *name, const MtmWalkMetrics *walk,
+                      FILE *output) {
+  double average = walk->lookups == 0 ? 0 :
+                   (double) walk->steps / (double) walk->lookups;
+  fprintf(output, "%s: lookups: %llu, average steps: %.3f, max steps: %llu\n",
+          name, (unsigned long long) walk->lookups, average,
+          (unsigned long long) walk->max_steps);
+}
+
+void mtmMetricsPrint(const MtmMetrics *metrics, FILE *output) {
+  fprintf(output, "Metrics:\n");
+  for (int api = 0; api < MTM_METRICS_API_COUNT; api++) {
+    const MtmApiMetrics *api_metrics = &metrics->api[api];
+    fprintf(output, "%s: calls: %llu, errors: %llu\n", api_names[api],
+            (unsigned long long) api_metrics->calls,
+            (unsigned long long) api_metrics->errors);
+    for (int bucket = 0; bucket < MTM_METRICS_LATENCY_BUCKETS; bucket++) {
+      if (api_metrics->latency[bucket] == 0) {
+        continue;
+      }
+      if (bucket == MTM_METRICS_LATENCY_BUCKETS - 1) {
+        fprintf(output, "  >= %lluns: %llu\n", 1ULL << bucket,
+                (unsigned long long) api_metrics->latency[bucket]);
+      } else {
+        fprintf(output, "  < %lluns: %llu\n", 1ULL << (bucket + 1),
+                (unsigned long long) api_metrics->latency[bucket]);
+      }
+    }
+  }
+  printWalk("product lookups", &metrics->product_walks, output);
+  printWalk("order lookups", &metrics->order_walks, output);
+}
@@ -0,0 +1,55 @@
+#ifndef MATAMAZOM_METRICS_H_
+#define MATAMAZOM_METRICS_H_
+
+#include "matamazom.h"
+
+/**
+ * Internal instrumentation helpers for matamazom.c.
+ *
+ * When MTM_ENABLE_METRICS is not defined all the macros below expand to
+ * nothing, so the uninstrumented build pays nothing for them.
+ *
+ *   MTM_METRICS_START  - Declares a variable holding the current time
+ *   MTM_METRICS_STOP   - Records a call of a public function
+ *   MTM_METRICS_WALK   - Records the length of a linear search
+ */
+
+#ifdef MTM_ENABLE_METRICS
+
+/** Returns the time of a monotonic clock, in nanoseconds */
+uint64_t mtmMetricsNow();
+
+/** Records a single call to a public function that started at 'start' */
+void mtmMetricsRecordCall(MtmMetrics *metrics, MtmMetricsApi api,
+                          uint64_t start, bool failed);
+
+/** Records a single linear search that visited 'steps' elements */
+void mtmMetricsRecordWalk(MtmWalkMetrics *walk, uint64_t steps);
+
+#define MTM_METRICS_START(start) uint64_t start = mtmMetricsNow()
+#define MTM_METRICS_STOP(matamazom, api, start, failed)                     \
+    do {                                                                    \
+      if ((matamazom) != NULL) {                                            \
+        mtmMetricsRecordCall(&(matamazom)->metrics, (api), (start),         \
+                             (failed));                                     \
+      }                                                                     \
+    } while (0)
+#define MTM_METRICS_WALK(matamazom, walk, steps)                            \
+    do {                                                                    \
+      if ((matamazom) != NULL) {                                            \
+        mtmMetricsRecordWalk(&(matamazom)->metrics.walk, (steps));          \
+      }                                                                     \
+    } while (0)
+
+#else
+
+#define MTM_METRICS_START(start)
+#define MTM_METRICS_STOP(matamazom, api, start, failed) ((void) 0)
+#define MTM_METRICS_WALK(matamazom, walk, steps) ((void) (steps))
+
+#endif /* MTM_ENABLE_METRICS */
+
+/** Prints a metrics structure in the format of mtmPrintMetrics */
+void mtmMetricsPrint(const MtmMetrics *metrics, FILE *output);
+
+#endif /* MATAMAZOM_METRICS_H_ */
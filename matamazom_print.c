@@ -4,6 +4,10 @@ void mtmPrintProductDetails(const char* name, const unsigned int id, const doubl
     fprintf(output,"name: %s, id: %d, amount: %.3f, price: %.3f\n",name, id, amount, price);
 }
 
+void mtmPrintProductDemandDetails(const char* name, const unsigned int id, const double amount, const double price, const double onOrder, FILE* output){
+    fprintf(output,"name: %s, id: %d, amount: %.3f, price: %.3f, on order: %.3f\n",name, id, amount, price, onOrder);
+}
+
 void mtmPrintOrderHeading(const unsigned int orderId, FILE* output){
     fprintf(output,"Order %d Details:\n", orderId);
 }
@@ -9,6 +9,13 @@
  */
 void mtmPrintProductDetails(const char* name, const unsigned int id, const double amount, const double price, FILE* output);
 
+/**
+ * mtmPrintProductDemandDetails: print the details of a single product as
+ * mtmPrintProductDetails does, followed by its amount in all the open orders,
+ * for inventory reports which show the demand (@see mtmSetReportDemand).
+ */
+void mtmPrintProductDemandDetails(const char* name, const unsigned int id, const double amount, const double price, const double onOrder, FILE* output);
+
 /**
  * mtmPrintOrderHeading: print the heading line of an order, as required from
  * mtmPrintOrder.
@@ -0,0 +1,138 @@
+#include "matamazom_protocol.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define INITIAL_CAPACITY 4096
+
+void mtmBufferInit(MtmBuffer *buffer) {
+  buffer->data = NULL;
+  buffer->size = 0;
+  buffer->capacity = 0;
+}
+
+void mtmBufferRelease(MtmBuffer *buffer) {
+  free(buffer->data);
+  mtmBufferInit(buffer);
+}
+
+bool mtmBufferReserve(MtmBuffer *buffer, size_t size) {
+  if (buffer->capacity - buffer->size >= size) {
+    return true;
+  }
+  size_t capacity = buffer->capacity > 0 ? buffer->capacity : INITIAL_CAPACITY;
+  while (capacity - buffer->size < size) {
+    capacity *= 2;
+  }
+  char *data = realloc(buffer->data, capacity);
+  if (data == NULL) {
+    return false;
+  }
+  buffer->data = data;
+  buffer->capacity = capacity;
+  return true;
+}
+
+bool mtmBufferAppend(MtmBuffer *buffer, const void *bytes, size_t size) {
+  if (!mtmBufferReserve(buffer, size)) {
+    return false;
+  }
+  if (size > 0) {
+    memcpy(buffer->data + buffer->size, bytes, size);
+    buffer->size += size;
+  }
+  return true;
+}
+
+void mtmBufferConsume(MtmBuffer *buffer, size_t size) {
+  if (size >= buffer->size) {
+    buffer->size = 0;
+    return;
+  }
+  memmove(buffer->data, buffer->data + size, buffer->size - size);
+  buffer->size -= size;
+}
+
+bool mtmFrameBegin(MtmBuffer *buffer, size_t *outStart) {
+  const uint32_t header[2] = {0, 0};
+  *outStart = buffer->size;
+  return mtmBufferAppend(buffer, header, sizeof(header));
+}
+
+bool mtmFrameMessage(MtmBuffer *buffer, size_t start, uint32_t tag,
+                     uint16_t code, const void *arguments, uint32_t length) {
+  if (!mtmBufferReserve(buffer, MTM_MESSAGE_HEADER_SIZE + length)) {
+    return false;
+  }
+  const uint16_t reserved = 0;
+  mtmBufferAppend(buffer, &tag, sizeof(tag));
+  mtmBufferAppend(buffer, &code, sizeof(code));
+  mtmBufferAppend(buffer, &reserved, sizeof(reserved));
+  mtmBufferAppend(buffer, &length, sizeof(length));
+  mtmBufferAppend(buffer, arguments, length);
+  uint32_t count;
+  memcpy(&count, buffer->data + start + sizeof(uint32_t), sizeof(count));
+  count++;
+  memcpy(buffer->data + start + sizeof(uint32_t), &count, sizeof(count));
+  return true;
+}
+
+void mtmFrameEnd(MtmBuffer *buffer, size_t start) {
+  uint32_t length = (uint32_t) (buffer->size - start - sizeof(uint32_t));
+  memcpy(buffer->data + start, &length, sizeof(length));
+}
+
+size_t mtmFrameLength(const char *data, size_t size) {
+  uint32_t length;
+  if (size < MTM_FRAME_HEADER_SIZE) {
+    return 0;
+  }
+  memcpy(&length, data, sizeof(length));
+  size_t frame_length = (size_t) length + sizeof(length);
+  if (frame_length < MTM_FRAME_HEADER_SIZE) {
+    // a malformed frame, which is reported as too large to be accepted
+    return MTM_MAX_FRAME_SIZE + 1;
+  }
+  return size >= frame_length || frame_length > MTM_MAX_FRAME_SIZE
+         ? frame_length : 0;
+}
+
+void mtmReaderInit(MtmReader *reader, const char *frame, size_t length,
+                   uint32_t *outCount) {
+  memcpy(outCount, frame + sizeof(uint32_t), sizeof(*outCount));
+  reader->data = frame;
+  reader->size = length;
+  reader->offset = MTM_FRAME_HEADER_SIZE;
+}
+
+static bool readBytes(MtmReader *reader, void *bytes, size_t size) {
+  if (reader->size - reader->offset < size) {
+    return false;
+  }
+  memcpy(bytes, reader->data + reader->offset, size);
+  reader->offset += size;
+  return true;
+}
+
+bool mtmReadMessage(MtmReader *reader, MtmMessage *outMessage) {
+  uint16_t reserved;
+  if (!readBytes(reader, &outMessage->tag, sizeof(outMessage->tag)) ||
+      !readBytes(reader, &outMessage->code, sizeof(outMessage->code)) ||
+      !readBytes(reader, &reserved, sizeof(reserved)) ||
+      !readBytes(reader, &outMessage->length, sizeof(outMessage->length)) ||
+      reader->size - reader->offset < outMessage->length) {
+    return false;
+  }
+  outMessage->arguments.data = reader->data + reader->offset;
+  outMessage->arguments.size = outMessage->length;
+  outMessage->arguments.offset = 0;
+  reader->offset += outMessage->length;
+  return true;
+}
+
+bool mtmReadUint32(MtmReader *reader, uint32_t *outValue) {
+  return readBytes(reader, outValue, sizeof(*outValue));
+}
+
+bool mtmReadDouble(MtmReader *reader, double *outValue) {
+  return readBytes(reader, outValue, sizeof(*outValue));
+}
@@ -0,0 +1,223 @@
+#ifndef MATAMAZOM_PROTOCOL_H_
+#define MATAMAZOM_PROTOCOL_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+/**
+ * Binary protocol of matamazomd
+ *
+ * A client sends frames of requests, and the server answers every frame with
+ * a frame of responses, one for each request and in the same order. A client
+ * may send more frames before the responses to the previous ones arrive
+ * (pipelining); the frames of a connection are answered in the order they were
+ * sent in.
+ *
+ * All the numbers are in the byte order of the host, since the server only
+ * serves clients on the same host. A frame is:
+ *   uint32 length   - the number of bytes after this field
+ *   uint32 count    - the number of messages in the frame
+ *   count messages
+ * and a message is:
+ *   uint32 tag      - chosen by the client, and copied to the response
+ *   uint16 code     - the MtmOpcode of a request, or the MatamazomResult of
+ *                     a response
+ *   uint16 reserved - 0
+ *   uint32 length   - the number of bytes of the arguments (or the result)
+ *   length bytes of arguments, as described for every MtmOpcode
+ *
+ * The following functions are available:
+ *   mtmBufferInit        - Initializes an empty buffer
+ *   mtmBufferRelease     - Frees the memory of a buffer
+ *   mtmBufferReserve     - Makes room at the end of a buffer
+ *   mtmBufferAppend      - Appends bytes to a buffer
+ *   mtmBufferConsume     - Removes bytes from the start of a buffer
+ *   mtmFrameBegin        - Starts a frame in a buffer
+ *   mtmFrameEnd          - Completes a frame started by mtmFrameBegin
+ *   mtmFrameMessage      - Appends a message to a frame
+ *   mtmFrameLength       - Returns the length of a complete frame
+ *   mtmReaderInit        - Initializes a reader of a frame's contents
+ *   mtmReadMessage       - Reads the header of the next message
+ *   mtmReadUint32        - Reads a uint32 argument
+ *   mtmReadDouble        - Reads a double argument
+ */
+
+/** The size of a frame's header */
+#define MTM_FRAME_HEADER_SIZE 8
+/** The size of a message's header */
+#define MTM_MESSAGE_HEADER_SIZE 12
+/** The largest frame, including its header, a server accepts */
+#define MTM_MAX_FRAME_SIZE (1u << 24)
+
+/** Requests of the protocol, and their arguments */
+typedef enum MtmOpcode_t {
+  /* uint32 id, uint32 amount type, double amount, double price of a unit,
+   * followed by the name (without a '\0') */
+  MTM_OP_NEW_PRODUCT = 1,
+  /* uint32 id, uint32 0, double amount */
+  MTM_OP_CHANGE_PRODUCT_AMOUNT,
+  /* uint32 id */
+  MTM_OP_CLEAR_PRODUCT,
+  /* nothing. the result has the uint32 id of the new order, or 0 */
+  MTM_OP_CREATE_NEW_ORDER,
+  /* uint32 order id, uint32 product id, double amount */
+  MTM_OP_CHANGE_PRODUCT_AMOUNT_IN_ORDER,
+  /* uint32 order id */
+  MTM_OP_SHIP_ORDER,
+  /* uint32 order id */
+  MTM_OP_CANCEL_ORDER,
+  /* nothing. the result has the printed text */
+  MTM_OP_PRINT_INVENTORY,
+  /* uint32 order id. the result has the printed text */
+  MTM_OP_PRINT_ORDER,
+  /* nothing. the result has the printed text */
+  MTM_OP_PRINT_BEST_SELLING
+} MtmOpcode;
+
+/** A growing byte buffer, whose valid bytes are data[0, size) */
+typedef struct MtmBuffer_t {
+  char *data;
+  size_t size;
+  size_t capacity;
+} MtmBuffer;
+
+/** A reader of the messages of a single frame */
+typedef struct MtmReader_t {
+  const char *data;
+  size_t size;
+  size_t offset;
+} MtmReader;
+
+/** The header of a message */
+typedef struct MtmMessage_t {
+  uint32_t tag;
+  uint16_t code;
+  uint32_t length;
+  MtmReader arguments; // a reader of the message's arguments only
+} MtmMessage;
+
+/**
+ * mtmBufferInit: Initializes an empty buffer, without allocating memory.
+ */
+void mtmBufferInit(MtmBuffer *buffer);
+
+/**
+ * mtmBufferRelease: Frees the memory of a buffer, which is left empty.
+ */
+void mtmBufferRelease(MtmBuffer *buffer);
+
+/**
+ * mtmBufferReserve: Makes sure there's room for at least 'size' more bytes at
+ * the end of a buffer.
+ *
+ * @return
+ *     false if a memory allocation failed, in which case the buffer is unchanged.
+ *     true otherwise.
+ */
+bool mtmBufferReserve(MtmBuffer *buffer, size_t size);
+
+/**
+ * mtmBufferAppend: Appends bytes to the end of a buffer.
+ *
+ * @return
+ *     false if a memory allocation failed, in which case the buffer is unchanged.
+ *     true otherwise.
+ */
+bool mtmBufferAppend(MtmBuffer *buffer, const void *bytes, size_t size);
+
+/**
+ * mtmBufferConsume: Removes 'size' bytes from the start of a buffer.
+ */
+void mtmBufferConsume(MtmBuffer *buffer, size_t size);
+
+/**
+ * mtmFrameBegin: Starts a new frame at the end of a buffer.
+ *
+ * @param buffer - the buffer to append the frame to.
+ * @param outStart - returns the position of the frame in the buffer, for the
+ *     other functions of the frame.
+ * @return
+ *     false if a memory allocation failed.
+ *     true otherwise.
+ */
+bool mtmFrameBegin(MtmBuffer *buffer, size_t *outStart);
+
+/**
+ * mtmFrameMessage: Appends a message to the frame at the end of a buffer.
+ *
+ * @param buffer - the buffer of the frame.
+ * @param start - the position of the frame, as returned by mtmFrameBegin.
+ * @param tag - the tag of the message.
+ * @param code - the opcode of a request, or the result of a response.
+ * @param arguments - the arguments of the message. May be NULL if length is 0.
+ * @param length - the number of bytes of arguments.
+ * @return
+ *     false if a memory allocation failed, in which case the frame is unchanged.
+ *     true otherwise.
+ */
+bool mtmFrameMessage(MtmBuffer *buffer, size_t start, uint32_t tag,
+                     uint16_t code, const void *arguments, uint32_t length);
+
+/**
+ * mtmFrameEnd: Completes the frame at the end of a buffer, by writing its
+ * length.
+ *
+ * @param buffer - the buffer of the frame.
+ * @param start - the position of the frame, as returned by mtmFrameBegin.
+ */
+void mtmFrameEnd(MtmBuffer *buffer, size_t start);
+
+/**
+ * mtmFrameLength: Returns the length of the first frame in some bytes, if it
+ * has been received completely.
+ *
+ * @param data - the received bytes.
+ * @param size - the number of received bytes.
+ * @return
+ *     0 if the frame hasn't been received completely yet.
+ *     The length of the frame, including its header, otherwise. It may be
+ *     larger than MTM_MAX_FRAME_SIZE, which the receiver should reject.
+ */
+size_t mtmFrameLength(const char *data, size_t size);
+
+/**
+ * mtmReaderInit: Initializes a reader of the messages of a complete frame.
+ *
+ * @param reader - the reader to initialize.
+ * @param frame - the frame, including its header.
+ * @param length - the length of the frame, as returned by mtmFrameLength.
+ * @param outCount - returns the number of messages in the frame.
+ */
+void mtmReaderInit(MtmReader *reader, const char *frame, size_t length,
+                   uint32_t *outCount);
+
+/**
+ * mtmReadMessage: Reads the header of the next message of a frame, and skips
+ * its arguments.
+ *
+ * @return
+ *     false if the frame ends before the message does.
+ *     true otherwise.
+ */
+bool mtmReadMessage(MtmReader *reader, MtmMessage *outMessage);
+
+/**
+ * mtmReadUint32: Reads a uint32 from a reader.
+ *
+ * @return
+ *     false if there are no more 4 bytes to read.
+ *     true otherwise.
+ */
+bool mtmReadUint32(MtmReader *reader, uint32_t *outValue);
+
+/**
+ * mtmReadDouble: Reads a double from a reader.
+ *
+ * @return
+ *     false if there are no more 8 bytes to read.
+ *     true otherwise.
+ */
+bool mtmReadDouble(MtmReader *reader, double *outValue);
+
+#endif /* MATAMAZOM_PROTOCOL_H_ */
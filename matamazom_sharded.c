@@ -0,0 +1,986 @@
+#include "matamazom_sharded.h"
+#include <stdint.h>
+#include <string.h>
+#include <limits.h>
+#include <pthread.h>
+#include "matamazom_print.h"
+
+#define HASH_MULTIPLIER 2654435761u
+#define INITIAL_CAPACITY 16
+#define INITIAL_BUCKET_COUNT 64
+
+typedef struct Shard_t {
+  Matamazom warehouse;
+  pthread_mutex_t lock;
+} Shard;
+
+/* an order of the sharded products, made of a part (an order) in every shard
+ * which has products in it. its parts are changed only by the thread which
+ * claimed it (@see claimOrder), and a removed order is freed once that thread
+ * releases it */
+typedef struct ShardedOrder_t {
+  struct ShardedOrder_t *next; // the next order in the same bucket
+  unsigned int id;
+  bool claimed;
+  bool batched; // in the current run of mtmShardedShipOrders
+  unsigned int *parts; // the id of the part in every shard, NULL once removed
+} ShardedOrder;
+
+struct MatamazomSharded_t {
+  Allocator allocator;
+  Shard *shards;
+  unsigned int shard_count;
+  /* guards the table of orders and their claims only, so it's never held
+   * while waiting for a shard. a thread waits for a claim only while it holds
+   * neither a claim nor a shard, and the shards are locked in increasing
+   * order, so that no two threads wait for each other */
+  pthread_mutex_t orders_lock;
+  pthread_cond_t order_released;
+  /* the orders which weren't removed, in buckets by id. ids aren't reused, so
+   * the table only grows and shrinks with the number of these orders */
+  ShardedOrder **buckets;
+  size_t bucket_count;
+  size_t order_count;
+  unsigned int last_order_id;
+};
+
+static unsigned int getShardIndex(MatamazomSharded sharded, unsigned int id) {
+  uint32_t hash = (uint32_t) id * HASH_MULTIPLIER;
+  return (hash ^ (hash >> 16)) % sharded->shard_count;
+}
+
+static Shard *getShard(MatamazomSharded sharded, unsigned int id) {
+  return &sharded->shards[getShardIndex(sharded, id)];
+}
+
+/* the order with the given id, while holding orders_lock, or NULL if there's
+ * no such order. an order which isn't claimed by the calling thread may be
+ * freed once the lock is released, so it's found again after every wait */
+static ShardedOrder *findShardedOrder(MatamazomSharded sharded,
+                                      unsigned int orderId) {
+  if (sharded->bucket_count == 0) {
+    return NULL;
+  }
+  ShardedOrder *order = sharded->buckets[orderId % sharded->bucket_count];
+  while (order != NULL && order->id != orderId) {
+    order = order->next;
+  }
+  return order;
+}
+
+/* moving the orders to a number of buckets, while holding orders_lock. the
+ * table stays as it is if the allocation fails, it's only slower */
+static void resizeOrders(MatamazomSharded sharded, size_t bucketCount) {
+  ShardedOrder **buckets = allocatorAllocate(&sharded->allocator,
+                                             bucketCount * sizeof(*buckets));
+  if (buckets == NULL) {
+    return;
+  }
+  memset(buckets, 0, bucketCount * sizeof(*buckets));
+  for (size_t bucket = 0; bucket < sharded->bucket_count; bucket++) {
+    ShardedOrder *order = sharded->buckets[bucket];
+    while (order != NULL) {
+      ShardedOrder *next = order->next;
+      order->next = buckets[order->id % bucketCount];
+      buckets[order->id % bucketCount] = order;
+      order = next;
+    }
+  }
+  allocatorFree(&sharded->allocator, sharded->buckets);
+  sharded->buckets = buckets;
+  sharded->bucket_count = bucketCount;
+}
+
+/* taking a removed order out of the table, while holding orders_lock. the
+ * caller frees it after releasing the lock */
+static void unlinkShardedOrder(MatamazomSharded sharded, ShardedOrder *order) {
+  ShardedOrder **link = &sharded->buckets[order->id % sharded->bucket_count];
+  while (*link != order) {
+    link = &(*link)->next;
+  }
+  *link = order->next;
+  sharded->order_count--;
+  if (sharded->bucket_count > INITIAL_BUCKET_COUNT &&
+      sharded->order_count < sharded->bucket_count / 4) {
+    resizeOrders(sharded, sharded->bucket_count / 2);
+  }
+}
+
+/* claiming an order for the calling thread, once the thread which claimed it
+ * before releases it. returns NULL if there's no such order */
+static ShardedOrder *claimOrder(MatamazomSharded sharded,
+                                unsigned int orderId) {
+  pthread_mutex_lock(&sharded->orders_lock);
+  ShardedOrder *order = findShardedOrder(sharded, orderId);
+  while (order != NULL && order->claimed) {
+    pthread_cond_wait(&sharded->order_released, &sharded->orders_lock);
+    order = findShardedOrder(sharded, orderId);
+  }
+  if (order != NULL) {
+    order->claimed = true;
+  }
+  pthread_mutex_unlock(&sharded->orders_lock);
+  return order;
+}
+
+/* claiming the orders of a batch all at once, once none of them is claimed,
+ * so that a thread never waits while holding a claim. every entry gets its
+ * order, or NULL if there's no such order */
+static void claimOrders(MatamazomSharded sharded, const unsigned int *orderIds,
+                        size_t count, ShardedOrder **outOrders) {
+  pthread_mutex_lock(&sharded->orders_lock);
+  bool waiting = true;
+  while (waiting) {
+    waiting = false;
+    for (size_t entry = 0; entry < count && !waiting; entry++) {
+      ShardedOrder *order = findShardedOrder(sharded, orderIds[entry]);
+      waiting = order != NULL && order->claimed;
+    }
+    if (waiting) {
+      pthread_cond_wait(&sharded->order_released, &sharded->orders_lock);
+    }
+  }
+  for (size_t entry = 0; entry < count; entry++) {
+    // an order appearing twice gets the same claim for both entries
+    ShardedOrder *order = findShardedOrder(sharded, orderIds[entry]);
+    if (order != NULL) {
+      order->claimed = true;
+    }
+    outOrders[entry] = order;
+  }
+  pthread_mutex_unlock(&sharded->orders_lock);
+}
+
+/* removing a claimed order, which is freed when it's released */
+static void removeShardedOrder(MatamazomSharded sharded, ShardedOrder *order) {
+  allocatorFree(&sharded->allocator, order->parts);
+  order->parts = NULL;
+}
+
+/* releasing a claimed order, and waking the threads waiting for it. an order
+ * which was removed is freed, and no longer exists for them */
+static void releaseOrder(MatamazomSharded sharded, ShardedOrder *order) {
+  pthread_mutex_lock(&sharded->orders_lock);
+  order->claimed = false;
+  bool removed = order->parts == NULL;
+  if (removed) {
+    unlinkShardedOrder(sharded, order);
+  }
+  pthread_cond_broadcast(&sharded->order_released);
+  pthread_mutex_unlock(&sharded->orders_lock);
+  if (removed) {
+    allocatorFree(&sharded->allocator, order);
+  }
+}
+
+/* releasing the orders claimed by claimOrders, all at once, so that none of
+ * them is claimed again by another thread before the rest are released. the
+ * entries are overwritten with the removed orders, which are freed */
+static void releaseOrders(MatamazomSharded sharded, ShardedOrder **orders,
+                          size_t count) {
+  size_t removed = 0;
+  pthread_mutex_lock(&sharded->orders_lock);
+  for (size_t entry = 0; entry < count; entry++) {
+    ShardedOrder *order = orders[entry];
+    // an order which is no longer claimed was released by an earlier entry
+    if (order == NULL || !order->claimed) {
+      continue;
+    }
+    order->claimed = false;
+    if (order->parts == NULL) {
+      unlinkShardedOrder(sharded, order);
+      orders[removed++] = order;
+    }
+  }
+  pthread_cond_broadcast(&sharded->order_released);
+  pthread_mutex_unlock(&sharded->orders_lock);
+  for (size_t entry = 0; entry < removed; entry++) {
+    allocatorFree(&sharded->allocator, orders[entry]);
+  }
+}
+
+/* the number of shards with a part of the order, and the last of them */
+static unsigned int countParts(MatamazomSharded sharded,
+                               const ShardedOrder *order,
+                               unsigned int *outLastShard) {
+  unsigned int count = 0;
+  for (unsigned int shard = 0; shard < sharded->shard_count; shard++) {
+    if (order->parts[shard] != 0) {
+      count++;
+      *outLastShard = shard;
+    }
+  }
+  return count;
+}
+
+/* a task of a single shard, run by runOnShards */
+typedef void (*ShardTask)(Shard *shard, void *argument);
+
+typedef struct ShardJob_t {
+  ShardTask task;
+  Shard *shard;
+  void *argument;
+  pthread_t thread;
+  bool started;
+} ShardJob;
+
+static void *runShardJob(void *argument) {
+  ShardJob *job = argument;
+  job->task(job->shard, job->argument);
+  return NULL;
+}
+
+/* running a task on every shard with a non-NULL argument, in parallel. the
+ * calling thread runs the first of them itself, and any task whose thread
+ * couldn't be created, so the tasks are always run */
+static void runOnShards(MatamazomSharded sharded, ShardTask task,
+                        void **arguments) {
+  ShardJob *jobs = allocatorAllocate(&sharded->allocator,
+                                     sharded->shard_count * sizeof(*jobs));
+  if (jobs == NULL) {
+    for (unsigned int shard = 0; shard < sharded->shard_count; shard++) {
+      if (arguments[shard] != NULL) {
+        task(&sharded->shards[shard], arguments[shard]);
+      }
+    }
+    return;
+  }
+  unsigned int job_count = 0;
+  for (unsigned int shard = 0; shard < sharded->shard_count; shard++) {
+    if (arguments[shard] != NULL) {
+      jobs[job_count++] = (ShardJob) {.task = task,
+          .shard = &sharded->shards[shard], .argument = arguments[shard]};
+    }
+  }
+  for (unsigned int job = 1; job < job_count; job++) {
+    jobs[job].started = pthread_create(&jobs[job].thread, NULL, runShardJob,
+                                       &jobs[job]) == 0;
+  }
+  if (job_count > 0) {
+    runShardJob(&jobs[0]);
+  }
+  for (unsigned int job = 1; job < job_count; job++) {
+    if (jobs[job].started) {
+      pthread_join(jobs[job].thread, NULL);
+    } else {
+      runShardJob(&jobs[job]);
+    }
+  }
+  allocatorFree(&sharded->allocator, jobs);
+}
+
+static void lockAllShards(MatamazomSharded sharded) {
+  for (unsigned int shard = 0; shard < sharded->shard_count; shard++) {
+    pthread_mutex_lock(&sharded->shards[shard].lock);
+  }
+}
+
+static void unlockAllShards(MatamazomSharded sharded) {
+  for (unsigned int shard = 0; shard < sharded->shard_count; shard++) {
+    pthread_mutex_unlock(&sharded->shards[shard].lock);
+  }
+}
+
+MatamazomSharded mtmShardedCreate(unsigned int shardCount) {
+  return mtmShardedCreateWithAllocator(shardCount, NULL);
+}
+
+MatamazomSharded mtmShardedCreateWithAllocator(unsigned int shardCount,
+                                               const Allocator *allocator) {
+  if (shardCount == 0) {
+    return NULL;
+  }
+  if (allocator == NULL) {
+    allocator = allocatorGetDefault();
+  }
+  MatamazomSharded sharded = allocatorAllocate(allocator, sizeof(*sharded));
+  if (sharded == NULL) {
+    return NULL;
+  }
+  sharded->allocator = *allocator;
+  sharded->shards = allocatorAllocate(allocator,
+                                      shardCount * sizeof(*sharded->shards));
+  if (sharded->shards == NULL) {
+    allocatorFree(allocator, sharded);
+    return NULL;
+  }
+  sharded->shard_count = 0;
+  sharded->buckets = NULL;
+  sharded->bucket_count = 0;
+  sharded->order_count = 0;
+  sharded->last_order_id = 0;
+  pthread_mutex_init(&sharded->orders_lock, NULL);
+  pthread_cond_init(&sharded->order_released, NULL);
+  for (unsigned int shard = 0; shard < shardCount; shard++) {
+    Shard *current = &sharded->shards[shard];
+    current->warehouse = matamazomCreateWithAllocator(&sharded->allocator);
+    if (current->warehouse == NULL) {
+      mtmShardedDestroy(sharded);
+      return NULL;
+    }
+    pthread_mutex_init(&current->lock, NULL);
+    sharded->shard_count++;
+  }
+  return sharded;
+}
+
+void mtmShardedDestroy(MatamazomSharded sharded) {
+  if (sharded == NULL) {
+    return;
+  }
+  for (unsigned int shard = 0; shard < sharded->shard_count; shard++) {
+    matamazomDestroy(sharded->shards[shard].warehouse);
+    pthread_mutex_destroy(&sharded->shards[shard].lock);
+  }
+  for (size_t bucket = 0; bucket < sharded->bucket_count; bucket++) {
+    ShardedOrder *order = sharded->buckets[bucket];
+    while (order != NULL) {
+      ShardedOrder *next = order->next;
+      allocatorFree(&sharded->allocator, order->parts);
+      allocatorFree(&sharded->allocator, order);
+      order = next;
+    }
+  }
+  pthread_mutex_destroy(&sharded->orders_lock);
+  pthread_cond_destroy(&sharded->order_released);
+  // the sharded products hold their allocator, so it's copied first
+  Allocator allocator = sharded->allocator;
+  allocatorFree(&allocator, sharded->buckets);
+  allocatorFree(&allocator, sharded->shards);
+  allocatorFree(&allocator, sharded);
+}
+
+MatamazomResult
+mtmShardedNewProduct(MatamazomSharded sharded, const unsigned int id,
+                     const char *name, const double amount,
+                     const MatamazomAmountType amountType,
+                     const MtmProductData customData, MtmCopyData copyData,
+                     MtmFreeData freeData, MtmGetProductPrice prodPrice) {
+  if (sharded == NULL) {
+    return MATAMAZOM_NULL_ARGUMENT;
+  }
+  Shard *shard = getShard(sharded, id);
+  pthread_mutex_lock(&shard->lock);
+  MatamazomResult result = mtmNewProduct(shard->warehouse, id, name, amount,
+                                         amountType, customData, copyData,
+                                         freeData, prodPrice);
+  pthread_mutex_unlock(&shard->lock);
+  return result;
+}
+
+MatamazomResult mtmShardedChangeProductAmount(MatamazomSharded sharded,
+                                              const unsigned int id,
+                                              const double amount) {
+  if (sharded == NULL) {
+    return MATAMAZOM_NULL_ARGUMENT;
+  }
+  Shard *shard = getShard(sharded, id);
+  pthread_mutex_lock(&shard->lock);
+  MatamazomResult result = mtmChangeProductAmount(shard->warehouse, id, amount);
+  pthread_mutex_unlock(&shard->lock);
+  return result;
+}
+
+MatamazomResult mtmShardedClearProduct(MatamazomSharded sharded,
+                                       const unsigned int id) {
+  if (sharded == NULL) {
+    return MATAMAZOM_NULL_ARGUMENT;
+  }
+  Shard *shard = getShard(sharded, id);
+  pthread_mutex_lock(&shard->lock);
+  MatamazomResult result = mtmClearProduct(shard->warehouse, id);
+  pthread_mutex_unlock(&shard->lock);
+  return result;
+}
+
+/* the entries of a batch which belong to a single shard, in the order they
+ * were given in */
+typedef struct ShardBatch_t {
+  const size_t *entries;
+  size_t count;
+  const unsigned int *keys; // product ids, or ids of the orders' parts
+  const double *amounts;
+  MatamazomResult *results;
+} ShardBatch;
+
+/* splitting the entries of a batch between the shards, which are given by
+ * 'shards', keeping their order. 'entries' must have room for all of them */
+static void splitBatch(MatamazomSharded sharded, const unsigned int *shards,
+                       size_t count, size_t *entries, ShardBatch *batches,
+                       void **arguments) {
+  for (unsigned int shard = 0; shard < sharded->shard_count; shard++) {
+    batches[shard].count = 0;
+  }
+  for (size_t entry = 0; entry < count; entry++) {
+    batches[shards[entry]].count++;
+  }
+  size_t offset = 0;
+  for (unsigned int shard = 0; shard < sharded->shard_count; shard++) {
+    batches[shard].entries = entries + offset;
+    offset += batches[shard].count;
+    arguments[shard] = batches[shard].count > 0 ? &batches[shard] : NULL;
+    batches[shard].count = 0;
+  }
+  for (size_t entry = 0; entry < count; entry++) {
+    ShardBatch *batch = &batches[shards[entry]];
+    entries[batch->entries - entries + batch->count++] = entry;
+  }
+}
+
+static void changeShardAmounts(Shard *shard, void *argument) {
+  ShardBatch *batch = argument;
+  pthread_mutex_lock(&shard->lock);
+  for (size_t index = 0; index < batch->count; index++) {
+    size_t entry = batch->entries[index];
+    batch->results[entry] = mtmChangeProductAmount(shard->warehouse,
+                                                   batch->keys[entry],
+                                                   batch->amounts[entry]);
+  }
+  pthread_mutex_unlock(&shard->lock);
+}
+
+static MatamazomResult firstFailure(const MatamazomResult *results,
+                                    size_t count) {
+  for (size_t entry = 0; entry < count; entry++) {
+    if (results[entry] != MATAMAZOM_SUCCESS) {
+      return results[entry];
+    }
+  }
+  return MATAMAZOM_SUCCESS;
+}
+
+MatamazomResult mtmShardedChangeProductAmounts(MatamazomSharded sharded,
+                                               const unsigned int *ids,
+                                               const double *amounts,
+                                               size_t count,
+                                               MatamazomResult *outResults) {
+  if (sharded == NULL || ids == NULL || amounts == NULL ||
+      outResults == NULL) {
+    return MATAMAZOM_NULL_ARGUMENT;
+  }
+  const Allocator *allocator = &sharded->allocator;
+  unsigned int *shards = allocatorAllocate(allocator,
+                                           (count + 1) * sizeof(*shards));
+  size_t *entries = allocatorAllocate(allocator,
+                                      (count + 1) * sizeof(*entries));
+  ShardBatch *batches = allocatorAllocate(allocator, sharded->shard_count *
+                                                     sizeof(*batches));
+  void **arguments = allocatorAllocate(allocator, sharded->shard_count *
+                                                  sizeof(*arguments));
+  if (shards == NULL || entries == NULL || batches == NULL ||
+      arguments == NULL) {
+    allocatorFree(allocator, shards);
+    allocatorFree(allocator, entries);
+    allocatorFree(allocator, batches);
+    allocatorFree(allocator, arguments);
+    return MATAMAZOM_OUT_OF_MEMORY;
+  }
+  for (size_t entry = 0; entry < count; entry++) {
+    shards[entry] = getShardIndex(sharded, ids[entry]);
+  }
+  splitBatch(sharded, shards, count, entries, batches, arguments);
+  for (unsigned int shard = 0; shard < sharded->shard_count; shard++) {
+    batches[shard].keys = ids;
+    batches[shard].amounts = amounts;
+    batches[shard].results = outResults;
+  }
+  runOnShards(sharded, changeShardAmounts, arguments);
+  allocatorFree(allocator, shards);
+  allocatorFree(allocator, entries);
+  allocatorFree(allocator, batches);
+  allocatorFree(allocator, arguments);
+  return firstFailure(outResults, count);
+}
+
+unsigned int mtmShardedCreateNewOrder(MatamazomSharded sharded) {
+  if (sharded == NULL) {
+    return 0;
+  }
+  // the order is allocated before the table is locked
+  ShardedOrder *order = allocatorAllocate(&sharded->allocator, sizeof(*order));
+  unsigned int *parts = allocatorAllocate(&sharded->allocator,
+                                          sharded->shard_count *
+                                          sizeof(*parts));
+  if (order == NULL || parts == NULL) {
+    allocatorFree(&sharded->allocator, order);
+    allocatorFree(&sharded->allocator, parts);
+    return 0;
+  }
+  memset(parts, 0, sharded->shard_count * sizeof(*parts));
+  *order = (ShardedOrder) {.next = NULL, .id = 0, .claimed = false,
+      .batched = false, .parts = parts};
+  pthread_mutex_lock(&sharded->orders_lock);
+  if (sharded->order_count >= sharded->bucket_count) {
+    resizeOrders(sharded, sharded->bucket_count > 0
+                          ? 2 * sharded->bucket_count : INITIAL_BUCKET_COUNT);
+  }
+  unsigned int id = 0;
+  if (sharded->bucket_count > 0 && sharded->last_order_id < UINT_MAX) {
+    id = ++sharded->last_order_id;
+    order->id = id;
+    order->next = sharded->buckets[id % sharded->bucket_count];
+    sharded->buckets[id % sharded->bucket_count] = order;
+    sharded->order_count++;
+  }
+  pthread_mutex_unlock(&sharded->orders_lock);
+  if (id == 0) {
+    allocatorFree(&sharded->allocator, parts);
+    allocatorFree(&sharded->allocator, order);
+  }
+  return id;
+}
+
+MatamazomResult mtmShardedChangeProductAmountInOrder(MatamazomSharded sharded,
+                                                     const unsigned int orderId,
+                                                     const unsigned int productId,
+                                                     const double amount) {
+  if (sharded == NULL) {
+    return MATAMAZOM_NULL_ARGUMENT;
+  }
+  ShardedOrder *order = claimOrder(sharded, orderId);
+  if (order == NULL) {
+    return MATAMAZOM_ORDER_NOT_EXIST;
+  }
+  unsigned int shard_index = getShardIndex(sharded, productId);
+  Shard *shard = &sharded->shards[shard_index];
+  pthread_mutex_lock(&shard->lock);
+  unsigned int part = order->parts[shard_index];
+  bool created = part == 0;
+  if (created) {
+    part = mtmCreateNewOrder(shard->warehouse);
+  }
+  MatamazomResult result = part == 0 ? MATAMAZOM_OUT_OF_MEMORY
+                                     : mtmChangeProductAmountInOrder(
+          shard->warehouse, part, productId, amount);
+  if (created && part != 0) {
+    // a part is kept only once it has been changed successfully
+    if (result == MATAMAZOM_SUCCESS) {
+      order->parts[shard_index] = part;
+    } else {
+      mtmCancelOrder(shard->warehouse, part);
+    }
+  }
+  pthread_mutex_unlock(&shard->lock);
+  releaseOrder(sharded, order);
+  return result;
+}
+
+/* the part of an order in a single shard, checked or shipped by a task */
+typedef struct OrderPart_t {
+  unsigned int id;
+  MatamazomResult result;
+} OrderPart;
+
+static void checkOrderPart(Shard *shard, void *argument) {
+  OrderPart *part = argument;
+  part->result = mtmCanShipOrder(shard->warehouse, part->id);
+}
+
+/* shipping a part in a transaction of its shard, which is committed or
+ * aborted once all the parts were shipped */
+static void shipOrderPart(Shard *shard, void *argument) {
+  OrderPart *part = argument;
+  part->result = mtmBegin(shard->warehouse);
+  if (part->result == MATAMAZOM_SUCCESS) {
+    part->result = mtmShipOrder(shard->warehouse, part->id);
+  }
+}
+
+static MatamazomResult firstPartFailure(MatamazomSharded sharded,
+                                        const OrderPart *parts) {
+  for (unsigned int shard = 0; shard < sharded->shard_count; shard++) {
+    if (parts[shard].result != MATAMAZOM_SUCCESS) {
+      return parts[shard].result;
+    }
+  }
+  return MATAMAZOM_SUCCESS;
+}
+
+/* shipping a claimed order with parts in several shards. all of its shards
+ * are locked, and the parts are shipped only after every shard checked it can
+ * ship its part. shipping a checked part may still fail (e.g. on logging it),
+ * so every part is shipped in a transaction of its shard, and they're all
+ * aborted if any of them failed */
+static MatamazomResult shipSplitOrder(MatamazomSharded sharded,
+                                      ShardedOrder *order) {
+  OrderPart *parts = allocatorAllocate(&sharded->allocator,
+                                       sharded->shard_count * sizeof(*parts));
+  void **arguments = allocatorAllocate(&sharded->allocator,
+                                       sharded->shard_count *
+                                       sizeof(*arguments));
+  if (parts == NULL || arguments == NULL) {
+    allocatorFree(&sharded->allocator, parts);
+    allocatorFree(&sharded->allocator, arguments);
+    return MATAMAZOM_OUT_OF_MEMORY;
+  }
+  for (unsigned int shard = 0; shard < sharded->shard_count; shard++) {
+    parts[shard] = (OrderPart) {.id = order->parts[shard],
+        .result = MATAMAZOM_SUCCESS};
+    arguments[shard] = order->parts[shard] != 0 ? &parts[shard] : NULL;
+    if (arguments[shard] != NULL) {
+      pthread_mutex_lock(&sharded->shards[shard].lock);
+    }
+  }
+  runOnShards(sharded, checkOrderPart, arguments);
+  MatamazomResult result = firstPartFailure(sharded, parts);
+  if (result == MATAMAZOM_SUCCESS) {
+    runOnShards(sharded, shipOrderPart, arguments);
+    result = firstPartFailure(sharded, parts);
+    for (unsigned int shard = 0; shard < sharded->shard_count; shard++) {
+      if (arguments[shard] == NULL) {
+        continue;
+      }
+      Matamazom warehouse = sharded->shards[shard].warehouse;
+      // a part whose transaction didn't begin has nothing to abort
+      if (result == MATAMAZOM_SUCCESS) {
+        mtmCommit(warehouse);
+      } else {
+        mtmAbort(warehouse);
+      }
+    }
+  }
+  if (result == MATAMAZOM_SUCCESS) {
+    removeShardedOrder(sharded, order);
+  }
+  for (unsigned int shard = 0; shard < sharded->shard_count; shard++) {
+    if (arguments[shard] != NULL) {
+      pthread_mutex_unlock(&sharded->shards[shard].lock);
+    }
+  }
+  allocatorFree(&sharded->allocator, parts);
+  allocatorFree(&sharded->allocator, arguments);
+  return result;
+}
+
+/* shipping a claimed order, or NULL if there's no such order */
+static MatamazomResult shipShardedOrder(MatamazomSharded sharded,
+                                        ShardedOrder *order) {
+  // an order shipped by an earlier entry of a batch is still claimed
+  if (order == NULL || order->parts == NULL) {
+    return MATAMAZOM_ORDER_NOT_EXIST;
+  }
+  unsigned int shard_index = 0;
+  unsigned int part_count = countParts(sharded, order, &shard_index);
+  if (part_count > 1) {
+    return shipSplitOrder(sharded, order);
+  }
+  MatamazomResult result = MATAMAZOM_SUCCESS;
+  if (part_count == 1) {
+    Shard *shard = &sharded->shards[shard_index];
+    pthread_mutex_lock(&shard->lock);
+    result = mtmShipOrder(shard->warehouse, order->parts[shard_index]);
+    pthread_mutex_unlock(&shard->lock);
+  }
+  if (result == MATAMAZOM_SUCCESS) {
+    removeShardedOrder(sharded, order);
+  }
+  return result;
+}
+
+MatamazomResult mtmShardedShipOrder(MatamazomSharded sharded,
+                                    const unsigned int orderId) {
+  if (sharded == NULL) {
+    return MATAMAZOM_NULL_ARGUMENT;
+  }
+  ShardedOrder *order = claimOrder(sharded, orderId);
+  if (order == NULL) {
+    return MATAMAZOM_ORDER_NOT_EXIST;
+  }
+  MatamazomResult result = shipShardedOrder(sharded, order);
+  releaseOrder(sharded, order);
+  return result;
+}
+
+static void shipShardOrders(Shard *shard, void *argument) {
+  ShardBatch *batch = argument;
+  pthread_mutex_lock(&shard->lock);
+  for (size_t index = 0; index < batch->count; index++) {
+    size_t entry = batch->entries[index];
+    batch->results[entry] = mtmShipOrder(shard->warehouse, batch->keys[entry]);
+  }
+  pthread_mutex_unlock(&shard->lock);
+}
+
+/* shipping a run of claimed orders with parts in a single shard each. orders
+ * of different shards don't affect each other, so each shard ships its orders
+ * of the run in parallel to the others */
+static void shipSingleShardOrders(MatamazomSharded sharded,
+                                  ShardedOrder **orders,
+                                  const unsigned int *shards,
+                                  const unsigned int *parts, size_t count,
+                                  size_t *entries, ShardBatch *batches,
+                                  void **arguments,
+                                  MatamazomResult *outResults) {
+  splitBatch(sharded, shards, count, entries, batches, arguments);
+  for (unsigned int shard = 0; shard < sharded->shard_count; shard++) {
+    batches[shard].keys = parts;
+    batches[shard].amounts = NULL;
+    batches[shard].results = outResults;
+  }
+  runOnShards(sharded, shipShardOrders, arguments);
+  for (size_t entry = 0; entry < count; entry++) {
+    orders[entry]->batched = false;
+    if (outResults[entry] == MATAMAZOM_SUCCESS) {
+      removeShardedOrder(sharded, orders[entry]);
+    }
+  }
+}
+
+MatamazomResult mtmShardedShipOrders(MatamazomSharded sharded,
+                                     const unsigned int *orderIds,
+                                     size_t count,
+                                     MatamazomResult *outResults) {
+  if (sharded == NULL || orderIds == NULL || outResults == NULL) {
+    return MATAMAZOM_NULL_ARGUMENT;
+  }
+  const Allocator *allocator = &sharded->allocator;
+  ShardedOrder **orders = allocatorAllocate(allocator,
+                                            (count + 1) * sizeof(*orders));
+  unsigned int *shards = allocatorAllocate(allocator,
+                                           (count + 1) * sizeof(*shards));
+  unsigned int *parts = allocatorAllocate(allocator,
+                                          (count + 1) * sizeof(*parts));
+  size_t *entries = allocatorAllocate(allocator,
+                                      (count + 1) * sizeof(*entries));
+  ShardBatch *batches = allocatorAllocate(allocator, sharded->shard_count *
+                                                     sizeof(*batches));
+  void **arguments = allocatorAllocate(allocator, sharded->shard_count *
+                                                  sizeof(*arguments));
+  if (orders == NULL || shards == NULL || parts == NULL || entries == NULL ||
+      batches == NULL || arguments == NULL) {
+    allocatorFree(allocator, orders);
+    allocatorFree(allocator, shards);
+    allocatorFree(allocator, parts);
+    allocatorFree(allocator, entries);
+    allocatorFree(allocator, batches);
+    allocatorFree(allocator, arguments);
+    return MATAMAZOM_OUT_OF_MEMORY;
+  }
+  claimOrders(sharded, orderIds, count, orders);
+  size_t run_begin = 0;
+  for (size_t entry = 0; entry <= count; entry++) {
+    ShardedOrder *order = entry < count ? orders[entry] : NULL;
+    // an order appearing twice in a run would be shipped twice
+    unsigned int part_count = order != NULL && order->parts != NULL &&
+                              !order->batched
+                              ? countParts(sharded, order, &shards[entry]) : 0;
+    if (part_count == 1) {
+      order->batched = true;
+      parts[entry] = order->parts[shards[entry]];
+      continue;
+    }
+    // the run of single shard orders ends here
+    shipSingleShardOrders(sharded, orders + run_begin, shards + run_begin,
+                          parts + run_begin, entry - run_begin, entries,
+                          batches, arguments, outResults + run_begin);
+    run_begin = entry + 1;
+    if (entry < count) {
+      outResults[entry] = shipShardedOrder(sharded, order);
+    }
+  }
+  releaseOrders(sharded, orders, count);
+  allocatorFree(allocator, orders);
+  allocatorFree(allocator, shards);
+  allocatorFree(allocator, parts);
+  allocatorFree(allocator, entries);
+  allocatorFree(allocator, batches);
+  allocatorFree(allocator, arguments);
+  return firstFailure(outResults, count);
+}
+
+MatamazomResult mtmShardedCancelOrder(MatamazomSharded sharded,
+                                      const unsigned int orderId) {
+  if (sharded == NULL) {
+    return MATAMAZOM_NULL_ARGUMENT;
+  }
+  ShardedOrder *order = claimOrder(sharded, orderId);
+  if (order == NULL) {
+    return MATAMAZOM_ORDER_NOT_EXIST;
+  }
+  for (unsigned int shard = 0; shard < sharded->shard_count; shard++) {
+    if (order->parts[shard] != 0) {
+      pthread_mutex_lock(&sharded->shards[shard].lock);
+      mtmCancelOrder(sharded->shards[shard].warehouse, order->parts[shard]);
+      pthread_mutex_unlock(&sharded->shards[shard].lock);
+    }
+  }
+  removeShardedOrder(sharded, order);
+  releaseOrder(sharded, order);
+  return MATAMAZOM_SUCCESS;
+}
+
+/* a product collected from a shard for a report */
+typedef struct ReportRow_t {
+  unsigned int id;
+  const char *name;
+  double amount;
+  double price;
+  double income;
+} ReportRow;
+
+/* the products of a single shard, in increasing order of ids */
+typedef struct ShardReport_t {
+  const Allocator *allocator;
+  ReportRow *rows;
+  size_t size;
+  size_t capacity;
+  bool failed;
+} ShardReport;
+
+static bool collectRow(const unsigned int id, const char *name,
+                       const double amount, const double price,
+                       const double income, void *context) {
+  ShardReport *report = context;
+  if (report->size == report->capacity) {
+    size_t capacity = report->capacity > 0 ? 2 * report->capacity
+                                           : INITIAL_CAPACITY;
+    ReportRow *rows = allocatorAllocate(report->allocator,
+                                        capacity * sizeof(*rows));
+    if (rows == NULL) {
+      report->failed = true;
+      return false;
+    }
+    if (report->size > 0) {
+      memcpy(rows, report->rows, report->size * sizeof(*rows));
+    }
+    allocatorFree(report->allocator, report->rows);
+    report->rows = rows;
+    report->capacity = capacity;
+  }
+  report->rows[report->size++] = (ReportRow) {.id = id, .name = name,
+      .amount = amount, .price = price, .income = income};
+  return true;
+}
+
+static void collectShard(Shard *shard, void *argument) {
+  ShardReport *report = argument;
+  if (mtmForEachProduct(shard->warehouse, collectRow, report)
+      != MATAMAZOM_SUCCESS) {
+    report->failed = true;
+  }
+}
+
+static void freeReports(MatamazomSharded sharded, ShardReport *reports) {
+  for (unsigned int shard = 0; shard < sharded->shard_count; shard++) {
+    allocatorFree(&sharded->allocator, reports[shard].rows);
+  }
+  allocatorFree(&sharded->allocator, reports);
+}
+
+/* collecting the products of all the shards, which must be locked until the
+ * rows are no longer used, since the names belong to the shards */
+static ShardReport *collectReports(MatamazomSharded sharded) {
+  ShardReport *reports = allocatorAllocate(&sharded->allocator,
+                                          sharded->shard_count *
+                                          sizeof(*reports));
+  void **arguments = allocatorAllocate(&sharded->allocator,
+                                       sharded->shard_count *
+                                       sizeof(*arguments));
+  if (reports == NULL || arguments == NULL) {
+    allocatorFree(&sharded->allocator, reports);
+    allocatorFree(&sharded->allocator, arguments);
+    return NULL;
+  }
+  for (unsigned int shard = 0; shard < sharded->shard_count; shard++) {
+    reports[shard] = (ShardReport) {.allocator = &sharded->allocator,
+        .rows = NULL, .size = 0, .capacity = 0, .failed = false};
+    arguments[shard] = &reports[shard];
+  }
+  runOnShards(sharded, collectShard, arguments);
+  allocatorFree(&sharded->allocator, arguments);
+  bool failed = false;
+  for (unsigned int shard = 0; shard < sharded->shard_count; shard++) {
+    failed = failed || reports[shard].failed;
+  }
+  if (failed) {
+    freeReports(sharded, reports);
+    return NULL;
+  }
+  return reports;
+}
+
+/* taking the row with the smallest id among the next rows of the reports,
+ * where 'taken' counts the rows already taken from every report */
+static const ReportRow *takeNextRow(MatamazomSharded sharded,
+                                    ShardReport *reports, size_t *taken) {
+  unsigned int next = sharded->shard_count;
+  for (unsigned int shard = 0; shard < sharded->shard_count; shard++) {
+    if (taken[shard] < reports[shard].size &&
+        (next == sharded->shard_count ||
+         reports[shard].rows[taken[shard]].id <
+         reports[next].rows[taken[next]].id)) {
+      next = shard;
+    }
+  }
+  return next == sharded->shard_count ? NULL
+                                      : &reports[next].rows[taken[next]++];
+}
+
+MatamazomResult mtmShardedPrintInventory(MatamazomSharded sharded,
+                                         FILE *output) {
+  if (sharded == NULL || output == NULL) {
+    return MATAMAZOM_NULL_ARGUMENT;
+  }
+  size_t *taken = allocatorAllocate(&sharded->allocator,
+                                    sharded->shard_count * sizeof(*taken));
+  if (taken == NULL) {
+    return MATAMAZOM_OUT_OF_MEMORY;
+  }
+  memset(taken, 0, sharded->shard_count * sizeof(*taken));
+  lockAllShards(sharded);
+  ShardReport *reports = collectReports(sharded);
+  if (reports == NULL) {
+    unlockAllShards(sharded);
+    allocatorFree(&sharded->allocator, taken);
+    return MATAMAZOM_OUT_OF_MEMORY;
+  }
+  fprintf(output, "Inventory Status:\n");
+  for (const ReportRow *row = takeNextRow(sharded, reports, taken);
+       row != NULL; row = takeNextRow(sharded, reports, taken)) {
+    mtmPrintProductDetails(row->name, row->id, row->amount, row->price, output);
+  }
+  unlockAllShards(sharded);
+  freeReports(sharded, reports);
+  allocatorFree(&sharded->allocator, taken);
+  return MATAMAZOM_SUCCESS;
+}
+
+MatamazomResult mtmShardedPrintBestSelling(MatamazomSharded sharded,
+                                           FILE *output) {
+  if (sharded == NULL || output == NULL) {
+    return MATAMAZOM_NULL_ARGUMENT;
+  }
+  lockAllShards(sharded);
+  ShardReport *reports = collectReports(sharded);
+  if (reports == NULL) {
+    unlockAllShards(sharded);
+    return MATAMAZOM_OUT_OF_MEMORY;
+  }
+  // if incomes are equal the product with the lower id is the best selling
+  const ReportRow *best_selling = NULL;
+  for (unsigned int shard = 0; shard < sharded->shard_count; shard++) {
+    for (size_t row = 0; row < reports[shard].size; row++) {
+      const ReportRow *current = &reports[shard].rows[row];
+      if (best_selling == NULL || current->income > best_selling->income ||
+          (current->income == best_selling->income &&
+           current->id < best_selling->id)) {
+        best_selling = current;
+      }
+    }
+  }
+  MatamazomResult result = MATAMAZOM_SUCCESS;
+  if (best_selling == NULL) {
+    // as mtmPrintBestSelling, for products without any product
+    result = MATAMAZOM_ORDER_NOT_EXIST;
+  } else if (best_selling->income == 0) {
+    fprintf(output, "Best Selling Product:\n"
+                    "none\n");
+  } else {
+    fprintf(output, "Best Selling Product:\n");
+    mtmPrintIncomeLine(best_selling->name, best_selling->id,
+                       best_selling->income, output);
+  }
+  unlockAllShards(sharded);
+  freeReports(sharded, reports);
+  return result;
+}
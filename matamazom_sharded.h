@@ -0,0 +1,239 @@
+#ifndef MATAMAZOM_SHARDED_H_
+#define MATAMAZOM_SHARDED_H_
+
+#include <stdio.h>
+#include <stddef.h>
+#include "matamazom.h"
+
+/**
+ * Sharded Matamazom products
+ *
+ * Partitions the products between several Matamazom products (shards) by a
+ * hash of their ids. Functions of a single product are sent to the shard of
+ * the product only, while reports and batches of operations run on all the
+ * shards in parallel threads, and their results are merged in the order of
+ * ids. An order may contain products of several shards, in which case it has
+ * a part in each of them, and it's still shipped as a whole or not at all.
+ *
+ * All the functions may be called concurrently from several threads. Functions
+ * of products in different shards don't wait for each other, and neither do
+ * functions of different orders, unless they use the same shards. Functions
+ * of the same order wait for each other. The MtmGetProductPrice and
+ * MtmCopyData functions of the products, and the functions of the allocator,
+ * may be called from several threads concurrently.
+ *
+ * The following functions are available:
+ *   mtmShardedCreate                    - Creates a sharded products.
+ *   mtmShardedCreateWithAllocator       - Creates a sharded products which
+ *                                         allocates using a given allocator.
+ *   mtmShardedDestroy                   - Deletes a sharded products.
+ *   mtmShardedNewProduct                - Adds a product.
+ *   mtmShardedChangeProductAmount       - Changes the amount of a product.
+ *   mtmShardedChangeProductAmounts      - Changes the amounts of several
+ *                                         products in parallel.
+ *   mtmShardedClearProduct              - Removes a product.
+ *   mtmShardedCreateNewOrder            - Creates an empty order.
+ *   mtmShardedChangeProductAmountInOrder - Changes the amount of a product in
+ *                                         an order.
+ *   mtmShardedShipOrder                 - Ships an order atomically.
+ *   mtmShardedShipOrders                - Ships several orders in parallel.
+ *   mtmShardedCancelOrder               - Cancels an order.
+ *   mtmShardedPrintInventory            - Prints the products, by id.
+ *   mtmShardedPrintBestSelling          - Prints the best selling product.
+ */
+
+/** Type for a sharded Matamazom products */
+typedef struct MatamazomSharded_t *MatamazomSharded;
+
+/**
+ * mtmShardedCreate: create an empty sharded Matamazom products.
+ *
+ * @param shardCount - the number of shards, which is also the most threads a
+ *     report or a batch uses.
+ * @return A new sharded products in case of success, and NULL otherwise (e.g.
+ *     in case of an allocation error or if shardCount is 0)
+ */
+MatamazomSharded mtmShardedCreate(unsigned int shardCount);
+
+/**
+ * mtmShardedCreateWithAllocator: create an empty sharded Matamazom products,
+ * which allocates all of its memory (its shards, their orders and the memory
+ * of reports and batches) using the given allocator.
+ *
+ * @param shardCount - the number of shards, which is also the most threads a
+ *     report or a batch uses.
+ * @param allocator - the allocator to use, which must be thread safe. NULL
+ *     means malloc and free. The allocator is copied, but its context must
+ *     outlive the sharded products.
+ * @return A new sharded products in case of success, and NULL otherwise (e.g.
+ *     in case of an allocation error or if shardCount is 0)
+ */
+MatamazomSharded mtmShardedCreateWithAllocator(unsigned int shardCount,
+                                               const Allocator *allocator);
+
+/**
+ * mtmShardedDestroy: free a sharded Matamazom products, and all its contents,
+ * from memory.
+ *
+ * @param sharded - the products to free from memory. A NULL value is allowed,
+ *     and in that case the function does nothing.
+ */
+void mtmShardedDestroy(MatamazomSharded sharded);
+
+/**
+ * mtmShardedNewProduct: add a new product to a sharded Matamazom products.
+ *
+ * @see mtmNewProduct for the parameters and the results.
+ */
+MatamazomResult
+mtmShardedNewProduct(MatamazomSharded sharded, const unsigned int id,
+                     const char *name, const double amount,
+                     const MatamazomAmountType amountType,
+                     const MtmProductData customData, MtmCopyData copyData,
+                     MtmFreeData freeData, MtmGetProductPrice prodPrice);
+
+/**
+ * mtmShardedChangeProductAmount: increase or decrease the amount of an
+ * existing product in a sharded Matamazom products.
+ *
+ * @see mtmChangeProductAmount for the parameters and the results.
+ */
+MatamazomResult mtmShardedChangeProductAmount(MatamazomSharded sharded,
+                                              const unsigned int id,
+                                              const double amount);
+
+/**
+ * mtmShardedChangeProductAmounts: change the amounts of several products, as
+ * mtmShardedChangeProductAmount of each of them in turn would.
+ *
+ * The changes are split between the shards of their products, and the shards
+ * apply their changes in parallel, each in the order they were given in.
+ *
+ * @param sharded - the products to change.
+ * @param ids - the ids of the products to change.
+ * @param amounts - the amount to add to each product, may be negative.
+ * @param count - the number of changes.
+ * @param outResults - returns the result of every change, as
+ *     mtmShardedChangeProductAmount would return it.
+ * @return
+ *     MATAMAZOM_NULL_ARGUMENT - if a NULL argument is passed. Nothing is
+ *         changed in that case.
+ *     The result of the first change (in the given order) which failed, if
+ *         there is one.
+ *     MATAMAZOM_SUCCESS - otherwise.
+ */
+MatamazomResult mtmShardedChangeProductAmounts(MatamazomSharded sharded,
+                                               const unsigned int *ids,
+                                               const double *amounts,
+                                               size_t count,
+                                               MatamazomResult *outResults);
+
+/**
+ * mtmShardedClearProduct: clear a product from a sharded Matamazom products,
+ * and from all the orders.
+ *
+ * @see mtmClearProduct for the parameters and the results.
+ */
+MatamazomResult mtmShardedClearProduct(MatamazomSharded sharded,
+                                       const unsigned int id);
+
+/**
+ * mtmShardedCreateNewOrder: create a new empty order in a sharded Matamazom
+ * products, and return the order's id.
+ *
+ * @param sharded - a sharded products.
+ * @return
+ *     Positive id of the new order, if successful.
+ *     0 in case of failure.
+ */
+unsigned int mtmShardedCreateNewOrder(MatamazomSharded sharded);
+
+/**
+ * mtmShardedChangeProductAmountInOrder: add/increase/remove/decrease products
+ * in an existing order of a sharded Matamazom products.
+ *
+ * @see mtmChangeProductAmountInOrder for the parameters and the results.
+ */
+MatamazomResult mtmShardedChangeProductAmountInOrder(MatamazomSharded sharded,
+                                                     const unsigned int orderId,
+                                                     const unsigned int productId,
+                                                     const double amount);
+
+/**
+ * mtmShardedShipOrder: ship an order and remove it from a sharded Matamazom
+ * products.
+ *
+ * Every shard containing products of the order first checks whether it can
+ * ship its part, and the parts are shipped only if all of them can. Each part
+ * is shipped in a transaction of its shard (@see mtmBegin), which is aborted
+ * if shipping any other part failed, so either the whole order is shipped or
+ * nothing is changed. The shards of the order check and ship their parts in
+ * parallel.
+ *
+ * @see mtmShipOrder for the parameters and the results.
+ */
+MatamazomResult mtmShardedShipOrder(MatamazomSharded sharded,
+                                    const unsigned int orderId);
+
+/**
+ * mtmShardedShipOrders: ship several orders, as mtmShardedShipOrder of each of
+ * them in turn would.
+ *
+ * Consecutive orders whose products are all in a single shard are shipped by
+ * their shards in parallel, while an order with products in several shards is
+ * shipped atomically on its own (@see mtmShardedShipOrder).
+ *
+ * @param sharded - the products containing the orders.
+ * @param orderIds - the ids of the orders to ship.
+ * @param count - the number of orders.
+ * @param outResults - returns the result of shipping every order, as
+ *     mtmShardedShipOrder would return it.
+ * @return
+ *     MATAMAZOM_NULL_ARGUMENT - if a NULL argument is passed. Nothing is
+ *         shipped in that case.
+ *     The result of the first order (in the given order) which wasn't
+ *         shipped, if there is one.
+ *     MATAMAZOM_SUCCESS - otherwise.
+ */
+MatamazomResult mtmShardedShipOrders(MatamazomSharded sharded,
+                                     const unsigned int *orderIds,
+                                     size_t count,
+                                     MatamazomResult *outResults);
+
+/**
+ * mtmShardedCancelOrder: cancel an order and remove it from a sharded
+ * Matamazom products.
+ *
+ * @see mtmCancelOrder for the parameters and the results.
+ */
+MatamazomResult mtmShardedCancelOrder(MatamazomSharded sharded,
+                                      const unsigned int orderId);
+
+/**
+ * mtmShardedPrintInventory: print the products of a sharded Matamazom
+ * products, exactly as mtmPrintInventory prints the same products.
+ *
+ * The shards collect their products in parallel, and the products are printed
+ * after all of them were collected, in increasing order of ids.
+ *
+ * @param sharded - a sharded products to print.
+ * @param output - an open, writable output stream, to which the contents are printed.
+ * @return
+ *     MATAMAZOM_NULL_ARGUMENT - if a NULL argument is passed.
+ *     MATAMAZOM_OUT_OF_MEMORY - in case of memory allocation failure.
+ *     MATAMAZOM_SUCCESS - if printed successfully.
+ */
+MatamazomResult mtmShardedPrintInventory(MatamazomSharded sharded,
+                                         FILE *output);
+
+/**
+ * mtmShardedPrintBestSelling: print the best selling product of a sharded
+ * Matamazom products, exactly as mtmPrintBestSelling prints it for the same
+ * products.
+ *
+ * @see mtmPrintBestSelling for the parameters and the results.
+ */
+MatamazomResult mtmShardedPrintBestSelling(MatamazomSharded sharded,
+                                           FILE *output);
+
+#endif /* MATAMAZOM_SHARDED_H_ */
@@ -0,0 +1,622 @@
+/* shm_open, mmap and process-shared locks are POSIX, and aren't declared by a
+ * strict C99 library */
+#define _POSIX_C_SOURCE 200809L
+
+#include "matamazom_shm.h"
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "matamazom_print.h"
+
+#define SHM_MAGIC 0x534d544du
+#define SHM_VERSION 1
+#define NO_INDEX UINT32_MAX
+#define RANGE 0.001
+#define SHM_ALIGNMENT 8
+#define ALIGN_UP(size) (((size) + SHM_ALIGNMENT - 1) & ~(uint64_t) (SHM_ALIGNMENT - 1))
+
+/* a product slot. 'amount' is changed atomically while the lock is shared */
+typedef struct ShmProduct_t {
+  double amount;
+  double price;
+  double income;
+  uint32_t id;
+  uint32_t next_free; // the next free slot, while the slot is free
+  unsigned char type;
+  char name[MTM_SHM_NAME_SIZE];
+} ShmProduct;
+
+/* an order slot. the id of an order is generation * capacity + slot + 1, so
+ * the slot is found by the id alone */
+typedef struct ShmOrder_t {
+  uint32_t id; // 0 while the slot is free
+  uint32_t generation;
+  uint32_t first_line; // the lines are sorted by product id
+  uint32_t next_free;
+} ShmOrder;
+
+typedef struct ShmOrderLine_t {
+  double amount;
+  uint32_t product_id;
+  uint32_t next; // the next line of the order, or the next free line
+} ShmOrderLine;
+
+/* the start of the segment. every region is given by its offset from the
+ * start of the segment */
+typedef struct ShmHeader_t {
+  uint32_t magic; // set last, once the segment is initialized
+  uint32_t version;
+  uint64_t size;
+  pthread_rwlock_t lock;
+  uint32_t product_capacity;
+  uint32_t order_capacity;
+  uint32_t line_capacity;
+  uint32_t product_count;
+  uint32_t free_product;
+  uint32_t free_order;
+  uint32_t free_line;
+  uint64_t products_offset;
+  uint64_t index_offset; // slots of the products, sorted by id
+  uint64_t orders_offset;
+  uint64_t lines_offset;
+} ShmHeader;
+
+struct MatamazomShm_t {
+  ShmHeader *header;
+  size_t size;
+};
+
+static ShmProduct *getProducts(MatamazomShm shm) {
+  return (ShmProduct *) ((char *) shm->header + shm->header->products_offset);
+}
+
+static uint32_t *getIndex(MatamazomShm shm) {
+  return (uint32_t *) ((char *) shm->header + shm->header->index_offset);
+}
+
+static ShmOrder *getOrders(MatamazomShm shm) {
+  return (ShmOrder *) ((char *) shm->header + shm->header->orders_offset);
+}
+
+static ShmOrderLine *getLines(MatamazomShm shm) {
+  return (ShmOrderLine *) ((char *) shm->header + shm->header->lines_offset);
+}
+
+static bool isNameValid(const char *name) {
+  return ((*name >= 'a' && *name <= 'z') || (*name >= 'A' && *name <= 'Z')
+      || (*name >= '0' && *name <= '9')) &&
+      strlen(name) < MTM_SHM_NAME_SIZE;
+}
+
+static bool isAmountValid(double amount, unsigned char type) {
+  amount = fabs(amount);
+  if (type == MATAMAZOM_INTEGER_AMOUNT) {
+    return fabs(amount - round(amount)) <= RANGE;
+  }
+  if (type == MATAMAZOM_HALF_INTEGER_AMOUNT) {
+    return fabs(2 * amount - round(2 * amount)) <= 2 * RANGE;
+  }
+  return true;
+}
+
+/* the position in the index of the first product whose id isn't smaller */
+static uint32_t findPosition(MatamazomShm shm, unsigned int id) {
+  ShmProduct *products = getProducts(shm);
+  uint32_t *index = getIndex(shm);
+  uint32_t low = 0;
+  uint32_t high = shm->header->product_count;
+  while (low < high) {
+    uint32_t middle = low + (high - low) / 2;
+    if (products[index[middle]].id < id) {
+      low = middle + 1;
+    } else {
+      high = middle;
+    }
+  }
+  return low;
+}
+
+static ShmProduct *findProduct(MatamazomShm shm, unsigned int id) {
+  uint32_t position = findPosition(shm, id);
+  if (position == shm->header->product_count) {
+    return NULL;
+  }
+  ShmProduct *product = &getProducts(shm)[getIndex(shm)[position]];
+  return product->id == id ? product : NULL;
+}
+
+static ShmOrder *findOrder(MatamazomShm shm, unsigned int orderId) {
+  if (orderId == 0) {
+    return NULL;
+  }
+  ShmOrder *order = &getOrders(shm)[(orderId - 1) %
+                                    shm->header->order_capacity];
+  return order->id == orderId ? order : NULL;
+}
+
+static void lockShared(MatamazomShm shm) {
+  pthread_rwlock_rdlock(&shm->header->lock);
+}
+
+static void lockExclusive(MatamazomShm shm) {
+  pthread_rwlock_wrlock(&shm->header->lock);
+}
+
+static void unlock(MatamazomShm shm) {
+  pthread_rwlock_unlock(&shm->header->lock);
+}
+
+static double loadAmount(const ShmProduct *product) {
+  double amount;
+  __atomic_load(&product->amount, &amount, __ATOMIC_ACQUIRE);
+  return amount;
+}
+
+/* computing the offsets of the regions, and returning the segment's size */
+static uint64_t layOut(ShmHeader *header, const MtmShmCapacity *capacity) {
+  uint64_t offset = ALIGN_UP(sizeof(ShmHeader));
+  header->products_offset = offset;
+  offset = ALIGN_UP(offset + (uint64_t) capacity->products *
+      sizeof(ShmProduct));
+  header->index_offset = offset;
+  offset = ALIGN_UP(offset + (uint64_t) capacity->products * sizeof(uint32_t));
+  header->orders_offset = offset;
+  offset = ALIGN_UP(offset + (uint64_t) capacity->orders * sizeof(ShmOrder));
+  header->lines_offset = offset;
+  return offset + (uint64_t) capacity->order_lines * sizeof(ShmOrderLine);
+}
+
+static void initialize(MatamazomShm shm, const MtmShmCapacity *capacity) {
+  ShmHeader *header = shm->header;
+  header->version = SHM_VERSION;
+  header->size = shm->size;
+  header->product_capacity = capacity->products;
+  header->order_capacity = capacity->orders;
+  header->line_capacity = capacity->order_lines;
+  header->product_count = 0;
+  // chaining all the slots into the free lists
+  ShmProduct *products = getProducts(shm);
+  for (uint32_t slot = 0; slot < capacity->products; slot++) {
+    products[slot].next_free = slot + 1 < capacity->products ? slot + 1
+                                                             : NO_INDEX;
+  }
+  header->free_product = 0;
+  ShmOrder *orders = getOrders(shm);
+  for (uint32_t slot = 0; slot < capacity->orders; slot++) {
+    orders[slot] = (ShmOrder) {.id = 0, .generation = 0,
+        .first_line = NO_INDEX,
+        .next_free = slot + 1 < capacity->orders ? slot + 1 : NO_INDEX};
+  }
+  header->free_order = 0;
+  ShmOrderLine *lines = getLines(shm);
+  for (uint32_t line = 0; line < capacity->order_lines; line++) {
+    lines[line].next = line + 1 < capacity->order_lines ? line + 1 : NO_INDEX;
+  }
+  header->free_line = 0;
+}
+
+MatamazomShm mtmShmCreate(const char *name, const MtmShmCapacity *capacity) {
+  if (name == NULL || capacity == NULL || capacity->products == 0 ||
+      capacity->orders == 0 || capacity->order_lines == 0) {
+    return NULL;
+  }
+  MatamazomShm shm = malloc(sizeof(*shm));
+  if (shm == NULL) {
+    return NULL;
+  }
+  ShmHeader layout;
+  memset(&layout, 0, sizeof(layout));
+  shm->size = layOut(&layout, capacity);
+  int fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, S_IRUSR | S_IWUSR);
+  if (fd < 0) {
+    free(shm);
+    return NULL;
+  }
+  void *base = MAP_FAILED;
+  if (ftruncate(fd, (off_t) shm->size) == 0) {
+    base = mmap(NULL, shm->size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  }
+  close(fd);
+  pthread_rwlockattr_t attributes;
+  if (base == MAP_FAILED || pthread_rwlockattr_init(&attributes) != 0) {
+    if (base != MAP_FAILED) {
+      munmap(base, shm->size);
+    }
+    shm_unlink(name);
+    free(shm);
+    return NULL;
+  }
+  // the magic number is still 0, so other processes don't use it yet
+  shm->header = base;
+  *shm->header = layout;
+  pthread_rwlockattr_setpshared(&attributes, PTHREAD_PROCESS_SHARED);
+  int result = pthread_rwlock_init(&shm->header->lock, &attributes);
+  pthread_rwlockattr_destroy(&attributes);
+  if (result != 0) {
+    munmap(base, shm->size);
+    shm_unlink(name);
+    free(shm);
+    return NULL;
+  }
+  initialize(shm, capacity);
+  __atomic_store_n(&shm->header->magic, SHM_MAGIC, __ATOMIC_RELEASE);
+  return shm;
+}
+
+MatamazomShm mtmShmOpen(const char *name) {
+  if (name == NULL) {
+    return NULL;
+  }
+  int fd = shm_open(name, O_RDWR, 0);
+  if (fd < 0) {
+    return NULL;
+  }
+  struct stat status;
+  void *base = MAP_FAILED;
+  if (fstat(fd, &status) == 0 && (size_t) status.st_size >= sizeof(ShmHeader)) {
+    base = mmap(NULL, (size_t) status.st_size, PROT_READ | PROT_WRITE,
+                MAP_SHARED, fd, 0);
+  }
+  close(fd);
+  if (base == MAP_FAILED) {
+    return NULL;
+  }
+  ShmHeader *header = base;
+  MatamazomShm shm = malloc(sizeof(*shm));
+  if (shm == NULL ||
+      __atomic_load_n(&header->magic, __ATOMIC_ACQUIRE) != SHM_MAGIC ||
+      header->version != SHM_VERSION ||
+      header->size != (uint64_t) status.st_size) {
+    munmap(base, (size_t) status.st_size);
+    free(shm);
+    return NULL;
+  }
+  shm->header = header;
+  shm->size = (size_t) status.st_size;
+  return shm;
+}
+
+void mtmShmClose(MatamazomShm shm) {
+  if (shm == NULL) {
+    return;
+  }
+  munmap(shm->header, shm->size);
+  free(shm);
+}
+
+MatamazomResult mtmShmUnlink(const char *name) {
+  if (name == NULL) {
+    return MATAMAZOM_NULL_ARGUMENT;
+  }
+  return shm_unlink(name) == 0 ? MATAMAZOM_SUCCESS : MATAMAZOM_OUT_OF_MEMORY;
+}
+
+MatamazomResult mtmShmNewProduct(MatamazomShm shm, const unsigned int id,
+                                 const char *name, const double amount,
+                                 const MatamazomAmountType amountType,
+                                 const double price) {
+  if (shm == NULL || name == NULL) {
+    return MATAMAZOM_NULL_ARGUMENT;
+  }
+  if (!isNameValid(name)) {
+    return MATAMAZOM_INVALID_NAME;
+  }
+  if (amount < 0 || !isAmountValid(amount, amountType)) {
+    return MATAMAZOM_INVALID_AMOUNT;
+  }
+  lockExclusive(shm);
+  ShmHeader *header = shm->header;
+  uint32_t position = findPosition(shm, id);
+  uint32_t *index = getIndex(shm);
+  ShmProduct *products = getProducts(shm);
+  MatamazomResult result = MATAMAZOM_SUCCESS;
+  if (position < header->product_count &&
+      products[index[position]].id == id) {
+    result = MATAMAZOM_PRODUCT_ALREADY_EXIST;
+  } else if (header->free_product == NO_INDEX) {
+    result = MATAMAZOM_OUT_OF_MEMORY;
+  } else {
+    uint32_t slot = header->free_product;
+    ShmProduct *product = &products[slot];
+    header->free_product = product->next_free;
+    product->amount = amount;
+    product->price = price;
+    product->income = 0;
+    product->id = id;
+    product->type = (unsigned char) amountType;
+    strcpy(product->name, name);
+    memmove(&index[position + 1], &index[position],
+            (header->product_count - position) * sizeof(*index));
+    index[position] = slot;
+    header->product_count++;
+  }
+  unlock(shm);
+  return result;
+}
+
+MatamazomResult mtmShmChangeProductAmount(MatamazomShm shm,
+                                          const unsigned int id,
+                                          const double amount) {
+  if (shm == NULL) {
+    return MATAMAZOM_NULL_ARGUMENT;
+  }
+  lockShared(shm);
+  ShmProduct *product = findProduct(shm, id);
+  MatamazomResult result = MATAMAZOM_SUCCESS;
+  if (product == NULL) {
+    result = MATAMAZOM_PRODUCT_NOT_EXIST;
+  } else if (!isAmountValid(amount, product->type)) {
+    result = MATAMAZOM_INVALID_AMOUNT;
+  } else {
+    // other processes may change the amount concurrently
+    double current = loadAmount(product);
+    double changed;
+    do {
+      changed = current + amount;
+      if (changed < 0) {
+        result = MATAMAZOM_INSUFFICIENT_AMOUNT;
+        break;
+      }
+    } while (!__atomic_compare_exchange(&product->amount, &current, &changed,
+                                        true, __ATOMIC_ACQ_REL,
+                                        __ATOMIC_ACQUIRE));
+  }
+  unlock(shm);
+  return result;
+}
+
+MatamazomResult mtmShmGetProductAmount(MatamazomShm shm,
+                                       const unsigned int id,
+                                       double *outAmount) {
+  if (shm == NULL || outAmount == NULL) {
+    return MATAMAZOM_NULL_ARGUMENT;
+  }
+  lockShared(shm);
+  ShmProduct *product = findProduct(shm, id);
+  if (product != NULL) {
+    *outAmount = loadAmount(product);
+  }
+  unlock(shm);
+  return product != NULL ? MATAMAZOM_SUCCESS : MATAMAZOM_PRODUCT_NOT_EXIST;
+}
+
+/* returning a chain of lines to the free lines */
+static void freeLines(MatamazomShm shm, uint32_t first) {
+  ShmOrderLine *lines = getLines(shm);
+  while (first != NO_INDEX) {
+    uint32_t next = lines[first].next;
+    lines[first].next = shm->header->free_line;
+    shm->header->free_line = first;
+    first = next;
+  }
+}
+
+/* finding the link to the first line of an order whose product id isn't
+ * smaller than productId */
+static uint32_t *findLineLink(MatamazomShm shm, ShmOrder *order,
+                              unsigned int productId) {
+  ShmOrderLine *lines = getLines(shm);
+  uint32_t *link = &order->first_line;
+  while (*link != NO_INDEX && lines[*link].product_id < productId) {
+    link = &lines[*link].next;
+  }
+  return link;
+}
+
+MatamazomResult mtmShmClearProduct(MatamazomShm shm, const unsigned int id) {
+  if (shm == NULL) {
+    return MATAMAZOM_NULL_ARGUMENT;
+  }
+  lockExclusive(shm);
+  ShmHeader *header = shm->header;
+  uint32_t position = findPosition(shm, id);
+  uint32_t *index = getIndex(shm);
+  ShmProduct *products = getProducts(shm);
+  if (position == header->product_count ||
+      products[index[position]].id != id) {
+    unlock(shm);
+    return MATAMAZOM_PRODUCT_NOT_EXIST;
+  }
+  uint32_t slot = index[position];
+  products[slot].next_free = header->free_product;
+  header->free_product = slot;
+  header->product_count--;
+  memmove(&index[position], &index[position + 1],
+          (header->product_count - position) * sizeof(*index));
+  // the product is removed from every order which contains it
+  ShmOrder *orders = getOrders(shm);
+  ShmOrderLine *lines = getLines(shm);
+  for (uint32_t order = 0; order < header->order_capacity; order++) {
+    if (orders[order].id == 0) {
+      continue;
+    }
+    uint32_t *link = findLineLink(shm, &orders[order], id);
+    if (*link != NO_INDEX && lines[*link].product_id == id) {
+      uint32_t line = *link;
+      *link = lines[line].next;
+      lines[line].next = NO_INDEX;
+      freeLines(shm, line);
+    }
+  }
+  unlock(shm);
+  return MATAMAZOM_SUCCESS;
+}
+
+unsigned int mtmShmCreateNewOrder(MatamazomShm shm) {
+  if (shm == NULL) {
+    return 0;
+  }
+  lockExclusive(shm);
+  ShmHeader *header = shm->header;
+  unsigned int id = 0;
+  if (header->free_order != NO_INDEX) {
+    uint32_t slot = header->free_order;
+    ShmOrder *order = &getOrders(shm)[slot];
+    header->free_order = order->next_free;
+    // the ids of a slot start over once they no longer fit in an id
+    uint64_t next_id = (uint64_t) order->generation * header->order_capacity +
+        slot + 1;
+    if (next_id > UINT32_MAX) {
+      order->generation = 0;
+      next_id = slot + 1;
+    }
+    order->generation++;
+    order->id = (uint32_t) next_id;
+    order->first_line = NO_INDEX;
+    id = order->id;
+  }
+  unlock(shm);
+  return id;
+}
+
+MatamazomResult mtmShmChangeProductAmountInOrder(MatamazomShm shm,
+                                                 const unsigned int orderId,
+                                                 const unsigned int productId,
+                                                 const double amount) {
+  if (shm == NULL) {
+    return MATAMAZOM_NULL_ARGUMENT;
+  }
+  lockExclusive(shm);
+  ShmOrder *order = findOrder(shm, orderId);
+  ShmProduct *product = findProduct(shm, productId);
+  MatamazomResult result = MATAMAZOM_SUCCESS;
+  if (order == NULL) {
+    result = MATAMAZOM_ORDER_NOT_EXIST;
+  } else if (product == NULL) {
+    result = MATAMAZOM_PRODUCT_NOT_EXIST;
+  } else if (!isAmountValid(amount, product->type)) {
+    result = MATAMAZOM_INVALID_AMOUNT;
+  }
+  if (result != MATAMAZOM_SUCCESS || amount == 0) {
+    unlock(shm);
+    return result;
+  }
+  ShmOrderLine *lines = getLines(shm);
+  uint32_t *link = findLineLink(shm, order, productId);
+  bool exists = *link != NO_INDEX && lines[*link].product_id == productId;
+  double amount_after_change = (exists ? lines[*link].amount : 0) + amount;
+  if (amount_after_change <= 0) {
+    // the product is removed from the order, if it's there
+    if (exists) {
+      uint32_t line = *link;
+      *link = lines[line].next;
+      lines[line].next = NO_INDEX;
+      freeLines(shm, line);
+    }
+  } else if (exists) {
+    lines[*link].amount = amount_after_change;
+  } else if (shm->header->free_line == NO_INDEX) {
+    result = MATAMAZOM_OUT_OF_MEMORY;
+  } else {
+    uint32_t line = shm->header->free_line;
+    shm->header->free_line = lines[line].next;
+    lines[line] = (ShmOrderLine) {.amount = amount_after_change,
+        .product_id = productId, .next = *link};
+    *link = line;
+  }
+  unlock(shm);
+  return result;
+}
+
+static void removeOrder(MatamazomShm shm, ShmOrder *order) {
+  freeLines(shm, order->first_line);
+  order->first_line = NO_INDEX;
+  order->id = 0;
+  uint32_t slot = (uint32_t) (order - getOrders(shm));
+  order->next_free = shm->header->free_order;
+  shm->header->free_order = slot;
+}
+
+MatamazomResult mtmShmShipOrder(MatamazomShm shm, const unsigned int orderId) {
+  if (shm == NULL) {
+    return MATAMAZOM_NULL_ARGUMENT;
+  }
+  lockExclusive(shm);
+  ShmOrder *order = findOrder(shm, orderId);
+  if (order == NULL) {
+    unlock(shm);
+    return MATAMAZOM_ORDER_NOT_EXIST;
+  }
+  // no amount changes while the lock is held, so checking first is enough
+  ShmOrderLine *lines = getLines(shm);
+  for (uint32_t line = order->first_line; line != NO_INDEX;
+       line = lines[line].next) {
+    if (lines[line].amount > findProduct(shm, lines[line].product_id)->amount) {
+      unlock(shm);
+      return MATAMAZOM_INSUFFICIENT_AMOUNT;
+    }
+  }
+  for (uint32_t line = order->first_line; line != NO_INDEX;
+       line = lines[line].next) {
+    ShmProduct *product = findProduct(shm, lines[line].product_id);
+    product->amount -= lines[line].amount;
+    product->income += product->price * lines[line].amount;
+  }
+  removeOrder(shm, order);
+  unlock(shm);
+  return MATAMAZOM_SUCCESS;
+}
+
+MatamazomResult mtmShmCancelOrder(MatamazomShm shm, const unsigned int orderId) {
+  if (shm == NULL) {
+    return MATAMAZOM_NULL_ARGUMENT;
+  }
+  lockExclusive(shm);
+  ShmOrder *order = findOrder(shm, orderId);
+  if (order != NULL) {
+    removeOrder(shm, order);
+  }
+  unlock(shm);
+  return order != NULL ? MATAMAZOM_SUCCESS : MATAMAZOM_ORDER_NOT_EXIST;
+}
+
+MatamazomResult mtmShmPrintInventory(MatamazomShm shm, FILE *output) {
+  if (shm == NULL || output == NULL) {
+    return MATAMAZOM_NULL_ARGUMENT;
+  }
+  lockShared(shm);
+  ShmProduct *products = getProducts(shm);
+  uint32_t *index = getIndex(shm);
+  fprintf(output, "Inventory Status:\n");
+  for (uint32_t position = 0; position < shm->header->product_count;
+       position++) {
+    ShmProduct *product = &products[index[position]];
+    mtmPrintProductDetails(product->name, product->id, loadAmount(product),
+                           product->price, output);
+  }
+  unlock(shm);
+  return MATAMAZOM_SUCCESS;
+}
+
+MatamazomResult mtmShmPrintOrder(MatamazomShm shm, const unsigned int orderId,
+                                 FILE *output) {
+  if (shm == NULL || output == NULL) {
+    return MATAMAZOM_NULL_ARGUMENT;
+  }
+  lockShared(shm);
+  ShmOrder *order = findOrder(shm, orderId);
+  if (order == NULL) {
+    unlock(shm);
+    return MATAMAZOM_ORDER_NOT_EXIST;
+  }
+  ShmOrderLine *lines = getLines(shm);
+  double total_price = 0;
+  mtmPrintOrderHeading(orderId, output);
+  for (uint32_t line = order->first_line; line != NO_INDEX;
+       line = lines[line].next) {
+    ShmProduct *product = findProduct(shm, lines[line].product_id);
+    double price = product->price * lines[line].amount;
+    mtmPrintProductDetails(product->name, product->id, lines[line].amount,
+                           price, output);
+    total_price += price;
+  }
+  mtmPrintOrderSummary(total_price, output);
+  unlock(shm);
+  return MATAMAZOM_SUCCESS;
+}
@@ -0,0 +1,221 @@
+#ifndef MATAMAZOM_SHM_H_
+#define MATAMAZOM_SHM_H_
+
+#include <stdio.h>
+#include "matamazom.h"
+
+/**
+ * Shared-memory Matamazom products
+ *
+ * Keeps the products and the orders of a warehouse in a named POSIX
+ * shared-memory segment, so that several processes on the same host can
+ * change a single warehouse directly, without copying it between them. Every
+ * process maps the segment with mtmShmCreate or mtmShmOpen, and gets its own
+ * handle to it.
+ *
+ * The segment is addressed only by offsets from its start, since every process
+ * may map it at a different address. For the same reason it can't hold
+ * function pointers or pointers to custom data, so the price of a product is
+ * a fixed price per unit. The capacities of the segment are fixed when it's
+ * created.
+ *
+ * A process-shared read-write lock guards the segment. Changes of the amounts
+ * of products only share it, and are made with atomic compare-and-swap, so
+ * processes changing amounts don't wait for each other. Adding and removing
+ * products and all the functions of orders hold it exclusively. A process
+ * which dies while holding the lock leaves the segment locked.
+ *
+ * The following functions are available:
+ *   mtmShmCreate                     - Creates a new segment and maps it.
+ *   mtmShmOpen                       - Maps an existing segment.
+ *   mtmShmClose                      - Unmaps a segment.
+ *   mtmShmUnlink                     - Removes a segment's name.
+ *   mtmShmNewProduct                 - Adds a product.
+ *   mtmShmChangeProductAmount        - Changes the amount of a product.
+ *   mtmShmGetProductAmount           - Returns the amount of a product.
+ *   mtmShmClearProduct               - Removes a product.
+ *   mtmShmCreateNewOrder             - Creates an empty order.
+ *   mtmShmChangeProductAmountInOrder - Changes the amount of a product in an
+ *                                      order.
+ *   mtmShmShipOrder                  - Ships an order.
+ *   mtmShmCancelOrder                - Cancels an order.
+ *   mtmShmPrintInventory             - Prints the products.
+ *   mtmShmPrintOrder                 - Prints an order.
+ */
+
+/** The size of the buffer of a product's name, including the '\0' */
+#define MTM_SHM_NAME_SIZE 48
+
+/** Type for a process's handle of a shared-memory products */
+typedef struct MatamazomShm_t *MatamazomShm;
+
+/** The capacities of a shared-memory segment */
+typedef struct MtmShmCapacity_t {
+  unsigned int products;
+  unsigned int orders;
+  unsigned int order_lines; // products in all the orders together
+} MtmShmCapacity;
+
+/**
+ * mtmShmCreate: create a new shared-memory segment with an empty products,
+ * and map it.
+ *
+ * @param name - the name of the segment, as given to shm_open, e.g.
+ *     "/warehouse". A segment with this name must not exist.
+ * @param capacity - the capacities of the segment, all of which must be
+ *     positive.
+ * @return A handle of the new segment in case of success, and NULL otherwise
+ *     (e.g. if the segment exists, or creating it failed)
+ */
+MatamazomShm mtmShmCreate(const char *name, const MtmShmCapacity *capacity);
+
+/**
+ * mtmShmOpen: map an existing shared-memory segment, created by mtmShmCreate
+ * in this process or in another one.
+ *
+ * @param name - the name the segment was created with.
+ * @return A handle of the segment in case of success, and NULL otherwise (e.g.
+ *     if there's no such segment, or it hasn't been initialized yet)
+ */
+MatamazomShm mtmShmOpen(const char *name);
+
+/**
+ * mtmShmClose: unmap a shared-memory segment and free the handle. The segment
+ * and its contents remain for the other processes, and for mtmShmOpen.
+ *
+ * @param shm - the handle to close. A NULL value is allowed, and in that case
+ *     the function does nothing.
+ */
+void mtmShmClose(MatamazomShm shm);
+
+/**
+ * mtmShmUnlink: remove the name of a shared-memory segment. The segment is
+ * freed once all the processes closed it.
+ *
+ * @param name - the name the segment was created with.
+ * @return
+ *     MATAMAZOM_NULL_ARGUMENT - if a NULL argument is passed.
+ *     MATAMAZOM_OUT_OF_MEMORY - if there's no such segment, or removing it
+ *         failed.
+ *     MATAMAZOM_SUCCESS - if the name was removed.
+ */
+MatamazomResult mtmShmUnlink(const char *name);
+
+/**
+ * mtmShmNewProduct: add a new product to a shared-memory products.
+ *
+ * @param shm - products to add the product to.
+ * @param id - new product id. Must be unique.
+ * @param name - name of the product. Must be non-empty, start with a letter or
+ *     a digit, and be shorter than MTM_SHM_NAME_SIZE.
+ * @param amount - the initial amount of the product.
+ * @param amountType - defines what are valid amounts for this product.
+ * @param price - the price of a single unit of the product.
+ * @return
+ *     MATAMAZOM_NULL_ARGUMENT - if shm or name are NULL.
+ *     MATAMAZOM_INVALID_NAME - if name is invalid, or too long.
+ *     MATAMAZOM_INVALID_AMOUNT - if amount < 0, or is not consistent with
+ *         amountType.
+ *     MATAMAZOM_PRODUCT_ALREADY_EXIST - if a product with the given id already
+ *         exist.
+ *     MATAMAZOM_OUT_OF_MEMORY - if the segment is full of products.
+ *     MATAMAZOM_SUCCESS - if product was added successfully.
+ */
+MatamazomResult mtmShmNewProduct(MatamazomShm shm, const unsigned int id,
+                                 const char *name, const double amount,
+                                 const MatamazomAmountType amountType,
+                                 const double price);
+
+/**
+ * mtmShmChangeProductAmount: increase or decrease the amount of an existing
+ * product in a shared-memory products. Changes of different processes are
+ * applied atomically, and none of them is lost.
+ *
+ * @see mtmChangeProductAmount for the parameters and the results.
+ */
+MatamazomResult mtmShmChangeProductAmount(MatamazomShm shm,
+                                          const unsigned int id,
+                                          const double amount);
+
+/**
+ * mtmShmGetProductAmount: return the amount of a product in a shared-memory
+ * products.
+ *
+ * @param shm - the products containing the product.
+ * @param id - the id of the product.
+ * @param outAmount - returns the amount of the product.
+ * @return
+ *     MATAMAZOM_NULL_ARGUMENT - if a NULL argument is passed.
+ *     MATAMAZOM_PRODUCT_NOT_EXIST - if there's no product with the given id.
+ *     MATAMAZOM_SUCCESS - otherwise.
+ */
+MatamazomResult mtmShmGetProductAmount(MatamazomShm shm,
+                                       const unsigned int id,
+                                       double *outAmount);
+
+/**
+ * mtmShmClearProduct: clear a product from a shared-memory products, and
+ * from all the orders.
+ *
+ * @see mtmClearProduct for the parameters and the results.
+ */
+MatamazomResult mtmShmClearProduct(MatamazomShm shm, const unsigned int id);
+
+/**
+ * mtmShmCreateNewOrder: create a new empty order in a shared-memory products,
+ * and return the order's id.
+ *
+ * @param shm - a shared-memory products.
+ * @return
+ *     Positive id of the new order, if successful.
+ *     0 in case of failure, e.g. if the segment is full of orders.
+ */
+unsigned int mtmShmCreateNewOrder(MatamazomShm shm);
+
+/**
+ * mtmShmChangeProductAmountInOrder: add/increase/remove/decrease products in
+ * an existing order of a shared-memory products.
+ *
+ * @see mtmChangeProductAmountInOrder for the parameters and the results.
+ *     MATAMAZOM_OUT_OF_MEMORY is returned if the orders of the segment are
+ *     full of products.
+ */
+MatamazomResult mtmShmChangeProductAmountInOrder(MatamazomShm shm,
+                                                 const unsigned int orderId,
+                                                 const unsigned int productId,
+                                                 const double amount);
+
+/**
+ * mtmShmShipOrder: ship an order and remove it from a shared-memory products.
+ * Either the whole order is shipped, or nothing is changed.
+ *
+ * @see mtmShipOrder for the parameters and the results.
+ */
+MatamazomResult mtmShmShipOrder(MatamazomShm shm, const unsigned int orderId);
+
+/**
+ * mtmShmCancelOrder: cancel an order and remove it from a shared-memory
+ * products.
+ *
+ * @see mtmCancelOrder for the parameters and the results.
+ */
+MatamazomResult mtmShmCancelOrder(MatamazomShm shm, const unsigned int orderId);
+
+/**
+ * mtmShmPrintInventory: print a shared-memory products as mtmPrintInventory
+ * prints a Matamazom products.
+ *
+ * @see mtmPrintInventory for the parameters and the results.
+ */
+MatamazomResult mtmShmPrintInventory(MatamazomShm shm, FILE *output);
+
+/**
+ * mtmShmPrintOrder: print an order of a shared-memory products as
+ * mtmPrintOrder prints an order of a Matamazom products.
+ *
+ * @see mtmPrintOrder for the parameters and the results.
+ */
+MatamazomResult mtmShmPrintOrder(MatamazomShm shm, const unsigned int orderId,
+                                 FILE *output);
+
+#endif /* MATAMAZOM_SHM_H_ */
@@ -0,0 +1,681 @@
+/* sockets, epoll and memory streams are POSIX (or Linux), and aren't declared
+ * by a strict C99 library */
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "matamazom.h"
+#include "matamazom_protocol.h"
+
+/**
+ * matamazomd - serves a Matamazom products over a Unix domain socket
+ *
+ * usage: matamazomd [socket path]
+ *
+ * A single thread runs an epoll loop which accepts connections, reads frames
+ * of requests and writes frames of responses (@see matamazom_protocol.h).
+ * Complete frames are passed to a single warehouse thread, which owns the
+ * Matamazom products, so the products are never locked. The warehouse thread
+ * takes all the frames waiting for it at once, and answers them in the order
+ * they arrived in, so the frames of every connection are answered in order.
+ *
+ * A request with an unknown opcode or with malformed arguments is answered
+ * with MATAMAZOM_NULL_ARGUMENT. A connection sending a frame larger than
+ * MTM_MAX_FRAME_SIZE is closed. A client may shut down the sending side of its
+ * connection (shutdown(SHUT_WR)) and still receive the responses to the frames
+ * it sent, after which the server closes the connection.
+ */
+
+#define DEFAULT_SOCKET_PATH "/tmp/matamazomd.sock"
+#define MAX_EVENTS 64
+#define READ_SIZE 65536
+#define LISTEN_BACKLOG 128
+
+typedef struct Connection_t {
+  int fd;
+  MtmBuffer input;
+  MtmBuffer output;
+  unsigned int pending; // frames passed to the warehouse thread, unanswered
+  bool closed; // freed once no frames are pending
+  bool finished; // the client won't send more frames
+  bool watching_output; // waiting for the socket to become writable
+  struct Connection_t *previous;
+  struct Connection_t *next;
+} Connection;
+
+/* a frame of requests, which is replaced by the frame of responses */
+typedef struct Job_t {
+  struct Job_t *next;
+  Connection *connection;
+  MtmBuffer frame;
+  bool failed;
+} Job;
+
+typedef struct JobQueue_t {
+  pthread_mutex_t lock;
+  pthread_cond_t ready;
+  Job *head;
+  Job *tail;
+  bool stopped;
+} JobQueue;
+
+typedef struct Server_t {
+  Matamazom matamazom;
+  JobQueue requests;
+  JobQueue responses;
+  int event_fd; // signaled by the warehouse thread when it answered frames
+  int epoll_fd;
+  Connection *connections;
+} Server;
+
+/* the epoll data of the descriptors which aren't connections */
+static char listen_marker;
+static char event_marker;
+
+static volatile sig_atomic_t stopping = 0;
+
+static void stop(int signal_number) {
+  (void) signal_number;
+  stopping = 1;
+}
+
+static void jobQueueInit(JobQueue *queue) {
+  pthread_mutex_init(&queue->lock, NULL);
+  pthread_cond_init(&queue->ready, NULL);
+  queue->head = NULL;
+  queue->tail = NULL;
+  queue->stopped = false;
+}
+
+static void freeJobs(Job *job) {
+  while (job != NULL) {
+    Job *next = job->next;
+    mtmBufferRelease(&job->frame);
+    free(job);
+    job = next;
+  }
+}
+
+static void jobQueueRelease(JobQueue *queue) {
+  freeJobs(queue->head);
+  pthread_mutex_destroy(&queue->lock);
+  pthread_cond_destroy(&queue->ready);
+}
+
+/* appending a list of jobs to a queue */
+static void jobQueuePush(JobQueue *queue, Job *head, Job *tail) {
+  if (head == NULL) {
+    return;
+  }
+  pthread_mutex_lock(&queue->lock);
+  if (queue->tail != NULL) {
+    queue->tail->next = head;
+  } else {
+    queue->head = head;
+  }
+  queue->tail = tail;
+  pthread_cond_signal(&queue->ready);
+  pthread_mutex_unlock(&queue->lock);
+}
+
+/* taking all the jobs of a queue. if 'wait' is true, waits until there are
+ * some, or the queue is stopped */
+static Job *jobQueueTakeAll(JobQueue *queue, bool wait) {
+  pthread_mutex_lock(&queue->lock);
+  while (wait && queue->head == NULL && !queue->stopped) {
+    pthread_cond_wait(&queue->ready, &queue->lock);
+  }
+  Job *jobs = queue->head;
+  queue->head = NULL;
+  queue->tail = NULL;
+  pthread_mutex_unlock(&queue->lock);
+  return jobs;
+}
+
+static void jobQueueStop(JobQueue *queue) {
+  pthread_mutex_lock(&queue->lock);
+  queue->stopped = true;
+  pthread_cond_broadcast(&queue->ready);
+  pthread_mutex_unlock(&queue->lock);
+}
+
+/* the custom data of a product served by the server is its price of a unit */
+static MtmProductData copyPrice(MtmProductData price) {
+  double *copy = malloc(sizeof(*copy));
+  if (copy != NULL) {
+    *copy = *(double *) price;
+  }
+  return copy;
+}
+
+static void freePrice(MtmProductData price) {
+  free(price);
+}
+
+static double getPrice(MtmProductData price, const double amount) {
+  return *(double *) price * amount;
+}
+
+/* printing with a print function of the products into the response */
+static MatamazomResult printToResponse(MatamazomResult (*print)(Matamazom,
+                                                                FILE *),
+                                       Matamazom matamazom, char **outText,
+                                       size_t *outLength) {
+  FILE *stream = open_memstream(outText, outLength);
+  if (stream == NULL) {
+    return MATAMAZOM_OUT_OF_MEMORY;
+  }
+  MatamazomResult result = print(matamazom, stream);
+  if (fclose(stream) != 0) {
+    result = MATAMAZOM_OUT_OF_MEMORY;
+  }
+  return result;
+}
+
+static MatamazomResult printOrderToResponse(Matamazom matamazom,
+                                            unsigned int orderId,
+                                            char **outText,
+                                            size_t *outLength) {
+  FILE *stream = open_memstream(outText, outLength);
+  if (stream == NULL) {
+    return MATAMAZOM_OUT_OF_MEMORY;
+  }
+  MatamazomResult result = mtmPrintOrder(matamazom, orderId, stream);
+  if (fclose(stream) != 0) {
+    result = MATAMAZOM_OUT_OF_MEMORY;
+  }
+  return result;
+}
+
+/* executing a single request, and appending its response to a frame */
+static bool executeRequest(Matamazom matamazom, MtmMessage *request,
+                           MtmBuffer *response, size_t start) {
+  MtmReader *arguments = &request->arguments;
+  uint32_t id = 0;
+  uint32_t other = 0;
+  double amount = 0;
+  double price = 0;
+  uint32_t order_id = 0;
+  char *text = NULL;
+  size_t text_length = 0;
+  MatamazomResult result = MATAMAZOM_NULL_ARGUMENT;
+  switch (request->code) {
+    case MTM_OP_NEW_PRODUCT:
+      if (mtmReadUint32(arguments, &id) && mtmReadUint32(arguments, &other) &&
+          mtmReadDouble(arguments, &amount) &&
+          mtmReadDouble(arguments, &price)) {
+        // the name is the rest of the arguments, without a '\0'
+        size_t name_length = arguments->size - arguments->offset;
+        char *name = malloc(name_length + 1);
+        if (name == NULL) {
+          result = MATAMAZOM_OUT_OF_MEMORY;
+          break;
+        }
+        memcpy(name, arguments->data + arguments->offset, name_length);
+        name[name_length] = '\0';
+        result = mtmNewProduct(matamazom, id, name, amount,
+                               (MatamazomAmountType) other, &price, copyPrice,
+                               freePrice, getPrice);
+        free(name);
+      }
+      break;
+    case MTM_OP_CHANGE_PRODUCT_AMOUNT:
+      if (mtmReadUint32(arguments, &id) && mtmReadUint32(arguments, &other) &&
+          mtmReadDouble(arguments, &amount)) {
+        result = mtmChangeProductAmount(matamazom, id, amount);
+      }
+      break;
+    case MTM_OP_CLEAR_PRODUCT:
+      if (mtmReadUint32(arguments, &id)) {
+        result = mtmClearProduct(matamazom, id);
+      }
+      break;
+    case MTM_OP_CREATE_NEW_ORDER:
+      order_id = mtmCreateNewOrder(matamazom);
+      result = order_id != 0 ? MATAMAZOM_SUCCESS : MATAMAZOM_OUT_OF_MEMORY;
+      return mtmFrameMessage(response, start, request->tag, result, &order_id,
+                             sizeof(order_id));
+    case MTM_OP_CHANGE_PRODUCT_AMOUNT_IN_ORDER:
+      if (mtmReadUint32(arguments, &order_id) &&
+          mtmReadUint32(arguments, &id) && mtmReadDouble(arguments, &amount)) {
+        result = mtmChangeProductAmountInOrder(matamazom, order_id, id,
+                                               amount);
+      }
+      break;
+    case MTM_OP_SHIP_ORDER:
+      if (mtmReadUint32(arguments, &order_id)) {
+        result = mtmShipOrder(matamazom, order_id);
+      }
+      break;
+    case MTM_OP_CANCEL_ORDER:
+      if (mtmReadUint32(arguments, &order_id)) {
+        result = mtmCancelOrder(matamazom, order_id);
+      }
+      break;
+    case MTM_OP_PRINT_INVENTORY:
+      result = printToResponse(mtmPrintInventory, matamazom, &text,
+                               &text_length);
+      break;
+    case MTM_OP_PRINT_ORDER:
+      if (mtmReadUint32(arguments, &order_id)) {
+        result = printOrderToResponse(matamazom, order_id, &text,
+                                      &text_length);
+      }
+      break;
+    case MTM_OP_PRINT_BEST_SELLING:
+      result = printToResponse(mtmPrintBestSelling, matamazom, &text,
+                               &text_length);
+      break;
+    default:
+      break;
+  }
+  if (result != MATAMAZOM_SUCCESS) {
+    text_length = 0;
+  }
+  bool appended = mtmFrameMessage(response, start, request->tag, result, text,
+                                  (uint32_t) text_length);
+  // the memory streams' buffers are allocated by the C library
+  free(text);
+  return appended;
+}
+
+/* answering all the requests of a job's frame */
+static void executeJob(Matamazom matamazom, Job *job) {
+  MtmBuffer response;
+  mtmBufferInit(&response);
+  size_t start = 0;
+  uint32_t count = 0;
+  MtmReader reader;
+  mtmReaderInit(&reader, job->frame.data, job->frame.size, &count);
+  bool succeeded = mtmFrameBegin(&response, &start);
+  for (uint32_t index = 0; succeeded && index < count; index++) {
+    MtmMessage request;
+    succeeded = mtmReadMessage(&reader, &request) &&
+        executeRequest(matamazom, &request, &response, start);
+  }
+  mtmFrameEnd(&response, start);
+  mtmBufferRelease(&job->frame);
+  job->frame = response;
+  job->failed = !succeeded;
+}
+
+static void *serveWarehouse(void *argument) {
+  Server *server = argument;
+  const uint64_t signal_value = 1;
+  while (true) {
+    Job *jobs = jobQueueTakeAll(&server->requests, true);
+    if (jobs == NULL) {
+      return NULL; // stopped
+    }
+    Job *tail = jobs;
+    for (Job *job = jobs; job != NULL; job = job->next) {
+      executeJob(server->matamazom, job);
+      tail = job;
+    }
+    jobQueuePush(&server->responses, jobs, tail);
+    if (write(server->event_fd, &signal_value, sizeof(signal_value)) < 0) {
+      perror("matamazomd: write");
+    }
+  }
+}
+
+static bool setNonBlocking(int fd) {
+  int flags = fcntl(fd, F_GETFL, 0);
+  return flags >= 0 && fcntl(fd, F_SETFL, flags | O_NONBLOCK) == 0;
+}
+
+static void freeConnection(Server *server, Connection *connection) {
+  if (connection->previous != NULL) {
+    connection->previous->next = connection->next;
+  } else {
+    server->connections = connection->next;
+  }
+  if (connection->next != NULL) {
+    connection->next->previous = connection->previous;
+  }
+  mtmBufferRelease(&connection->input);
+  mtmBufferRelease(&connection->output);
+  free(connection);
+}
+
+/* closing the socket of a connection. returns whether the connection was
+ * freed, which it is unless frames it sent are still pending */
+static bool closeConnection(Server *server, Connection *connection) {
+  if (connection->closed) {
+    return false;
+  }
+  epoll_ctl(server->epoll_fd, EPOLL_CTL_DEL, connection->fd, NULL);
+  close(connection->fd);
+  connection->closed = true;
+  if (connection->pending == 0) {
+    freeConnection(server, connection);
+    return true;
+  }
+  return false;
+}
+
+/* updating the events of a connection's socket: reading until the client
+ * finished sending, and writing while responses are waiting for the socket */
+static void watchConnection(Server *server, Connection *connection,
+                            bool watchOutput) {
+  struct epoll_event event = {
+      .events = (connection->finished ? 0 : EPOLLIN) |
+          (watchOutput ? EPOLLOUT : 0),
+      .data.ptr = connection};
+  epoll_ctl(server->epoll_fd, EPOLL_CTL_MOD, connection->fd, &event);
+  connection->watching_output = watchOutput;
+}
+
+/* writing as much of the responses of a connection as the socket takes, and
+ * closing a connection which finished once all of its responses are written.
+ * returns whether the connection was freed */
+static bool flushConnection(Server *server, Connection *connection) {
+  size_t written = 0;
+  while (written < connection->output.size) {
+    ssize_t result = send(connection->fd, connection->output.data + written,
+                          connection->output.size - written, MSG_NOSIGNAL);
+    if (result < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      if (errno != EAGAIN && errno != EWOULDBLOCK) {
+        return closeConnection(server, connection);
+      }
+      break;
+    }
+    written += (size_t) result;
+  }
+  mtmBufferConsume(&connection->output, written);
+  if (connection->finished && connection->pending == 0 &&
+      connection->output.size == 0) {
+    return closeConnection(server, connection);
+  }
+  if (connection->watching_output != (connection->output.size > 0)) {
+    watchConnection(server, connection, connection->output.size > 0);
+  }
+  return false;
+}
+
+static void acceptConnections(Server *server, int listen_fd) {
+  while (true) {
+    int fd = accept(listen_fd, NULL, NULL);
+    if (fd < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return; // EAGAIN, or an error of a single connection
+    }
+    Connection *connection = malloc(sizeof(*connection));
+    if (connection == NULL || !setNonBlocking(fd)) {
+      free(connection);
+      close(fd);
+      continue;
+    }
+    connection->fd = fd;
+    mtmBufferInit(&connection->input);
+    mtmBufferInit(&connection->output);
+    connection->pending = 0;
+    connection->closed = false;
+    connection->finished = false;
+    connection->watching_output = false;
+    struct epoll_event event = {.events = EPOLLIN, .data.ptr = connection};
+    if (epoll_ctl(server->epoll_fd, EPOLL_CTL_ADD, fd, &event) != 0) {
+      close(fd);
+      free(connection);
+      continue;
+    }
+    connection->previous = NULL;
+    connection->next = server->connections;
+    if (server->connections != NULL) {
+      server->connections->previous = connection;
+    }
+    server->connections = connection;
+  }
+}
+
+/* passing the complete frames a connection received to the warehouse thread */
+static bool dispatchFrames(Server *server, Connection *connection) {
+  Job *head = NULL;
+  Job *tail = NULL;
+  size_t consumed = 0;
+  bool valid = true;
+  while (true) {
+    const char *data = connection->input.data + consumed;
+    size_t length = mtmFrameLength(data, connection->input.size - consumed);
+    if (length == 0) {
+      break;
+    }
+    Job *job = malloc(sizeof(*job));
+    if (length > MTM_MAX_FRAME_SIZE || job == NULL) {
+      free(job);
+      valid = false;
+      break;
+    }
+    job->next = NULL;
+    job->connection = connection;
+    job->failed = false;
+    mtmBufferInit(&job->frame);
+    if (!mtmBufferAppend(&job->frame, data, length)) {
+      free(job);
+      valid = false;
+      break;
+    }
+    if (tail != NULL) {
+      tail->next = job;
+    } else {
+      head = job;
+    }
+    tail = job;
+    connection->pending++;
+    consumed += length;
+  }
+  mtmBufferConsume(&connection->input, consumed);
+  jobQueuePush(&server->requests, head, tail);
+  return valid;
+}
+
+/* reading the frames a connection sent. a client which finished sending
+ * (e.g. by shutdown(SHUT_WR)) still receives the responses to its frames, and
+ * its connection is closed after they're written. returns whether the
+ * connection was freed */
+static bool readConnection(Server *server, Connection *connection) {
+  while (true) {
+    if (!mtmBufferReserve(&connection->input, READ_SIZE)) {
+      return closeConnection(server, connection);
+    }
+    ssize_t result = recv(connection->fd,
+                          connection->input.data + connection->input.size,
+                          READ_SIZE, 0);
+    if (result < 0 && errno == EINTR) {
+      continue;
+    }
+    if (result < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+      break;
+    }
+    if (result < 0) {
+      return closeConnection(server, connection);
+    }
+    if (result == 0) {
+      // the client finished sending. a partial frame is never completed
+      if (!dispatchFrames(server, connection)) {
+        return closeConnection(server, connection);
+      }
+      connection->finished = true;
+      watchConnection(server, connection, connection->watching_output);
+      return flushConnection(server, connection);
+    }
+    connection->input.size += (size_t) result;
+  }
+  if (!dispatchFrames(server, connection)) {
+    return closeConnection(server, connection);
+  }
+  return false;
+}
+
+/* sending the answered frames to their connections */
+static void deliverResponses(Server *server) {
+  uint64_t signals;
+  if (read(server->event_fd, &signals, sizeof(signals)) < 0 &&
+      errno != EAGAIN) {
+    perror("matamazomd: read");
+  }
+  Job *jobs = jobQueueTakeAll(&server->responses, false);
+  for (Job *job = jobs; job != NULL; job = job->next) {
+    Connection *connection = job->connection;
+    connection->pending--;
+    if (connection->closed) {
+      if (connection->pending == 0) {
+        freeConnection(server, connection);
+      }
+      continue;
+    }
+    if (job->failed || !mtmBufferAppend(&connection->output, job->frame.data,
+                                        job->frame.size)) {
+      closeConnection(server, connection);
+    } else if (!connection->watching_output) {
+      flushConnection(server, connection);
+    }
+  }
+  freeJobs(jobs);
+}
+
+static int listenOn(const char *path) {
+  struct sockaddr_un address;
+  if (strlen(path) >= sizeof(address.sun_path)) {
+    fprintf(stderr, "matamazomd: socket path too long\n");
+    return -1;
+  }
+  memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  strcpy(address.sun_path, path);
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0) {
+    perror("matamazomd: socket");
+    return -1;
+  }
+  unlink(path);
+  if (bind(fd, (struct sockaddr *) &address, sizeof(address)) != 0 ||
+      listen(fd, LISTEN_BACKLOG) != 0 || !setNonBlocking(fd)) {
+    perror("matamazomd: bind");
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+static int runEventLoop(Server *server, int listen_fd) {
+  struct epoll_event event = {.events = EPOLLIN, .data.ptr = &listen_marker};
+  if (epoll_ctl(server->epoll_fd, EPOLL_CTL_ADD, listen_fd, &event) != 0) {
+    perror("matamazomd: epoll_ctl");
+    return 1;
+  }
+  event.data.ptr = &event_marker;
+  if (epoll_ctl(server->epoll_fd, EPOLL_CTL_ADD, server->event_fd,
+                &event) != 0) {
+    perror("matamazomd: epoll_ctl");
+    return 1;
+  }
+  struct epoll_event events[MAX_EVENTS];
+  while (!stopping) {
+    int count = epoll_wait(server->epoll_fd, events, MAX_EVENTS, -1);
+    if (count < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      perror("matamazomd: epoll_wait");
+      return 1;
+    }
+    /* responses are delivered last, since they may free connections which
+     * other events of this batch refer to */
+    bool responses = false;
+    for (int index = 0; index < count; index++) {
+      void *source = events[index].data.ptr;
+      if (source == &listen_marker) {
+        acceptConnections(server, listen_fd);
+      } else if (source == &event_marker) {
+        responses = true;
+      } else {
+        Connection *connection = source;
+        uint32_t ready = events[index].events;
+        if (connection->closed) {
+          continue;
+        }
+        if (connection->finished && (ready & (EPOLLHUP | EPOLLERR))) {
+          // the client is gone, and won't receive the pending responses
+          closeConnection(server, connection);
+          continue;
+        }
+        if ((ready & (EPOLLIN | EPOLLHUP | EPOLLERR)) &&
+            readConnection(server, connection)) {
+          continue;
+        }
+        if (!connection->closed && (ready & EPOLLOUT)) {
+          flushConnection(server, connection);
+        }
+      }
+    }
+    if (responses) {
+      deliverResponses(server);
+    }
+  }
+  return 0;
+}
+
+int main(int argc, char **argv) {
+  const char *path = argc > 1 ? argv[1] : DEFAULT_SOCKET_PATH;
+  struct sigaction action;
+  memset(&action, 0, sizeof(action));
+  action.sa_handler = stop;
+  sigaction(SIGINT, &action, NULL);
+  sigaction(SIGTERM, &action, NULL);
+  action.sa_handler = SIG_IGN;
+  sigaction(SIGPIPE, &action, NULL);
+
+  Server server;
+  server.matamazom = matamazomCreate();
+  server.connections = NULL;
+  server.event_fd = eventfd(0, EFD_NONBLOCK);
+  server.epoll_fd = epoll_create1(0);
+  int listen_fd = listenOn(path);
+  if (server.matamazom == NULL || server.event_fd < 0 ||
+      server.epoll_fd < 0 || listen_fd < 0) {
+    fprintf(stderr, "matamazomd: failed to start\n");
+    return 1;
+  }
+  jobQueueInit(&server.requests);
+  jobQueueInit(&server.responses);
+  pthread_t warehouse;
+  if (pthread_create(&warehouse, NULL, serveWarehouse, &server) != 0) {
+    fprintf(stderr, "matamazomd: failed to start\n");
+    return 1;
+  }
+  int status = runEventLoop(&server, listen_fd);
+
+  jobQueueStop(&server.requests);
+  pthread_join(warehouse, NULL);
+  close(listen_fd);
+  unlink(path);
+  while (server.connections != NULL) {
+    Connection *connection = server.connections;
+    if (!connection->closed) {
+      close(connection->fd);
+    }
+    freeConnection(&server, connection);
+  }
+  jobQueueRelease(&server.requests);
+  jobQueueRelease(&server.responses);
+  close(server.event_fd);
+  close(server.epoll_fd);
+  matamazomDestroy(server.matamazom);
+  return status;
+}
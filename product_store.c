@@ -0,0 +1,115 @@
+#include "product_store.h"
+#include <string.h>
+#include <assert.h>
+#include <math.h>
+
+void productStoreInit(ProductStore *store, const Allocator *allocator) {
+  if (store == NULL) {
+    return;
+  }
+  memset(store, 0, sizeof(*store));
+  store->allocator = allocator != NULL ? allocator : allocatorGetDefault();
+}
+
+void productStoreRelease(ProductStore *store) {
+  if (store == NULL) {
+    return;
+  }
+  // all the columns are a single block, which starts with 'amounts'
+  allocatorFree(store->allocator, store->amounts);
+  allocatorFree(store->allocator, store->names);
+  productStoreInit(store, store->allocator);
+}
+
+/* allocating all the columns as a single block, ordered by decreasing
+ * alignment so that every column is aligned */
+static bool allocateColumns(ProductStore *store, size_t capacity) {
+  char *block = allocatorAllocate(store->allocator,
+                                  capacity * (3 * sizeof(double) +
+                                              sizeof(size_t) +
+                                              sizeof(void *) +
+                                              sizeof(unsigned int) + 1) + 1);
+  if (block == NULL) {
+    return false;
+  }
+  allocatorFree(store->allocator, store->amounts);
+  store->amounts = (double *) block;
+  store->incomes = store->amounts + capacity;
+  store->values = store->incomes + capacity;
+  store->name_offsets = (size_t *) (store->values + capacity);
+  store->infos = (void **) (store->name_offsets + capacity);
+  store->ids = (unsigned int *) (store->infos + capacity);
+  store->types = (unsigned char *) (store->ids + capacity);
+  store->capacity = capacity;
+  return true;
+}
+
+bool productStoreReset(ProductStore *store, size_t rows, size_t namesSize) {
+  assert(store != NULL);
+  store->valid = false;
+  store->size = 0;
+  store->names_size = 0;
+  if (rows > store->capacity && !allocateColumns(store, rows)) {
+    productStoreRelease(store);
+    return false;
+  }
+  if (namesSize > store->names_capacity) {
+    char *names = allocatorAllocate(store->allocator, namesSize);
+    if (names == NULL) {
+      productStoreRelease(store);
+      return false;
+    }
+    allocatorFree(store->allocator, store->names);
+    store->names = names;
+    store->names_capacity = namesSize;
+  }
+  return true;
+}
+
+void productStoreAppend(ProductStore *store, unsigned int id,
+                        const char *name, double amount, double income,
+                        unsigned char type, void *info) {
+  assert(store != NULL && store->size < store->capacity);
+  assert(store->size == 0 || store->ids[store->size - 1] < id);
+  size_t name_size = strlen(name) + 1;
+  assert(store->names_size + name_size <= store->names_capacity);
+  size_t row = store->size++;
+  store->ids[row] = id;
+  store->amounts[row] = amount;
+  store->incomes[row] = income;
+  store->values[row] = NAN;
+  store->types[row] = type;
+  store->infos[row] = info;
+  store->name_offsets[row] = store->names_size;
+  memcpy(store->names + store->names_size, name, name_size);
+  store->names_size += name_size;
+}
+
+size_t productStoreLowerBound(const ProductStore *store, unsigned int id) {
+  size_t low = 0;
+  size_t high = store->size;
+  while (low < high) {
+    size_t middle = low + (high - low) / 2;
+    if (store->ids[middle] < id) {
+      low = middle + 1;
+    } else {
+      high = middle;
+    }
+  }
+  return low;
+}
+
+bool productStoreFind(const ProductStore *store, unsigned int id,
+                      size_t *outRow) {
+  size_t row = productStoreLowerBound(store, id);
+  if (row == store->size || store->ids[row] != id) {
+    return false;
+  }
+  *outRow = row;
+  return true;
+}
+
+const char *productStoreGetName(const ProductStore *store, size_t row) {
+  assert(row < store->size);
+  return store->names + store->name_offsets[row];
+}
@@ -0,0 +1,121 @@
+#ifndef PRODUCT_STORE_H_
+#define PRODUCT_STORE_H_
+
+#include <stddef.h>
+#include <stdbool.h>
+#include "allocator.h"
+
+/**
+ * Columnar product store
+ *
+ * Holds the scalar fields of a warehouse's products as contiguous arrays
+ * (one row per product, sorted by id) so that scans over the whole inventory
+ * stream through memory instead of chasing a pointer per product, and simple
+ * loops over a single column can be vectorized by the compiler. The names are
+ * copied into a single string pool, and each row keeps an opaque pointer to
+ * the product it was built from, for everything which isn't a column.
+ *
+ * The store is a cache: its owner fills it with productStoreReset and
+ * productStoreAppend, may update the amount and income of a row in place, and
+ * invalidates it whenever the rows themselves change. The values of the rows
+ * (the prices of their amounts) are computed by the owner when needed, so
+ * they start as NAN, and must be reset to NAN whenever an amount changes.
+ *
+ * The following functions are available:
+ *   productStoreInit       - Initializes an empty, invalid store
+ *   productStoreRelease    - Frees all the memory held by a store
+ *   productStoreReset      - Empties a store and prepares it for new rows
+ *   productStoreAppend     - Appends a row to a store
+ *   productStoreFind       - Finds the row of a product by its id
+ *   productStoreLowerBound - Finds the first row whose id isn't below an id
+ *   productStoreGetName    - Returns the name of a row
+ */
+
+/** Type for the columnar store */
+typedef struct ProductStore_t {
+  const Allocator *allocator;
+  bool valid; // false until filled, and whenever the rows are out of date
+  size_t size;
+  size_t capacity;
+  unsigned int *ids;
+  double *amounts;
+  double *incomes;
+  double *values; // the price of the amount of each row, or NAN
+  unsigned char *types; // MatamazomAmountType of each row
+  size_t *name_offsets; // offsets into 'names'
+  void **infos; // the product each row was built from
+  char *names;
+  size_t names_size;
+  size_t names_capacity;
+} ProductStore;
+
+/**
+ * productStoreInit: Initializes an empty store. No memory is allocated until
+ * the store is first reset.
+ *
+ * @param store - The store to initialize.
+ * @param allocator - The allocator to allocate the columns with. NULL means
+ *     the default allocator. It must outlive the store.
+ */
+void productStoreInit(ProductStore *store, const Allocator *allocator);
+
+/**
+ * productStoreRelease: Frees all the memory held by a store, which is left
+ * empty and invalid.
+ *
+ * @param store - The store to release. If store is NULL nothing will be done.
+ */
+void productStoreRelease(ProductStore *store);
+
+/**
+ * productStoreReset: Removes all the rows of a store, and makes sure it has
+ * room for the given number of rows and bytes of names (including the
+ * terminating null characters) so that appending them can't fail.
+ * The store is invalid after this call, until its owner marks it valid.
+ *
+ * @param store - The store to reset.
+ * @param rows - The number of rows about to be appended.
+ * @param namesSize - The total size of the names about to be appended.
+ * @return
+ *     false if a memory allocation failed, in which case the store is empty.
+ *     true otherwise.
+ */
+bool productStoreReset(ProductStore *store, size_t rows, size_t namesSize);
+
+/**
+ * productStoreAppend: Appends a row to a store, whose value is NAN. Rows must
+ * be appended in increasing order of ids, and within the room made by
+ * productStoreReset.
+ */
+void productStoreAppend(ProductStore *store, unsigned int id,
+                        const char *name, double amount, double income,
+                        unsigned char type, void *info);
+
+/**
+ * productStoreFind: Finds the row of a product in a store, by binary search.
+ *
+ * @param store - The store to search.
+ * @param id - The id of the product.
+ * @param outRow - Returns the row of the product if it was found.
+ * @return
+ *     true if the store contains a row with the given id.
+ *     false otherwise.
+ */
+bool productStoreFind(const ProductStore *store, unsigned int id,
+                      size_t *outRow);
+
+/**
+ * productStoreLowerBound: Finds the first row of a store whose id isn't
+ * smaller than the given id, by binary search.
+ *
+ * @return
+ *     The row found, or the size of the store if all the ids are smaller.
+ */
+size_t productStoreLowerBound(const ProductStore *store, unsigned int id);
+
+/**
+ * productStoreGetName: Returns the name of the product in the given row.
+ */
+const char *productStoreGetName(const ProductStore *store, size_t row);
+
+#endif /* PRODUCT_STORE_H_ */
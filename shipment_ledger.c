@@ -0,0 +1,245 @@
+/* mmap, ftruncate and clock_gettime are POSIX, and aren't declared by a strict
+ * C99 library */
+#define _POSIX_C_SOURCE 200809L
+
+#include "shipment_ledger.h"
+#include <string.h>
+#include <assert.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define LEDGER_MAGIC 0x4744454cu
+#define LEDGER_VERSION 1
+#define NANO_IN_SECOND 1000000000u
+
+/* the header takes a whole cache line, so the chunks after it are aligned */
+struct ShipmentLedgerHeader_t {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t chunk_records;
+  uint32_t unused;
+  uint64_t count;
+  uint64_t capacity;
+  uint64_t last_time;
+  char padding[64 - 4 * sizeof(uint32_t) - 3 * sizeof(uint64_t)];
+};
+
+static size_t chunksFor(size_t records) {
+  return (records + SHIPMENT_LEDGER_CHUNK_RECORDS - 1)
+      / SHIPMENT_LEDGER_CHUNK_RECORDS;
+}
+
+static size_t sizeFor(size_t records) {
+  return sizeof(ShipmentLedgerHeader) + chunksFor(records) * sizeof(ShipmentChunk);
+}
+
+void shipmentLedgerInit(ShipmentLedger *ledger, const Allocator *allocator) {
+  if (ledger == NULL) {
+    return;
+  }
+  memset(ledger, 0, sizeof(*ledger));
+  ledger->fd = -1;
+  ledger->allocator = allocator != NULL ? allocator : allocatorGetDefault();
+}
+
+/* returns the capacity of the ledger in the file, or 0 if the file is empty.
+ * fails if the file can't be read, or isn't a ledger. */
+static ShipmentLedgerResult readFileCapacity(int fd, size_t *outCapacity) {
+  struct stat status;
+  if (fstat(fd, &status) != 0) {
+    return SHIPMENT_LEDGER_FAILED;
+  }
+  *outCapacity = 0;
+  if (status.st_size == 0) {
+    return SHIPMENT_LEDGER_SUCCESS;
+  }
+  ShipmentLedgerHeader header;
+  if (pread(fd, &header, sizeof(header), 0) != (ssize_t) sizeof(header)
+      || header.magic != LEDGER_MAGIC || header.version != LEDGER_VERSION
+      || header.chunk_records != SHIPMENT_LEDGER_CHUNK_RECORDS
+      || header.count > header.capacity
+      || (uint64_t) status.st_size < sizeFor((size_t) header.capacity)) {
+    return SHIPMENT_LEDGER_NOT_A_LEDGER;
+  }
+  *outCapacity = (size_t) header.capacity;
+  return SHIPMENT_LEDGER_SUCCESS;
+}
+
+static ShipmentLedgerResult mapFile(ShipmentLedger *ledger, const char *path,
+                                    size_t *capacity, void **outBase) {
+  ledger->fd = open(path, O_RDWR | O_CREAT, S_IRUSR | S_IWUSR);
+  if (ledger->fd < 0) {
+    return SHIPMENT_LEDGER_FAILED;
+  }
+  size_t file_capacity = 0;
+  void *base = MAP_FAILED;
+  ShipmentLedgerResult result = readFileCapacity(ledger->fd, &file_capacity);
+  if (result == SHIPMENT_LEDGER_SUCCESS) {
+    if (file_capacity > *capacity) {
+      *capacity = file_capacity;
+    }
+    if (ftruncate(ledger->fd, (off_t) sizeFor(*capacity)) == 0) {
+      base = mmap(NULL, sizeFor(*capacity), PROT_READ | PROT_WRITE,
+                  MAP_SHARED, ledger->fd, 0);
+    }
+  }
+  if (base == MAP_FAILED) {
+    close(ledger->fd);
+    ledger->fd = -1;
+    return result != SHIPMENT_LEDGER_SUCCESS ? result : SHIPMENT_LEDGER_FAILED;
+  }
+  *outBase = base;
+  return SHIPMENT_LEDGER_SUCCESS;
+}
+
+ShipmentLedgerResult shipmentLedgerOpen(ShipmentLedger *ledger,
+                                        const char *path, size_t capacity) {
+  assert(ledger != NULL && ledger->header == NULL);
+  if (capacity == 0) {
+    capacity = SHIPMENT_LEDGER_CHUNK_RECORDS;
+  }
+  void *base = NULL;
+  if (path != NULL) {
+    ShipmentLedgerResult result = mapFile(ledger, path, &capacity, &base);
+    if (result != SHIPMENT_LEDGER_SUCCESS) {
+      return result;
+    }
+  } else {
+    base = allocatorAllocate(ledger->allocator, sizeFor(capacity));
+    if (base == NULL) {
+      return SHIPMENT_LEDGER_FAILED;
+    }
+    memset(base, 0, sizeof(ShipmentLedgerHeader));
+  }
+  ledger->header = base;
+  ledger->chunks = (ShipmentChunk *) (ledger->header + 1);
+  ledger->capacity = capacity;
+  ledger->mapped_size = sizeFor(capacity);
+  if (ledger->header->magic != LEDGER_MAGIC) {
+    // a new ledger. a new file is all zeros, so its records are too.
+    ledger->header->magic = LEDGER_MAGIC;
+    ledger->header->version = LEDGER_VERSION;
+    ledger->header->chunk_records = SHIPMENT_LEDGER_CHUNK_RECORDS;
+    ledger->header->count = 0;
+    ledger->header->last_time = 0;
+  }
+  ledger->header->capacity = capacity;
+  return SHIPMENT_LEDGER_SUCCESS;
+}
+
+void shipmentLedgerClose(ShipmentLedger *ledger) {
+  if (ledger == NULL || ledger->header == NULL) {
+    return;
+  }
+  if (ledger->fd >= 0) {
+    msync(ledger->header, ledger->mapped_size, MS_SYNC);
+    munmap(ledger->header, ledger->mapped_size);
+    close(ledger->fd);
+  } else {
+    allocatorFree(ledger->allocator, ledger->header);
+  }
+  shipmentLedgerInit(ledger, ledger->allocator);
+}
+
+bool shipmentLedgerIsOpen(const ShipmentLedger *ledger) {
+  return ledger->header != NULL;
+}
+
+bool shipmentLedgerHasRoom(const ShipmentLedger *ledger, size_t records) {
+  return ledger->header != NULL
+      && records <= ledger->capacity - ledger->header->count;
+}
+
+uint64_t shipmentLedgerNow(const ShipmentLedger *ledger) {
+  struct timespec time;
+  clock_gettime(CLOCK_REALTIME, &time);
+  uint64_t now = (uint64_t) time.tv_sec * NANO_IN_SECOND
+      + (uint64_t) time.tv_nsec;
+  uint64_t last = ledger->header != NULL ? ledger->header->last_time : 0;
+  return now > last ? now : last;
+}
+
+void shipmentLedgerAppend(ShipmentLedger *ledger, unsigned int orderId,
+                          unsigned int productId, double amount, double price,
+                          uint64_t time) {
+  assert(shipmentLedgerHasRoom(ledger, 1));
+  assert(time >= ledger->header->last_time);
+  size_t index = (size_t) ledger->header->count;
+  ShipmentChunk *chunk = &ledger->chunks[index / SHIPMENT_LEDGER_CHUNK_RECORDS];
+  size_t slot = index % SHIPMENT_LEDGER_CHUNK_RECORDS;
+  chunk->times[slot] = time;
+  chunk->amounts[slot] = amount;
+  chunk->prices[slot] = price;
+  chunk->order_ids[slot] = orderId;
+  chunk->product_ids[slot] = productId;
+  // the record is counted only once it's complete
+  ledger->header->last_time = time;
+  ledger->header->count = index + 1;
+}
+
+size_t shipmentLedgerCount(const ShipmentLedger *ledger) {
+  return ledger->header != NULL ? (size_t) ledger->header->count : 0;
+}
+
+void shipmentLedgerTruncate(ShipmentLedger *ledger, size_t count) {
+  assert(ledger->header != NULL);
+  if (count < ledger->header->count) {
+    ledger->header->count = count;
+  }
+}
+
+/* returns the first of 'size' sorted times which isn't smaller than time */
+static size_t lowerBound(const uint64_t *times, size_t size, uint64_t time) {
+  size_t low = 0;
+  size_t high = size;
+  while (low < high) {
+    size_t middle = low + (high - low) / 2;
+    if (times[middle] < time) {
+      low = middle + 1;
+    } else {
+      high = middle;
+    }
+  }
+  return low;
+}
+
+double shipmentLedgerRevenue(const ShipmentLedger *ledger, bool allProducts,
+                             unsigned int productId, uint64_t fromTime,
+                             uint64_t toTime, size_t *outCount) {
+  double revenue = 0;
+  size_t count = 0;
+  size_t records = ledger->header != NULL ? (size_t) ledger->header->count : 0;
+  for (size_t first = 0; first < records && fromTime < toTime;
+       first += SHIPMENT_LEDGER_CHUNK_RECORDS) {
+    const ShipmentChunk *chunk =
+        &ledger->chunks[first / SHIPMENT_LEDGER_CHUNK_RECORDS];
+    size_t size = records - first < SHIPMENT_LEDGER_CHUNK_RECORDS ?
+                  records - first : SHIPMENT_LEDGER_CHUNK_RECORDS;
+    if (chunk->times[size - 1] < fromTime) {
+      continue;
+    }
+    if (chunk->times[0] >= toTime) {
+      break; // the chunks are sorted by time as well
+    }
+    size_t begin = lowerBound(chunk->times, size, fromTime);
+    size_t end = lowerBound(chunk->times, size, toTime);
+    if (allProducts) {
+      for (size_t i = begin; i < end; i++) {
+        revenue += chunk->prices[i];
+      }
+      count += end - begin;
+      continue;
+    }
+    // a single column is compared, without branching on the result
+    for (size_t i = begin; i < end; i++) {
+      bool match = chunk->product_ids[i] == productId;
+      revenue += match ? chunk->prices[i] : 0;
+      count += match;
+    }
+  }
+  *outCount = count;
+  return revenue;
+}
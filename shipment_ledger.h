@@ -0,0 +1,166 @@
+#ifndef SHIPMENT_LEDGER_H_
+#define SHIPMENT_LEDGER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "allocator.h"
+
+/**
+ * Shipment ledger
+ *
+ * An append-only record of every product shipped: the order, the product,
+ * the amount, its price and the time it was shipped. The records are kept in
+ * fixed-size chunks of fixed-width columns (all the times of a chunk, then all
+ * the amounts, and so on), so scanning a single column streams through
+ * memory. The ledger is a single mapping of a file (or a single block of
+ * memory) made when it's opened, with a fixed capacity, so appending never
+ * allocates.
+ *
+ * The times are those of the real time clock, in nanoseconds since the epoch,
+ * so they keep increasing when a file is reopened after a reboot, unlike those
+ * of a monotonic clock. They never decrease within a ledger, even if the clock
+ * is set back, so the records of each chunk are sorted by time.
+ *
+ * The following functions are available:
+ *   shipmentLedgerInit     - Initializes a closed ledger
+ *   shipmentLedgerOpen     - Maps a ledger, keeping the records of its file
+ *   shipmentLedgerClose    - Writes a ledger to its file, and unmaps it
+ *   shipmentLedgerIsOpen   - Checks whether a ledger is open
+ *   shipmentLedgerHasRoom  - Checks whether records can be appended
+ *   shipmentLedgerNow      - Returns the time to record shipments with
+ *   shipmentLedgerAppend   - Appends a record
+ *   shipmentLedgerCount    - Returns the number of records
+ *   shipmentLedgerTruncate - Removes the records after a given number
+ *   shipmentLedgerRevenue  - Sums the prices of records in a time window
+ */
+
+/** The number of records in a chunk */
+#define SHIPMENT_LEDGER_CHUNK_RECORDS 1024
+
+/** A chunk of records, one column after another */
+typedef struct ShipmentChunk_t {
+  uint64_t times[SHIPMENT_LEDGER_CHUNK_RECORDS];
+  double amounts[SHIPMENT_LEDGER_CHUNK_RECORDS];
+  double prices[SHIPMENT_LEDGER_CHUNK_RECORDS];
+  uint32_t order_ids[SHIPMENT_LEDGER_CHUNK_RECORDS];
+  uint32_t product_ids[SHIPMENT_LEDGER_CHUNK_RECORDS];
+} ShipmentChunk;
+
+/** The results of opening a ledger */
+typedef enum ShipmentLedgerResult_t {
+  SHIPMENT_LEDGER_SUCCESS = 0,
+  SHIPMENT_LEDGER_FAILED, // couldn't open or map the file, or allocate memory
+  SHIPMENT_LEDGER_NOT_A_LEDGER, // the file exists but isn't a ledger
+} ShipmentLedgerResult;
+
+/** The header at the start of a ledger's memory */
+typedef struct ShipmentLedgerHeader_t ShipmentLedgerHeader;
+
+/** Type for the ledger */
+typedef struct ShipmentLedger_t {
+  ShipmentLedgerHeader *header; // NULL while the ledger is closed
+  ShipmentChunk *chunks;
+  size_t capacity; // in records
+  size_t mapped_size;
+  int fd; // -1 if the ledger isn't backed by a file
+  const Allocator *allocator; // of the memory of a ledger without a file
+} ShipmentLedger;
+
+/**
+ * shipmentLedgerInit: Initializes a closed ledger.
+ *
+ * @param ledger - The ledger to initialize.
+ * @param allocator - The allocator of the memory of a ledger which isn't
+ *     backed by a file. NULL means the default allocator. It must outlive the
+ *     ledger.
+ */
+void shipmentLedgerInit(ShipmentLedger *ledger, const Allocator *allocator);
+
+/**
+ * shipmentLedgerOpen: Maps a ledger with room for 'capacity' records. If path
+ * names an existing ledger file, its records are kept, and its capacity is
+ * only ever increased. If the file doesn't exist (or is empty) it's created.
+ *
+ * @param ledger - A closed ledger.
+ * @param path - The file to map, or NULL to keep the ledger in memory only.
+ * @param capacity - The number of records the ledger can hold.
+ * @return
+ *     SHIPMENT_LEDGER_FAILED if the file couldn't be opened or mapped, or the
+ *     memory couldn't be allocated.
+ *     SHIPMENT_LEDGER_NOT_A_LEDGER if the file exists but isn't a ledger. The
+ *     file isn't changed.
+ *     SHIPMENT_LEDGER_SUCCESS otherwise. If opening fails the ledger stays
+ *     closed.
+ */
+ShipmentLedgerResult shipmentLedgerOpen(ShipmentLedger *ledger,
+                                        const char *path, size_t capacity);
+
+/**
+ * shipmentLedgerClose: Writes the records of a ledger to its file (if it has
+ * one) and unmaps it. If the ledger is closed nothing will be done.
+ */
+void shipmentLedgerClose(ShipmentLedger *ledger);
+
+/**
+ * shipmentLedgerIsOpen: Returns whether a ledger is open.
+ */
+bool shipmentLedgerIsOpen(const ShipmentLedger *ledger);
+
+/**
+ * shipmentLedgerHasRoom: Returns whether a ledger is open and has room for
+ * 'records' more records.
+ */
+bool shipmentLedgerHasRoom(const ShipmentLedger *ledger, size_t records);
+
+/**
+ * shipmentLedgerNow: Returns the current time of a ledger, with which
+ * records are appended: the time of the real time clock, or the time of the
+ * last record if it's later.
+ */
+uint64_t shipmentLedgerNow(const ShipmentLedger *ledger);
+
+/**
+ * shipmentLedgerAppend: Appends a record to a ledger, which must have room
+ * for it (@see shipmentLedgerHasRoom). Doesn't allocate.
+ *
+ * @param time - The time of the shipment, which must not be smaller than the
+ *     time of the last record (@see shipmentLedgerNow).
+ */
+void shipmentLedgerAppend(ShipmentLedger *ledger, unsigned int orderId,
+                          unsigned int productId, double amount, double price,
+                          uint64_t time);
+
+/**
+ * shipmentLedgerCount: Returns the number of records of a ledger, 0 if it's
+ * closed.
+ */
+size_t shipmentLedgerCount(const ShipmentLedger *ledger);
+
+/**
+ * shipmentLedgerTruncate: Removes the records of an open ledger after the
+ * first 'count' records, e.g. those of shipments which were undone. The time
+ * of the ledger doesn't go back, so the times of the records stay sorted.
+ */
+void shipmentLedgerTruncate(ShipmentLedger *ledger, size_t count);
+
+/**
+ * shipmentLedgerRevenue: Sums the prices of the records of a ledger in the
+ * time window [fromTime, toTime). The window is found by binary search in
+ * every chunk it overlaps, and only the first and last times of the chunks
+ * outside of it are read.
+ *
+ * @param ledger - The ledger to scan. May be closed, which counts as empty.
+ * @param allProducts - true to sum the records of all the products, false
+ *     for those of productId only.
+ * @param productId - The product whose records are summed.
+ * @param fromTime - The start of the window.
+ * @param toTime - The end of the window, which isn't in it.
+ * @param outCount - Returns the number of records summed.
+ * @return The sum of the prices.
+ */
+double shipmentLedgerRevenue(const ShipmentLedger *ledger, bool allProducts,
+                             unsigned int productId, uint64_t fromTime,
+                             uint64_t toTime, size_t *outCount);
+
+#endif /* SHIPMENT_LEDGER_H_ */
@@ -0,0 +1,108 @@
+#include "stock_counters.h"
+#include <string.h>
+#include <math.h>
+#include <assert.h>
+
+#define CACHE_LINE_SIZE 64
+
+void stockCountersInit(StockCounters *counters, const Allocator *allocator) {
+  if (counters == NULL) {
+    return;
+  }
+  memset(counters, 0, sizeof(*counters));
+  counters->allocator = allocator != NULL ? allocator : allocatorGetDefault();
+}
+
+void stockCountersRelease(StockCounters *counters) {
+  if (counters == NULL) {
+    return;
+  }
+  allocatorFree(counters->allocator, counters->block);
+  stockCountersInit(counters, counters->allocator);
+}
+
+bool stockCountersReset(StockCounters *counters, size_t size) {
+  assert(counters != NULL);
+  counters->size = 0;
+  if (size <= counters->capacity) {
+    return true;
+  }
+  /* the counters start at a cache line, so no two of them share one, and
+   * the ids follow them */
+  char *block = allocatorAllocate(counters->allocator,
+                                  size * (sizeof(StockCounter) +
+                                          sizeof(unsigned int)) +
+                                  CACHE_LINE_SIZE);
+  if (block == NULL) {
+    stockCountersRelease(counters);
+    return false;
+  }
+  allocatorFree(counters->allocator, counters->block);
+  counters->block = block;
+  uintptr_t offset = (uintptr_t) block % CACHE_LINE_SIZE;
+  counters->counters = (StockCounter *) (block + (offset > 0 ?
+                                                  CACHE_LINE_SIZE - offset
+                                                             : 0));
+  counters->ids = (unsigned int *) (counters->counters + size);
+  counters->capacity = size;
+  return true;
+}
+
+static int64_t toFixedPoint(double amount) {
+  return llround(amount * STOCK_COUNTERS_SCALE);
+}
+
+void stockCountersAppend(StockCounters *counters, unsigned int id,
+                         double amount, double floor,
+                         MatamazomAmountType type) {
+  assert(counters->size < counters->capacity);
+  assert(counters->size == 0 || counters->ids[counters->size - 1] < id);
+  assert(amount >= 0 && amount <= STOCK_COUNTERS_MAX_AMOUNT);
+  StockCounter *counter = &counters->counters[counters->size];
+  counter->amount = toFixedPoint(amount);
+  counter->initial_amount = counter->amount;
+  counter->floor = toFixedPoint(floor);
+  counter->type = type;
+  counters->ids[counters->size++] = id;
+}
+
+StockCounter *stockCountersFind(const StockCounters *counters,
+                                unsigned int id) {
+  size_t low = 0;
+  size_t high = counters->size;
+  while (low < high) {
+    size_t middle = low + (high - low) / 2;
+    if (counters->ids[middle] < id) {
+      low = middle + 1;
+    } else {
+      high = middle;
+    }
+  }
+  return low < counters->size && counters->ids[low] == id
+         ? &counters->counters[low] : NULL;
+}
+
+bool stockCountersChange(StockCounter *counter, double amount) {
+  if (fabs(amount) > STOCK_COUNTERS_MAX_AMOUNT) {
+    return false;
+  }
+  int64_t change = toFixedPoint(amount);
+  int64_t current = __atomic_load_n(&counter->amount, __ATOMIC_RELAXED);
+  int64_t changed;
+  do {
+    // the checks are repeated for every value seen, inside the loop
+    if ((change < 0 && current + change < counter->floor) ||
+        (change > 0 && current > INT64_MAX - change)) {
+      return false;
+    }
+    changed = current + change;
+  } while (!__atomic_compare_exchange_n(&counter->amount, &current, changed,
+                                        true, __ATOMIC_RELAXED,
+                                        __ATOMIC_RELAXED));
+  return true;
+}
+
+double stockCountersGetChange(const StockCounter *counter) {
+  int64_t amount = __atomic_load_n(&counter->amount, __ATOMIC_RELAXED);
+  return (double) (amount - counter->initial_amount) / STOCK_COUNTERS_SCALE;
+}
@@ -0,0 +1,134 @@
+#ifndef STOCK_COUNTERS_H_
+#define STOCK_COUNTERS_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "allocator.h"
+#include "matamazom.h"
+
+/**
+ * Atomic stock counters
+ *
+ * Keeps the amounts of products as fixed-point integers, in thousandths of a
+ * unit, which may be changed by many threads at once without a lock: a change
+ * is a compare-and-swap loop which checks the new amount isn't below the
+ * product's floor (0, or the amount reserved by orders) before storing it.
+ * The ids of the products are kept sorted in a separate array, so finding a
+ * product is a binary search over memory nobody writes to.
+ *
+ * Adding and removing products isn't thread safe; the counters are filled
+ * once, and then only their amounts change.
+ *
+ * The following functions are available:
+ *   stockCountersInit       - Initializes an empty set of counters
+ *   stockCountersRelease    - Frees all the memory held by counters
+ *   stockCountersReset      - Empties counters, making room for products
+ *   stockCountersAppend     - Adds a product with a bigger id than the rest
+ *   stockCountersFind       - Finds the counter of a product
+ *   stockCountersChange     - Atomically changes the amount of a counter
+ *   stockCountersGetChange  - Returns how much a counter changed in total
+ */
+
+/** The number of units of the fixed-point amounts in a single unit */
+#define STOCK_COUNTERS_SCALE 1000
+
+/** The largest amount a counter can hold */
+#define STOCK_COUNTERS_MAX_AMOUNT ((double) (INT64_MAX / STOCK_COUNTERS_SCALE))
+
+/** The counter of a single product, alone in its cache line */
+typedef struct StockCounter_t {
+  int64_t amount; // changed atomically
+  int64_t initial_amount;
+  int64_t floor;
+  MatamazomAmountType type;
+  char padding[64 - 3 * sizeof(int64_t) - sizeof(MatamazomAmountType)];
+} StockCounter;
+
+/** Type for the counters */
+typedef struct StockCounters_t {
+  const Allocator *allocator;
+  void *block; // the memory of both arrays
+  unsigned int *ids; // sorted
+  StockCounter *counters; // counters[i] is the counter of ids[i]
+  size_t size;
+  size_t capacity;
+} StockCounters;
+
+/**
+ * stockCountersInit: Initializes an empty set of counters. No memory is
+ * allocated until stockCountersReset is called.
+ *
+ * @param counters - The counters to initialize.
+ * @param allocator - The allocator of the counters' memory. NULL means the
+ *     default allocator. It must outlive the counters.
+ */
+void stockCountersInit(StockCounters *counters, const Allocator *allocator);
+
+/**
+ * stockCountersRelease: Frees all the memory held by counters, which are left
+ * empty.
+ *
+ * @param counters - The counters to release. If NULL nothing will be done.
+ */
+void stockCountersRelease(StockCounters *counters);
+
+/**
+ * stockCountersReset: Removes all the products from counters, and makes room
+ * for 'size' products.
+ *
+ * @return
+ *     false if a memory allocation failed, in which case the counters are
+ *     released.
+ *     true otherwise.
+ */
+bool stockCountersReset(StockCounters *counters, size_t size);
+
+/**
+ * stockCountersAppend: Adds a product, whose id is bigger than the ids of all
+ * the products in the counters. There must be room for it (@see
+ * stockCountersReset).
+ *
+ * @param counters - The counters to add the product to.
+ * @param id - The id of the product.
+ * @param amount - The amount of the product. Must be between 0 and
+ *     STOCK_COUNTERS_MAX_AMOUNT.
+ * @param floor - The amount below which the amount can't be changed.
+ * @param type - The amount type of the product, for the caller's use.
+ */
+void stockCountersAppend(StockCounters *counters, unsigned int id,
+                         double amount, double floor,
+                         MatamazomAmountType type);
+
+/**
+ * stockCountersFind: Finds the counter of a product, in O(log n). May be
+ * called by many threads at once.
+ *
+ * @return
+ *     NULL if the product isn't in the counters.
+ *     Its counter otherwise.
+ */
+StockCounter *stockCountersFind(const StockCounters *counters,
+                                unsigned int id);
+
+/**
+ * stockCountersChange: Atomically adds 'amount' to the amount of a counter,
+ * unless it would drop below the counter's floor. May be called by many
+ * threads at once, even for the same counter.
+ *
+ * @param counter - The counter to change.
+ * @param amount - The amount to add, which is rounded to a thousandth.
+ * @return
+ *     false if the amount would have dropped below the floor, or grown beyond
+ *     STOCK_COUNTERS_MAX_AMOUNT, in which case it isn't changed.
+ *     true otherwise.
+ */
+bool stockCountersChange(StockCounter *counter, double amount);
+
+/**
+ * stockCountersGetChange: Returns how much the amount of a counter changed
+ * since it was appended. Not atomic with respect to stockCountersChange.
+ */
+double stockCountersGetChange(const StockCounter *counter);
+
+#endif /* STOCK_COUNTERS_H_ */
@@ -0,0 +1,323 @@
+#include "stock_index.h"
+#include <string.h>
+#include <stdint.h>
+#include <assert.h>
+
+#define INITIAL_CAPACITY 16
+#define NO_SLOT SIZE_MAX
+#define HASH_MULTIPLIER 2654435761u
+
+typedef struct StockHeapEntry_t {
+  double amount;
+  unsigned int id;
+  size_t slot; // the product's slot in the hash table
+} StockHeapEntry;
+
+typedef struct StockSlot_t {
+  bool used;
+  bool has_watermark;
+  unsigned int id;
+  size_t position; // the product's position in the heap
+  double watermark;
+  MtmLowStockCallback callback;
+  void *context;
+} StockSlot;
+
+void stockIndexInit(StockIndex *index, const Allocator *allocator) {
+  if (index == NULL) {
+    return;
+  }
+  index->allocator = allocator != NULL ? allocator : allocatorGetDefault();
+  index->heap = NULL;
+  index->size = 0;
+  index->capacity = 0;
+  index->slots = NULL;
+  index->slot_count = 0;
+}
+
+void stockIndexRelease(StockIndex *index) {
+  if (index == NULL) {
+    return;
+  }
+  allocatorFree(index->allocator, index->heap);
+  allocatorFree(index->allocator, index->slots);
+  stockIndexInit(index, index->allocator);
+}
+
+static size_t homeSlot(const StockIndex *index, unsigned int id) {
+  uint32_t hash = (uint32_t) id * HASH_MULTIPLIER;
+  return (size_t) (hash ^ (hash >> 16)) & (index->slot_count - 1);
+}
+
+static size_t findSlot(const StockIndex *index, unsigned int id) {
+  if (index->slot_count == 0) {
+    return NO_SLOT;
+  }
+  for (size_t slot = homeSlot(index, id); index->slots[slot].used;
+       slot = (slot + 1) & (index->slot_count - 1)) {
+    if (index->slots[slot].id == id) {
+      return slot;
+    }
+  }
+  return NO_SLOT;
+}
+
+/* placing a slot's contents in the table, without checking for room */
+static size_t placeSlot(StockIndex *index, const StockSlot *contents) {
+  size_t slot = homeSlot(index, contents->id);
+  while (index->slots[slot].used) {
+    slot = (slot + 1) & (index->slot_count - 1);
+  }
+  index->slots[slot] = *contents;
+  index->heap[contents->position].slot = slot;
+  return slot;
+}
+
+static bool resizeSlots(StockIndex *index, size_t slot_count) {
+  StockSlot *slots = allocatorAllocate(index->allocator,
+                                       slot_count * sizeof(*slots));
+  if (slots == NULL) {
+    return false;
+  }
+  memset(slots, 0, slot_count * sizeof(*slots));
+  StockSlot *old_slots = index->slots;
+  size_t old_slot_count = index->slot_count;
+  index->slots = slots;
+  index->slot_count = slot_count;
+  for (size_t slot = 0; slot < old_slot_count; slot++) {
+    if (old_slots[slot].used) {
+      placeSlot(index, &old_slots[slot]);
+    }
+  }
+  allocatorFree(index->allocator, old_slots);
+  return true;
+}
+
+/* removing a slot by shifting back the slots after it, so that no slot is
+ * separated from its home slot by an empty one */
+static void removeSlot(StockIndex *index, size_t slot) {
+  size_t mask = index->slot_count - 1;
+  index->slots[slot].used = false;
+  for (size_t next = (slot + 1) & mask; index->slots[next].used;
+       next = (next + 1) & mask) {
+    size_t home = homeSlot(index, index->slots[next].id);
+    // the distance from home to 'slot' is smaller than to 'next'
+    if (((slot - home) & mask) < ((next - home) & mask)) {
+      index->slots[slot] = index->slots[next];
+      index->heap[index->slots[slot].position].slot = slot;
+      index->slots[next].used = false;
+      slot = next;
+    }
+  }
+}
+
+static bool isLess(const StockHeapEntry *entry1, const StockHeapEntry *entry2) {
+  return entry1->amount < entry2->amount ||
+      (entry1->amount == entry2->amount && entry1->id < entry2->id);
+}
+
+static void swapEntries(StockIndex *index, size_t position1, size_t position2) {
+  StockHeapEntry temp = index->heap[position1];
+  index->heap[position1] = index->heap[position2];
+  index->heap[position2] = temp;
+  index->slots[index->heap[position1].slot].position = position1;
+  index->slots[index->heap[position2].slot].position = position2;
+}
+
+static void siftUp(StockIndex *index, size_t position) {
+  while (position > 0) {
+    size_t parent = (position - 1) / 2;
+    if (!isLess(&index->heap[position], &index->heap[parent])) {
+      return;
+    }
+    swapEntries(index, position, parent);
+    position = parent;
+  }
+}
+
+static void siftDown(StockIndex *index, size_t position) {
+  while (true) {
+    size_t smallest = position;
+    for (size_t child = 2 * position + 1;
+         child <= 2 * position + 2 && child < index->size; child++) {
+      if (isLess(&index->heap[child], &index->heap[smallest])) {
+        smallest = child;
+      }
+    }
+    if (smallest == position) {
+      return;
+    }
+    swapEntries(index, position, smallest);
+    position = smallest;
+  }
+}
+
+bool stockIndexInsert(StockIndex *index, unsigned int id, double amount) {
+  assert(index != NULL && findSlot(index, id) == NO_SLOT);
+  if (index->size == index->capacity) {
+    size_t capacity = index->capacity > 0 ? 2 * index->capacity
+                                          : INITIAL_CAPACITY;
+    StockHeapEntry *heap = allocatorAllocate(index->allocator,
+                                             capacity * sizeof(*heap));
+    if (heap == NULL) {
+      return false;
+    }
+    if (index->size > 0) {
+      memcpy(heap, index->heap, index->size * sizeof(*heap));
+    }
+    allocatorFree(index->allocator, index->heap);
+    index->heap = heap;
+    index->capacity = capacity;
+  }
+  if (2 * (index->size + 1) > index->slot_count &&
+      !resizeSlots(index, index->slot_count > 0 ? 2 * index->slot_count
+                                                : 2 * INITIAL_CAPACITY)) {
+    return false;
+  }
+  size_t position = index->size++;
+  index->heap[position].amount = amount;
+  index->heap[position].id = id;
+  StockSlot contents = {.used = true, .has_watermark = false, .id = id,
+      .position = position};
+  placeSlot(index, &contents);
+  siftUp(index, position);
+  return true;
+}
+
+void stockIndexRemove(StockIndex *index, unsigned int id) {
+  size_t slot = findSlot(index, id);
+  if (slot == NO_SLOT) {
+    return;
+  }
+  size_t position = index->slots[slot].position;
+  size_t last = --index->size;
+  if (position != last) {
+    index->heap[position] = index->heap[last];
+    index->slots[index->heap[position].slot].position = position;
+    siftUp(index, position);
+    siftDown(index, position);
+  }
+  removeSlot(index, slot);
+}
+
+bool stockIndexChangeAmount(StockIndex *index, unsigned int id, double amount,
+                            double *outOldAmount) {
+  size_t slot = findSlot(index, id);
+  if (slot == NO_SLOT) {
+    return false;
+  }
+  size_t position = index->slots[slot].position;
+  *outOldAmount = index->heap[position].amount;
+  index->heap[position].amount += amount;
+  if (amount < 0) {
+    siftUp(index, position);
+  } else {
+    siftDown(index, position);
+  }
+  return true;
+}
+
+bool stockIndexSetWatermark(StockIndex *index, unsigned int id,
+                            double watermark, MtmLowStockCallback callback,
+                            void *context) {
+  size_t slot = findSlot(index, id);
+  if (slot == NO_SLOT) {
+    return false;
+  }
+  index->slots[slot].has_watermark = callback != NULL;
+  index->slots[slot].watermark = watermark;
+  index->slots[slot].callback = callback;
+  index->slots[slot].context = context;
+  return true;
+}
+
+bool stockIndexGetWatermark(const StockIndex *index, unsigned int id,
+                            double *outWatermark,
+                            MtmLowStockCallback *outCallback,
+                            void **outContext) {
+  size_t slot = findSlot(index, id);
+  if (slot == NO_SLOT || !index->slots[slot].has_watermark) {
+    return false;
+  }
+  *outWatermark = index->slots[slot].watermark;
+  *outCallback = index->slots[slot].callback;
+  *outContext = index->slots[slot].context;
+  return true;
+}
+
+/* the frontier of a query is a min-heap of positions in the index's heap */
+static void pushFrontier(const StockIndex *index, size_t *frontier,
+                         size_t *size, size_t position) {
+  size_t current = (*size)++;
+  frontier[current] = position;
+  while (current > 0) {
+    size_t parent = (current - 1) / 2;
+    if (!isLess(&index->heap[frontier[current]],
+                &index->heap[frontier[parent]])) {
+      break;
+    }
+    size_t temp = frontier[current];
+    frontier[current] = frontier[parent];
+    frontier[parent] = temp;
+    current = parent;
+  }
+}
+
+static size_t popFrontier(const StockIndex *index, size_t *frontier,
+                          size_t *size) {
+  size_t top = frontier[0];
+  frontier[0] = frontier[--(*size)];
+  size_t current = 0;
+  while (true) {
+    size_t smallest = current;
+    for (size_t child = 2 * current + 1;
+         child <= 2 * current + 2 && child < *size; child++) {
+      if (isLess(&index->heap[frontier[child]],
+                 &index->heap[frontier[smallest]])) {
+        smallest = child;
+      }
+    }
+    if (smallest == current) {
+      return top;
+    }
+    size_t temp = frontier[current];
+    frontier[current] = frontier[smallest];
+    frontier[smallest] = temp;
+    current = smallest;
+  }
+}
+
+bool stockIndexQuery(const StockIndex *index, double threshold,
+                     unsigned int *outIds, size_t maxIds, size_t *outCount) {
+  *outCount = 0;
+  if (maxIds > index->size) {
+    maxIds = index->size;
+  }
+  if (maxIds == 0 || index->heap[0].amount >= threshold) {
+    return true;
+  }
+  /* popping k positions pushes at most 2k + 1, so the frontier never holds
+   * more than maxIds + 1 positions */
+  size_t *frontier = allocatorAllocate(index->allocator,
+                                       (maxIds + 1) * sizeof(*frontier));
+  if (frontier == NULL) {
+    return false;
+  }
+  size_t frontier_size = 0;
+  pushFrontier(index, frontier, &frontier_size, 0);
+  size_t count = 0;
+  while (count < maxIds && frontier_size > 0) {
+    size_t position = popFrontier(index, frontier, &frontier_size);
+    outIds[count++] = index->heap[position].id;
+    // the children are never smaller than their parent
+    for (size_t child = 2 * position + 1;
+         child <= 2 * position + 2 && child < index->size; child++) {
+      if (index->heap[child].amount < threshold) {
+        pushFrontier(index, frontier, &frontier_size, child);
+      }
+    }
+  }
+  allocatorFree(index->allocator, frontier);
+  *outCount = count;
+  return true;
+}
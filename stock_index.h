@@ -0,0 +1,130 @@
+#ifndef STOCK_INDEX_H_
+#define STOCK_INDEX_H_
+
+#include <stddef.h>
+#include <stdbool.h>
+#include "allocator.h"
+#include "matamazom.h"
+
+/**
+ * Low-stock index
+ *
+ * Keeps the amounts of products in a binary min-heap, ordered by amount and
+ * then by id, so the products with the smallest amounts can be found without
+ * scanning all of them. A hash table maps the id of every product to its
+ * position in the heap, together with an optional low-stock watermark of the
+ * product.
+ *
+ * The following functions are available:
+ *   stockIndexInit          - Initializes an empty index
+ *   stockIndexRelease       - Frees all the memory held by an index
+ *   stockIndexInsert        - Adds a product to an index
+ *   stockIndexRemove        - Removes a product from an index
+ *   stockIndexChangeAmount  - Changes the amount of a product in an index
+ *   stockIndexSetWatermark  - Sets the low-stock watermark of a product
+ *   stockIndexGetWatermark  - Returns the low-stock watermark of a product
+ *   stockIndexQuery         - Finds the products with the smallest amounts
+ */
+
+/** Type for the index */
+typedef struct StockIndex_t {
+  const Allocator *allocator;
+  struct StockHeapEntry_t *heap;
+  size_t size;
+  size_t capacity;
+  struct StockSlot_t *slots; // hash table of the products, by id
+  size_t slot_count; // a power of 2, at least twice 'size'
+} StockIndex;
+
+/**
+ * stockIndexInit: Initializes an empty index. No memory is allocated until the
+ * first product is inserted.
+ *
+ * @param index - The index to initialize.
+ * @param allocator - The allocator of the index's memory. NULL means the
+ *     default allocator. It must outlive the index.
+ */
+void stockIndexInit(StockIndex *index, const Allocator *allocator);
+
+/**
+ * stockIndexRelease: Frees all the memory held by an index, which is left
+ * empty.
+ *
+ * @param index - The index to release. If index is NULL nothing will be done.
+ */
+void stockIndexRelease(StockIndex *index);
+
+/**
+ * stockIndexInsert: Adds a product which isn't in an index yet, without a
+ * watermark, in O(log n).
+ *
+ * @return
+ *     false if a memory allocation failed, in which case the index is unchanged.
+ *     true otherwise.
+ */
+bool stockIndexInsert(StockIndex *index, unsigned int id, double amount);
+
+/**
+ * stockIndexRemove: Removes a product from an index, in O(log n). Does nothing
+ * if the product isn't in the index.
+ */
+void stockIndexRemove(StockIndex *index, unsigned int id);
+
+/**
+ * stockIndexChangeAmount: Adds 'amount' to the amount of a product in an
+ * index, in O(log n).
+ *
+ * @param index - The index containing the product.
+ * @param id - The id of the product.
+ * @param amount - The amount to add, may be negative.
+ * @param outOldAmount - Returns the amount of the product before the change.
+ * @return
+ *     false if the product isn't in the index.
+ *     true otherwise.
+ */
+bool stockIndexChangeAmount(StockIndex *index, unsigned int id, double amount,
+                            double *outOldAmount);
+
+/**
+ * stockIndexSetWatermark: Sets the low-stock watermark of a product in an
+ * index. A NULL callback removes the watermark.
+ *
+ * @return
+ *     false if the product isn't in the index.
+ *     true otherwise.
+ */
+bool stockIndexSetWatermark(StockIndex *index, unsigned int id,
+                            double watermark, MtmLowStockCallback callback,
+                            void *context);
+
+/**
+ * stockIndexGetWatermark: Returns the low-stock watermark of a product in an
+ * index.
+ *
+ * @return
+ *     false if the product isn't in the index or has no watermark.
+ *     true otherwise.
+ */
+bool stockIndexGetWatermark(const StockIndex *index, unsigned int id,
+                            double *outWatermark,
+                            MtmLowStockCallback *outCallback,
+                            void **outContext);
+
+/**
+ * stockIndexQuery: Finds the products whose amount is smaller than a
+ * threshold, in increasing order of amounts (and of ids, for equal amounts).
+ * Finding k products takes O(k log k), however many products the index has.
+ *
+ * @param index - The index to search.
+ * @param threshold - Only products with smaller amounts are found.
+ * @param outIds - A buffer of maxIds ids for the found products.
+ * @param maxIds - The maximal number of products to find.
+ * @param outCount - Returns the number of products found.
+ * @return
+ *     false if a memory allocation failed.
+ *     true otherwise.
+ */
+bool stockIndexQuery(const StockIndex *index, double threshold,
+                     unsigned int *outIds, size_t maxIds, size_t *outCount);
+
+#endif /* STOCK_INDEX_H_ */
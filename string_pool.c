@@ -0,0 +1,138 @@
+#include "string_pool.h"
+#include <string.h>
+#include <assert.h>
+
+#define INITIAL_BUCKET_COUNT 64
+#define FNV_OFFSET_BASIS 2166136261u
+#define FNV_PRIME 16777619u
+
+typedef struct PooledString_t {
+  struct PooledString_t *next; // the next string in the same bucket
+  size_t hash;
+  size_t ref_count;
+  char chars[];
+} *PooledString;
+
+static PooledString getPooledString(const char *string) {
+  return (PooledString) (string - offsetof(struct PooledString_t, chars));
+}
+
+static size_t hashString(const char *string) {
+  // FNV-1a
+  size_t hash = FNV_OFFSET_BASIS;
+  for (; *string != '\0'; string++) {
+    hash = (hash ^ (unsigned char) *string) * FNV_PRIME;
+  }
+  return hash;
+}
+
+void stringPoolInit(StringPool *pool, const Allocator *allocator) {
+  if (pool == NULL) {
+    return;
+  }
+  pool->allocator = allocator != NULL ? allocator : allocatorGetDefault();
+  pool->buckets = NULL;
+  pool->bucket_count = 0;
+  pool->size = 0;
+}
+
+void stringPoolRelease(StringPool *pool) {
+  if (pool == NULL) {
+    return;
+  }
+  for (size_t bucket = 0; bucket < pool->bucket_count; bucket++) {
+    PooledString pooled = pool->buckets[bucket];
+    while (pooled != NULL) {
+      PooledString next = pooled->next;
+      allocatorFree(pool->allocator, pooled);
+      pooled = next;
+    }
+  }
+  allocatorFree(pool->allocator, pool->buckets);
+  stringPoolInit(pool, pool->allocator);
+}
+
+/* doubling the number of buckets (or creating the first ones). the pool stays
+ * as it is if the allocation fails, it's only slower. */
+static void growPool(StringPool *pool) {
+  size_t bucket_count = pool->bucket_count > 0 ? 2 * pool->bucket_count
+                                               : INITIAL_BUCKET_COUNT;
+  PooledString *buckets = allocatorAllocate(pool->allocator,
+                                            bucket_count * sizeof(*buckets));
+  if (buckets == NULL) {
+    return;
+  }
+  memset(buckets, 0, bucket_count * sizeof(*buckets));
+  for (size_t bucket = 0; bucket < pool->bucket_count; bucket++) {
+    PooledString pooled = pool->buckets[bucket];
+    while (pooled != NULL) {
+      PooledString next = pooled->next;
+      pooled->next = buckets[pooled->hash % bucket_count];
+      buckets[pooled->hash % bucket_count] = pooled;
+      pooled = next;
+    }
+  }
+  allocatorFree(pool->allocator, pool->buckets);
+  pool->buckets = buckets;
+  pool->bucket_count = bucket_count;
+}
+
+const char *stringPoolIntern(StringPool *pool, const char *string) {
+  if (pool == NULL || string == NULL) {
+    return NULL;
+  }
+  size_t hash = hashString(string);
+  if (pool->bucket_count > 0) {
+    for (PooledString pooled = pool->buckets[hash % pool->bucket_count];
+         pooled != NULL; pooled = pooled->next) {
+      if (pooled->hash == hash && strcmp(pooled->chars, string) == 0) {
+        pooled->ref_count++;
+        return pooled->chars;
+      }
+    }
+  }
+  if (pool->size >= pool->bucket_count) {
+    growPool(pool);
+    if (pool->bucket_count == 0) {
+      return NULL;
+    }
+  }
+  size_t length = strlen(string);
+  PooledString pooled = allocatorAllocate(pool->allocator,
+                                          sizeof(*pooled) + length + 1);
+  if (pooled == NULL) {
+    return NULL;
+  }
+  memcpy(pooled->chars, string, length + 1);
+  pooled->hash = hash;
+  pooled->ref_count = 1;
+  pooled->next = pool->buckets[hash % pool->bucket_count];
+  pool->buckets[hash % pool->bucket_count] = pooled;
+  pool->size++;
+  return pooled->chars;
+}
+
+const char *stringPoolRetain(const char *string) {
+  if (string != NULL) {
+    getPooledString(string)->ref_count++;
+  }
+  return string;
+}
+
+void stringPoolDrop(StringPool *pool, const char *string) {
+  if (pool == NULL || string == NULL) {
+    return;
+  }
+  PooledString pooled = getPooledString(string);
+  assert(pooled->ref_count > 0);
+  if (--pooled->ref_count > 0) {
+    return;
+  }
+  PooledString *link = &pool->buckets[pooled->hash % pool->bucket_count];
+  while (*link != pooled) {
+    link = &(*link)->next;
+  }
+  *link = pooled->next;
+  pool->size--;
+  allocatorFree(pool->allocator, pooled);
+}
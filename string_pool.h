@@ -0,0 +1,78 @@
+#ifndef STRING_POOL_H_
+#define STRING_POOL_H_
+
+#include <stddef.h>
+#include "allocator.h"
+
+/**
+ * Refcounted string pool
+ *
+ * Interns strings, so that all the users of equal strings share a single
+ * buffer, and equal interned strings can be compared by their pointers. Every
+ * string in the pool has a reference count, and it's freed when the last
+ * reference to it is dropped.
+ *
+ * The following functions are available:
+ *   stringPoolInit     - Initializes an empty pool
+ *   stringPoolRelease  - Frees all the memory held by a pool
+ *   stringPoolIntern   - Returns the pool's copy of a string
+ *   stringPoolRetain   - Adds a reference to an interned string
+ *   stringPoolDrop     - Drops a reference to an interned string
+ */
+
+/** Type for the pool */
+typedef struct StringPool_t {
+  const Allocator *allocator;
+  struct PooledString_t **buckets;
+  size_t bucket_count;
+  size_t size; // number of strings in the pool
+} StringPool;
+
+/**
+ * stringPoolInit: Initializes an empty pool. No memory is allocated until the
+ * first string is interned.
+ *
+ * @param pool - The pool to initialize.
+ * @param allocator - The allocator of the pool's memory. NULL means the
+ *     default allocator. It must outlive the pool.
+ */
+void stringPoolInit(StringPool *pool, const Allocator *allocator);
+
+/**
+ * stringPoolRelease: Frees all the memory held by a pool, including strings
+ * which are still referenced. The pool is left empty.
+ *
+ * @param pool - The pool to release. If pool is NULL nothing will be done.
+ */
+void stringPoolRelease(StringPool *pool);
+
+/**
+ * stringPoolIntern: Returns the pool's copy of a string, adding it to the pool
+ * if it isn't there yet, and adds a reference to it.
+ *
+ * @param pool - The pool to intern the string in.
+ * @param string - The string to intern.
+ * @return
+ *     NULL if a NULL argument was sent or a memory allocation failed.
+ *     The pool's copy of string otherwise, which must not be modified.
+ */
+const char *stringPoolIntern(StringPool *pool, const char *string);
+
+/**
+ * stringPoolRetain: Adds a reference to a string returned by stringPoolIntern.
+ *
+ * @param string - The interned string.
+ * @return string.
+ */
+const char *stringPoolRetain(const char *string);
+
+/**
+ * stringPoolDrop: Drops a reference to a string returned by stringPoolIntern
+ * or stringPoolRetain, and frees the string if it was the last one.
+ *
+ * @param pool - The pool the string was interned in.
+ * @param string - The interned string. If string is NULL nothing will be done.
+ */
+void stringPoolDrop(StringPool *pool, const char *string);
+
+#endif /* STRING_POOL_H_ */
@@ -11,5 +11,32 @@ int main()
     RUN_TEST(testPrintOrder);
     RUN_TEST(testPrintBestSelling);
     RUN_TEST(testPrintFiltered);
+    RUN_TEST(testMetrics);
+    RUN_TEST(testAllocator);
+    RUN_TEST(testOrderIds);
+    RUN_TEST(testSnapshot);
+    RUN_TEST(testFilterProducts);
+    RUN_TEST(testPrintInventoryParallel);
+    RUN_TEST(testScansAfterChanges);
+    RUN_TEST(testSharedNames);
+    RUN_TEST(testReservationMode);
+    RUN_TEST(testLowStock);
+    RUN_TEST(testSharded);
+    RUN_TEST(testSharedMemory);
+    RUN_TEST(testImportProducts);
+    RUN_TEST(testConcurrentMode);
+    RUN_TEST(testPrintInventoryRange);
+    RUN_TEST(testMergeOrders);
+    RUN_TEST(testSetAlgebra);
+    RUN_TEST(testCheckOrders);
+    RUN_TEST(testProductDemand);
+    RUN_TEST(testShipmentLedger);
+    RUN_TEST(testAggregate);
+    RUN_TEST(testCloneOrder);
+    RUN_TEST(testOrderPool);
+    RUN_TEST(testChangeProductAmounts);
+    RUN_TEST(testTransactions);
+    RUN_TEST(testProtocol);
+    RUN_TEST(testServer);
     return 0;
 }
@@ -1,10 +1,26 @@
+/* the server test uses fork, signals and sockets, which are POSIX */
+#define _POSIX_C_SOURCE 200809L
+
 #include "matamazom_tests.h"
 #include "../matamazom.h"
+#include "../matamazom_sharded.h"
+#include "../matamazom_shm.h"
+#include "../matamazom_protocol.h"
+#include "../amount_set.h"
 #include "test_utilities.h"
 #include <assert.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdlib.h>
+#include <pthread.h>
+#include <math.h>
+#include <limits.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
 
 #define INVENTORY_OUT_FILE "tests/printed_inventory.txt"
 #define INVENTORY_TEST_FILE "tests/expected_inventory.txt"
@@ -17,6 +33,8 @@
 #define FILTERED_OUT_FILE "tests/printed_filtered.txt"
 #define FILTERED_TEST_FILE "tests/expected_filtered.txt"
 
+#define SHM_NAME "/matamazom_tests"
+
 #define ASSERT_OR_DESTROY(expr) ASSERT_TEST_WITH_FREE((expr), matamazomDestroy(mtm))
 
 bool testCreate() {
@@ -52,6 +70,14 @@ static double simplePrice(MtmProductData basePrice, const double amount) {
     return (*(double*)basePrice) * amount;
 }
 
+/* the number of calls to countedPrice */
+static int price_calls = 0;
+
+static double countedPrice(MtmProductData basePrice, const double amount) {
+    price_calls++;
+    return simplePrice(basePrice, amount);
+}
+
 static double buy10Get10ForFree(MtmProductData basePrice, const double amount) {
     double realAmount = amount;
     if (amount >= 20) {
@@ -268,3 +294,1775 @@ bool testPrintFiltered() {
     matamazomDestroy(mtm);
     return true;
 }
+
+bool testMetrics() {
+    Matamazom mtm = matamazomCreate();
+    makeInventory(mtm);
+    unsigned int order = mtmCreateNewOrder(mtm);
+    mtmChangeProductAmountInOrder(mtm, order, 10, 2.0);
+    mtmChangeProductAmountInOrder(mtm, order, 15, 1.0);
+    mtmShipOrder(mtm, order);
+
+    MtmMetrics metrics;
+    ASSERT_OR_DESTROY(mtmGetMetrics(NULL, &metrics) == MATAMAZOM_NULL_ARGUMENT);
+    ASSERT_OR_DESTROY(mtmGetMetrics(mtm, &metrics) == MATAMAZOM_SUCCESS);
+#ifdef MTM_ENABLE_METRICS
+    ASSERT_OR_DESTROY(metrics.api[MTM_METRICS_NEW_PRODUCT].calls == 5);
+    ASSERT_OR_DESTROY(metrics.api[MTM_METRICS_CHANGE_PRODUCT_AMOUNT_IN_ORDER].calls == 2);
+    ASSERT_OR_DESTROY(metrics.api[MTM_METRICS_CHANGE_PRODUCT_AMOUNT_IN_ORDER].errors == 1);
+    ASSERT_OR_DESTROY(metrics.api[MTM_METRICS_SHIP_ORDER].calls == 1);
+    /* shipping cancels the order internally, which isn't a public call */
+    ASSERT_OR_DESTROY(metrics.api[MTM_METRICS_CANCEL_ORDER].calls == 0);
+    ASSERT_OR_DESTROY(metrics.product_walks.lookups > 0);
+    ASSERT_OR_DESTROY(metrics.order_walks.max_steps == 1);
+#else
+    ASSERT_OR_DESTROY(metrics.api[MTM_METRICS_NEW_PRODUCT].calls == 0);
+#endif
+    matamazomDestroy(mtm);
+    return true;
+}
+
+typedef struct {
+    int allocated;
+    int freed;
+} AllocationCounter;
+
+static void *countingAllocate(void *context, size_t size) {
+    ((AllocationCounter*)context)->allocated++;
+    return malloc(size);
+}
+
+static void countingFree(void *context, void *memory) {
+    ((AllocationCounter*)context)->freed++;
+    free(memory);
+}
+
+bool testAllocator() {
+    AllocationCounter counter = {0, 0};
+    Allocator allocator = {countingAllocate, countingFree, &counter};
+    Matamazom mtm = matamazomCreateWithAllocator(&allocator);
+    ASSERT_TEST(mtm != NULL);
+    makeInventory(mtm);
+    int products_allocations = counter.allocated;
+    ASSERT_OR_DESTROY(products_allocations > 0);
+
+    ASSERT_OR_DESTROY(mtmSetCartArena(mtm, 4096) == MATAMAZOM_SUCCESS);
+    unsigned int order = mtmCreateNewOrder(mtm);
+    ASSERT_OR_DESTROY(MATAMAZOM_SUCCESS == mtmChangeProductAmountInOrder(mtm, order, 6, 10.25));
+    ASSERT_OR_DESTROY(MATAMAZOM_SUCCESS == mtmChangeProductAmountInOrder(mtm, order, 7, 1.5));
+    ASSERT_OR_DESTROY(MATAMAZOM_SUCCESS == mtmChangeProductAmountInOrder(mtm, order, 7, -1.5));
+    ASSERT_OR_DESTROY(MATAMAZOM_SUCCESS == mtmShipOrder(mtm, order));
+
+    ASSERT_OR_DESTROY(mtmSetCartArena(mtm, 0) == MATAMAZOM_SUCCESS);
+    order = mtmCreateNewOrder(mtm);
+    ASSERT_OR_DESTROY(MATAMAZOM_SUCCESS == mtmChangeProductAmountInOrder(mtm, order, 4, 1.0));
+    ASSERT_OR_DESTROY(MATAMAZOM_SUCCESS == mtmCancelOrder(mtm, order));
+
+    matamazomDestroy(mtm);
+    ASSERT_TEST(counter.allocated > products_allocations);
+    ASSERT_TEST(counter.allocated == counter.freed);
+    return true;
+}
+
+bool testOrderIds() {
+    Matamazom mtm = matamazomCreate();
+    makeInventory(mtm);
+    unsigned int order1 = mtmCreateNewOrder(mtm);
+    unsigned int order2 = mtmCreateNewOrder(mtm);
+    unsigned int order3 = mtmCreateNewOrder(mtm);
+    ASSERT_OR_DESTROY(order1 < order2 && order2 < order3);
+
+    ASSERT_OR_DESTROY(MATAMAZOM_SUCCESS == mtmCancelOrder(mtm, order2));
+    ASSERT_OR_DESTROY(MATAMAZOM_ORDER_NOT_EXIST == mtmCancelOrder(mtm, order2));
+    ASSERT_OR_DESTROY(MATAMAZOM_SUCCESS == mtmChangeProductAmountInOrder(mtm, order3, 4, 1.0));
+    ASSERT_OR_DESTROY(MATAMAZOM_SUCCESS == mtmCancelOrder(mtm, order3));
+
+    /* ids are never reused, even after the last order is canceled */
+    unsigned int order4 = mtmCreateNewOrder(mtm);
+    ASSERT_OR_DESTROY(order4 > order3);
+    ASSERT_OR_DESTROY(MATAMAZOM_ORDER_NOT_EXIST ==
+                      mtmChangeProductAmountInOrder(mtm, order3, 4, 1.0));
+    ASSERT_OR_DESTROY(MATAMAZOM_SUCCESS == mtmChangeProductAmountInOrder(mtm, order4, 4, 1.0));
+    ASSERT_OR_DESTROY(MATAMAZOM_SUCCESS == mtmShipOrder(mtm, order4));
+    ASSERT_OR_DESTROY(MATAMAZOM_SUCCESS == mtmShipOrder(mtm, order1));
+    ASSERT_OR_DESTROY(MATAMAZOM_ORDER_NOT_EXIST == mtmShipOrder(mtm, order1));
+    matamazomDestroy(mtm);
+    return true;
+}
+
+static bool printedEqual(MatamazomResult (*print)(Matamazom, FILE*),
+                         Matamazom mtm1, Matamazom mtm2) {
+    FILE *file1 = tmpfile();
+    FILE *file2 = tmpfile();
+    assert(file1);
+    assert(file2);
+    print(mtm1, file1);
+    print(mtm2, file2);
+    rewind(file1);
+    rewind(file2);
+    bool result = fileEqual(file1, file2);
+    fclose(file1);
+    fclose(file2);
+    return result;
+}
+
+bool testSnapshot() {
+    Matamazom mtm = matamazomCreate();
+    makeInventory(mtm);
+    Matamazom frozen = mtmSnapshot(mtm);
+    ASSERT_OR_DESTROY(frozen != NULL);
+    Matamazom copy = matamazomCreate();
+    makeInventory(copy);
+
+    ASSERT_OR_DESTROY(MATAMAZOM_SUCCESS == mtmChangeProductAmount(mtm, 10, 5.0));
+    unsigned int order = mtmCreateNewOrder(mtm);
+    mtmChangeProductAmountInOrder(mtm, order, 7, 1.5);
+    mtmChangeProductAmountInOrder(mtm, order, 11, 2.0);
+    ASSERT_OR_DESTROY(MATAMAZOM_SUCCESS == mtmShipOrder(mtm, order));
+    ASSERT_OR_DESTROY(MATAMAZOM_SUCCESS == mtmClearProduct(mtm, 4));
+    double basePrice = 1;
+    ASSERT_OR_DESTROY(MATAMAZOM_SUCCESS ==
+                      mtmNewProduct(mtm, 5, "Garlic", 3, MATAMAZOM_INTEGER_AMOUNT,
+                                    &basePrice, copyDouble, freeDouble, simplePrice));
+
+    /* the snapshot still looks exactly like the untouched inventory */
+    ASSERT_OR_DESTROY(printedEqual(mtmPrintInventory, frozen, copy));
+    ASSERT_OR_DESTROY(printedEqual(mtmPrintBestSelling, frozen, copy));
+    ASSERT_OR_DESTROY(!printedEqual(mtmPrintInventory, frozen, mtm));
+    ASSERT_OR_DESTROY(!printedEqual(mtmPrintBestSelling, frozen, mtm));
+    ASSERT_OR_DESTROY(MATAMAZOM_PRODUCT_NOT_EXIST == mtmChangeProductAmount(frozen, 5, 1));
+    ASSERT_OR_DESTROY(MATAMAZOM_SUCCESS == mtmChangeProductAmount(frozen, 4, 1));
+
+    matamazomDestroy(frozen);
+    matamazomDestroy(copy);
+    matamazomDestroy(mtm);
+
+    /* once the last snapshot (even of a snapshot) is gone, nothing is shared,
+     * so a change updates the store in place and only its product is priced
+     * again, instead of all of them */
+    mtm = matamazomCreate();
+    basePrice = 2;
+    for (unsigned int id = 1; id <= 5; id++) {
+        ASSERT_OR_DESTROY(MATAMAZOM_SUCCESS ==
+                          mtmNewProduct(mtm, id, "Grain", 10, MATAMAZOM_ANY_AMOUNT,
+                                        &basePrice, copyDouble, freeDouble, countedPrice));
+    }
+    frozen = mtmSnapshot(mtm);
+    Matamazom nested = mtmSnapshot(frozen);
+    ASSERT_OR_DESTROY(frozen != NULL && nested != NULL);
+    matamazomDestroy(frozen);
+    ASSERT_OR_DESTROY(MATAMAZOM_SUCCESS == mtmChangeProductAmount(mtm, 1, 1));
+    ASSERT_OR_DESTROY(!printedEqual(mtmPrintInventory, mtm, nested));
+    matamazomDestroy(nested);
+    MtmTotals totals;
+    ASSERT_OR_DESTROY(MATAMAZOM_SUCCESS == mtmAggregate(mtm, &totals, 1));
+    price_calls = 0;
+    ASSERT_OR_DESTROY(MATAMAZOM_SUCCESS == mtmChangeProductAmount(mtm, 3, 1));
+    ASSERT_OR_DESTROY(MATAMAZOM_SUCCESS == mtmAggregate(mtm, &totals, 1));
+    ASSERT_OR_DESTROY(price_calls == 1 && totals.stock_value == 2 * 52);
+    matamazomDestroy(mtm);
+    return true;
+}
+
+static bool nameLongerThan5(const unsigned int id, const char *name,
+                            const double amount, MtmProductData customData) {
+    return strlen(name) > 5;
+}
+
+bool testFilterProducts() {
+    Matamazom mtm = matamazomCreate();
+    makeInventory(mtm);
+    unsigned int ids[5];
+    size_t count = 0;
+
+    MtmFilterSpec all = { .predicates = 0 };
+    ASSERT_OR_DESTROY(MATAMAZOM_SUCCESS == mtmFilterProducts(mtm, &all, ids, 5, &count));
+    ASSERT_OR_DESTROY(count == 5 && ids[0] == 4 && ids[4] == 11);
+
+    MtmFilterSpec low = { .predicates = MTM_FILTER_AMOUNT_BELOW | MTM_FILTER_ID_RANGE,
+                          .amount_below = 100, .min_id = 5, .max_id = 10 };
+    ASSERT_OR_DESTROY(MATAMAZOM_SUCCESS == mtmFilterProducts(mtm, &low, ids, 5, &count));
+    ASSERT_OR_DESTROY(count == 2 && ids[0] == 7 && ids[1] == 10);
+
+    MtmFilterSpec integers = { .predicates = MTM_FILTER_AMOUNT_TYPE,
+                               .amount_type = MATAMAZOM_INTEGER_AMOUNT };
+    ASSERT_OR_DESTROY(MATAMAZOM_SUCCESS == mtmFilterProducts(mtm, &integers, ids, 1, &count));
+    ASSERT_OR_DESTROY(count == 2 && ids[0] == 10);
+
+    MtmFilterSpec names = { .predicates = MTM_FILTER_NAME_PREFIX, .name_prefix = "T",
+                            .residual = nameLongerThan5 };
+    ASSERT_OR_DESTROY(MATAMAZOM_SUCCESS == mtmFilterProducts(mtm, &names, ids, 5, &count));
+    ASSERT_OR_DESTROY(count == 2 && ids[0] == 4 && ids[1] == 10);
+
+    MtmFilterSpec empty_range = { .predicates = MTM_FILTER_ID_RANGE,
+                                  .min_id = 10, .max_id = 4 };
+    ASSERT_OR_DESTROY(MATAMAZOM_SUCCESS == mtmFilterProducts(mtm, &empty_range, NULL, 0, &count));
+    ASSERT_OR_DESTROY(count == 0);
+
+    names.name_prefix = NULL;
+    ASSERT_OR_DESTROY(MATAMAZOM_NULL_ARGUMENT == mtmFilterProducts(mtm, &names, ids, 5, &count));
+    ASSERT_OR_DESTROY(MATAMAZOM_NULL_ARGUMENT == mtmFilterProducts(mtm, &all, NULL, 5, &count));
+
+    matamazomDestroy(mtm);
+    return true;
+}
+
+static bool parallelPrintEqual(Matamazom mtm, unsigned int workers) {
+    FILE *expected = tmpfile();
+    FILE *actual = tmpfile();
+    assert(expected);
+    assert(actual);
+    mtmPrintInventory(mtm, expected);
+    MatamazomResult result = mtmPrintInventoryParallel(mtm, actual, workers);
+    rewind(expected);
+    rewind(actual);
+    bool equal = result == MATAMAZOM_SUCCESS && fileEqual(expected, actual);
+    fclose(expected);
+    fclose(actual);
+    return equal;
+}
+
+bool testPrintInventoryParallel() {
+    Matamazom mtm = matamazomCreate();
+    ASSERT_OR_DESTROY(parallelPrintEqual(mtm, 4));
+    makeInventory(mtm);
+    ASSERT_OR_DESTROY(parallelPrintEqual(mtm, 0));
+    ASSERT_OR_DESTROY(parallelPrintEqual(mtm, 2));
+    ASSERT_OR_DESTROY(parallelPrintEqual(mtm, 16));
+    double basePrice = 1.5;
+    char name[16];
+    for (unsigned int id = 100; id < 1100; id++) {
+        sprintf(name, "Product %u", id);
+        mtmNewProduct(mtm, id, name, id / 3.0, MATAMAZOM_ANY_AMOUNT, &basePrice,
+                      copyDouble, freeDouble, buy10Get10ForFree);
+    }
+    ASSERT_OR_DESTROY(parallelPrintEqual(mtm, 3));
+    ASSERT_OR_DESTROY(parallelPrintEqual(mtm, 8));
+    ASSERT_OR_DESTROY(MATAMAZOM_NULL_ARGUMENT == mtmPrintInventoryParallel(mtm, NULL, 2));
+    matamazomDestroy(mtm);
+    return true;
+}
+
+bool testScansAfterChanges() {
+    Matamazom mtm = matamazomCreate();
+    makeInventory(mtm);
+    unsigned int ids[5];
+    size_t count = 0;
+    MtmFilterSpec low = { .predicates = MTM_FILTER_AMOUNT_BELOW, .amount_below = 5 };
+    ASSERT_OR_DESTROY(MATAMAZOM_SUCCESS == mtmFilterProducts(mtm, &low, ids, 5, &count));
+    ASSERT_OR_DESTROY(count == 1 && ids[0] == 11);
+
+    /* scans see changes of amounts, incomes and of the products themselves */
+    ASSERT_OR_DESTROY(MATAMAZOM_SUCCESS == mtmChangeProductAmount(mtm, 10, -14));
+    unsigned int order = mtmCreateNewOrder(mtm);
+    mtmChangeProductAmountInOrder(mtm, order, 4, 2019.11);
+    ASSERT_OR_DESTROY(MATAMAZOM_SUCCESS == mtmShipOrder(mtm, order));
+    ASSERT_OR_DESTROY(MATAMAZOM_SUCCESS == mtmFilterProducts(mtm, &low, ids, 5, &count));
+    ASSERT_OR_DESTROY(count == 3 && ids[0] == 4 && ids[1] == 10 && ids[2] == 11);
+    FILE *output = tmpfile();
+    ASSERT_OR_DESTROY(MATAMAZOM_SUCCESS == mtmPrintBestSelling(mtm, output));
+    rewind(output);
+    char line[64] = "";
+    fgets(line, sizeof(line), output);
+    fgets(line, sizeof(line), output);
+    fclose(output);
+    ASSERT_OR_DESTROY(strstr(line, "Tomato") != NULL);
+
+    Matamazom frozen = mtmSnapshot(mtm);
+    ASSERT_OR_DESTROY(MATAMAZOM_SUCCESS == mtmClearProduct(mtm, 11));
+    ASSERT_OR_DESTROY(MATAMAZOM_SUCCESS == mtmChangeProductAmount(mtm, 4, 100));
+    ASSERT_OR_DESTROY(MATAMAZOM_SUCCESS == mtmFilterProducts(frozen, &low, ids, 5, &count));
+    ASSERT_OR_DESTROY(count == 3);
+    matamazomDestroy(frozen);
+    ASSERT_OR_DESTROY(MATAMAZOM_SUCCESS == mtmChangeProductAmount(mtm, 10, 1));
+    ASSERT_OR_DESTROY(MATAMAZOM_SUCCESS == mtmFilterProducts(mtm, &low, ids, 5, &count));
+    ASSERT_OR_DESTROY(count == 1 && ids[0] == 10);
+
+    matamazomDestroy(mtm);
+    return true;
+}
+
+bool testSharedNames() {
+    AllocationCounter counter = {0, 0};
+    Allocator allocator = {countingAllocate, countingFree, &counter};
+    Matamazom mtm = matamazomCreateWithAllocator(&allocator);
+    ASSERT_TEST(mtm != NULL);
+    double basePrice = 3;
+    const char *long_name = "Extra Virgin Olive Oil 750ml";
+    ASSERT_OR_DESTROY(MATAMAZOM_SUCCESS ==
+                      mtmNewProduct(mtm, 1, long_name, 100, MATAMAZOM_INTEGER_AMOUNT,
+                                    &basePrice, copyDouble, freeDouble, simplePrice));
+    ASSERT_OR_DESTROY(MATAMAZOM_SUCCESS ==
+                      mtmNewProduct(mtm, 2, "Olive Oil", 100, MATAMAZOM_INTEGER_AMOUNT,
+                                    &basePrice, copyDouble, freeDouble, simplePrice));
+
+    /* copying a product with a long name into a cart allocates no more than
+     * copying one with a short name: the name itself is shared */
+    unsigned int order = mtmCreateNewOrder(mtm);
+    int before = counter.allocated;
+    mtmChangeProductAmountInOrder(mtm, order, 2, 1);
+    int short_name_copy = counter.allocated - before;
+    before = counter.allocated;
+    mtmChangeProductAmountInOrder(mtm, order, 1, 1);
+    ASSERT_OR_DESTROY(counter.allocated - before == short_name_copy);
+
+    MtmFilterSpec extra = { .predicates = MTM_FILTER_NAME_PREFIX, .name_prefix = "Extra" };
+    unsigned int id = 0;
+    size_t count = 0;
+    ASSERT_OR_DESTROY(MATAMAZOM_SUCCESS == mtmFilterProducts(mtm, &extra, &id, 1, &count));
+    ASSERT_OR_DESTROY(count == 1 && id == 1);
+    /* the name outlives the product in the warehouse while a cart uses it */
+    ASSERT_OR_DESTROY(MATAMAZOM_SUCCESS == mtmClearProduct(mtm, 1));
+    ASSERT_OR_DESTROY(MATAMAZOM_SUCCESS ==
+                      mtmNewProduct(mtm, 3, long_name, 1, MATAMAZOM_INTEGER_AMOUNT,
+                                    &basePrice, copyDouble, freeDouble, simplePrice));
+    ASSERT_OR_DESTROY(MATAMAZOM_SUCCESS == mtmShipOrder(mtm, order));
+
+    matamazomDestroy(mtm);
+    ASSERT_TEST(counter.allocated == counter.freed);
+    return true;
+}
+
+static bool reservedEquals(Matamazom mtm, unsigned int id, double expected) {
+    double reserved = -1;
+    return mtmGetReservedAmount(mtm, id, &reserved) == MATAMAZOM_SUCCESS &&
+           reserved == expected;
+}
+
+bool testReservationMode() {
+    Matamazom mtm = matamazomCreate();
+    makeInventory(mtm);
+    unsigned int order1 = mtmCreateNewOrder(mtm);
+    mtmChangeProductAmountInOrder(mtm, order1, 11, 3);
+    ASSERT_OR_DESTROY(reservedEquals(mtm, 11, 0));
+    ASSERT_OR_DESTROY(MATAMAZOM_SUCCESS == mtmSetReservationMode(mtm, true));
+    ASSERT_OR_DESTROY(reservedEquals(mtm, 11, 3));
+
+    /* only 4 Smart TVs, 3 of them are reserved */
+    unsigned int order2 = mtmCreateNewOrder(mtm);
+    ASSERT_OR_DESTROY(MATAMAZOM_INSUFFICIENT_AMOUNT ==
+                      mtmChangeProductAmountInOrder(mtm, order2, 11, 2));
+    ASSERT_OR_DESTROY(MATAMAZOM_SUCCESS == mtmChangeProductAmountInOrder(mtm, order2, 11, 1));
+    ASSERT_OR_DESTROY(reservedEquals(mtm, 11, 4));
+    ASSERT_OR_DESTROY(MATAMAZOM_INSUFFICIENT_AMOUNT == mtmChangeProductAmount(mtm, 11, -1));
+    ASSERT_OR_DESTROY(MATAMAZOM_SUCCESS == mtmCancelOrder(mtm, order2));
+    ASSERT_OR_DESTROY(reservedEquals(mtm, 11, 3));
+    ASSERT_OR_DESTROY(MATAMAZOM_SUCCESS == mtmChangeProductAmountInOrder(mtm, order1, 11, -5));
+    ASSERT_OR_DESTROY(reservedEquals(mtm, 11, 0));
+    ASSERT_OR_DESTROY(MATAMAZOM_SUCCESS == mtmChangeProductAmountInOrder(mtm, order1, 11, 3));
+    ASSERT_OR_DESTROY(MATAMAZOM_SUCCESS == mtmChangeProductAmountInOrder(mtm, order1, 7, 1.5));
+
+    /* shipping turns the reservations into decreases, also of shared products */
+    Matamazom frozen = mtmSnapshot(mtm);
+    ASSERT_OR_DESTROY(MATAMAZOM_SUCCESS == mtmShipOrder(mtm, order1));
+    ASSERT_OR_DESTROY(reservedEquals(mtm, 11, 0) && reservedEquals(mtm, 7, 0));
+    ASSERT_OR_DESTROY(MATAMAZOM_SUCCESS == mtmChangeProductAmount(mtm, 11, -1));
+    ASSERT_OR_DESTROY(MATAMAZOM_INSUFFICIENT_AMOUNT == mtmChangeProductAmount(mtm, 11, -1));
+    ASSERT_OR_DESTROY(MATAMAZOM_SUCCESS == mtmChangeProductAmount(frozen, 11, -4));
+    matamazomDestroy(frozen);
+
+    /* enabling fails if the existing orders can't all be reserved */
+    ASSERT_OR_DESTROY(MATAMAZOM_SUCCESS == mtmSetReservationMode(mtm, false));
+    unsigned int order3 = mtmCreateNewOrder(mtm);
+    unsigned int order4 = mtmCreateNewOrder(mtm);
+    mtmChangeProductAmountInOrder(mtm, order3, 10, 15);
+    mtmChangeProductAmountInOrder(mtm, order4, 10, 1);
+    ASSERT_OR_DESTROY(MATAMAZOM_INSUFFICIENT_AMOUNT == mtmSetReservationMode(mtm, true));
+    ASSERT_OR_DESTROY(reservedEquals(mtm, 10, 0));
+    ASSERT_OR_DESTROY(MATAMAZOM_SUCCESS == mtmCancelOrder(mtm, order3));
+    ASSERT_OR_DESTROY(MATAMAZOM_SUCCESS == mtmSetReservationMode(mtm, true));
+    ASSERT_OR_DESTROY(reservedEquals(mtm, 10, 1));
+
+    matamazomDestroy(mtm);
+    return true;
+}
+
+typedef struct LowStockLog_t {
+    int calls;
+    unsigned int last_id;
+    double last_amount;
+} LowStockLog;
+
+static void logLowStock(const unsigned int id, const double amount, void *context) {
+    LowStockLog *log = context;
+    log->calls++;
+    log->last_id = id;
+    log->last_amount = amount;
+}
+
+bool testLowStock() {
+    Matamazom mtm = matamazomCreate();
+    makeInventory(mtm);
+    unsigned int ids[5];
+    size_t count = 0;
+    ASSERT_OR_DESTROY(MATAMAZOM_SUCCESS == mtmGetLowStock(mtm, 100, ids, 5, &count));
+    ASSERT_OR_DESTROY(count == 3 && ids[0] == 11 && ids[1] == 10 && ids[2] == 7);
+    ASSERT_OR_DESTROY(MATAMAZOM_SUCCESS == mtmGetLowStock(mtm, 100, ids, 2, &count));
+    ASSERT_OR_DESTROY(count == 2 && ids[1] == 10);
+    ASSERT_OR_DESTROY(MATAMAZOM_SUCCESS == mtmGetLowStock(mtm, 4, ids, 5, &count));
+    ASSERT_OR_DESTROY(count == 0);
+
+    LowStockLog global = {0, 0, 0};
+    LowStockLog tomato = {0, 0, 0};
+    ASSERT_OR_DESTROY(MATAMAZOM_SUCCESS == mtmSetLowStockWatermark(mtm, 10, logLowStock, &global));
+    ASSERT_OR_DESTROY(MATAMAZOM_SUCCESS ==
+                      mtmSetProductLowStockWatermark(mtm, 4, 2000, logLowStock, &tomato));
+    ASSERT_OR_DESTROY(MATAMAZOM_PRODUCT_NOT_EXIST ==
+                      mtmSetProductLowStockWatermark(mtm, 5, 1, logLowStock, &tomato));
+
+    /* only crossing the watermark downwards is reported */
+    ASSERT_OR_DESTROY(MATAMAZOM_SUCCESS == mtmChangeProductAmount(mtm, 10, -5));
+    ASSERT_OR_DESTROY(global.calls == 0);
+    ASSERT_OR_DESTROY(MATAMAZOM_SUCCESS == mtmChangeProductAmount(mtm, 10, -1));
+    ASSERT_OR_DESTROY(global.calls == 1 && global.last_id == 10 && global.last_amount == 9);
+    ASSERT_OR_DESTROY(MATAMAZOM_SUCCESS == mtmChangeProductAmount(mtm, 10, -1));
+    ASSERT_OR_DESTROY(global.calls == 1);
+    unsigned int order = mtmCreateNewOrder(mtm);
+    mtmChangeProductAmountInOrder(mtm, order, 4, 20);
+    mtmChangeProductAmountInOrder(mtm, order, 7, 20);
+    ASSERT_OR_DESTROY(MATAMAZOM_SUCCESS == mtmShipOrder(mtm, order));
+    ASSERT_OR_DESTROY(tomato.calls == 1 && tomato.last_id == 4);
+    ASSERT_OR_DESTROY(global.calls == 2 && global.last_id == 7);
+
+    ASSERT_OR_DESTROY(MATAMAZOM_SUCCESS == mtmClearProduct(mtm, 11));
+    double basePrice = 1;
+    mtmNewProduct(mtm, 3, "Garlic", 0.5, MATAMAZOM_ANY_AMOUNT, &basePrice,
+                  copyDouble, freeDouble, simplePrice);
+    ASSERT_OR_DESTROY(MATAMAZOM_SUCCESS == mtmGetLowStock(mtm, 10, ids, 5, &count));
+    ASSERT_OR_DESTROY(count == 3 && ids[0] == 3 && ids[1] == 7 && ids[2] == 10);
+
+    ASSERT_OR_DESTROY(MATAMAZOM_SUCCESS == mtmSetLowStockWatermark(mtm, 10, NULL, NULL));
+    ASSERT_OR_DESTROY(MATAMAZOM_SUCCESS == mtmChangeProductAmount(mtm, 6, -1785));
+    ASSERT_OR_DESTROY(global.calls == 2);
+    matamazomDestroy(mtm);
+    return true;
+}
+
+static bool shardedPrintEqual(MatamazomResult (*print)(Matamazom, FILE*),
+                              MatamazomResult (*printSharded)(MatamazomSharded, FILE*),
+                              Matamazom mtm, MatamazomSharded sharded) {
+    FILE *expected = tmpfile();
+    FILE *actual = tmpfile();
+    assert(expected);
+    assert(actual);
+    print(mtm, expected);
+    MatamazomResult result = printSharded(sharded, actual);
+    rewind(expected);
+    rewind(actual);
+    bool equal = result == MATAMAZOM_SUCCESS && fileEqual(expected, actual);
+    fclose(expected);
+    fclose(actual);
+    return equal;
+}
+
+#define ASSERT_OR_DESTROY_BOTH(expr) \
+    ASSERT_TEST_WITH_FREE((expr), (matamazomDestroy(mtm), mtmShardedDestroy(sharded)))
+
+bool testSharded() {
+    ASSERT_TEST(mtmShardedCreate(0) == NULL);
+    Matamazom mtm = matamazomCreate();
+    MatamazomSharded sharded = mtmShardedCreate(4);
+    ASSERT_OR_DESTROY_BOTH(sharded != NULL);
+    double basePrice = 2.5;
+    char name[16];
+    for (unsigned int id = 1; id <= 40; id++) {
+        sprintf(name, "Product %u", id);
+        mtmNewProduct(mtm, id, name, id, MATAMAZOM_INTEGER_AMOUNT, &basePrice,
+                      copyDouble, freeDouble, simplePrice);
+        ASSERT_OR_DESTROY_BOTH(MATAMAZOM_SUCCESS ==
+                               mtmShardedNewProduct(sharded, id, name, id,
+                                                    MATAMAZOM_INTEGER_AMOUNT, &basePrice,
+                                                    copyDouble, freeDouble, simplePrice));
+    }
+    ASSERT_OR_DESTROY_BOTH(MATAMAZOM_PRODUCT_ALREADY_EXIST ==
+                           mtmShardedNewProduct(sharded, 7, "Again", 1,
+                                                MATAMAZOM_INTEGER_AMOUNT, &basePrice,
+                                                copyDouble, freeDouble, simplePrice));
+    ASSERT_OR_DESTROY_BOTH(shardedPrintEqual(mtmPrintInventory, mtmShardedPrintInventory,
+                                             mtm, sharded));
+
+    /* a batch applies every change, in order, and reports the failed ones */
+    unsigned int ids[] = {3, 41, 3, 20, 3};
+    double amounts[] = {-3, 1, -1, 0.5, 5};
+    MatamazomResult results[5];
+    ASSERT_OR_DESTROY_BOTH(MATAMAZOM_PRODUCT_NOT_EXIST ==
+                           mtmShardedChangeProductAmounts(sharded, ids, amounts, 5, results));
+    ASSERT_OR_DESTROY_BOTH(results[0] == MATAMAZOM_SUCCESS &&
+                           results[1] == MATAMAZOM_PRODUCT_NOT_EXIST &&
+                           results[2] == MATAMAZOM_INSUFFICIENT_AMOUNT &&
+                           results[3] == MATAMAZOM_INVALID_AMOUNT &&
+                           results[4] == MATAMAZOM_SUCCESS);
+    mtmChangeProductAmount(mtm, 3, 2);
+    ASSERT_OR_DESTROY_BOTH(shardedPrintEqual(mtmPrintInventory, mtmShardedPrintInventory,
+                                             mtm, sharded));
+
+    /* an order spanning several shards is shipped whole or not at all */
+    unsigned int order1 = mtmShardedCreateNewOrder(sharded);
+    unsigned int order2 = mtmShardedCreateNewOrder(sharded);
+    unsigned int order3 = mtmShardedCreateNewOrder(sharded);
+    for (unsigned int id = 1; id <= 40; id++) {
+        ASSERT_OR_DESTROY_BOTH(MATAMAZOM_SUCCESS ==
+                               mtmShardedChangeProductAmountInOrder(sharded, order1, id, 1));
+    }
+    ASSERT_OR_DESTROY_BOTH(MATAMAZOM_SUCCESS ==
+                           mtmShardedChangeProductAmountInOrder(sharded, order2, 40, 40));
+    ASSERT_OR_DESTROY_BOTH(MATAMAZOM_PRODUCT_NOT_EXIST ==
+                           mtmShardedChangeProductAmountInOrder(sharded, order2, 41, 1));
+    ASSERT_OR_DESTROY_BOTH(MATAMAZOM_ORDER_NOT_EXIST ==
+                           mtmShardedChangeProductAmountInOrder(sharded, order3 + 1, 1, 1));
+    mtmShardedChangeProductAmountInOrder(sharded, order3, 2, 2);
+    mtmShardedChangeProductAmountInOrder(sharded, order3, 5, 5);
+    ASSERT_OR_DESTROY_BOTH(MATAMAZOM_SUCCESS == mtmShardedChangeProductAmount(sharded, 1, -1));
+    ASSERT_OR_DESTROY_BOTH(MATAMAZOM_INSUFFICIENT_AMOUNT == mtmShardedShipOrder(sharded, order1));
+    mtmChangeProductAmount(mtm, 1, -1);
+    ASSERT_OR_DESTROY_BOTH(shardedPrintEqual(mtmPrintInventory, mtmShardedPrintInventory,
+                                             mtm, sharded));
+
+    unsigned int orders[] = {order2, order1, order3, order2};
+    ASSERT_OR_DESTROY_BOTH(MATAMAZOM_SUCCESS == mtmShardedChangeProductAmount(sharded, 1, 1));
+    ASSERT_OR_DESTROY_BOTH(MATAMAZOM_INSUFFICIENT_AMOUNT ==
+                           mtmShardedShipOrders(sharded, orders, 4, results));
+    ASSERT_OR_DESTROY_BOTH(results[0] == MATAMAZOM_SUCCESS &&
+                           results[1] == MATAMAZOM_INSUFFICIENT_AMOUNT &&
+                           results[2] == MATAMAZOM_SUCCESS &&
+                           results[3] == MATAMAZOM_ORDER_NOT_EXIST);
+    mtmChangeProductAmount(mtm, 1, 1);
+    unsigned int order = mtmCreateNewOrder(mtm);
+    mtmChangeProductAmountInOrder(mtm, order, 40, 40);
+    mtmChangeProductAmountInOrder(mtm, order, 2, 2);
+    mtmChangeProductAmountInOrder(mtm, order, 5, 5);
+    mtmShipOrder(mtm, order);
+    ASSERT_OR_DESTROY_BOTH(shardedPrintEqual(mtmPrintInventory, mtmShardedPrintInventory,
+                                             mtm, sharded));
+    ASSERT_OR_DESTROY_BOTH(MATAMAZOM_SUCCESS == mtmShardedCancelOrder(sharded, order1));
+    ASSERT_OR_DESTROY_BOTH(MATAMAZOM_ORDER_NOT_EXIST == mtmShardedShipOrder(sharded, order1));
+
+    /* the best selling product is found across the shards */
+    ASSERT_OR_DESTROY_BOTH(shardedPrintEqual(mtmPrintBestSelling, mtmShardedPrintBestSelling,
+                                             mtm, sharded));
+    ASSERT_OR_DESTROY_BOTH(MATAMAZOM_SUCCESS == mtmShardedClearProduct(sharded, 40));
+    mtmClearProduct(mtm, 40);
+    ASSERT_OR_DESTROY_BOTH(shardedPrintEqual(mtmPrintBestSelling, mtmShardedPrintBestSelling,
+                                             mtm, sharded));
+    mtmShardedDestroy(sharded);
+
+    /* the shards, the orders and the reports are all allocated by the given
+     * allocator. a single shard runs everything on the calling thread */
+    AllocationCounter counter = {0, 0};
+    Allocator allocator = {countingAllocate, countingFree, &counter};
+    sharded = mtmShardedCreateWithAllocator(1, &allocator);
+    ASSERT_OR_DESTROY_BOTH(sharded != NULL);
+    ASSERT_OR_DESTROY_BOTH(MATAMAZOM_SUCCESS ==
+                           mtmShardedNewProduct(sharded, 1, "Product 1", 5,
+                                                MATAMAZOM_INTEGER_AMOUNT, &basePrice,
+                                                copyDouble, freeDouble, simplePrice));
+    order1 = mtmShardedCreateNewOrder(sharded);
+    ASSERT_OR_DESTROY_BOTH(MATAMAZOM_SUCCESS ==
+                           mtmShardedChangeProductAmountInOrder(sharded, order1, 1, 2));
+    FILE *output = tmpfile();
+    ASSERT_OR_DESTROY_BOTH(output != NULL);
+    MatamazomResult printed = mtmShardedPrintInventory(sharded, output);
+    fclose(output);
+    ASSERT_OR_DESTROY_BOTH(MATAMAZOM_SUCCESS == printed);
+    ASSERT_OR_DESTROY_BOTH(MATAMAZOM_SUCCESS == mtmShardedShipOrder(sharded, order1));
+
+    /* removed orders are freed, so the memory doesn't grow with their number */
+    int outstanding = counter.allocated - counter.freed;
+    for (int index = 0; index < 1000; index++) {
+        unsigned int order = mtmShardedCreateNewOrder(sharded);
+        ASSERT_OR_DESTROY_BOTH(order == order1 + 1 + index);
+        ASSERT_OR_DESTROY_BOTH(MATAMAZOM_SUCCESS ==
+                               mtmShardedChangeProductAmountInOrder(sharded, order, 1, 1));
+        ASSERT_OR_DESTROY_BOTH(MATAMAZOM_SUCCESS == mtmShardedCancelOrder(sharded, order));
+        ASSERT_OR_DESTROY_BOTH(counter.allocated - counter.freed == outstanding);
+    }
+    ASSERT_OR_DESTROY_BOTH(MATAMAZOM_ORDER_NOT_EXIST == mtmShardedCancelOrder(sharded, order1));
+    mtmShardedDestroy(sharded);
+    matamazomDestroy(mtm);
+    ASSERT_TEST(counter.allocated > 0 && counter.allocated == counter.freed);
+    return true;
+}
+
+#define SHM_WORKERS 4
+#define SHM_CHANGES 1000
+
+static void *restockShm(void *argument) {
+    /* every worker maps the segment for itself, as another process would */
+    MatamazomShm shm = mtmShmOpen(SHM_NAME);
+    bool *failed = argument;
+    *failed = shm == NULL;
+    for (int change = 0; !*failed && change < SHM_CHANGES; change++) {
+        *failed = mtmShmChangeProductAmount(shm, 4, 1) != MATAMAZOM_SUCCESS ||
+                  mtmShmChangeProductAmount(shm, 10, -1) != MATAMAZOM_SUCCESS;
+    }
+    mtmShmClose(shm);
+    return NULL;
+}
+
+static bool shmAmountEquals(MatamazomShm shm, unsigned int id, double expected) {
+    double amount = -1;
+    return mtmShmGetProductAmount(shm, id, &amount) == MATAMAZOM_SUCCESS &&
+           amount == expected;
+}
+
+#define ASSERT_OR_CLOSE(expr) \
+    ASSERT_TEST_WITH_FREE((expr), (mtmShmClose(shm), mtmShmClose(other), \
+                                   mtmShmUnlink(SHM_NAME)))
+
+bool testSharedMemory() {
+    mtmShmUnlink(SHM_NAME);
+    MtmShmCapacity capacity = {.products = 8, .orders = 2, .order_lines = 3};
+    MatamazomShm shm = mtmShmCreate(SHM_NAME, &capacity);
+    MatamazomShm other = mtmShmOpen(SHM_NAME);
+    ASSERT_OR_CLOSE(shm != NULL && other != NULL);
+    ASSERT_OR_CLOSE(mtmShmCreate(SHM_NAME, &capacity) == NULL);
+
+    ASSERT_OR_CLOSE(MATAMAZOM_SUCCESS ==
+                    mtmShmNewProduct(shm, 10, "Television", 4 * SHM_CHANGES + 15,
+                                     MATAMAZOM_INTEGER_AMOUNT, 2000));
+    ASSERT_OR_CLOSE(MATAMAZOM_SUCCESS ==
+                    mtmShmNewProduct(other, 4, "Tomato", 2019.11, MATAMAZOM_ANY_AMOUNT, 8.9));
+    ASSERT_OR_CLOSE(MATAMAZOM_SUCCESS ==
+                    mtmShmNewProduct(shm, 7, "Watermelon", 24.5,
+                                     MATAMAZOM_HALF_INTEGER_AMOUNT, 18.5));
+    ASSERT_OR_CLOSE(MATAMAZOM_PRODUCT_ALREADY_EXIST ==
+                    mtmShmNewProduct(other, 7, "Melon", 1, MATAMAZOM_ANY_AMOUNT, 1));
+    ASSERT_OR_CLOSE(MATAMAZOM_INVALID_NAME ==
+                    mtmShmNewProduct(shm, 1, "A name which doesn't fit in the segment's buffer",
+                                     1, MATAMAZOM_ANY_AMOUNT, 1));
+    ASSERT_OR_CLOSE(MATAMAZOM_INVALID_AMOUNT == mtmShmChangeProductAmount(other, 7, 0.3));
+    ASSERT_OR_CLOSE(MATAMAZOM_INSUFFICIENT_AMOUNT == mtmShmChangeProductAmount(other, 7, -25));
+
+    /* concurrent changes through different mappings are never lost */
+    pthread_t threads[SHM_WORKERS];
+    bool failed[SHM_WORKERS];
+    for (int worker = 0; worker < SHM_WORKERS; worker++) {
+        ASSERT_OR_CLOSE(pthread_create(&threads[worker], NULL, restockShm,
+                                       &failed[worker]) == 0);
+    }
+    for (int worker = 0; worker < SHM_WORKERS; worker++) {
+        pthread_join(threads[worker], NULL);
+        ASSERT_OR_CLOSE(!failed[worker]);
+    }
+    ASSERT_OR_CLOSE(shmAmountEquals(shm, 10, 15));
+    ASSERT_OR_CLOSE(MATAMAZOM_SUCCESS == mtmShmChangeProductAmount(shm, 4, -4 * SHM_CHANGES));
+
+    /* the orders are shared too, and shipped whole or not at all */
+    unsigned int order = mtmShmCreateNewOrder(shm);
+    ASSERT_OR_CLOSE(order != 0);
+    ASSERT_OR_CLOSE(MATAMAZOM_SUCCESS == mtmShmChangeProductAmountInOrder(other, order, 10, 16));
+    ASSERT_OR_CLOSE(MATAMAZOM_SUCCESS == mtmShmChangeProductAmountInOrder(shm, order, 4, 1));
+    ASSERT_OR_CLOSE(MATAMAZOM_SUCCESS == mtmShmChangeProductAmountInOrder(shm, order, 7, 2.5));
+    unsigned int full = mtmShmCreateNewOrder(other);
+    ASSERT_OR_CLOSE(full != 0 && mtmShmCreateNewOrder(shm) == 0);
+    ASSERT_OR_CLOSE(MATAMAZOM_OUT_OF_MEMORY == mtmShmChangeProductAmountInOrder(shm, full, 7, 1));
+    ASSERT_OR_CLOSE(MATAMAZOM_SUCCESS == mtmShmCancelOrder(other, full));
+    ASSERT_OR_CLOSE(MATAMAZOM_INSUFFICIENT_AMOUNT == mtmShmShipOrder(other, order));
+    ASSERT_OR_CLOSE(shmAmountEquals(shm, 10, 15) && shmAmountEquals(shm, 7, 24.5));
+    ASSERT_OR_CLOSE(MATAMAZOM_SUCCESS == mtmShmChangeProductAmountInOrder(other, order, 10, -6));
+    ASSERT_OR_CLOSE(MATAMAZOM_SUCCESS == mtmShmClearProduct(other, 4));
+    FILE *output = tmpfile();
+    ASSERT_OR_CLOSE(MATAMAZOM_SUCCESS == mtmShmPrintOrder(shm, order, output));
+    rewind(output);
+    char line[64] = "";
+    int lines = 0;
+    bool cleared = true;
+    while (fgets(line, sizeof(line), output) != NULL) {
+        lines++;
+        cleared = cleared && strstr(line, "Tomato") == NULL;
+    }
+    fclose(output);
+    ASSERT_OR_CLOSE(lines == 5 && cleared);
+    ASSERT_OR_CLOSE(MATAMAZOM_SUCCESS == mtmShmShipOrder(other, order));
+    ASSERT_OR_CLOSE(MATAMAZOM_ORDER_NOT_EXIST == mtmShmShipOrder(shm, order));
+    ASSERT_OR_CLOSE(shmAmountEquals(shm, 10, 5) && shmAmountEquals(other, 7, 22));
+    ASSERT_OR_CLOSE(MATAMAZOM_PRODUCT_NOT_EXIST == mtmShmGetProductAmount(shm, 4, &(double){0}));
+
+    /* a freed order slot gets a new id */
+    unsigned int next = mtmShmCreateNewOrder(other);
+    ASSERT_OR_CLOSE(next != 0 && next != order);
+    ASSERT_OR_CLOSE(MATAMAZOM_SUCCESS == mtmShmCancelOrder(shm, next));
+    ASSERT_OR_CLOSE(MATAMAZOM_ORDER_NOT_EXIST == mtmShmCancelOrder(shm, next));
+
+    mtmShmClose(shm);
+    mtmShmClose(other);
+    ASSERT_TEST(MATAMAZOM_SUCCESS == mtmShmUnlink(SHM_NAME));
+    ASSERT_TEST(mtmShmOpen(SHM_NAME) == NULL);
+    return true;
+}
+
+static MtmProductData makePrice(const double price) {
+    return copyDouble((MtmProductData) &price);
+}
+
+typedef struct RejectedRows_t {
+    size_t lines[16];
+    MatamazomResult reasons[16];
+    size_t count;
+} RejectedRows;
+
+static void recordRejectedRow(const size_t line, const MatamazomResult reason,
+                              void *context) {
+    RejectedRows *rejected = context;
+    if (rejected->count < 16) {
+        rejected->lines[rejected->count] = line;
+        rejected->reasons[rejected->count] = reason;
+    }
+    rejected->count++;
+}
+
+#define ASSERT_OR_DESTROY_WAREHOUSES(expr) \
+    ASSERT_TEST_WITH_FREE((expr), (matamazomDestroy(mtm), matamazomDestroy(expected)))
+
+bool testImportProducts() {
+    Matamazom mtm = matamazomCreate();
+    Matamazom expected = matamazomCreate();
+    makeInventory(mtm);
+    makeInventory(expected);
+    unsigned int ids[5];
+    size_t count = 0;
+    // building the low-stock index, which the import must update as well
+    ASSERT_OR_DESTROY_WAREHOUSES(MATAMAZOM_SUCCESS == mtmGetLowStock(mtm, 0, ids, 0, &count));
+
+    FILE *catalog = tmpfile();
+    ASSERT_OR_DESTROY_WAREHOUSES(catalog != NULL);
+    fputs("20,Cheese,2.5,half_integer,40\n"
+          "1,Apple,30,integer,1.5\n"
+          "4,Tomato,1,any,1\n"
+          "\n"
+          "5,Sparkling mineral water,12,integer,0.75\r\n"
+          "1,Apple again,3,integer,1\n"
+          "8,?Nothing,1,any,1\n"
+          "9,Nails,1.2,integer,0.1\n"
+          "12,Bolts,3,integer\n"
+          "x,Screws,3,integer,1\n"
+          "13,Glue,3,liquid,1\n"
+          "14,Tape,three,integer,1", catalog);
+    rewind(catalog);
+    RejectedRows rejected = { .count = 0 };
+    MtmImportSpec spec = { .makeData = makePrice, .copyData = copyDouble,
+                           .freeData = freeDouble, .prodPrice = simplePrice,
+                           .rejected = recordRejectedRow, .context = &rejected };
+    size_t imported = 0;
+    size_t rejected_count = 0;
+    MatamazomResult result = mtmImportProducts(mtm, catalog, &spec, &imported,
+                                               &rejected_count);
+    fclose(catalog);
+    ASSERT_OR_DESTROY_WAREHOUSES(MATAMAZOM_SUCCESS == result);
+    ASSERT_OR_DESTROY_WAREHOUSES(imported == 3 && rejected_count == 8 && rejected.count == 8);
+    const size_t lines[] = {3, 6, 7, 8, 9, 10, 11, 12};
+    const MatamazomResult reasons[] = {
+        MATAMAZOM_PRODUCT_ALREADY_EXIST, MATAMAZOM_PRODUCT_ALREADY_EXIST,
+        MATAMAZOM_INVALID_NAME, MATAMAZOM_INVALID_AMOUNT, MATAMAZOM_INVALID_FORMAT,
+        MATAMAZOM_INVALID_FORMAT, MATAMAZOM_INVALID_FORMAT, MATAMAZOM_INVALID_AMOUNT};
+    for (size_t i = 0; i < 8; i++) {
+        ASSERT_OR_DESTROY_WAREHOUSES(rejected.lines[i] == lines[i]);
+        ASSERT_OR_DESTROY_WAREHOUSES(rejected.reasons[i] == reasons[i]);
+    }
+
+    double price = 1.5;
+    mtmNewProduct(expected, 1, "Apple", 30, MATAMAZOM_INTEGER_AMOUNT, &price,
+                  copyDouble, freeDouble, simplePrice);
+    price = 0.75;
+    mtmNewProduct(expected, 5, "Sparkling mineral water", 12, MATAMAZOM_INTEGER_AMOUNT,
+                  &price, copyDouble, freeDouble, simplePrice);
+    price = 40;
+    mtmNewProduct(expected, 20, "Cheese", 2.5, MATAMAZOM_HALF_INTEGER_AMOUNT, &price,
+                  copyDouble, freeDouble, simplePrice);
+    FILE *expected_output = tmpfile();
+    FILE *actual_output = tmpfile();
+    assert(expected_output && actual_output);
+    mtmPrintInventory(expected, expected_output);
+    mtmPrintInventory(mtm, actual_output);
+    rewind(expected_output);
+    rewind(actual_output);
+    bool equal = fileEqual(expected_output, actual_output);
+    fclose(expected_output);
+    fclose(actual_output);
+    ASSERT_OR_DESTROY_WAREHOUSES(equal);
+
+    ASSERT_OR_DESTROY_WAREHOUSES(MATAMAZOM_SUCCESS == mtmGetLowStock(mtm, 10, ids, 5, &count));
+    ASSERT_OR_DESTROY_WAREHOUSES(count == 2 && ids[0] == 20 && ids[1] == 11);
+    ASSERT_OR_DESTROY_WAREHOUSES(MATAMAZOM_SUCCESS == mtmChangeProductAmount(mtm, 1, -29));
+    ASSERT_OR_DESTROY_WAREHOUSES(MATAMAZOM_SUCCESS == mtmGetLowStock(mtm, 10, ids, 5, &count));
+    ASSERT_OR_DESTROY_WAREHOUSES(count == 3 && ids[0] == 1);
+
+    spec.makeData = NULL;
+    ASSERT_OR_DESTROY_WAREHOUSES(MATAMAZOM_NULL_ARGUMENT ==
+                           mtmImportProducts(mtm, stdin, &spec, NULL, NULL));
+    matamazomDestroy(mtm);
+    matamazomDestroy(expected);
+    return true;
+}
+
+#define CONCURRENT_WORKERS 4
+#define CONCURRENT_CHANGES 1000
+
+typedef struct ConcurrentWorker_t {
+    Matamazom mtm;
+    bool failed;
+} ConcurrentWorker;
+
+/* every worker adds and takes back Televisions and Watermelons, and in the
+ * end takes a single Television */
+static void *changeConcurrently(void *argument) {
+    ConcurrentWorker *worker = argument;
+    worker->failed = false;
+    for (int change = 0; change < CONCURRENT_CHANGES; change++) {
+        worker->failed |= mtmChangeProductAmount(worker->mtm, 10, 1) != MATAMAZOM_SUCCESS;
+        worker->failed |= mtmChangeProductAmount(worker->mtm, 7, -0.5) != MATAMAZOM_SUCCESS;
+        worker->failed |= mtmChangeProductAmount(worker->mtm, 10, -1) != MATAMAZOM_SUCCESS;
+        worker->failed |= mtmChangeProductAmount(worker->mtm, 7, 0.5) != MATAMAZOM_SUCCESS;
+    }
+    worker->failed |= mtmChangeProductAmount(worker->mtm, 10, -1) != MATAMAZOM_SUCCESS;
+    return NULL;
+}
+
+bool testConcurrentMode() {
+    Matamazom mtm = matamazomCreate();
+    Matamazom expected = matamazomCreate();
+    makeInventory(mtm);
+    makeInventory(expected);
+    LowStockLog log = {0, 0, 0};
+    ASSERT_OR_DESTROY_WAREHOUSES(MATAMAZOM_SUCCESS ==
+                                 mtmSetProductLowStockWatermark(mtm, 10, 12, logLowStock, &log));
+    ASSERT_OR_DESTROY_WAREHOUSES(MATAMAZOM_SUCCESS == mtmSetReservationMode(mtm, true));
+    unsigned int order = mtmCreateNewOrder(mtm);
+    ASSERT_OR_DESTROY_WAREHOUSES(MATAMAZOM_SUCCESS ==
+                                 mtmChangeProductAmountInOrder(mtm, order, 11, 3));
+    ASSERT_OR_DESTROY_WAREHOUSES(MATAMAZOM_SUCCESS == mtmSetConcurrentMode(mtm, true));
+
+    ConcurrentWorker workers[CONCURRENT_WORKERS];
+    pthread_t threads[CONCURRENT_WORKERS];
+    for (int i = 0; i < CONCURRENT_WORKERS; i++) {
+        workers[i].mtm = mtm;
+        ASSERT_OR_DESTROY_WAREHOUSES(pthread_create(&threads[i], NULL, changeConcurrently,
+                                                    &workers[i]) == 0);
+    }
+    for (int i = 0; i < CONCURRENT_WORKERS; i++) {
+        pthread_join(threads[i], NULL);
+        ASSERT_OR_DESTROY_WAREHOUSES(!workers[i].failed);
+    }
+    ASSERT_OR_DESTROY_WAREHOUSES(MATAMAZOM_PRODUCT_NOT_EXIST == mtmChangeProductAmount(mtm, 5, 1));
+    ASSERT_OR_DESTROY_WAREHOUSES(MATAMAZOM_INVALID_AMOUNT == mtmChangeProductAmount(mtm, 10, 0.5));
+    /* 3 of the 4 Smart TVs are reserved by the order */
+    ASSERT_OR_DESTROY_WAREHOUSES(MATAMAZOM_INSUFFICIENT_AMOUNT ==
+                                 mtmChangeProductAmount(mtm, 11, -2));
+    ASSERT_OR_DESTROY_WAREHOUSES(MATAMAZOM_SUCCESS == mtmChangeProductAmount(mtm, 11, -1));
+    ASSERT_OR_DESTROY_WAREHOUSES(MATAMAZOM_SUCCESS == mtmChangeProductAmount(mtm, 4, -0.11));
+    /* the low-stock callback is called only once the changes are applied */
+    ASSERT_OR_DESTROY_WAREHOUSES(log.calls == 0);
+    /* nothing but the amounts may change until the mode is disabled */
+    double basePrice = 1;
+    ASSERT_OR_DESTROY_WAREHOUSES(MATAMAZOM_CONCURRENT_MODE ==
+                                 mtmNewProduct(mtm, 50, "Lamp", 1, MATAMAZOM_INTEGER_AMOUNT,
+                                               &basePrice, copyDouble, freeDouble, simplePrice));
+    ASSERT_OR_DESTROY_WAREHOUSES(MATAMAZOM_CONCURRENT_MODE == mtmClearProduct(mtm, 4));
+    ASSERT_OR_DESTROY_WAREHOUSES(MATAMAZOM_CONCURRENT_MODE ==
+                                 mtmChangeProductAmountInOrder(mtm, order, 11, -1));
+    ASSERT_OR_DESTROY_WAREHOUSES(MATAMAZOM_CONCURRENT_MODE == mtmShipOrder(mtm, order));
+    ASSERT_OR_DESTROY_WAREHOUSES(MATAMAZOM_CONCURRENT_MODE == mtmCancelOrder(mtm, order));
+    ASSERT_OR_DESTROY_WAREHOUSES(MATAMAZOM_CONCURRENT_MODE == mtmSetReservationMode(mtm, false));
+    ASSERT_OR_DESTROY_WAREHOUSES(MATAMAZOM_CONCURRENT_MODE == mtmBegin(mtm));
+    ASSERT_OR_DESTROY_WAREHOUSES(mtmCreateNewOrder(mtm) == 0 && mtmCloneOrder(mtm, order) == 0);
+    ASSERT_OR_DESTROY_WAREHOUSES(mtmSnapshot(mtm) == NULL);
+    ASSERT_OR_DESTROY_WAREHOUSES(MATAMAZOM_SUCCESS == mtmSetConcurrentMode(mtm, false));
+    ASSERT_OR_DESTROY_WAREHOUSES(log.calls == 1 && log.last_id == 10 && log.last_amount == 11);
+
+    mtmChangeProductAmount(expected, 10, -CONCURRENT_WORKERS);
+    mtmChangeProductAmount(expected, 11, -1);
+    mtmChangeProductAmount(expected, 4, -0.11);
+    FILE *expected_output = tmpfile();
+    FILE *actual_output = tmpfile();
+    assert(expected_output && actual_output);
+    mtmPrintInventory(expected, expected_output);
+    mtmPrintInventory(mtm, actual_output);
+    rewind(expected_output);
+    rewind(actual_output);
+    bool equal = fileEqual(expected_output, actual_output);
+    fclose(expected_output);
+    fclose(actual_output);
+    ASSERT_OR_DESTROY_WAREHOUSES(equal);
+    ASSERT_OR_DESTROY_WAREHOUSES(MATAMAZOM_SUCCESS == mtmShipOrder(mtm, order));
+    ASSERT_OR_DESTROY_WAREHOUSES(MATAMAZOM_NULL_ARGUMENT == mtmSetConcurrentMode(NULL, true));
+    matamazomDestroy(mtm);
+    matamazomDestroy(expected);
+    return true;
+}
+
+/* prints the products of mtm in [fromId, toId), returning whether the output
+ * equals 'expected' */
+static bool printedRangeEquals(Matamazom mtm, unsigned int fromId,
+                               unsigned int toId, const char *expected) {
+    FILE *output = tmpfile();
+    assert(output);
+    bool result = mtmPrintInventoryRange(mtm, fromId, toId, output) == MATAMAZOM_SUCCESS;
+    char printed[512] = "";
+    rewind(output);
+    size_t length = fread(printed, 1, sizeof(printed) - 1, output);
+    printed[length] = '\0';
+    fclose(output);
+    return result && strcmp(printed, expected) == 0;
+}
+
+bool testPrintInventoryRange() {
+    Matamazom mtm = matamazomCreate();
+    ASSERT_OR_DESTROY(printedRangeEquals(mtm, 0, 100, "Inventory Status:\n"));
+    makeInventory(mtm);
+    ASSERT_OR_DESTROY(printedRangeEquals(mtm, 5, 11,
+        "Inventory Status:\n"
+        "name: Onion, id: 6, amount: 1789.750, price: 5.800\n"
+        "name: Watermelon, id: 7, amount: 24.500, price: 18.500\n"
+        "name: Television, id: 10, amount: 15.000, price: 2000.000\n"));
+    ASSERT_OR_DESTROY(printedRangeEquals(mtm, 11, 12,
+        "Inventory Status:\n"
+        "name: Smart TV, id: 11, amount: 4.000, price: 5000.000\n"));
+    ASSERT_OR_DESTROY(printedRangeEquals(mtm, 8, 10, "Inventory Status:\n"));
+    ASSERT_OR_DESTROY(printedRangeEquals(mtm, 10, 6, "Inventory Status:\n"));
+    ASSERT_OR_DESTROY(printedRangeEquals(mtm, 12, 4000000000u, "Inventory Status:\n"));
+
+    /* the range sees products added and changed since the last print */
+    double price = 1.5;
+    ASSERT_OR_DESTROY(MATAMAZOM_SUCCESS == mtmNewProduct(mtm, 8, "Melon", 3, MATAMAZOM_INTEGER_AMOUNT,
+                                                         &price, copyDouble, freeDouble, buy10Get10ForFree));
+    ASSERT_OR_DESTROY(MATAMAZOM_SUCCESS == mtmChangeProductAmount(mtm, 7, 0.5));
+    ASSERT_OR_DESTROY(printedRangeEquals(mtm, 7, 10,
+        "Inventory Status:\n"
+        "name: Watermelon, id: 7, amount: 25.000, price: 18.500\n"
+        "name: Melon, id: 8, amount: 3.000, price: 1.500\n"));
+
+    /* ids on both sides of INT_MAX are still sorted by their value */
+    ASSERT_OR_DESTROY(MATAMAZOM_SUCCESS == mtmNewProduct(mtm, 3000000000u, "Radio", 2, MATAMAZOM_INTEGER_AMOUNT,
+                                                         &price, copyDouble, freeDouble, simplePrice));
+    ASSERT_OR_DESTROY(MATAMAZOM_SUCCESS == mtmNewProduct(mtm, 2147483648u, "Clock", 1, MATAMAZOM_INTEGER_AMOUNT,
+                                                         &price, copyDouble, freeDouble, simplePrice));
+    const unsigned int ids[] = {3000000000u, 4, 2147483648u};
+    const double amounts[] = {1, 0.89, 2};
+    MatamazomResult results[3];
+    ASSERT_OR_DESTROY(MATAMAZOM_SUCCESS == mtmChangeProductAmounts(mtm, ids, amounts, 3, results,
+                                                                   MTM_BATCH_ALL_OR_NOTHING));
+    unsigned int found[4];
+    size_t count = 0;
+    MtmFilterSpec large = { .predicates = MTM_FILTER_ID_RANGE | MTM_FILTER_AMOUNT_BELOW,
+                            .min_id = 11, .max_id = UINT_MAX, .amount_below = 3.5 };
+    ASSERT_OR_DESTROY(MATAMAZOM_SUCCESS == mtmFilterProducts(mtm, &large, found, 4, &count));
+    ASSERT_OR_DESTROY(count == 2 && found[0] == 2147483648u && found[1] == 3000000000u);
+    FILE *output = tmpfile();
+    ASSERT_OR_DESTROY(MATAMAZOM_SUCCESS == mtmPrintInventoryRange(mtm, 11, UINT_MAX, output));
+    fclose(output);
+    ASSERT_OR_DESTROY(printedRangeEquals(mtm, 2, 5,
+        "Inventory Status:\n"
+        "name: Tomato, id: 4, amount: 2020.000, price: 8.900\n"));
+    ASSERT_OR_DESTROY(MATAMAZOM_NULL_ARGUMENT == mtmPrintInventoryRange(mtm, 0, 10, NULL));
+    ASSERT_OR_DESTROY(MATAMAZOM_NULL_ARGUMENT == mtmPrintInventoryRange(NULL, 0, 10, stdout));
+    matamazomDestroy(mtm);
+    return true;
+}
+
+/* prints an order without its heading, which holds the order's id */
+static void printOrderLines(Matamazom mtm, unsigned int orderId, char *buffer, size_t size) {
+    FILE *output = tmpfile();
+    assert(output);
+    buffer[0] = '\0';
+    if (mtmPrintOrder(mtm, orderId, output) == MATAMAZOM_SUCCESS) {
+        rewind(output);
+        char heading[64];
+        fgets(heading, sizeof(heading), output);
+        size_t length = fread(buffer, 1, size - 1, output);
+        buffer[length] = '\0';
+    }
+    fclose(output);
+}
+
+bool testMergeOrders() {
+    Matamazom mtm = matamazomCreate();
+    unsigned int first = makeOrder(mtm);
+    ASSERT_OR_DESTROY(MATAMAZOM_SUCCESS == mtmSetReservationMode(mtm, true));
+    unsigned int second = mtmCreateNewOrder(mtm);
+    mtmChangeProductAmountInOrder(mtm, second, 11, 1);
+    mtmChangeProductAmountInOrder(mtm, second, 6, 4);
+    mtmChangeProductAmountInOrder(mtm, second, 4, 3);
+    unsigned int expected = mtmCreateNewOrder(mtm);
+    mtmChangeProductAmountInOrder(mtm, expected, 4, 3);
+    mtmChangeProductAmountInOrder(mtm, expected, 6, 14.25);
+    mtmChangeProductAmountInOrder(mtm, expected, 7, 1.5);
+    mtmChangeProductAmountInOrder(mtm, expected, 10, 2);
+    mtmChangeProductAmountInOrder(mtm, expected, 11, 1);
+    double reserved = 0;
+    ASSERT_OR_DESTROY(MATAMAZOM_SUCCESS == mtmGetReservedAmount(mtm, 6, &reserved));
+    ASSERT_OR_DESTROY(reserved == 10.25 + 4 + 14.25);
+
+    ASSERT_OR_DESTROY(MATAMAZOM_SUCCESS == mtmMergeOrders(mtm, first, second));
+    char merged[512];
+    char manual[512];
+    printOrderLines(mtm, first, merged, sizeof(merged));
+    printOrderLines(mtm, expected, manual, sizeof(manual));
+    ASSERT_OR_DESTROY(strlen(merged) > 0 && strcmp(merged, manual) == 0);
+    ASSERT_OR_DESTROY(MATAMAZOM_SUCCESS == mtmGetReservedAmount(mtm, 6, &reserved));
+    ASSERT_OR_DESTROY(reserved == 10.25 + 4 + 14.25);
+
+    ASSERT_OR_DESTROY(MATAMAZOM_ORDER_NOT_EXIST == mtmCancelOrder(mtm, second));
+    ASSERT_OR_DESTROY(MATAMAZOM_ORDER_NOT_EXIST == mtmMergeOrders(mtm, first, second));
+    ASSERT_OR_DESTROY(MATAMAZOM_ORDER_NOT_EXIST == mtmMergeOrders(mtm, second, first));
+    ASSERT_OR_DESTROY(MATAMAZOM_NULL_ARGUMENT == mtmMergeOrders(NULL, first, expected));
+    ASSERT_OR_DESTROY(MATAMAZOM_SUCCESS == mtmMergeOrders(mtm, first, first));
+    printOrderLines(mtm, first, merged, sizeof(merged));
+    ASSERT_OR_DESTROY(strcmp(merged, manual) == 0);
+
+    /* merging into an empty order copies the other order */
+    unsigned int empty = mtmCreateNewOrder(mtm);
+    ASSERT_OR_DESTROY(MATAMAZOM_SUCCESS == mtmMergeOrders(mtm, empty, first));
+    printOrderLines(mtm, empty, merged, sizeof(merged));
+    ASSERT_OR_DESTROY(strcmp(merged, manual) == 0);
+    ASSERT_OR_DESTROY(MATAMAZOM_SUCCESS == mtmShipOrder(mtm, empty));
+    matamazomDestroy(mtm);
+    return true;
+}
+
+static ASElement copyInt(ASElement number) {
+    int *copy = malloc(sizeof(*copy));
+    if (copy) {
+        *copy = *(int*)number;
+    }
+    return copy;
+}
+
+static void freeInt(ASElement number) {
+    free(number);
+}
+
+static int compareInts(ASElement first, ASElement second) {
+    return *(int*)first - *(int*)second;
+}
+
+/* fills set with the given numbers and amounts, which end with a negative number */
+static AmountSet makeSet(const int *numbers, const double *amounts) {
+    AmountSet set = asCreate(copyInt, freeInt, compareInts);
+    assert(set);
+    for (int i = 0; numbers[i] >= 0; i++) {
+        asRegister(set, (ASElement) &numbers[i]);
+        asChangeAmount(set, (ASElement) &numbers[i], amounts[i]);
+    }
+    return set;
+}
+
+/* checks set holds exactly the given numbers and amounts, as in makeSet */
+static bool setEquals(AmountSet set, const int *numbers, const double *amounts) {
+    int i = 0;
+    double amount = 0;
+    AS_FOREACH(int*, number, set) {
+        if (numbers[i] < 0 || *number != numbers[i] ||
+            asGetAmount(set, number, &amount) != AS_SUCCESS || amount != amounts[i]) {
+            return false;
+        }
+        i++;
+    }
+    return numbers[i] < 0;
+}
+
+#define ASSERT_OR_DESTROY_SETS(expr) \
+    ASSERT_TEST_WITH_FREE((expr), (asDestroy(set), asDestroy(other), asDestroy(snapshot)))
+
+bool testSetAlgebra() {
+    const int numbers[] = {1, 3, 5, 7, -1};
+    const double amounts[] = {1, 2, 3, 4};
+    const int other_numbers[] = {0, 3, 4, 5, 9, -1};
+    const double other_amounts[] = {5, 1, 1, 4, 2};
+    AmountSet set = makeSet(numbers, amounts);
+    AmountSet other = makeSet(other_numbers, other_amounts);
+    AmountSet snapshot = asSnapshot(set);
+
+    ASSERT_OR_DESTROY_SETS(asMergeAdd(set, other) == AS_SUCCESS);
+    const int merged[] = {0, 1, 3, 4, 5, 7, 9, -1};
+    const double merged_amounts[] = {5, 1, 3, 1, 7, 4, 2};
+    ASSERT_OR_DESTROY_SETS(setEquals(set, merged, merged_amounts));
+    ASSERT_OR_DESTROY_SETS(setEquals(snapshot, numbers, amounts));
+
+    /* subtracting fails as a whole, unless amounts are clamped */
+    ASSERT_OR_DESTROY_SETS(asSubtract(snapshot, other, false) == AS_INSUFFICIENT_AMOUNT);
+    ASSERT_OR_DESTROY_SETS(setEquals(snapshot, numbers, amounts));
+    ASSERT_OR_DESTROY_SETS(asSubtract(snapshot, other, true) == AS_SUCCESS);
+    const double clamped[] = {1, 1, 0, 4};
+    ASSERT_OR_DESTROY_SETS(setEquals(snapshot, numbers, clamped));
+    ASSERT_OR_DESTROY_SETS(asSubtract(set, other, false) == AS_SUCCESS);
+    const double subtracted[] = {0, 1, 2, 0, 3, 4, 0};
+    ASSERT_OR_DESTROY_SETS(setEquals(set, merged, subtracted));
+
+    ASSERT_OR_DESTROY_SETS(asIntersect(set, snapshot) == AS_SUCCESS);
+    const double intersected[] = {1, 1, 0, 4};
+    ASSERT_OR_DESTROY_SETS(setEquals(set, numbers, intersected));
+    asDestroy(snapshot);
+    snapshot = asSnapshot(set);
+    ASSERT_OR_DESTROY_SETS(asIntersect(set, other) == AS_SUCCESS);
+    ASSERT_OR_DESTROY_SETS(setEquals(snapshot, numbers, intersected));
+    const int common[] = {3, 5, -1};
+    const double common_amounts[] = {1, 0};
+    ASSERT_OR_DESTROY_SETS(setEquals(set, common, common_amounts));
+    ASSERT_OR_DESTROY_SETS(setEquals(other, other_numbers, other_amounts));
+    asClear(other);
+    ASSERT_OR_DESTROY_SETS(asIntersect(set, other) == AS_SUCCESS && asGetSize(set) == 0);
+    ASSERT_OR_DESTROY_SETS(asMergeAdd(NULL, other) == AS_NULL_ARGUMENT);
+    asDestroy(snapshot);
+    asDestroy(other);
+    asDestroy(set);
+    return true;
+}
+
+bool testCheckOrders() {
+    Matamazom mtm = matamazomCreate();
+    MtmOrderChecks checks;
+    ASSERT_OR_DESTROY(MATAMAZOM_SUCCESS == mtmCheckOrders(mtm, &checks));
+    ASSERT_OR_DESTROY(checks.count == 0);
+    mtmReleaseOrderChecks(&checks);
+    unsigned int first = makeOrder(mtm);
+    unsigned int second = mtmCreateNewOrder(mtm);
+    mtmChangeProductAmountInOrder(mtm, second, 11, 5);
+    mtmChangeProductAmountInOrder(mtm, second, 4, 3);
+    mtmChangeProductAmountInOrder(mtm, second, 7, 30);
+    unsigned int empty = mtmCreateNewOrder(mtm);
+
+    ASSERT_OR_DESTROY(MATAMAZOM_SUCCESS == mtmCheckOrders(mtm, &checks));
+    ASSERT_OR_DESTROY(checks.count == 3);
+    ASSERT_OR_DESTROY(checks.orders[0].order_id == first && checks.orders[0].can_ship);
+    ASSERT_OR_DESTROY(checks.orders[0].shortfalls_count == 0);
+    ASSERT_OR_DESTROY(checks.orders[2].order_id == empty && checks.orders[2].can_ship);
+    MtmOrderCheck *check = &checks.orders[1];
+    ASSERT_OR_DESTROY(check->order_id == second && !check->can_ship);
+    ASSERT_OR_DESTROY(check->shortfalls_count == 2);
+    ASSERT_OR_DESTROY(check->shortfalls[0].product_id == 7 && check->shortfalls[0].amount == 5.5);
+    ASSERT_OR_DESTROY(check->shortfalls[1].product_id == 11 && check->shortfalls[1].amount == 1);
+    for (size_t i = 0; i < checks.count; i++) {
+        MatamazomResult expected = checks.orders[i].can_ship ? MATAMAZOM_SUCCESS
+                                                             : MATAMAZOM_INSUFFICIENT_AMOUNT;
+        ASSERT_OR_DESTROY(expected == mtmCanShipOrder(mtm, checks.orders[i].order_id));
+    }
+    mtmReleaseOrderChecks(&checks);
+
+    /* the checks see the current amounts, and change nothing themselves */
+    ASSERT_OR_DESTROY(MATAMAZOM_SUCCESS == mtmChangeProductAmount(mtm, 11, 1));
+    ASSERT_OR_DESTROY(MATAMAZOM_SUCCESS == mtmCheckOrders(mtm, &checks));
+    check = &checks.orders[1];
+    ASSERT_OR_DESTROY(!check->can_ship && check->shortfalls_count == 1);
+    ASSERT_OR_DESTROY(check->shortfalls[0].product_id == 7);
+    mtmReleaseOrderChecks(&checks);
+    ASSERT_OR_DESTROY(MATAMAZOM_SUCCESS == mtmShipOrder(mtm, first));
+    ASSERT_OR_DESTROY(MATAMAZOM_INSUFFICIENT_AMOUNT == mtmShipOrder(mtm, second));
+    ASSERT_OR_DESTROY(MATAMAZOM_NULL_ARGUMENT == mtmCheckOrders(mtm, NULL));
+    ASSERT_OR_DESTROY(MATAMAZOM_NULL_ARGUMENT == mtmCheckOrders(NULL, &checks));
+    matamazomDestroy(mtm);
+    return true;
+}
+
+static bool demandEquals(Matamazom mtm, unsigned int id, double expected) {
+    double demand = -1;
+    return mtmGetProductDemand(mtm, id, &demand) == MATAMAZOM_SUCCESS && demand == expected;
+}
+
+bool testProductDemand() {
+    Matamazom mtm = matamazomCreate();
+    unsigned int first = makeOrder(mtm);
+    unsigned int second = mtmCreateNewOrder(mtm);
+    mtmChangeProductAmountInOrder(mtm, second, 6, 4);
+    mtmChangeProductAmountInOrder(mtm, second, 11, 2);
+    ASSERT_OR_DESTROY(demandEquals(mtm, 6, 14.25));
+    ASSERT_OR_DESTROY(demandEquals(mtm, 11, 2));
+    ASSERT_OR_DESTROY(demandEquals(mtm, 4, 0));
+
+    /* removing more than an order has only removes what it has */
+    ASSERT_OR_DESTROY(MATAMAZOM_SUCCESS == mtmChangeProductAmountInOrder(mtm, second, 11, -5));
+    ASSERT_OR_DESTROY(demandEquals(mtm, 11, 0));
+    ASSERT_OR_DESTROY(MATAMAZOM_SUCCESS == mtmChangeProductAmountInOrder(mtm, second, 11, 1));
+    ASSERT_OR_DESTROY(MATAMAZOM_SUCCESS == mtmMergeOrders(mtm, first, second));
+    ASSERT_OR_DESTROY(demandEquals(mtm, 6, 14.25) && demandEquals(mtm, 11, 1));
+
+    ASSERT_OR_DESTROY(MATAMAZOM_SUCCESS == mtmSetReportDemand(mtm, true));
+    ASSERT_OR_DESTROY(printedRangeEquals(mtm, 10, 12,
+        "Inventory Status:\n"
+        "name: Television, id: 10, amount: 15.000, price: 2000.000, on order: 2.000\n"
+        "name: Smart TV, id: 11, amount: 4.000, price: 5000.000, on order: 1.000\n"));
+
+    /* a snapshot keeps the demand it had */
+    Matamazom frozen = mtmSnapshot(mtm);
+    second = mtmCreateNewOrder(mtm);
+    mtmChangeProductAmountInOrder(mtm, second, 10, 3);
+    ASSERT_OR_DESTROY(MATAMAZOM_SUCCESS == mtmCancelOrder(mtm, first));
+    ASSERT_OR_DESTROY(demandEquals(mtm, 6, 0) && demandEquals(mtm, 10, 3));
+    ASSERT_OR_DESTROY(demandEquals(frozen, 6, 14.25) && demandEquals(frozen, 10, 2));
+    ASSERT_OR_DESTROY(printedRangeEquals(frozen, 10, 11,
+        "Inventory Status:\n"
+        "name: Television, id: 10, amount: 15.000, price: 2000.000, on order: 2.000\n"));
+    matamazomDestroy(frozen);
+
+    ASSERT_OR_DESTROY(MATAMAZOM_SUCCESS == mtmShipOrder(mtm, second));
+    ASSERT_OR_DESTROY(demandEquals(mtm, 10, 0));
+    ASSERT_OR_DESTROY(MATAMAZOM_SUCCESS == mtmClearProduct(mtm, 10));
+    double demand = 0;
+    ASSERT_OR_DESTROY(MATAMAZOM_PRODUCT_NOT_EXIST == mtmGetProductDemand(mtm, 10, &demand));
+    ASSERT_OR_DESTROY(MATAMAZOM_NULL_ARGUMENT == mtmGetProductDemand(mtm, 6, NULL));
+    ASSERT_OR_DESTROY(MATAMAZOM_SUCCESS == mtmSetReportDemand(mtm, false));
+    ASSERT_OR_DESTROY(printedRangeEquals(mtm, 11, 12,
+        "Inventory Status:\n"
+        "name: Smart TV, id: 11, amount: 4.000, price: 5000.000\n"));
+    matamazomDestroy(mtm);
+    return true;
+}
+
+#define LEDGER_FILE "tests/shipments.ledger"
+
+static bool revenueEquals(Matamazom mtm, bool allProducts, unsigned int productId, uint64_t from,
+                          uint64_t to, double expected, size_t expectedShipments) {
+    MtmLedgerQuery query = { .all_products = allProducts, .product_id = productId,
+                             .from_time = from, .to_time = to };
+    double revenue = -1;
+    size_t shipments = 0;
+    return mtmGetLedgerRevenue(mtm, &query, &revenue, &shipments) == MATAMAZOM_SUCCESS &&
+           shipments == expectedShipments && revenue > expected - 0.001 && revenue < expected + 0.001;
+}
+
+bool testShipmentLedger() {
+    Matamazom mtm = matamazomCreate();
+    ASSERT_OR_DESTROY(revenueEquals(mtm, true, 0, 0, UINT64_MAX, 0, 0));
+    ASSERT_OR_DESTROY(MATAMAZOM_SUCCESS == mtmOpenLedger(mtm, NULL, 4));
+    unsigned int first = makeOrder(mtm);
+    uint64_t before = mtmGetLedgerTime(mtm);
+    ASSERT_OR_DESTROY(MATAMAZOM_SUCCESS == mtmShipOrder(mtm, first));
+    uint64_t between = mtmGetLedgerTime(mtm) + 1;
+    /* the times are of the real time clock, so a ledger reopened after a
+     * reboot goes on from them */
+    uint64_t seconds_before = (uint64_t) time(NULL);
+    uint64_t seconds = mtmGetLedgerTime(mtm) / 1000000000u;
+    ASSERT_OR_DESTROY(seconds + 1 >= seconds_before && seconds <= (uint64_t) time(NULL));
+    ASSERT_OR_DESTROY(revenueEquals(mtm, true, 0, before, between, 4085.75, 3));
+    ASSERT_OR_DESTROY(revenueEquals(mtm, false, 10, before, between, 4000, 1));
+    ASSERT_OR_DESTROY(revenueEquals(mtm, false, 4, 0, UINT64_MAX, 0, 0));
+
+    /* the ledger has room for a single line more, so an order of two can't ship */
+    unsigned int second = mtmCreateNewOrder(mtm);
+    mtmChangeProductAmountInOrder(mtm, second, 10, 1);
+    mtmChangeProductAmountInOrder(mtm, second, 4, 1);
+    ASSERT_OR_DESTROY(MATAMAZOM_OUT_OF_MEMORY == mtmShipOrder(mtm, second));
+    ASSERT_OR_DESTROY(MATAMAZOM_SUCCESS == mtmChangeProductAmountInOrder(mtm, second, 4, -1));
+    ASSERT_OR_DESTROY(MATAMAZOM_SUCCESS == mtmShipOrder(mtm, second));
+    ASSERT_OR_DESTROY(revenueEquals(mtm, false, 10, 0, UINT64_MAX, 6000, 2));
+    ASSERT_OR_DESTROY(revenueEquals(mtm, false, 10, between, UINT64_MAX, 2000, 1));
+    ASSERT_OR_DESTROY(revenueEquals(mtm, true, 0, between, between, 0, 0));
+
+    /* a ledger in a file keeps its shipments when it's opened again */
+    remove(LEDGER_FILE);
+    ASSERT_OR_DESTROY(MATAMAZOM_SUCCESS == mtmOpenLedger(mtm, LEDGER_FILE, 10));
+    ASSERT_OR_DESTROY(revenueEquals(mtm, true, 0, 0, UINT64_MAX, 0, 0));
+    second = mtmCreateNewOrder(mtm);
+    mtmChangeProductAmountInOrder(mtm, second, 11, 1);
+    ASSERT_OR_DESTROY(MATAMAZOM_SUCCESS == mtmShipOrder(mtm, second));
+    ASSERT_OR_DESTROY(MATAMAZOM_SUCCESS == mtmCloseLedger(mtm));
+    ASSERT_OR_DESTROY(MATAMAZOM_SUCCESS == mtmOpenLedger(mtm, LEDGER_FILE, 1));
+    ASSERT_OR_DESTROY(revenueEquals(mtm, false, 11, 0, UINT64_MAX, 5000, 1));
+    matamazomDestroy(mtm);
+    mtm = matamazomCreate();
+    ASSERT_OR_DESTROY(MATAMAZOM_SUCCESS == mtmOpenLedger(mtm, LEDGER_FILE, 0));
+    ASSERT_OR_DESTROY(revenueEquals(mtm, true, 0, 0, UINT64_MAX, 5000, 1));
+    ASSERT_OR_DESTROY(MATAMAZOM_NULL_ARGUMENT == mtmOpenLedger(NULL, NULL, 10));
+
+    /* a file which isn't a ledger is rejected, and isn't changed */
+    remove(LEDGER_FILE);
+    FILE *not_ledger = fopen(LEDGER_FILE, "w");
+    ASSERT_OR_DESTROY(not_ledger != NULL);
+    fputs("not a ledger\n", not_ledger);
+    fclose(not_ledger);
+    ASSERT_OR_DESTROY(MATAMAZOM_INVALID_FORMAT == mtmOpenLedger(mtm, LEDGER_FILE, 10));
+    ASSERT_OR_DESTROY(revenueEquals(mtm, true, 0, 0, UINT64_MAX, 0, 0));
+    not_ledger = fopen(LEDGER_FILE, "r");
+    ASSERT_OR_DESTROY(not_ledger != NULL);
+    char contents[32] = "";
+    size_t length = fread(contents, 1, sizeof(contents) - 1, not_ledger);
+    fclose(not_ledger);
+    ASSERT_OR_DESTROY(length == 13 && strcmp(contents, "not a ledger\n") == 0);
+    remove(LEDGER_FILE);
+    matamazomDestroy(mtm);
+    return true;
+}
+
+static bool totalsEqual(Matamazom mtm, unsigned int workers, double income,
+                        double integerUnits, double halfUnits, double anyUnits,
+                        double stockValue) {
+    MtmTotals totals;
+    if (mtmAggregate(mtm, &totals, workers) != MATAMAZOM_SUCCESS) {
+        return false;
+    }
+    return fabs(totals.income - income) < 1e-6
+        && fabs(totals.units[MATAMAZOM_INTEGER_AMOUNT] - integerUnits) < 1e-6
+        && fabs(totals.units[MATAMAZOM_HALF_INTEGER_AMOUNT] - halfUnits) < 1e-6
+        && fabs(totals.units[MATAMAZOM_ANY_AMOUNT] - anyUnits) < 1e-6
+        && fabs(totals.stock_value - stockValue) < 1e-6;
+}
+
+bool testAggregate() {
+    Matamazom mtm = matamazomCreate();
+    ASSERT_OR_DESTROY(totalsEqual(mtm, 1, 0, 0, 0, 0, 0));
+    unsigned int order = makeOrder(mtm);
+    ASSERT_OR_DESTROY(totalsEqual(mtm, 1, 0, 19, 24.5, 3808.86, 78745.879));
+    ASSERT_OR_DESTROY(MATAMAZOM_SUCCESS == mtmShipOrder(mtm, order));
+    ASSERT_OR_DESTROY(totalsEqual(mtm, 3, 4085.75, 17, 23, 3798.61, 74658.679));
+    ASSERT_OR_DESTROY(MATAMAZOM_SUCCESS == mtmChangeProductAmount(mtm, 11, -4));
+    ASSERT_OR_DESTROY(totalsEqual(mtm, 100, 4085.75, 13, 23, 3798.61, 54658.679));
+    ASSERT_OR_DESTROY(MATAMAZOM_SUCCESS == mtmClearProduct(mtm, 4));
+    ASSERT_OR_DESTROY(totalsEqual(mtm, 2, 4085.75, 13, 23, 1779.5, 36688.6));
+    MtmTotals totals;
+    ASSERT_OR_DESTROY(MATAMAZOM_NULL_ARGUMENT == mtmAggregate(mtm, NULL, 1));
+    ASSERT_OR_DESTROY(MATAMAZOM_NULL_ARGUMENT == mtmAggregate(NULL, &totals, 1));
+    matamazomDestroy(mtm);
+
+    /* the units a plain sum would round away are kept */
+    mtm = matamazomCreate();
+    double basePrice = 1;
+    mtmNewProduct(mtm, 1, "Sand", 1e16, MATAMAZOM_ANY_AMOUNT, &basePrice, copyDouble,
+                  freeDouble, simplePrice);
+    for (unsigned int id = 2; id <= 11; id++) {
+        mtmNewProduct(mtm, id, "Grain", 1, MATAMAZOM_ANY_AMOUNT, &basePrice, copyDouble,
+                      freeDouble, simplePrice);
+    }
+    ASSERT_OR_DESTROY(MATAMAZOM_SUCCESS == mtmAggregate(mtm, &totals, 1));
+    ASSERT_OR_DESTROY(totals.units[MATAMAZOM_ANY_AMOUNT] == 1e16 + 10);
+    ASSERT_OR_DESTROY(totals.stock_value == 1e16 + 10);
+    matamazomDestroy(mtm);
+    return true;
+}
+
+bool testCloneOrder() {
+    Matamazom mtm = matamazomCreate();
+    unsigned int first = makeOrder(mtm);
+    unsigned int clone = mtmCloneOrder(mtm, first);
+    ASSERT_OR_DESTROY(clone > first);
+    char original[512];
+    char cloned[512];
+    printOrderLines(mtm, first, original, sizeof(original));
+    printOrderLines(mtm, clone, cloned, sizeof(cloned));
+    ASSERT_OR_DESTROY(strlen(original) > 0 && strcmp(original, cloned) == 0);
+    ASSERT_OR_DESTROY(demandEquals(mtm, 10, 4) && demandEquals(mtm, 6, 20.5));
+
+    /* the orders are separate once either of them changes */
+    ASSERT_OR_DESTROY(MATAMAZOM_SUCCESS == mtmChangeProductAmountInOrder(mtm, clone, 10, 1));
+    printOrderLines(mtm, first, cloned, sizeof(cloned));
+    ASSERT_OR_DESTROY(strcmp(original, cloned) == 0);
+    ASSERT_OR_DESTROY(MATAMAZOM_SUCCESS == mtmShipOrder(mtm, first));
+    ASSERT_OR_DESTROY(demandEquals(mtm, 10, 3) && demandEquals(mtm, 6, 10.25));
+
+    /* in reservation mode a clone reserves its contents, or isn't made */
+    ASSERT_OR_DESTROY(MATAMAZOM_SUCCESS == mtmSetReservationMode(mtm, true));
+    unsigned int big = mtmCreateNewOrder(mtm);
+    mtmChangeProductAmountInOrder(mtm, big, 11, 3);
+    ASSERT_OR_DESTROY(mtmCloneOrder(mtm, big) == 0);
+    ASSERT_OR_DESTROY(demandEquals(mtm, 11, 3));
+    unsigned int second = mtmCloneOrder(mtm, clone);
+    ASSERT_OR_DESTROY(second > big);
+    double reserved = 0;
+    ASSERT_OR_DESTROY(MATAMAZOM_SUCCESS == mtmGetReservedAmount(mtm, 10, &reserved));
+    ASSERT_OR_DESTROY(reserved == 6);
+
+    /* carts in arenas are copied, and a snapshot keeps the demand it had */
+    ASSERT_OR_DESTROY(MATAMAZOM_SUCCESS == mtmSetCartArena(mtm, 4096));
+    Matamazom frozen = mtmSnapshot(mtm);
+    unsigned int third = mtmCloneOrder(mtm, second);
+    ASSERT_OR_DESTROY(third > second);
+    ASSERT_OR_DESTROY(MATAMAZOM_SUCCESS == mtmCancelOrder(mtm, second));
+    printOrderLines(mtm, clone, original, sizeof(original));
+    printOrderLines(mtm, third, cloned, sizeof(cloned));
+    ASSERT_OR_DESTROY(strcmp(original, cloned) == 0);
+    ASSERT_OR_DESTROY(demandEquals(mtm, 10, 6) && demandEquals(frozen, 10, 6));
+    ASSERT_OR_DESTROY(MATAMAZOM_SUCCESS == mtmShipOrder(mtm, third));
+    ASSERT_OR_DESTROY(demandEquals(mtm, 10, 3) && demandEquals(frozen, 10, 6));
+    matamazomDestroy(frozen);
+
+    ASSERT_OR_DESTROY(mtmCloneOrder(mtm, second) == 0);
+    ASSERT_OR_DESTROY(mtmCloneOrder(NULL, clone) == 0);
+    matamazomDestroy(mtm);
+    return true;
+}
+
+static bool poolEquals(Matamazom mtm, size_t size, uint64_t hits, uint64_t misses) {
+    MtmOrderPoolStats stats;
+    return mtmGetOrderPoolStats(mtm, &stats) == MATAMAZOM_SUCCESS && stats.size == size
+        && stats.hits == hits && stats.misses == misses;
+}
+
+bool testOrderPool() {
+    Matamazom mtm = matamazomCreate();
+    makeInventory(mtm);
+    ASSERT_OR_DESTROY(poolEquals(mtm, 0, 0, 0));
+    unsigned int first = mtmCreateNewOrder(mtm);
+    mtmChangeProductAmountInOrder(mtm, first, 10, 2);
+    ASSERT_OR_DESTROY(MATAMAZOM_SUCCESS == mtmShipOrder(mtm, first));
+    ASSERT_OR_DESTROY(poolEquals(mtm, 1, 0, 1));
+
+    /* a recycled order has a new id and an empty cart */
+    unsigned int second = mtmCreateNewOrder(mtm);
+    ASSERT_OR_DESTROY(second > first && poolEquals(mtm, 0, 1, 1));
+    char lines[256];
+    printOrderLines(mtm, second, lines, sizeof(lines));
+    ASSERT_OR_DESTROY(strlen(lines) > 0 && strstr(lines, "Television") == NULL);
+    MtmOrderPoolStats stats;
+    ASSERT_OR_DESTROY(MATAMAZOM_SUCCESS == mtmGetOrderPoolStats(mtm, &stats));
+    ASSERT_OR_DESTROY(stats.capacity == 64 && stats.hit_rate == 0.5);
+
+    /* the pool keeps no more than its capacity */
+    ASSERT_OR_DESTROY(MATAMAZOM_SUCCESS == mtmSetOrderPool(mtm, 2));
+    unsigned int third = mtmCreateNewOrder(mtm);
+    unsigned int fourth = mtmCreateNewOrder(mtm);
+    mtmMergeOrders(mtm, second, third);
+    mtmCancelOrder(mtm, second);
+    mtmCancelOrder(mtm, fourth);
+    ASSERT_OR_DESTROY(poolEquals(mtm, 2, 1, 3));
+    ASSERT_OR_DESTROY(MATAMAZOM_SUCCESS == mtmSetOrderPool(mtm, 1));
+    ASSERT_OR_DESTROY(poolEquals(mtm, 1, 1, 3));
+    ASSERT_OR_DESTROY(MATAMAZOM_SUCCESS == mtmTrimOrderPool(mtm));
+    ASSERT_OR_DESTROY(poolEquals(mtm, 0, 1, 3));
+
+    /* changing the arenas of carts empties the pool */
+    second = mtmCreateNewOrder(mtm);
+    mtmCancelOrder(mtm, second);
+    ASSERT_OR_DESTROY(MATAMAZOM_SUCCESS == mtmSetCartArena(mtm, 256));
+    ASSERT_OR_DESTROY(poolEquals(mtm, 0, 1, 4));
+    for (int round = 0; round < 3; round++) {
+        second = mtmCreateNewOrder(mtm);
+        mtmChangeProductAmountInOrder(mtm, second, 4, 1.5);
+        mtmChangeProductAmountInOrder(mtm, second, 11, 1);
+        printOrderLines(mtm, second, lines, sizeof(lines));
+        ASSERT_OR_DESTROY(strstr(lines, "Tomato") && strstr(lines, "Smart TV"));
+        ASSERT_OR_DESTROY(MATAMAZOM_SUCCESS == mtmCancelOrder(mtm, second));
+    }
+    ASSERT_OR_DESTROY(poolEquals(mtm, 1, 3, 5));
+
+    ASSERT_OR_DESTROY(MATAMAZOM_SUCCESS == mtmSetOrderPool(mtm, 0));
+    ASSERT_OR_DESTROY(poolEquals(mtm, 0, 3, 5));
+    ASSERT_OR_DESTROY(MATAMAZOM_NULL_ARGUMENT == mtmGetOrderPoolStats(mtm, NULL));
+    ASSERT_OR_DESTROY(MATAMAZOM_NULL_ARGUMENT == mtmSetOrderPool(NULL, 1));
+    ASSERT_OR_DESTROY(MATAMAZOM_NULL_ARGUMENT == mtmTrimOrderPool(NULL));
+    matamazomDestroy(mtm);
+    return true;
+}
+
+bool testChangeProductAmounts() {
+    Matamazom mtm = matamazomCreate();
+    makeInventory(mtm);
+    const unsigned int ids[] = {11, 4, 99, 10, 11, 7, 11};
+    const double amounts[] = {-3, 0.89, 1, 1.5, 5, -30, -6};
+    MatamazomResult results[7];
+    ASSERT_OR_DESTROY(MATAMAZOM_PRODUCT_NOT_EXIST ==
+                      mtmChangeProductAmounts(mtm, ids, amounts, 7, results,
+                                              MTM_BATCH_ALL_OR_NOTHING));
+    ASSERT_OR_DESTROY(results[0] == MATAMAZOM_SUCCESS && results[3] == MATAMAZOM_INVALID_AMOUNT);
+    ASSERT_OR_DESTROY(printedRangeEquals(mtm, 11, 12,
+        "Inventory Status:\n"
+        "name: Smart TV, id: 11, amount: 4.000, price: 5000.000\n"));
+
+    /* the changes of a product are made in the order of the batch */
+    ASSERT_OR_DESTROY(MATAMAZOM_SUCCESS ==
+                      mtmChangeProductAmounts(mtm, ids, amounts, 7, results,
+                                              MTM_BATCH_BEST_EFFORT));
+    const MatamazomResult expected[] = {MATAMAZOM_SUCCESS, MATAMAZOM_SUCCESS,
+                                        MATAMAZOM_PRODUCT_NOT_EXIST, MATAMAZOM_INVALID_AMOUNT,
+                                        MATAMAZOM_SUCCESS, MATAMAZOM_INSUFFICIENT_AMOUNT,
+                                        MATAMAZOM_SUCCESS};
+    ASSERT_OR_DESTROY(memcmp(results, expected, sizeof(expected)) == 0);
+    ASSERT_OR_DESTROY(printedRangeEquals(mtm, 4, 12,
+        "Inventory Status:\n"
+        "name: Tomato, id: 4, amount: 2020.000, price: 8.900\n"
+        "name: Onion, id: 6, amount: 1789.750, price: 5.800\n"
+        "name: Watermelon, id: 7, amount: 24.500, price: 18.500\n"
+        "name: Television, id: 10, amount: 15.000, price: 2000.000\n"
+        "name: Smart TV, id: 11, amount: 0.000, price: 5000.000\n"));
+
+    /* in reservation mode what's reserved can't be taken */
+    ASSERT_OR_DESTROY(MATAMAZOM_SUCCESS == mtmSetReservationMode(mtm, true));
+    unsigned int order = mtmCreateNewOrder(mtm);
+    mtmChangeProductAmountInOrder(mtm, order, 10, 5);
+    const unsigned int reserved_ids[] = {10, 10};
+    const double reserved_amounts[] = {-11, -10};
+    ASSERT_OR_DESTROY(MATAMAZOM_SUCCESS ==
+                      mtmChangeProductAmounts(mtm, reserved_ids, reserved_amounts, 2, results,
+                                              MTM_BATCH_BEST_EFFORT));
+    ASSERT_OR_DESTROY(results[0] == MATAMAZOM_INSUFFICIENT_AMOUNT);
+    ASSERT_OR_DESTROY(results[1] == MATAMAZOM_SUCCESS);
+    ASSERT_OR_DESTROY(MATAMAZOM_INSUFFICIENT_AMOUNT == mtmChangeProductAmount(mtm, 10, -1));
+
+    ASSERT_OR_DESTROY(MATAMAZOM_SUCCESS ==
+                      mtmChangeProductAmounts(mtm, NULL, NULL, 0, results,
+                                              MTM_BATCH_ALL_OR_NOTHING));
+    ASSERT_OR_DESTROY(MATAMAZOM_NULL_ARGUMENT ==
+                      mtmChangeProductAmounts(mtm, ids, amounts, 7, NULL,
+                                              MTM_BATCH_BEST_EFFORT));
+    ASSERT_OR_DESTROY(MATAMAZOM_NULL_ARGUMENT ==
+                      mtmChangeProductAmounts(NULL, ids, amounts, 7, results,
+                                              MTM_BATCH_BEST_EFFORT));
+    matamazomDestroy(mtm);
+    return true;
+}
+
+bool testTransactions() {
+    Matamazom mtm = matamazomCreate();
+    unsigned int first = makeOrder(mtm);
+    ASSERT_OR_DESTROY(MATAMAZOM_SUCCESS == mtmSetReservationMode(mtm, true));
+    ASSERT_OR_DESTROY(MATAMAZOM_SUCCESS == mtmOpenLedger(mtm, NULL, 10));
+    LowStockLog tomato = {0, 0, 0};
+    ASSERT_OR_DESTROY(MATAMAZOM_SUCCESS ==
+                      mtmSetProductLowStockWatermark(mtm, 4, 2000, logLowStock, &tomato));
+    char lines[256];
+    char saved_lines[256];
+    printOrderLines(mtm, first, saved_lines, sizeof(saved_lines));
+
+    /* everything done in the transaction is undone by mtmAbort */
+    ASSERT_OR_DESTROY(MATAMAZOM_SUCCESS == mtmBegin(mtm));
+    ASSERT_OR_DESTROY(MATAMAZOM_SUCCESS == mtmChangeProductAmount(mtm, 10, -3));
+    unsigned int second = mtmCreateNewOrder(mtm);
+    ASSERT_OR_DESTROY(second == 2);
+    ASSERT_OR_DESTROY(MATAMAZOM_SUCCESS == mtmChangeProductAmountInOrder(mtm, second, 11, 2));
+    ASSERT_OR_DESTROY(MATAMAZOM_SUCCESS == mtmChangeProductAmountInOrder(mtm, second, 4, 3));
+    ASSERT_OR_DESTROY(MATAMAZOM_SUCCESS == mtmMergeOrders(mtm, first, second));
+    ASSERT_OR_DESTROY(MATAMAZOM_SUCCESS == mtmShipOrder(mtm, first));
+    unsigned int third = mtmCreateNewOrder(mtm);
+    ASSERT_OR_DESTROY(MATAMAZOM_SUCCESS == mtmChangeProductAmountInOrder(mtm, third, 6, 1));
+    ASSERT_OR_DESTROY(MATAMAZOM_SUCCESS == mtmClearProduct(mtm, 6));
+    double basePrice = 30;
+    ASSERT_OR_DESTROY(MATAMAZOM_SUCCESS ==
+                      mtmNewProduct(mtm, 20, "Radio", 5, MATAMAZOM_INTEGER_AMOUNT, &basePrice,
+                                    copyDouble, freeDouble, simplePrice));
+    ASSERT_OR_DESTROY(printedRangeEquals(mtm, 10, 12,
+        "Inventory Status:\n"
+        "name: Television, id: 10, amount: 10.000, price: 2000.000\n"
+        "name: Smart TV, id: 11, amount: 2.000, price: 5000.000\n"));
+    ASSERT_OR_DESTROY(revenueEquals(mtm, true, 0, 0, UINT64_MAX, 14085.75 + 3 * 8.9, 5));
+    ASSERT_OR_DESTROY(MATAMAZOM_SUCCESS == mtmAbort(mtm));
+
+    ASSERT_OR_DESTROY(printedRangeEquals(mtm, 0, 100,
+        "Inventory Status:\n"
+        "name: Tomato, id: 4, amount: 2019.110, price: 8.900\n"
+        "name: Onion, id: 6, amount: 1789.750, price: 5.800\n"
+        "name: Watermelon, id: 7, amount: 24.500, price: 18.500\n"
+        "name: Television, id: 10, amount: 15.000, price: 2000.000\n"
+        "name: Smart TV, id: 11, amount: 4.000, price: 5000.000\n"));
+    printOrderLines(mtm, first, lines, sizeof(lines));
+    ASSERT_OR_DESTROY(strcmp(lines, saved_lines) == 0);
+    ASSERT_OR_DESTROY(MATAMAZOM_ORDER_NOT_EXIST == mtmCancelOrder(mtm, second));
+    ASSERT_OR_DESTROY(demandEquals(mtm, 6, 10.25) && demandEquals(mtm, 11, 0));
+    double reserved = 0;
+    ASSERT_OR_DESTROY(MATAMAZOM_SUCCESS == mtmGetReservedAmount(mtm, 10, &reserved));
+    ASSERT_OR_DESTROY(reserved == 2);
+    ASSERT_OR_DESTROY(revenueEquals(mtm, true, 0, 0, UINT64_MAX, 0, 0));
+    unsigned int ids[5];
+    size_t count = 0;
+    ASSERT_OR_DESTROY(MATAMAZOM_SUCCESS == mtmGetLowStock(mtm, 100, ids, 5, &count));
+    ASSERT_OR_DESTROY(count == 3 && ids[0] == 11 && ids[1] == 10 && ids[2] == 7);
+    /* the watermark of the cleared product is back as well */
+    ASSERT_OR_DESTROY(MATAMAZOM_SUCCESS == mtmChangeProductAmount(mtm, 4, -20));
+    ASSERT_OR_DESTROY(tomato.calls == 1 && tomato.last_id == 4);
+
+    /* nested transactions are committed by the outermost mtmCommit */
+    ASSERT_OR_DESTROY(MATAMAZOM_SUCCESS == mtmBegin(mtm));
+    ASSERT_OR_DESTROY(MATAMAZOM_SUCCESS == mtmShipOrder(mtm, first));
+    ASSERT_OR_DESTROY(MATAMAZOM_SUCCESS == mtmBegin(mtm));
+    ASSERT_OR_DESTROY(MATAMAZOM_SUCCESS == mtmChangeProductAmount(mtm, 11, 1));
+    ASSERT_OR_DESTROY(MATAMAZOM_SUCCESS == mtmCommit(mtm));
+    ASSERT_OR_DESTROY(MATAMAZOM_SUCCESS == mtmCommit(mtm));
+    ASSERT_OR_DESTROY(MATAMAZOM_SUCCESS == mtmAbort(mtm));
+    ASSERT_OR_DESTROY(printedRangeEquals(mtm, 10, 12,
+        "Inventory Status:\n"
+        "name: Television, id: 10, amount: 13.000, price: 2000.000\n"
+        "name: Smart TV, id: 11, amount: 5.000, price: 5000.000\n"));
+    ASSERT_OR_DESTROY(MATAMAZOM_ORDER_NOT_EXIST == mtmCancelOrder(mtm, first));
+    ASSERT_OR_DESTROY(mtmCreateNewOrder(mtm) == 2);
+
+    /* a snapshot taken before a transaction isn't changed by it, and none may
+     * be taken during it */
+    Matamazom snapshot = mtmSnapshot(mtm);
+    ASSERT_OR_DESTROY(snapshot != NULL);
+    ASSERT_OR_DESTROY(MATAMAZOM_SUCCESS == mtmBegin(mtm));
+    ASSERT_OR_DESTROY(mtmSnapshot(mtm) == NULL);
+    ASSERT_OR_DESTROY(MATAMAZOM_SUCCESS == mtmChangeProductAmount(mtm, 10, 2));
+    ASSERT_OR_DESTROY(MATAMAZOM_SUCCESS == mtmClearProduct(mtm, 11));
+    ASSERT_OR_DESTROY(MATAMAZOM_SUCCESS == mtmAbort(mtm));
+    const char *television =
+        "Inventory Status:\n"
+        "name: Television, id: 10, amount: 13.000, price: 2000.000\n"
+        "name: Smart TV, id: 11, amount: 5.000, price: 5000.000\n";
+    ASSERT_OR_DESTROY(printedRangeEquals(mtm, 10, 12, television));
+    ASSERT_OR_DESTROY(printedRangeEquals(snapshot, 10, 12, television));
+    matamazomDestroy(snapshot);
+
+    /* a transaction left open is committed when the warehouse is destroyed */
+    ASSERT_OR_DESTROY(MATAMAZOM_SUCCESS == mtmBegin(mtm));
+    ASSERT_OR_DESTROY(MATAMAZOM_SUCCESS == mtmCancelOrder(mtm, 2));
+    ASSERT_OR_DESTROY(MATAMAZOM_NULL_ARGUMENT == mtmBegin(NULL));
+    ASSERT_OR_DESTROY(MATAMAZOM_NULL_ARGUMENT == mtmCommit(NULL));
+    ASSERT_OR_DESTROY(MATAMAZOM_NULL_ARGUMENT == mtmAbort(NULL));
+    matamazomDestroy(mtm);
+    return true;
+}
+
+#define ASSERT_OR_RELEASE(expr) ASSERT_TEST_WITH_FREE((expr), mtmBufferRelease(&buffer))
+
+bool testProtocol() {
+    MtmBuffer buffer;
+    mtmBufferInit(&buffer);
+    size_t start = 0;
+    const uint32_t order_id = 3;
+    const uint32_t product_id = 10;
+    const double amount = 2.5;
+    char arguments[16];
+    memcpy(arguments, &order_id, sizeof(order_id));
+    memcpy(arguments + 4, &product_id, sizeof(product_id));
+    memcpy(arguments + 8, &amount, sizeof(amount));
+    ASSERT_OR_RELEASE(mtmFrameBegin(&buffer, &start) && start == 0);
+    ASSERT_OR_RELEASE(mtmFrameMessage(&buffer, start, 7, MTM_OP_CHANGE_PRODUCT_AMOUNT_IN_ORDER,
+                                      arguments, sizeof(arguments)));
+    ASSERT_OR_RELEASE(mtmFrameMessage(&buffer, start, 8, MTM_OP_PRINT_INVENTORY, NULL, 0));
+    mtmFrameEnd(&buffer, start);
+    size_t length = buffer.size;
+    ASSERT_OR_RELEASE(length == MTM_FRAME_HEADER_SIZE + 2 * MTM_MESSAGE_HEADER_SIZE + sizeof(arguments));
+
+    /* a frame is complete only once all of its bytes arrived, even if the
+     * next frame has started arriving */
+    ASSERT_OR_RELEASE(mtmFrameLength(buffer.data, MTM_FRAME_HEADER_SIZE - 1) == 0);
+    ASSERT_OR_RELEASE(mtmFrameLength(buffer.data, length - 1) == 0);
+    ASSERT_OR_RELEASE(mtmFrameLength(buffer.data, length) == length);
+    ASSERT_OR_RELEASE(mtmFrameBegin(&buffer, &start) && start == length);
+    ASSERT_OR_RELEASE(mtmFrameLength(buffer.data, buffer.size) == length);
+
+    uint32_t count = 0;
+    MtmReader reader;
+    mtmReaderInit(&reader, buffer.data, length, &count);
+    ASSERT_OR_RELEASE(count == 2);
+    MtmMessage message;
+    ASSERT_OR_RELEASE(mtmReadMessage(&reader, &message));
+    ASSERT_OR_RELEASE(message.tag == 7 && message.code == MTM_OP_CHANGE_PRODUCT_AMOUNT_IN_ORDER &&
+                      message.length == sizeof(arguments));
+    uint32_t read_order_id = 0;
+    uint32_t read_product_id = 0;
+    double read_amount = 0;
+    ASSERT_OR_RELEASE(mtmReadUint32(&message.arguments, &read_order_id) && read_order_id == order_id);
+    ASSERT_OR_RELEASE(mtmReadUint32(&message.arguments, &read_product_id) && read_product_id == product_id);
+    ASSERT_OR_RELEASE(mtmReadDouble(&message.arguments, &read_amount) && read_amount == amount);
+    ASSERT_OR_RELEASE(!mtmReadUint32(&message.arguments, &read_order_id));
+    ASSERT_OR_RELEASE(mtmReadMessage(&reader, &message));
+    ASSERT_OR_RELEASE(message.tag == 8 && message.code == MTM_OP_PRINT_INVENTORY && message.length == 0);
+    ASSERT_OR_RELEASE(!mtmReadMessage(&reader, &message));
+
+    /* the received frame is removed, and the next one is left */
+    mtmBufferConsume(&buffer, length);
+    ASSERT_OR_RELEASE(buffer.size == MTM_FRAME_HEADER_SIZE);
+
+    /* a length shorter than the frame's header is reported as too large */
+    const uint32_t malformed[2] = {2, 0};
+    ASSERT_OR_RELEASE(mtmFrameLength((const char *) malformed, sizeof(malformed)) > MTM_MAX_FRAME_SIZE);
+    mtmBufferRelease(&buffer);
+    return true;
+}
+
+#ifdef MATAMAZOMD_PATH
+
+#define SERVER_SOCKET_FILE "tests/matamazomd.sock"
+#define SERVER_CONNECT_ATTEMPTS 500
+
+static int connectServer() {
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strcpy(address.sun_path, SERVER_SOCKET_FILE);
+    /* the server may not be listening yet */
+    for (int attempt = 0; attempt < SERVER_CONNECT_ATTEMPTS; attempt++) {
+        int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd < 0) {
+            return -1;
+        }
+        if (connect(fd, (struct sockaddr *) &address, sizeof(address)) == 0) {
+            return fd;
+        }
+        close(fd);
+        const struct timespec delay = {0, 10000000};
+        nanosleep(&delay, NULL);
+    }
+    return -1;
+}
+
+/* sends a frame which creates an order and cancels it, and checks the
+ * responses. if 'finish' is true, the client shuts down its sending side
+ * right after the frame, and expects the server to close the connection once
+ * it answered */
+static bool exchangeFrame(int fd, uint32_t expectedOrderId, bool finish) {
+    MtmBuffer buffer;
+    mtmBufferInit(&buffer);
+    size_t start = 0;
+    bool built = mtmFrameBegin(&buffer, &start) &&
+                 mtmFrameMessage(&buffer, start, 1, MTM_OP_CREATE_NEW_ORDER, NULL, 0) &&
+                 mtmFrameMessage(&buffer, start, 2, MTM_OP_CANCEL_ORDER, &expectedOrderId,
+                                 sizeof(expectedOrderId));
+    ASSERT_OR_RELEASE(built);
+    mtmFrameEnd(&buffer, start);
+    ASSERT_OR_RELEASE(send(fd, buffer.data, buffer.size, MSG_NOSIGNAL) == (ssize_t) buffer.size);
+    ASSERT_OR_RELEASE(!finish || shutdown(fd, SHUT_WR) == 0);
+    buffer.size = 0;
+    size_t length = 0;
+    while ((length = mtmFrameLength(buffer.data, buffer.size)) == 0) {
+        ASSERT_OR_RELEASE(mtmBufferReserve(&buffer, 4096));
+        ssize_t received = recv(fd, buffer.data + buffer.size, 4096, 0);
+        ASSERT_OR_RELEASE(received > 0);
+        buffer.size += (size_t) received;
+    }
+    ASSERT_OR_RELEASE(length == buffer.size);
+    uint32_t count = 0;
+    MtmReader reader;
+    mtmReaderInit(&reader, buffer.data, length, &count);
+    ASSERT_OR_RELEASE(count == 2);
+    MtmMessage message;
+    uint32_t order_id = 0;
+    ASSERT_OR_RELEASE(mtmReadMessage(&reader, &message));
+    ASSERT_OR_RELEASE(message.tag == 1 && message.code == MATAMAZOM_SUCCESS);
+    ASSERT_OR_RELEASE(mtmReadUint32(&message.arguments, &order_id) && order_id == expectedOrderId);
+    ASSERT_OR_RELEASE(mtmReadMessage(&reader, &message));
+    ASSERT_OR_RELEASE(message.tag == 2 && message.code == MATAMAZOM_SUCCESS && message.length == 0);
+    char extra;
+    ASSERT_OR_RELEASE(!finish || recv(fd, &extra, sizeof(extra), 0) == 0);
+    mtmBufferRelease(&buffer);
+    return true;
+}
+
+static bool serverAnswers() {
+    /* clients which disconnect, with no frames pending or right after they
+     * sent a frame, don't affect the others */
+    int fd = connectServer();
+    ASSERT_TEST(fd >= 0);
+    close(fd);
+    fd = connectServer();
+    ASSERT_TEST(fd >= 0);
+    ASSERT_TEST_WITH_FREE(exchangeFrame(fd, 1, false), close(fd));
+    close(fd);
+    fd = connectServer();
+    ASSERT_TEST(fd >= 0);
+    ASSERT_TEST_WITH_FREE(exchangeFrame(fd, 2, true), close(fd));
+    close(fd);
+    fd = connectServer();
+    ASSERT_TEST(fd >= 0);
+    ASSERT_TEST_WITH_FREE(exchangeFrame(fd, 3, false), close(fd));
+    close(fd);
+    return true;
+}
+
+#endif
+
+bool testServer() {
+#ifdef MATAMAZOMD_PATH
+    unlink(SERVER_SOCKET_FILE);
+    pid_t server = fork();
+    ASSERT_TEST(server >= 0);
+    if (server == 0) {
+        execl(MATAMAZOMD_PATH, MATAMAZOMD_PATH, SERVER_SOCKET_FILE, (char *) NULL);
+        _exit(127);
+    }
+    bool answered = serverAnswers();
+    kill(server, SIGTERM);
+    int status = 0;
+    ASSERT_TEST(waitpid(server, &status, 0) == server);
+    ASSERT_TEST(answered);
+    ASSERT_TEST(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+#endif
+    return true;
+}
@@ -11,5 +11,32 @@ bool testPrintInventory();
 bool testPrintOrder();
 bool testPrintBestSelling();
 bool testPrintFiltered();
+bool testMetrics();
+bool testAllocator();
+bool testOrderIds();
+bool testSnapshot();
+bool testFilterProducts();
+bool testPrintInventoryParallel();
+bool testScansAfterChanges();
+bool testSharedNames();
+bool testReservationMode();
+bool testLowStock();
+bool testSharded();
+bool testSharedMemory();
+bool testImportProducts();
+bool testConcurrentMode();
+bool testPrintInventoryRange();
+bool testMergeOrders();
+bool testSetAlgebra();
+bool testCheckOrders();
+bool testProductDemand();
+bool testShipmentLedger();
+bool testAggregate();
+bool testCloneOrder();
+bool testOrderPool();
+bool testChangeProductAmounts();
+bool testTransactions();
+bool testProtocol();
+bool testServer();
 
 #endif /* MATAMAZOM_TESTS_H_ */